@@ -43,6 +43,7 @@ INCLUDEPATH += \
     third_party/utils/ \
     mainwindow/list_items/ \
     mainwindow/live_danmaku/ \
+    mainwindow/diagnostics/ \
     third_party/interactive_buttons/ \
     third_party/facile_menu/ \
     third_party/qhttpserver/ \
@@ -58,6 +59,7 @@ INCLUDEPATH += \
     widgets/guard_online/ \
     widgets/smooth_scroll/ \
     widgets/buy_vip/ \
+    widgets/screen_danmaku/ \
     widgets/ \
     third_party/ \
     widgets/editor/ \
@@ -67,17 +69,28 @@ INCLUDEPATH += \
 
 SOURCES += \
     third_party/color_octree/coloroctree.cpp \
+    third_party/color_octree/imageanalysis.cpp \
     third_party/color_octree/imageutil.cpp \
     third_party/facile_menu/facilemenu.cpp \
     third_party/facile_menu/facilemenuitem.cpp \
     third_party/gif/avilib.cpp \
     third_party/gif/gif.cpp \
+    third_party/interactive_buttons/animationticker.cpp \
     third_party/interactive_buttons/appendbutton.cpp \
     third_party/interactive_buttons/generalbuttoninterface.cpp \
     third_party/interactive_buttons/infobutton.cpp \
     third_party/interactive_buttons/interactivebuttonbase.cpp \
     mainwindow/list_items/listiteminterface.cpp \
+    mainwindow/live_danmaku/liveanalytics.cpp \
+    mainwindow/live_danmaku/livelog.cpp \
+    mainwindow/live_danmaku/livemetrics.cpp \
+    mainwindow/live_danmaku/replaybenchmark.cpp \
+    mainwindow/live_danmaku/heartbeatsigner.cpp \
+    mainwindow/live_danmaku/wordssnapshot.cpp \
     mainwindow/live_danmaku/livedanmakuwindow.cpp \
+    mainwindow/live_danmaku/moderationstate.cpp \
+    mainwindow/diagnostics/selftest.cpp \
+    mainwindow/diagnostics/componentbenchmark.cpp \
     third_party/interactive_buttons/pointmenubutton.cpp \
     third_party/interactive_buttons/threedimenbutton.cpp \
     third_party/interactive_buttons/watercirclebutton.cpp \
@@ -94,6 +107,7 @@ SOURCES += \
     third_party/notification/tipcard.cpp \
     third_party/utils/warmwishtutil.cpp \
     widgets/buy_vip/buyvipdialog.cpp \
+    widgets/csvtablemodel.cpp \
     widgets/csvviewer.cpp \
     widgets/guard_online/guardonlinedialog.cpp \
     widgets/lucky_draw/luckydrawwindow.cpp \
@@ -101,8 +115,13 @@ SOURCES += \
     mainwindow/mainwindow.cpp \
     order_player/desktoplyricwidget.cpp \
     order_player/logindialog.cpp \
+    order_player/lyrictimeline.cpp \
     order_player/numberanimation.cpp \
     order_player/orderplayerwindow.cpp \
+    order_player/songcache.cpp \
+    order_player/songlistjournal.cpp \
+    order_player/songlistmodel.cpp \
+    order_player/songsearchindex.cpp \
     third_party/picture_browser/picturebrowser.cpp \
     third_party/picture_browser/resizablepicture.cpp \
     third_party/qrencode/bitstream.c \
@@ -115,12 +134,15 @@ SOURCES += \
     third_party/qrencode/rsecc.c \
     third_party/qrencode/split.c \
     mainwindow/server.cpp \
+    third_party/utils/kvstore.cpp \
+    third_party/utils/pcmringbuffer.cpp \
     third_party/utils/xfytts.cpp \
     widgets/smooth_scroll/smoothlistwidget.cpp \
     widgets/smooth_scroll/waterfallscrollarea.cpp \
     widgets/variantviewer.cpp \
     widgets/video_player/videosurface.cpp \
     widgets/catch_you_dialog/catchyouwidget.cpp \
+    widgets/catch_you_dialog/crawlscheduler.cpp \
     widgets/editor/conditioneditor.cpp \
     widgets/escape_dialog/escapedialog.cpp \
     widgets/escape_dialog/hoverbutton.cpp \
@@ -128,23 +150,30 @@ SOURCES += \
     mainwindow/list_items/eventwidget.cpp \
     widgets/fluentbutton.cpp \
     widgets/mytabwidget.cpp \
+    widgets/pagedfetcher.cpp \
+    widgets/screen_danmaku/screendanmakuoverlay.cpp \
     widgets/login_dialog/qrcodelogindialog.cpp \
     mainwindow/list_items/replywidget.cpp \
+    mainwindow/list_items/rulelistitem.cpp \
     widgets/room_status_dialog/roomstatusdialog.cpp \
     mainwindow/list_items/taskwidget.cpp \
     third_party/utils/fileutil.cpp \
+    third_party/utils/speechcache.cpp \
     third_party/utils/stringutil.cpp \
+    third_party/utils/timerwheel.cpp \
     third_party/utils/textinputdialog.cpp \
     widgets/video_player/livevideoplayer.cpp \
     widgets/video_lyric_creator/videolyricscreator.cpp
 
 HEADERS += \
     third_party/color_octree/coloroctree.h \
+    third_party/color_octree/imageanalysis.h \
     third_party/color_octree/imageutil.h \
     third_party/facile_menu/facilemenu.h \
     third_party/facile_menu/facilemenuitem.h \
     third_party/gif/avilib.h \
     third_party/gif/gif.h \
+    third_party/interactive_buttons/animationticker.h \
     third_party/interactive_buttons/appendbutton.h \
     third_party/interactive_buttons/generalbuttoninterface.h \
     third_party/interactive_buttons/infobutton.h \
@@ -152,7 +181,16 @@ HEADERS += \
     mainwindow/list_items/listiteminterface.h \
     mainwindow/live_danmaku/commonvalues.h \
     mainwindow/live_danmaku/freecopyedit.h \
+    mainwindow/live_danmaku/liveanalytics.h \
+    mainwindow/live_danmaku/livelog.h \
+    mainwindow/live_danmaku/livemetrics.h \
+    mainwindow/live_danmaku/replaybenchmark.h \
+    mainwindow/live_danmaku/heartbeatsigner.h \
+    mainwindow/live_danmaku/wordssnapshot.h \
     mainwindow/live_danmaku/livedanmakuwindow.h \
+    mainwindow/live_danmaku/moderationstate.h \
+    mainwindow/diagnostics/selftest.h \
+    mainwindow/diagnostics/componentbenchmark.h \
     mainwindow/live_danmaku/livedanmaku.h \
     mainwindow/live_danmaku/portraitlabel.h \
     third_party/interactive_buttons/pointmenubutton.h \
@@ -174,6 +212,7 @@ HEADERS += \
     widgets/buy_vip/buyvipdialog.h \
     widgets/clickablelabel.h \
     widgets/clickablewidget.h \
+    widgets/csvtablemodel.h \
     widgets/csvviewer.h \
     widgets/custompaintwidget.h \
     widgets/guard_online/guardonlinedialog.h \
@@ -184,10 +223,15 @@ HEADERS += \
     order_player/itemselectionlistview.h \
     order_player/logindialog.h \
     order_player/lyricstreamwidget.h \
+    order_player/lyrictimeline.h \
     order_player/numberanimation.h \
     order_player/orderplayerwindow.h \
     order_player/roundedpixmaplabel.h \
     order_player/songbeans.h \
+    order_player/songcache.h \
+    order_player/songlistjournal.h \
+    order_player/songlistmodel.h \
+    order_player/songsearchindex.h \
     third_party/picture_browser/ASCII_Art.h \
     third_party/picture_browser/picturebrowser.h \
     third_party/picture_browser/resizablepicture.h \
@@ -203,6 +247,8 @@ HEADERS += \
     third_party/qrencode/rsecc.h \
     third_party/qrencode/split.h \
     third_party/utils/myjson.h \
+    third_party/utils/kvstore.h \
+    third_party/utils/pcmringbuffer.h \
     third_party/utils/xfytts.h \
     widgets/partimagewidget.h \
     widgets/smooth_scroll/smoothlistwidget.h \
@@ -212,6 +258,7 @@ HEADERS += \
     widgets/video_player/videosurface.h \
     widgets/RoundedAnimationLabel.h \
     widgets/catch_you_dialog/catchyouwidget.h \
+    widgets/catch_you_dialog/crawlscheduler.h \
     widgets/editor/conditioneditor.h \
     widgets/escape_dialog/escapedialog.h \
     widgets/escape_dialog/hoverbutton.h \
@@ -220,15 +267,20 @@ HEADERS += \
     widgets/fluentbutton.h \
     widgets/mytabwidget.h \
     widgets/netinterface.h \
+    widgets/pagedfetcher.h \
+    widgets/screen_danmaku/screendanmakuoverlay.h \
     widgets/login_dialog/qrcodelogindialog.h \
     mainwindow/list_items/replywidget.h \
+    mainwindow/list_items/rulelistitem.h \
     widgets/room_status_dialog/roomstatusdialog.h \
     mainwindow/list_items/taskwidget.h \
     third_party/utils/dlog.h \
     third_party/utils/fileutil.h \
     third_party/utils/netutil.h \
     third_party/utils/pinyinutil.h \
+    third_party/utils/speechcache.h \
     third_party/utils/stringutil.h \
+    third_party/utils/timerwheel.h \
     third_party/utils/textinputdialog.h \
     widgets/video_player/livevideoplayer.h \
     widgets/video_lyric_creator/videolyricscreator.h
@@ -295,6 +347,7 @@ contains(ANDROID_TARGET_ARCH,) {
 
 unix|win32: LIBS += -L$$PWD/third_party/libs/ -lqhttpserver
 win32: LIBS += -lversion
+win32: LIBS += -lpsapi
 
 INCLUDEPATH += $$PWD/third_party/libs \
     qhttpserver/
@@ -0,0 +1,354 @@
+#include <QApplication>
+#include <QPainter>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QTimer>
+#include <QVector>
+#include <QDir>
+#include <QPixmap>
+#include <algorithm>
+#include <functional>
+#include <ctime>
+#include "componentbenchmark.h"
+#include "screendanmakuoverlay.h"
+#include "animationticker.h"
+#include "interactivebuttonbase.h"
+#include "imageanalysis.h"
+
+QT_BEGIN_NAMESPACE
+    extern Q_WIDGETS_EXPORT void qt_blurImage( QPainter *p, QImage &blurImage, qreal radius, bool quality, bool alphaOnly, int transposed = 0 );
+QT_END_NAMESPACE
+
+#define COMPONENT_BENCHMARK_MAX_COVERS 50 // 封面测试最多读取的图片数量
+
+QStringList ComponentBenchmark::names()
+{
+    return QStringList{"screen", "button", "cover"};
+}
+
+bool ComponentBenchmark::isComponent(const QString &source)
+{
+    return names().contains(source);
+}
+
+/**
+ * @param args 完整的命令行参数，读取其中的 --count 等
+ * @param ok 参数有误、缺少数据时为 false
+ */
+QString ComponentBenchmark::run(const QString &name, const QStringList &args, bool *ok)
+{
+    *ok = true;
+    if (name == "screen") // 同屏数量，默认2000
+        return screenOverlay(qMax(1, argValue(args, "--count", "2000").toInt()), QSize(1920, 540), 20);
+    if (name == "button") // 按钮数量，默认50
+        return animationTicker(qMax(1, argValue(args, "--count", "50").toInt()), 5);
+    if (name == "cover") // 轮数，默认5；封面目录默认为点歌下载的封面
+        return coverAnalysis(argValue(args, "--covers", QApplication::applicationDirPath() + "/musics"),
+                             qMax(1, argValue(args, "--count", "5").toInt()), ok);
+
+    *ok = false;
+    return "没有名为“" + name + "”的测试，可用：" + names().join("、");
+}
+
+/**
+ * 屏幕弹幕绘制：按固定帧间隔模拟 seconds 秒，每帧绘制到 QImage 上，不显示窗口
+ * count 条弹幕在一个飞行周期内均匀加入，之后同屏的数量大约就是 count
+ */
+QString ComponentBenchmark::screenOverlay(int count, const QSize &size, int seconds)
+{
+    ScreenDanmakuOverlay overlay;
+    overlay.setArea(QRect(QPoint(0, 0), size), false);
+    overlay.setDuration(8000);
+    QImage frame(size, QImage::Format_ARGB32_Premultiplied);
+
+    const QColor colors[] = { QColor(Qt::white), QColor("#fbe096"), QColor("#6c81b6"), QColor("#ee335f") };
+    qint64 total = seconds * 1000;
+    qint64 spawnInterval = qMax(1, overlay.duration / qMax(1, count));
+    qint64 nextSpawn = 0;
+    int spawned = 0;
+    int maxInFlight = 0;
+    QVector<qint64> frameNs;
+    QElapsedTimer timer;
+
+    for (qint64 now = 0; now < total; now += SCREEN_DANMAKU_FRAME_INTERVAL)
+    {
+        timer.start();
+        while (nextSpawn <= now && overlay.items.size() < SCREEN_DANMAKU_MAX_ITEMS)
+        {
+            // 礼物刷屏：大量重复文字，夹杂少量普通弹幕
+            QString text = spawned % 10 == 0 ? QString("普通弹幕第%1条，哈哈哈哈").arg(spawned)
+                                             : QString("用户%1 投喂 辣条×%2").arg(spawned % 100).arg(1 + spawned % 3);
+            overlay.addAt(text, colors[spawned % 4], nextSpawn);
+            spawned++;
+            nextSpawn += spawnInterval;
+        }
+        overlay.advance(now);
+        frame.fill(Qt::transparent);
+        QPainter painter(&frame);
+        overlay.render(&painter, now);
+        painter.end();
+        frameNs.append(timer.nsecsElapsed());
+        maxInFlight = qMax(maxInFlight, overlay.items.size());
+    }
+
+    if (frameNs.isEmpty())
+        return "没有绘制任何帧";
+    QVector<qint64> sorted = frameNs;
+    std::sort(sorted.begin(), sorted.end());
+    double sum = 0;
+    foreach (qint64 ns, frameNs)
+        sum += ns;
+    double avg = sum / frameNs.size() / 1e6;
+    auto percentile = [&](double q) -> double {
+        return sorted.at(qMin(sorted.size() - 1, int(q * sorted.size()))) / 1e6;
+    };
+
+    return QString("屏幕弹幕绘制：%1×%2，%3帧，共加入%4条，同屏最多%5条，缓存文字%6个\n"
+                   "每帧耗时(ms)：平均 %7  P50 %8  P99 %9  最大 %10，可达 %11 FPS")
+            .arg(size.width()).arg(size.height()).arg(frameNs.size()).arg(spawned).arg(maxInFlight)
+            .arg(overlay.sprites.size())
+            .arg(avg, 0, 'f', 3).arg(percentile(0.5), 0, 'f', 3).arg(percentile(0.99), 0, 'f', 3)
+            .arg(sorted.last() / 1e6, 0, 'f', 3).arg(avg > 0 ? 1000 / avg : 0, 0, 'f', 0);
+}
+
+/**
+ * 按钮动画：count 个按钮在鼠标悬浮（动画已经走完、停在最终状态）以及全部空闲时，
+ * 每秒的唤醒次数、重绘次数和CPU占用
+ * 旧版为每个按钮一个 10ms 的 QTimer，每次都 update()，悬浮期间一直不停
+ */
+QString ComponentBenchmark::animationTicker(int count, int seconds)
+{
+    AnimationTicker* ticker = AnimationTicker::instance();
+    QWidget container;
+    container.setAttribute(Qt::WA_DontShowOnScreen, true);
+    container.resize(400, 32 * count);
+    QList<InteractiveButtonBase*> list;
+    for (int i = 0; i < count; i++)
+    {
+        InteractiveButtonBase* button = new InteractiveButtonBase(&container);
+        button->setGeometry(0, 32 * i, 400, 32);
+        list.append(button);
+    }
+    container.show();
+
+    auto hoverAll = [&](bool hover) {
+        foreach (InteractiveButtonBase* button, list)
+        {
+            QEvent event(hover ? QEvent::Enter : QEvent::Leave);
+            QApplication::sendEvent(button, &event);
+        }
+    };
+    auto wait = [](int msec) {
+        QEventLoop loop;
+        QTimer::singleShot(msec, &loop, SLOT(quit()));
+        loop.exec();
+    };
+
+    // 旧版：每个按钮自己的定时器
+    hoverAll(true);
+    foreach (InteractiveButtonBase* button, list)
+        ticker->unregisterButton(button);
+    qint64 oldWakeups = 0;
+    QList<QTimer*> timers;
+    foreach (InteractiveButtonBase* button, list)
+    {
+        QTimer* timer = new QTimer(button);
+        timer->setInterval(AnimationTicker::STEP_INTERVAL);
+        QObject::connect(timer, &QTimer::timeout, button, [&oldWakeups, button]{
+            oldWakeups++;
+            button->anchorTimeOut();
+            button->update();
+        });
+        timer->start();
+        timers.append(timer);
+    }
+    wait(500); // 悬浮动画走完
+    oldWakeups = 0;
+    qint64 oldPaints = 0;
+    double oldCpu = 0;
+    measurePaints(seconds, list, &oldPaints, &oldCpu);
+    qint64 oldWakeupCount = oldWakeups;
+    qDeleteAll(timers);
+    hoverAll(false);
+    foreach (InteractiveButtonBase* button, list)
+        ticker->registerButton(button); // 用共用时钟走完离开动画
+    wait(1000);
+
+    // 新版：共用时钟
+    hoverAll(true);
+    wait(500);
+    qint64 frames = ticker->getFrameCount();
+    qint64 newPaints = 0;
+    double newCpu = 0;
+    measurePaints(seconds, list, &newPaints, &newCpu);
+    qint64 newWakeupCount = ticker->getFrameCount() - frames;
+
+    // 全部空闲
+    hoverAll(false);
+    wait(1000);
+    frames = ticker->getFrameCount();
+    qint64 idlePaints = 0;
+    double idleCpu = 0;
+    measurePaints(seconds, list, &idlePaints, &idleCpu);
+    qint64 idleWakeupCount = ticker->getFrameCount() - frames;
+
+    auto row = [=](const QString& name, qint64 wakeups, qint64 paints, double cpu) {
+        return QString("%1：唤醒 %2 次/秒，重绘 %3 次/秒，CPU %4%")
+                .arg(name).arg(wakeups / seconds).arg(paints / seconds).arg(cpu, 0, 'f', 1);
+    };
+    return QString("%1 个按钮，各测 %2 秒\n").arg(count).arg(seconds)
+            + row("悬浮 旧版（每个按钮一个定时器）", oldWakeupCount, oldPaints, oldCpu) + "\n"
+            + row("悬浮 共用时钟", newWakeupCount, newPaints, newCpu) + "\n"
+            + row("空闲 共用时钟", idleWakeupCount, idlePaints, idleCpu);
+}
+
+/**
+ * 运行事件循环 seconds 秒，统计按钮的重绘次数和进程CPU占用（百分比，单核）
+ */
+void ComponentBenchmark::measurePaints(int seconds, const QList<InteractiveButtonBase *> &buttons, qint64 *paints, double *cpu)
+{
+    class PaintCounter : public QObject
+    {
+    public:
+        qint64 count = 0;
+    protected:
+        bool eventFilter(QObject*, QEvent* event) override
+        {
+            if (event->type() == QEvent::Paint)
+                count++;
+            return false;
+        }
+    } counter;
+    foreach (InteractiveButtonBase* button, buttons)
+        button->installEventFilter(&counter);
+
+    std::clock_t cpuStart = std::clock();
+    QElapsedTimer wall;
+    wall.start();
+    QEventLoop loop;
+    QTimer::singleShot(seconds * 1000, &loop, SLOT(quit()));
+    loop.exec();
+    double cpuMsec = double(std::clock() - cpuStart) * 1000 / CLOCKS_PER_SEC;
+
+    foreach (InteractiveButtonBase* button, buttons)
+        button->removeEventFilter(&counter);
+    *paints = counter.count;
+    *cpu = wall.elapsed() > 0 ? cpuMsec * 100 / wall.elapsed() : 0;
+}
+
+/**
+ * 封面分析：读取目录中真实的歌曲封面，旧版和现在的实现各跑 rounds 轮，
+ * 分别统计平均色、主题色、模糊背景（含亮度）每张封面的平均耗时
+ * 默认使用点歌下载的封面（程序目录下的 musics），旧版的代码原样保留在这里，只用于对比
+ */
+QString ComponentBenchmark::coverAnalysis(const QString &dirPath, int rounds, bool *ok)
+{
+    QList<QImage> covers;
+    qint64 pixels = 0;
+    QDir dir(dirPath);
+    foreach (QFileInfo info, dir.entryInfoList(QStringList{"*.jpg", "*.jpeg", "*.png"}, QDir::Files, QDir::Name))
+    {
+        QImage image(info.absoluteFilePath());
+        if (image.isNull())
+            continue;
+        covers.append(image.convertToFormat(QImage::Format_ARGB32));
+        pixels += image.width() * image.height();
+        if (covers.size() >= COMPONENT_BENCHMARK_MAX_COVERS)
+            break;
+    }
+    if (covers.isEmpty())
+    {
+        *ok = false;
+        return "没有在 " + dir.absolutePath() + " 中找到封面图片，可以用 --covers 指定目录";
+    }
+
+    const QSize size(800, 600);
+    const int radius = qMax(20, qMin(size.width(), size.height()) / 5);
+    QElapsedTimer timer;
+    auto average = [&](std::function<void(const QImage&)> func) -> double {
+        timer.start();
+        for (int i = 0; i < rounds; i++)
+            foreach (const QImage& cover, covers)
+                func(cover);
+        return timer.nsecsElapsed() / 1e6 / rounds / covers.size();
+    };
+
+    volatile int sink = 0; // 避免结果被优化掉
+
+    // 平均色：旧版实际没有缩小，逐像素累加整张图
+    double oldAverage = average([&](const QImage& cover){
+        qint64 sumr = 0, sumg = 0, sumb = 0;
+        for (int y = 0; y < cover.height(); y++)
+        {
+            const QRgb* line = reinterpret_cast<const QRgb*>(cover.constScanLine(y));
+            for (int x = 0; x < cover.width(); x++)
+            {
+                sumr += qRed(line[x]);
+                sumg += qGreen(line[x]);
+                sumb += qBlue(line[x]);
+            }
+        }
+        sink = sink + int(sumr + sumg + sumb);
+    });
+    double newAverage = average([&](const QImage& cover){
+        sink = sink + ImageAnalysis::averageColor(cover).red();
+    });
+
+    // 主题色：旧版逐像素八叉树
+    double oldTheme = average([&](const QImage& cover){
+        ColorOctree octree(cover, IMAGE_ANALYSIS_MAX_SIZE, 7);
+        sink = sink + octree.result().size();
+    });
+    double newTheme = average([&](const QImage& cover){
+        sink = sink + ImageAnalysis::medianCut(cover, 7).size();
+    });
+
+    // 模糊背景：旧版放大后 qt_blurImage、裁掉黑边，再抽样亮度
+    double oldBlur = average([&](const QImage& cover){
+        QPixmap pixmap = QPixmap::fromImage(cover).scaled(size.width() + radius * 2, size.height() + radius * 2,
+                                                          Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        QImage img = pixmap.toImage();
+        QPainter painter(&pixmap);
+        qt_blurImage(&painter, img, radius, true, false);
+        painter.end();
+        int c = qMin(qMin(cover.width(), cover.height()) / 2, radius);
+        QImage clip = pixmap.copy(c, c, pixmap.width() - c * 2, pixmap.height() - c * 2).toImage();
+        qint64 rgbSum = 0;
+        const int m = 16;
+        for (int y = 0; y < m; y++)
+            for (int x = 0; x < m; x++)
+            {
+                QColor color = clip.pixelColor(clip.width() * x / m, clip.height() * x / m);
+                rgbSum += color.red() + color.green() + color.blue();
+            }
+        sink = sink + int(rgbSum);
+    });
+    double newBlur = average([&](const QImage& cover){
+        QImage image = ImageAnalysis::blurred(cover, size, radius);
+        sink = sink + ImageAnalysis::averageLuma(image);
+    });
+
+    auto row = [](const QString& name, double oldTime, double newTime) {
+        return QString("%1：旧版 %2 ms，现在 %3 ms，%4 倍")
+                .arg(name).arg(oldTime, 0, 'f', 2).arg(newTime, 0, 'f', 2)
+                .arg(newTime > 0 ? oldTime / newTime : 0, 0, 'f', 1);
+    };
+    *ok = true;
+    return QString("%1 张封面（%2，平均 %3 万像素），模糊到 %4×%5（半径 %6），%7 轮中每张的平均耗时\n")
+            .arg(covers.size()).arg(dir.absolutePath()).arg(pixels / covers.size() / 10000)
+            .arg(size.width()).arg(size.height()).arg(radius).arg(rounds)
+            + row("平均色", oldAverage, newAverage) + "\n"
+            + row("主题色", oldTheme, newTheme) + "\n"
+            + row("模糊背景", oldBlur, newBlur);
+}
+
+/**
+ * 命令行中 key 后面的值
+ */
+QString ComponentBenchmark::argValue(const QStringList &args, const QString &key, const QString &def)
+{
+    int index = args.indexOf(key);
+    if (index < 0 || index + 1 >= args.size())
+        return def;
+    return args.at(index + 1);
+}
@@ -0,0 +1,32 @@
+#ifndef COMPONENTBENCHMARK_H
+#define COMPONENTBENCHMARK_H
+
+#include <QString>
+#include <QStringList>
+#include <QSize>
+#include <QList>
+
+class InteractiveButtonBase;
+
+/**
+ * 单个组件的性能测试，和 CMDS 回放共用 --benchmark 参数：
+ * --benchmark <组件名> [--count N] [--covers 目录]，不需要登录和直播间，输出结果后退出
+ * 测试代码都放在这里，不放进被测的类中
+ */
+class ComponentBenchmark
+{
+public:
+    static QStringList names();
+    static bool isComponent(const QString& source);
+    static QString run(const QString& name, const QStringList& args, bool* ok);
+
+private:
+    static QString screenOverlay(int count, const QSize& size, int seconds);
+    static QString animationTicker(int count, int seconds);
+    static void measurePaints(int seconds, const QList<InteractiveButtonBase*>& buttons, qint64* paints, double* cpu);
+    static QString coverAnalysis(const QString& dirPath, int rounds, bool* ok);
+
+    static QString argValue(const QStringList& args, const QString& key, const QString& def = QString());
+};
+
+#endif // COMPONENTBENCHMARK_H
@@ -0,0 +1,357 @@
+#include <QEventLoop>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QPointer>
+#include <QUrl>
+#include <QHash>
+#include <climits>
+#include <QWebSocketServer>
+#include <QWebSocket>
+#include <QJsonDocument>
+#include "selftest.h"
+#include "heartbeatsigner.h"
+#include "crawlscheduler.h"
+#include "xfytts.h"
+
+namespace
+{
+
+/**
+ * 收集每一项的结果
+ */
+class CheckList
+{
+public:
+    void check(const QString& name, bool ok, const QString& detail = QString())
+    {
+        allPassed = allPassed && ok;
+        lines.append((ok ? "通过  " : "失败  ") + name + (detail.isEmpty() ? QString() : "：" + detail));
+    }
+
+    void equal(const QString& name, const QString& actual, const QString& expected)
+    {
+        check(name, actual == expected, actual == expected ? QString() : actual + " ≠ " + expected);
+    }
+
+    QString result(bool* passed) const
+    {
+        if (passed)
+            *passed = allPassed;
+        return lines.join("\n");
+    }
+
+private:
+    QStringList lines;
+    bool allPassed = true;
+};
+
+}
+
+QStringList SelfTest::names()
+{
+    return QStringList{"heartbeat", "crawl", "tts"};
+}
+
+/**
+ * @param name 为空时依次运行全部
+ * @param passed 全部通过时为 true
+ */
+QString SelfTest::run(const QString &name, bool *passed)
+{
+    if (name.isEmpty() || name.startsWith("--"))
+    {
+        QStringList results;
+        bool allPassed = true;
+        foreach (const QString& n, names())
+        {
+            bool ok = false;
+            results.append("[" + n + "]\n" + run(n, &ok));
+            allPassed = allPassed && ok;
+        }
+        if (passed)
+            *passed = allPassed;
+        return results.join("\n");
+    }
+
+    if (name == "heartbeat")
+        return heartbeatSigner(passed);
+    if (name == "crawl")
+        return crawlScheduler(passed);
+    if (name == "tts")
+        return xfyTTS(passed);
+
+    if (passed)
+        *passed = false;
+    return "失败  没有名为“" + name + "”的自检，可用：" + names().join("、");
+}
+
+/**
+ * 直播心跳签名
+ * 先是 RFC 2202 / RFC 4231 中每种 HMAC 的标准结果（Test Case 2），
+ * 再是两组完整的心跳签名。注意这两组不是从浏览器或 encServer 记录的，
+ * 而是按同样的算法离线算出来的（密钥也是随意取的），只能防止以后改动时结果变化，
+ * 不能证明服务器会接受；拿到真实记录的 secret_key/secret_rule 和 s 之后应当替换
+ */
+QString SelfTest::heartbeatSigner(bool *passed)
+{
+    CheckList list;
+
+    // 每种算法的标准向量
+    const char* hmacExpected[] = {
+        "750c783e6ab0b503eaa86e310a5db738",
+        "effcdf6ae5eb2fa2d27416d5f184df9c259a7c79",
+        "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843",
+        "a30e01098bc6dbbf45690f3a7e9e6d0f8bbea2a39e6148008fd05e44",
+        "164b7a7bfcf819e2e395fbe73b56e0a387bd64222e831fd610270cd7ea2505549758bf75c05a994a6d034f65f8f0e6fdcaeab1a34d4a6b4b636e070a38bce737",
+        "af45d2e376484031617f78d2b58a6b1b9c7ef464f5a01b47e42ec3736322445e8e2240ca5e69e2c78b3239ecfab21649",
+    };
+    const char* hmacNames[] = { "HMAC-MD5", "HMAC-SHA1", "HMAC-SHA256", "HMAC-SHA224", "HMAC-SHA512", "HMAC-SHA384" };
+    for (int i = 0; i < 6; i++)
+        list.equal(hmacNames[i], HeartbeatSigner::hmacHex(i, "Jefe", "what do ya want for nothing?"), hmacExpected[i]);
+
+    bool valid = false;
+    HeartbeatSigner::hmacHex(6, "Jefe", "", &valid);
+    list.check("不支持的加密方式", !valid);
+
+    // 完整的心跳签名（回归用，见上）
+    HeartbeatSigner::Payload payload;
+    payload.parentAreaId = 3;
+    payload.areaId = 321;
+    payload.seq = 1;
+    payload.roomId = 11584296;
+    payload.ets = 1612765538;
+    payload.time = 60;
+    payload.ts = 1612765598123;
+    list.equal("拼接心跳数据", HeartbeatSigner::payloadText(payload),
+               "{\"platform\":\"web\",\"parent_id\":3,\"area_id\":321,\"seq_id\":1,\"room_id\":11584296,"
+               "\"buvid\":\"AUTO4115984068636104\",\"uuid\":\"f5f08e2f-e4e3-4156-8127-616f79a17e1a\","
+               "\"ets\":1612765538,\"time\":60,\"ts\":1612765598123}");
+    list.equal("心跳签名回归 [2,5,1,4]", HeartbeatSigner::sign(payload, "seacasdgyijfhofiuxoannn", QJsonArray{2, 5, 1, 4}),
+               "2f507a06401a557f41312e3f7eccbcd869621f9dd1c9d35c775f00c782db5d5ccc651f6a2070797ca6f25906615829334cf57e35582ee33109104af7815a4c2b");
+
+    payload.parentAreaId = 9;
+    payload.areaId = 371;
+    payload.seq = 7;
+    payload.roomId = 22637261;
+    payload.ets = 1612770000;
+    payload.ts = 1612770361456;
+    list.equal("心跳签名回归 [0,3,4,1,5,2]", HeartbeatSigner::sign(payload, "axoaadsffcazxksectbbb", QJsonArray{0, 3, 4, 1, 5, 2}),
+               "d3981267cc8942fe6c22a97ce54fd66fc3ed9df9812c228f90f548192fdc1d6c");
+
+    return list.result(passed);
+}
+
+/**
+ * 批量抓取的调度，用本地模拟的接口检查：
+ * 并发窗口（同时进行的请求数）、令牌桶（发送的频率）、-412 后整体暂停再重试
+ */
+QString SelfTest::crawlScheduler(bool *passed)
+{
+    const int slowDelay = 200; // 模拟接口 /slow 的响应时间
+    CheckList list;
+
+    // 模拟的接口：/slow 延迟返回，/block 第一次返回 -412，其余立即返回
+    QTcpServer server;
+    if (!server.listen(QHostAddress::LocalHost, 0))
+    {
+        if (passed)
+            *passed = false;
+        return "失败  无法启动模拟接口：" + server.errorString();
+    }
+    QElapsedTimer clock;
+    clock.start();
+    int inFlight = 0, maxInFlight = 0;
+    QHash<QString, QList<qint64>> arrivals; // 路径 -> 每次收到请求的时刻
+    QObject::connect(&server, &QTcpServer::newConnection, &server, [&]{
+        while (QTcpSocket* socket = server.nextPendingConnection())
+        {
+            QObject::connect(socket, &QTcpSocket::disconnected, socket, &QTcpSocket::deleteLater);
+            QObject::connect(socket, &QTcpSocket::readyRead, socket, [&, socket]{
+                QByteArray buffer = socket->property("buffer").toByteArray() + socket->readAll();
+                socket->setProperty("buffer", buffer);
+                if (!buffer.contains("\r\n\r\n") || socket->property("handled").toBool())
+                    return ;
+                socket->setProperty("handled", true);
+
+                QString path = QUrl(QString::fromLatin1(buffer.split(' ').value(1))).path();
+                arrivals[path].append(clock.elapsed());
+                inFlight++;
+                maxInFlight = qMax(maxInFlight, inFlight);
+
+                int code = (path.endsWith("/block") && arrivals[path].size() == 1) ? -412 : 0;
+                QPointer<QTcpSocket> ptr = socket;
+                QTimer::singleShot(path.endsWith("/slow") ? slowDelay : 0, &server, [&, ptr, code]{
+                    inFlight--;
+                    if (!ptr)
+                        return ;
+                    QByteArray body = "{\"code\":" + QByteArray::number(code) + "}";
+                    ptr->write("HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nConnection: close\r\n"
+                               "Content-Length: " + QByteArray::number(body.size()) + "\r\n\r\n" + body);
+                    ptr->disconnectFromHost();
+                });
+            });
+        }
+    });
+    const QString base = QString("http://127.0.0.1:%1").arg(server.serverPort());
+
+    // 并发窗口：9 个慢请求、并发 3，应当分三批完成
+    {
+        CrawlScheduler crawler;
+        crawler.setApiBase(base);
+        crawler.setInterval(0);
+        crawler.setConcurrency(3);
+        crawler.setTask(1);
+        int done = 0, succeeded = 0;
+        qint64 start = clock.elapsed();
+        for (int i = 0; i < 9; i++)
+            crawler.get(1, "https://api.bilibili.com/slow?i=" + QString::number(i), [&](bool ok, QJsonObject){
+                done++;
+                succeeded += ok;
+            });
+        bool finished = waitFor([&]{ return done == 9; }, 5000);
+        qint64 cost = clock.elapsed() - start;
+        list.check("并发窗口", finished && succeeded == 9 && maxInFlight == 3 && cost >= slowDelay * 3,
+              "同时最多 " + QString::number(maxInFlight) + " 个，共 " + QString::number(cost) + " ms");
+    }
+
+    // 令牌桶：10 个立即返回的请求，每 100ms 一个令牌、最多积攒 2 个，
+    // 前两个立即发出，之后每个至少间隔约 100ms
+    {
+        CrawlScheduler crawler;
+        crawler.setApiBase(base);
+        crawler.setConcurrency(2);
+        crawler.setInterval(100);
+        crawler.setTask(2);
+        int done = 0;
+        for (int i = 0; i < 10; i++)
+            crawler.get(2, "https://api.bilibili.com/fast?i=" + QString::number(i), [&](bool, QJsonObject){
+                done++;
+            });
+        bool finished = waitFor([&]{ return done == 10; }, 5000);
+        const QList<qint64>& times = arrivals.value("/fast");
+        qint64 span = times.size() == 10 ? times.last() - times.first() : -1;
+        qint64 minGap = LLONG_MAX;
+        for (int i = 3; i < times.size(); i++)
+            minGap = qMin(minGap, times.at(i) - times.at(i - 1));
+        list.check("令牌桶限速", finished && times.size() == 10 && span >= 700 && minGap >= 50,
+              "10 个请求用时 " + QString::number(span) + " ms，最小间隔 " + QString::number(minGap == LLONG_MAX ? -1 : minGap) + " ms");
+    }
+
+    // -412：整体暂停 CRAWL_BLOCKED_PAUSE，被拦截的请求重试一次，暂停期间不发送其他请求
+    {
+        CrawlScheduler crawler;
+        crawler.setApiBase(base);
+        crawler.setInterval(0);
+        crawler.setConcurrency(1);
+        crawler.setTask(3);
+        int blockCode = 1;
+        bool afterDone = false;
+        crawler.get(3, "https://api.bilibili.com/block", [&](bool ok, QJsonObject json){
+            blockCode = ok ? json.value("code").toInt() : 1;
+        });
+        crawler.get(3, "https://api.bilibili.com/after", [&](bool, QJsonObject){
+            afterDone = true;
+        });
+        bool finished = waitFor([&]{ return afterDone; }, CRAWL_BLOCKED_PAUSE + 3000);
+        const QList<qint64>& blocks = arrivals.value("/block");
+        const QList<qint64>& afters = arrivals.value("/after");
+        qint64 pause = blocks.size() == 2 ? blocks.at(1) - blocks.at(0) : -1;
+        list.check("-412 暂停后重试", finished && blockCode == 0 && pause >= CRAWL_BLOCKED_PAUSE - 20,
+              "拦截 " + QString::number(blocks.size()) + " 次请求，间隔 " + QString::number(pause) + " ms");
+        list.check("暂停期间不发送", afters.size() == 1 && blocks.size() == 2 && afters.first() >= blocks.at(1));
+    }
+
+    return list.result(passed);
+}
+
+/**
+ * 讯飞语音合成，用本地模拟的合成服务检查，不需要网络和讯飞账号
+ * 模拟服务每句返回3帧音频，每帧间隔100毫秒，检查：
+ * 提前连接、连续两句都按顺序合成且共用一个连接、第一帧音频到达就开始送去播放
+ */
+QString SelfTest::xfyTTS(bool *passed)
+{
+    const int frameInterval = 100;
+    CheckList list;
+
+    // 模拟的合成服务
+    QWebSocketServer server("MockTTS", QWebSocketServer::NonSecureMode);
+    if (!server.listen(QHostAddress::LocalHost, 0))
+    {
+        if (passed)
+            *passed = false;
+        return "失败  无法启动模拟服务：" + server.errorString();
+    }
+    int connections = 0;
+    QStringList received;
+    QObject::connect(&server, &QWebSocketServer::newConnection, &server, [&]{
+        QWebSocket* client = server.nextPendingConnection();
+        connections++;
+        QObject::connect(client, &QWebSocket::textMessageReceived, client, [&, client](const QString& message){
+            QJsonObject data = QJsonDocument::fromJson(message.toUtf8()).object().value("data").toObject();
+            received.append(QString::fromUtf8(QByteArray::fromBase64(data.value("text").toString().toUtf8())));
+            QPointer<QWebSocket> ptr = client;
+            for (int i = 0; i < 3; i++)
+            {
+                QTimer::singleShot(i * frameInterval, client, [=]{
+                    if (!ptr)
+                        return ;
+                    QJsonObject frameData;
+                    frameData.insert("status", i == 2 ? 2 : 1);
+                    frameData.insert("audio", QString::fromLatin1(QByteArray(XFY_TTS_PREBUFFER_BYTES, char(i + 1)).toBase64()));
+                    QJsonObject frame;
+                    frame.insert("code", 0);
+                    frame.insert("data", frameData);
+                    ptr->sendTextMessage(QJsonDocument(frame).toJson(QJsonDocument::Compact));
+                });
+            }
+        });
+    });
+
+    XfyTTS tts("", "appid", "apikey", "apisecret");
+    tts.setHostUrl(QString("ws://127.0.0.1:%1/v2/tts").arg(server.serverPort()));
+
+    // 提前连接
+    tts.preconnect();
+    bool connected = waitFor([&]{ return tts.socketConnected; }, 3000);
+    list.check("提前连接", connected && connections == 1 && received.isEmpty());
+
+    // 连续两句
+    QElapsedTimer clock;
+    qint64 firstAudio = -1;
+    QObject::connect(tts.pcmBuffer, &PcmRingBuffer::readyRead, &tts, [&]{
+        if (firstAudio < 0)
+            firstAudio = clock.elapsed();
+    });
+    clock.start();
+    tts.speakText("第一句");
+    tts.speakText("第二句");
+    bool finished = waitFor([&]{ return received.size() == 2 && tts.speakingText.isEmpty() && tts.speakQueue.isEmpty(); }, 5000);
+    qint64 total = clock.elapsed();
+    list.check("两句都按顺序合成", finished && received == QStringList{"第一句", "第二句"}, received.join("、"));
+    list.check("共用一个连接", connections == 1, "连接" + QString::number(connections) + "次");
+    list.check("收到第一帧就开始播放", firstAudio >= 0 && firstAudio < frameInterval * 2,
+          "首帧 " + QString::number(firstAudio) + " ms，两句共 " + QString::number(total) + " ms");
+
+    return list.result(passed);
+}
+
+/**
+ * 运行事件循环直到条件满足或超时
+ */
+bool SelfTest::waitFor(std::function<bool()> condition, int timeout)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (!condition() && timer.elapsed() < timeout)
+    {
+        QEventLoop loop;
+        QTimer::singleShot(5, &loop, SLOT(quit()));
+        loop.exec();
+    }
+    return condition();
+}
@@ -0,0 +1,28 @@
+#ifndef SELFTEST_H
+#define SELFTEST_H
+
+#include <QString>
+#include <QStringList>
+#include <functional>
+
+/**
+ * 命令行自检：--selftest [名称]，不指定名称时全部运行
+ * 只用已知输入、本地模拟的服务检查各个模块，不需要网络和账号；
+ * 检查代码和模拟服务都放在这里，不放进被检查的类中。
+ * 每项结果一行，以“通过”或“失败”开头
+ */
+class SelfTest
+{
+public:
+    static QStringList names();
+    static QString run(const QString& name, bool* passed);
+
+private:
+    static QString heartbeatSigner(bool* passed);
+    static QString crawlScheduler(bool* passed);
+    static QString xfyTTS(bool* passed);
+
+    static bool waitFor(std::function<bool()> condition, int timeout);
+};
+
+#endif // SELFTEST_H
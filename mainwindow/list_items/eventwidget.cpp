@@ -28,34 +28,11 @@ EventWidget::EventWidget(QWidget *parent) : ListItemInterface(parent)
         sendMsgs(true);
     });
 
-    connect(eventEdit, &QLineEdit::textChanged, this, [=]{
-        cmdKey = eventEdit->text();
-    });
-
     connect(actionEdit, &QPlainTextEdit::textChanged, this, [=]{
         autoResizeEdit();
     });
 }
 
-void EventWidget::fromJson(MyJson json)
-{
-    check->setChecked(json.b("enabled"));
-    eventEdit->setText(json.s("event"));
-    actionEdit->setPlainText(json.s("action"));
-
-    cmdKey = eventEdit->text();
-}
-
-MyJson EventWidget::toJson() const
-{
-    MyJson json;
-    json.insert("anchor_key", CODE_EVENT_ACTION_KEY);
-    json.insert("enabled", check->isChecked());
-    json.insert("event", eventEdit->text());
-    json.insert("action", actionEdit->toPlainText());
-    return json;
-}
-
 bool EventWidget::isEnabled() const
 {
     return check->isChecked();
@@ -71,19 +48,6 @@ QString EventWidget::body() const
     return actionEdit->toPlainText();
 }
 
-void EventWidget::triggerCmdEvent(QString cmd, LiveDanmaku danmaku)
-{
-    if (!check->isChecked() || cmdKey != cmd)
-        return ;
-    qDebug() << "响应事件：" << cmd;
-    emit signalEventMsgs(actionEdit->toPlainText(), danmaku, false);
-}
-
-void EventWidget::triggerAction(LiveDanmaku danmaku)
-{
-    emit signalEventMsgs(actionEdit->toPlainText(), danmaku, false);
-}
-
 void EventWidget::autoResizeEdit()
 {
     actionEdit->document()->setPageSize(QSize(this->width(), actionEdit->document()->size().height()));
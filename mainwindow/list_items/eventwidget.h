@@ -22,9 +22,6 @@ class EventWidget : public ListItemInterface
 public:
     EventWidget(QWidget *parent = nullptr);
 
-    virtual void fromJson(MyJson json) override;
-    virtual MyJson toJson() const override;
-
     virtual bool isEnabled() const override;
     virtual QString title() const override;
     virtual QString body() const override;
@@ -33,15 +30,11 @@ signals:
     void signalEventMsgs(QString msgs, LiveDanmaku danmaku, bool manual);
 
 public slots:
-    void triggerCmdEvent(QString cmd, LiveDanmaku danmaku);
-    void triggerAction(LiveDanmaku danmaku);
     void autoResizeEdit() override;
 
 public:
     QLineEdit* eventEdit;
     QPlainTextEdit* actionEdit;
-
-    QString cmdKey;
 };
 
 #endif // EVENTWIDGET_H
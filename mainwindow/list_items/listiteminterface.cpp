@@ -1,4 +1,3 @@
-#include <QRegularExpression>
 #include "listiteminterface.h"
 
 ListItemInterface::ListItemInterface(QWidget *parent) : QWidget(parent)
@@ -54,12 +53,6 @@ int ListItemInterface::getRow() const
     return _row;
 }
 
-bool ListItemInterface::matchId(QString s) const
-{
-    QString body = this->body();
-    return body.indexOf(QRegularExpression("^\\s*//+\\s*" + s + "\\s*($|\n)")) > -1;
-}
-
 void ListItemInterface::resizeEvent(QResizeEvent *event)
 {
     _bgLabel->resize(event->size() - QSize(_cardMargin * 2, _cardMargin * 2));
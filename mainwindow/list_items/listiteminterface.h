@@ -17,9 +17,6 @@ class ListItemInterface : public QWidget
 public:
     explicit ListItemInterface(QWidget *parent = nullptr);
 
-    virtual void fromJson(MyJson) = 0;
-    virtual MyJson toJson() const = 0;
-
     virtual bool isEnabled() const
     {
         return false;
@@ -39,8 +36,6 @@ public:
 
     int getRow() const;
 
-    bool matchId(QString s) const;
-
 signals:
     void signalResized();
 
@@ -34,33 +34,11 @@ ReplyWidget::ReplyWidget(QWidget *parent) : ListItemInterface(parent)
         sendMsgs(true);
     });
 
-    connect(keyEdit, &QLineEdit::textChanged, this, [=]{
-        keyEmpty = keyEdit->text().trimmed().isEmpty();
-        keyRe = QRegularExpression(keyEdit->text());
-    });
-
     connect(replyEdit, &QPlainTextEdit::textChanged, this, [=]{
         autoResizeEdit();
     });
 }
 
-void ReplyWidget::fromJson(MyJson json)
-{
-    check->setChecked(json.b("enabled"));
-    keyEdit->setText(json.s("key"));
-    replyEdit->setPlainText(json.s("reply"));
-}
-
-MyJson ReplyWidget::toJson() const
-{
-    MyJson json;
-    json.insert("anchor_key", CODE_AUTO_REPLY_KEY);
-    json.insert("enabled", check->isChecked());
-    json.insert("key", keyEdit->text());
-    json.insert("reply", replyEdit->toPlainText());
-    return json;
-}
-
 bool ReplyWidget::isEnabled() const
 {
     return check->isChecked();
@@ -76,28 +54,6 @@ QString ReplyWidget::body() const
     return replyEdit->toPlainText();
 }
 
-void ReplyWidget::slotNewDanmaku(LiveDanmaku danmaku)
-{
-    if (!check->isChecked() || !danmaku.is(MSG_DANMAKU) || danmaku.isNoReply())
-        return ;
-
-    // 判断有无条件
-    if (keyEmpty || !keyRe.isValid())
-    {
-        qWarning() << "无效的自动回复：" << keyEdit->text();
-        return ;
-    }
-
-    QRegularExpressionMatch match;
-    if (danmaku.getText().indexOf(keyRe, 0, &match) == -1)
-        return ;
-
-    // 开始发送
-    qDebug() << "自动回复匹配    text:" << danmaku.getText() << "    exp:" << keyEdit->text();
-    danmaku.setArgs(match.capturedTexts());
-    emit signalReplyMsgs(replyEdit->toPlainText(), danmaku, false);
-}
-
 void ReplyWidget::autoResizeEdit()
 {
     replyEdit->document()->setPageSize(QSize(this->width(), replyEdit->document()->size().height()));
@@ -110,32 +66,3 @@ void ReplyWidget::autoResizeEdit()
     replyEdit->setFixedHeight(he);
     emit signalResized();
 }
-
-void ReplyWidget::triggerAction(LiveDanmaku danmaku)
-{
-    emit signalReplyMsgs(replyEdit->toPlainText(), danmaku, false);
-}
-
-/**
- * 强行运行，如果弹幕匹配
- * 无论是否开启
- */
-void ReplyWidget::triggerIfMatch(QString msg, LiveDanmaku danmaku)
-{
-    // 判断有无条件
-    if (keyEmpty || !keyRe.isValid())
-    {
-        qWarning() << "无效的自动回复：" << keyEdit->text();
-        return ;
-    }
-
-    QRegularExpressionMatch match;
-    if (msg.indexOf(keyRe, 0, &match) == -1)
-        return ;
-
-    // 开始发送
-    qDebug() << "自动回复匹配    text:" << danmaku.getText() << "    exp:" << keyEdit->text();
-    danmaku.setArgs(match.capturedTexts());
-    emit signalReplyMsgs(replyEdit->toPlainText(), danmaku, false);
-}
-
@@ -24,9 +24,6 @@ class ReplyWidget : public ListItemInterface
 public:
     ReplyWidget(QWidget *parent = nullptr);
 
-    virtual void fromJson(MyJson json) override;
-    virtual MyJson toJson() const override;
-
     virtual bool isEnabled() const override;
     virtual QString title() const override;
     virtual QString body() const override;
@@ -35,17 +32,11 @@ signals:
     void signalReplyMsgs(QString msgs, LiveDanmaku danmaku, bool manual);
 
 public slots:
-    void slotNewDanmaku(LiveDanmaku danmaku);
     void autoResizeEdit() override;
-    void triggerAction(LiveDanmaku danmaku);
-    void triggerIfMatch(QString msg, LiveDanmaku danmaku);
 
 public:
     QLineEdit* keyEdit;
     QPlainTextEdit* replyEdit;
-
-    bool keyEmpty = true;
-    QRegularExpression keyRe;
 };
 
 #endif // REPLYWIDGET_H
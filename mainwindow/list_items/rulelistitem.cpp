@@ -0,0 +1,280 @@
+#include <QDebug>
+#include "rulelistitem.h"
+#include "livelog.h"
+
+RuleListItem::RuleListItem(RuleKind kind) : QListWidgetItem(nullptr, QListWidgetItem::UserType), kind(kind)
+{
+}
+
+RuleListItem::~RuleListItem()
+{
+    stopTimer();
+}
+
+RuleListItem *RuleListItem::from(QListWidgetItem *item)
+{
+    return static_cast<RuleListItem*>(item);
+}
+
+RuleListItem::RuleKind RuleListItem::getKind() const
+{
+    return kind;
+}
+
+QString RuleListItem::getListKey() const
+{
+    switch (kind)
+    {
+    case TimerTask:
+        return CODE_TIMER_TASK_KEY;
+    case AutoReply:
+        return CODE_AUTO_REPLY_KEY;
+    case EventAction:
+        return CODE_EVENT_ACTION_KEY;
+    }
+    return "";
+}
+
+bool RuleListItem::isEnabled() const
+{
+    return enabled;
+}
+
+void RuleListItem::setEnabled(bool enable)
+{
+    this->enabled = enable;
+}
+
+int RuleListItem::getInterval() const
+{
+    return interval;
+}
+
+void RuleListItem::setInterval(int second)
+{
+    this->interval = qMax(1, second);
+}
+
+QString RuleListItem::getTitle() const
+{
+    return title;
+}
+
+void RuleListItem::setTitle(const QString &title)
+{
+    this->title = title;
+    if (kind == AutoReply)
+    {
+        keyRe = QRegularExpression(title);
+        keyRe.optimize();
+    }
+}
+
+QString RuleListItem::getBody() const
+{
+    return body;
+}
+
+void RuleListItem::setBody(const QString &body)
+{
+    this->body = body;
+}
+
+void RuleListItem::fromJson(MyJson json)
+{
+    setEnabled(json.b("enabled"));
+    if (kind == TimerTask)
+    {
+        setInterval(json.i("interval"));
+        setBody(json.s("text"));
+    }
+    else if (kind == AutoReply)
+    {
+        setTitle(json.s("key"));
+        setBody(json.s("reply"));
+    }
+    else if (kind == EventAction)
+    {
+        setTitle(json.s("event"));
+        setBody(json.s("action"));
+    }
+}
+
+MyJson RuleListItem::toJson() const
+{
+    MyJson json;
+    json.insert("anchor_key", getListKey());
+    json.insert("enabled", enabled);
+    if (kind == TimerTask)
+    {
+        json.insert("interval", interval);
+        json.insert("text", body);
+    }
+    else if (kind == AutoReply)
+    {
+        json.insert("key", title);
+        json.insert("reply", body);
+    }
+    else if (kind == EventAction)
+    {
+        json.insert("event", title);
+        json.insert("action", body);
+    }
+    return json;
+}
+
+/**
+ * 读取第 row 行，键名和旧版本相同：task/r0Msg、reply/r0Key、event/r0Action 等
+ */
+void RuleListItem::readSettings(QSettings *settings, int row)
+{
+    QString prefix = settingsGroup() + "/r" + QString::number(row);
+    setEnabled(settings->value(prefix + "Enable", false).toBool());
+    if (kind == TimerTask)
+    {
+        setInterval(settings->value(prefix + "Interval", 1800).toInt());
+        setBody(settings->value(prefix + "Msg", "").toString());
+    }
+    else if (kind == AutoReply)
+    {
+        setTitle(settings->value(prefix + "Key").toString());
+        setBody(settings->value(prefix + "Reply").toString());
+    }
+    else if (kind == EventAction)
+    {
+        setTitle(settings->value(prefix + "Cmd").toString());
+        setBody(settings->value(prefix + "Action").toString());
+    }
+}
+
+void RuleListItem::writeSettings(QSettings *settings, int row) const
+{
+    QString prefix = settingsGroup() + "/r" + QString::number(row);
+    settings->setValue(prefix + "Enable", enabled);
+    if (kind == TimerTask)
+    {
+        settings->setValue(prefix + "Interval", interval);
+        settings->setValue(prefix + "Msg", body);
+    }
+    else if (kind == AutoReply)
+    {
+        settings->setValue(prefix + "Key", title);
+        settings->setValue(prefix + "Reply", body);
+    }
+    else if (kind == EventAction)
+    {
+        settings->setValue(prefix + "Cmd", title);
+        settings->setValue(prefix + "Action", body);
+    }
+}
+
+/**
+ * 第一行为 “// ID” 的规则
+ */
+bool RuleListItem::matchId(QString s) const
+{
+    return body.indexOf(QRegularExpression("^\\s*//+\\s*" + s + "\\s*($|\n)")) > -1;
+}
+
+/**
+ * 自动回复的关键词是否匹配，匹配时 args 为捕获的文本
+ * 不检查是否开启
+ */
+bool RuleListItem::matchReply(const QString &text, QStringList *args) const
+{
+    if (title.trimmed().isEmpty() || !keyRe.isValid())
+    {
+        qWarning() << "无效的自动回复：" << title;
+        return false;
+    }
+
+    QRegularExpressionMatch match;
+    if (text.indexOf(keyRe, 0, &match) == -1)
+        return false;
+
+    LOG_DEB(LiveLog::Reply) << "自动回复匹配    text:" << text << "    exp:" << title;
+    if (args)
+        *args = match.capturedTexts();
+    return true;
+}
+
+/**
+ * 按当前间隔重新开始计时
+ */
+void RuleListItem::startTimer(QObject *context, std::function<void()> func)
+{
+    stopTimer();
+    timerId = TimerWheel::instance()->schedule(interval * 1000, interval * 1000, context, "定时任务", func);
+}
+
+void RuleListItem::stopTimer()
+{
+    if (timerId)
+        TimerWheel::instance()->cancel(timerId);
+    timerId = 0;
+}
+
+bool RuleListItem::isTimerActive() const
+{
+    return timerId && TimerWheel::instance()->isScheduled(timerId);
+}
+
+ListItemInterface *RuleListItem::createWidget(QWidget *parent) const
+{
+    ListItemInterface* widget = nullptr;
+    switch (kind)
+    {
+    case TimerTask:
+        widget = new TaskWidget(parent);
+        break;
+    case AutoReply:
+        widget = new ReplyWidget(parent);
+        break;
+    case EventAction:
+        widget = new EventWidget(parent);
+        break;
+    }
+    fillWidget(widget);
+    return widget;
+}
+
+/**
+ * 把规则的内容显示到控件上
+ */
+void RuleListItem::fillWidget(ListItemInterface *widget) const
+{
+    widget->check->setChecked(enabled);
+    if (kind == TimerTask)
+    {
+        auto tw = static_cast<TaskWidget*>(widget);
+        tw->spin->setValue(interval);
+        tw->edit->setPlainText(body);
+    }
+    else if (kind == AutoReply)
+    {
+        auto rw = static_cast<ReplyWidget*>(widget);
+        rw->keyEdit->setText(title);
+        rw->replyEdit->setPlainText(body);
+    }
+    else if (kind == EventAction)
+    {
+        auto ew = static_cast<EventWidget*>(widget);
+        ew->eventEdit->setText(title);
+        ew->actionEdit->setPlainText(body);
+    }
+    widget->autoResizeEdit();
+}
+
+QString RuleListItem::settingsGroup() const
+{
+    switch (kind)
+    {
+    case TimerTask:
+        return "task";
+    case AutoReply:
+        return "reply";
+    case EventAction:
+        return "event";
+    }
+    return "";
+}
@@ -0,0 +1,75 @@
+#ifndef RULELISTITEM_H
+#define RULELISTITEM_H
+
+#include <QListWidgetItem>
+#include <QRegularExpression>
+#include <QSettings>
+#include <functional>
+#include "myjson.h"
+#include "timerwheel.h"
+#include "taskwidget.h"
+#include "replywidget.h"
+#include "eventwidget.h"
+
+/**
+ * 定时任务、自动回复、事件动作列表中的一行
+ * 规则的内容保存在这里，运行时（定时发送、关键词匹配、事件响应）只读这里的数据；
+ * 编辑用的控件在滚动到可见时才创建，控件的修改写回这里。
+ */
+class RuleListItem : public QListWidgetItem
+{
+public:
+    enum RuleKind
+    {
+        TimerTask,
+        AutoReply,
+        EventAction
+    };
+
+    RuleListItem(RuleKind kind);
+    ~RuleListItem() override;
+
+    static RuleListItem* from(QListWidgetItem* item);
+
+    RuleKind getKind() const;
+    QString getListKey() const;
+
+    bool isEnabled() const;
+    void setEnabled(bool enable);
+    int getInterval() const;
+    void setInterval(int second);
+    QString getTitle() const;
+    void setTitle(const QString& title);
+    QString getBody() const;
+    void setBody(const QString& body);
+
+    void fromJson(MyJson json);
+    MyJson toJson() const;
+    void readSettings(QSettings* settings, int row);
+    void writeSettings(QSettings* settings, int row) const;
+
+    bool matchId(QString s) const;
+    bool matchReply(const QString& text, QStringList* args) const;
+
+    void startTimer(QObject* context, std::function<void()> func);
+    void stopTimer();
+    bool isTimerActive() const;
+
+    ListItemInterface* createWidget(QWidget* parent) const;
+    void fillWidget(ListItemInterface* widget) const;
+
+private:
+    QString settingsGroup() const;
+
+private:
+    RuleKind kind;
+    bool enabled = false;
+    int interval = 1800; // 定时任务的间隔，秒
+    QString title; // 自动回复的关键词、事件动作的命令
+    QString body;
+
+    QRegularExpression keyRe; // 自动回复的关键词
+    TimerWheel::TimerId timerId = 0; // 定时任务在时间轮上的ID
+};
+
+#endif // RULELISTITEM_H
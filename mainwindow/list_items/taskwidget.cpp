@@ -3,7 +3,6 @@
 
 TaskWidget::TaskWidget(QWidget *parent) : ListItemInterface(parent)
 {
-    timer = new QTimer(this);
     spin = new QSpinBox(this);
     edit = new ConditionEditor(this);
 
@@ -27,20 +26,8 @@ TaskWidget::TaskWidget(QWidget *parent) : ListItemInterface(parent)
         emit signalSendMsgs(edit->toPlainText(), manual);
     };
 
-    connect(check, &QCheckBox::stateChanged, this, [=](int){
-        bool enable = check->isChecked();
-        if (enable)
-            timer->start();
-        else
-            timer->stop();
-    });
-
     connect(spin, SIGNAL(valueChanged(int)), this, SLOT(slotSpinChanged(int)));
 
-    connect(timer, &QTimer::timeout, this, [=]{
-        sendMsgs(false);
-    });
-
     connect(btn, &QPushButton::clicked, this, [=]{
         sendMsgs(true);
     });
@@ -50,25 +37,6 @@ TaskWidget::TaskWidget(QWidget *parent) : ListItemInterface(parent)
     });
 }
 
-void TaskWidget::fromJson(MyJson json)
-{
-    check->setChecked(json.b("enabled"));
-    spin->setValue(json.i("interval"));
-    edit->setPlainText(json.s("text"));
-
-    timer->setInterval(spin->value() * 1000);
-}
-
-MyJson TaskWidget::toJson() const
-{
-    MyJson json;
-    json.insert("anchor_key", CODE_TIMER_TASK_KEY);
-    json.insert("enabled", check->isChecked());
-    json.insert("interval", spin->value());
-    json.insert("text", edit->toPlainText());
-    return json;
-}
-
 bool TaskWidget::isEnabled() const
 {
     return check->isChecked();
@@ -81,7 +49,6 @@ QString TaskWidget::body() const
 
 void TaskWidget::slotSpinChanged(int val)
 {
-    timer->setInterval(val * 1000);
     emit spinChanged(val);
 }
 
@@ -97,8 +64,3 @@ void TaskWidget::autoResizeEdit()
     edit->setFixedHeight(he);
     emit signalResized();
 }
-
-void TaskWidget::triggerAction(LiveDanmaku)
-{
-    emit signalSendMsgs(edit->toPlainText(), false);
-}
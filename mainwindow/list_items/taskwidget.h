@@ -25,9 +25,6 @@ class TaskWidget : public ListItemInterface
 public:
     TaskWidget(QWidget *parent = nullptr);
 
-    virtual void fromJson(MyJson json) override;
-    virtual MyJson toJson() const override;
-
     virtual bool isEnabled() const override;
     virtual QString body() const override;
 
@@ -38,10 +35,8 @@ signals:
 public slots:
     void slotSpinChanged(int val);
     void autoResizeEdit() override;
-    void triggerAction(LiveDanmaku);
 
 public:
-    QTimer* timer;
     QSpinBox* spin;
     QPlainTextEdit* edit;
 };
@@ -5,7 +5,7 @@
 #include "livedanmaku.h"
 
 class QSettings;
-class EternalBlockUser;
+class ModerationState;
 
 #if true
 #define s8(x) QString(x)
@@ -20,7 +20,6 @@ class CommonValues
 protected:
     static QHash<qint64, QString> localNicknames; // 本地昵称
     static QHash<qint64, qint64> userComeTimes;   // 用户进来的时间（客户端时间戳为准）
-    static QHash<qint64, qint64> userBlockIds;    // 本次用户屏蔽的ID
     static QSettings* danmakuCounts; // 保存弹幕次数的settings
     static QSettings* userMarks; // 保存每位用户的设置
     static QList<LiveDanmaku> allDanmakus;
@@ -33,7 +32,7 @@ protected:
     static QList<qint64> notWelcomeUsers; // 不自动欢迎的用户（某些领导、黑粉）
     static QList<qint64> notReplyUsers;   // 不自动回复的用户
     static QHash<int, QString> giftNames; // 礼物名字
-    static QList<EternalBlockUser> eternalBlockUsers; // 永久禁言
+    static ModerationState* moderation; // 禁言、永久禁言、粉丝
     static QHash<qint64, QString> currentGuards; // 当前船员ID-Name
     static QHash<qint64, QPixmap> giftImages; // 礼物图片（因为数量不多，直接用即可）
 
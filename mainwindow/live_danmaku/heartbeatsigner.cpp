@@ -0,0 +1,96 @@
+#include <QMessageAuthenticationCode>
+#include "heartbeatsigner.h"
+
+/**
+ * 计算签名
+ * @param ok 出现不支持的加密方式时为 false，返回空字符串
+ */
+QString HeartbeatSigner::sign(const Payload &payload, const QString &benchmark, const QJsonArray &rule, bool *ok)
+{
+    QByteArray key = benchmark.toUtf8();
+    QByteArray text = payloadText(payload).toUtf8();
+    for (int i = 0; i < rule.size(); i++)
+    {
+        bool valid = false;
+        text = hmacHex(rule.at(i).toInt(-1), key, text, &valid).toLatin1();
+        if (!valid)
+        {
+            if (ok)
+                *ok = false;
+            return "";
+        }
+    }
+    if (ok)
+        *ok = true;
+    return QString::fromLatin1(text);
+}
+
+/**
+ * 参与签名的文字，字段顺序固定，不能用 QJsonDocument（会按键名排序）
+ */
+QString HeartbeatSigner::payloadText(const Payload &payload)
+{
+    return QString("{\"platform\":\"web\",\"parent_id\":%1,\"area_id\":%2,\"seq_id\":%3,\"room_id\":%4,"
+                   "\"buvid\":\"%5\",\"uuid\":\"%6\",\"ets\":%7,\"time\":%8,\"ts\":%9}")
+            .arg(payload.parentAreaId).arg(payload.areaId).arg(payload.seq).arg(payload.roomId)
+            .arg(payload.buvid).arg(payload.uuid)
+            .arg(payload.ets).arg(payload.time).arg(payload.ts);
+}
+
+/**
+ * 空的规则也视为不支持，签名会变成未加密的原文
+ */
+bool HeartbeatSigner::isRuleSupported(const QJsonArray &rule)
+{
+    if (rule.isEmpty())
+        return false;
+    QCryptographicHash::Algorithm hash;
+    for (int i = 0; i < rule.size(); i++)
+        if (!toHashAlgorithm(rule.at(i).toInt(-1), &hash))
+            return false;
+    return true;
+}
+
+/**
+ * 小写十六进制的 HMAC
+ */
+QString HeartbeatSigner::hmacHex(int algorithm, const QByteArray &key, const QByteArray &message, bool *ok)
+{
+    QCryptographicHash::Algorithm hash;
+    if (!toHashAlgorithm(algorithm, &hash))
+    {
+        if (ok)
+            *ok = false;
+        return "";
+    }
+    if (ok)
+        *ok = true;
+    return QString::fromLatin1(QMessageAuthenticationCode::hash(message, key, hash).toHex());
+}
+
+bool HeartbeatSigner::toHashAlgorithm(int algorithm, QCryptographicHash::Algorithm *hash)
+{
+    switch (algorithm)
+    {
+    case 0:
+        *hash = QCryptographicHash::Md5;
+        return true;
+    case 1:
+        *hash = QCryptographicHash::Sha1;
+        return true;
+    case 2:
+        *hash = QCryptographicHash::Sha256;
+        return true;
+    case 3:
+        *hash = QCryptographicHash::Sha224;
+        return true;
+    case 4:
+        *hash = QCryptographicHash::Sha512;
+        return true;
+    case 5:
+        *hash = QCryptographicHash::Sha384;
+        return true;
+    default:
+        return false;
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef HEARTBEATSIGNER_H
+#define HEARTBEATSIGNER_H
+
+#include <QString>
+#include <QJsonArray>
+#include <QCryptographicHash>
+
+#define HEARTBEAT_BUVID "AUTO4115984068636104" // 心跳包中的设备ID
+#define HEARTBEAT_UUID "f5f08e2f-e4e3-4156-8127-616f79a17e1a" // 心跳包中的设备UUID
+
+/**
+ * 直播心跳X包的签名 s
+ * 把心跳数据按固定顺序拼成 JSON，再按 secret_rule 的顺序，
+ * 以 secret_key(benchmark) 为密钥逐个做 HMAC，上一次的十六进制结果作为下一次的输入。
+ * rule 中的数字对应：0 MD5, 1 SHA1, 2 SHA256, 3 SHA224, 4 SHA512, 5 SHA384
+ */
+class HeartbeatSigner
+{
+public:
+    struct Payload
+    {
+        qint64 parentAreaId = 0;
+        qint64 areaId = 0;
+        qint64 seq = 0;       // 心跳序号，X包从1开始
+        qint64 roomId = 0;
+        QString buvid = HEARTBEAT_BUVID;
+        QString uuid = HEARTBEAT_UUID;
+        qint64 ets = 0;       // 上次返回的 timestamp，秒
+        int time = 0;         // 上次返回的 heartbeat_interval，秒
+        qint64 ts = 0;        // 本次发送的时间，毫秒
+    };
+
+    static QString sign(const Payload& payload, const QString& benchmark, const QJsonArray& rule, bool* ok = nullptr);
+    static QString payloadText(const Payload& payload);
+    static bool isRuleSupported(const QJsonArray& rule);
+    static QString hmacHex(int algorithm, const QByteArray& key, const QByteArray& message, bool* ok = nullptr);
+
+private:
+    static bool toHashAlgorithm(int algorithm, QCryptographicHash::Algorithm* hash);
+};
+
+#endif // HEARTBEATSIGNER_H
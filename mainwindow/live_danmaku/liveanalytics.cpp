@@ -0,0 +1,639 @@
+#include <QDir>
+#include <QFile>
+#include <QDataStream>
+#include <QDateTime>
+#include <QSettings>
+#include <QMap>
+#include <QDebug>
+#include <climits>
+#include <algorithm>
+#include "liveanalytics.h"
+
+#define ANALYTICS_MAGIC 0x4C415331 // LAS1
+#define ANALYTICS_SECOND_BUCKETS 300 // 秒级保留5分钟
+#define ANALYTICS_MINUTE_BUCKETS 1440 // 分钟级保留一天
+#define ANALYTICS_HOUR_BUCKETS 720 // 小时级保留30天
+#define ANALYTICS_FLUSH_INTERVAL 300 // 归档的间隔，秒
+#define ANALYTICS_TICK_INTERVAL 1000 // 有数据时汇总的间隔，毫秒
+
+LiveAnalytics::LiveAnalytics(const QString &dirPath, QObject *parent) : QObject(parent), dirPath(dirPath)
+{
+    for (int i = 0; i < METRIC_COUNT; i++)
+    {
+        pendingCounts[i] = 0;
+        pendingGauges[i] = -1;
+    }
+    resetRings();
+    currentDate = QDate::currentDate();
+    lastFlushSecond = QDateTime::currentSecsSinceEpoch();
+
+    awake = true;
+    tickTimer = new WheelTimer("统计", this);
+    tickTimer->setInterval(ANALYTICS_TICK_INTERVAL);
+    connect(tickTimer, &WheelTimer::timeout, this, [=]{
+        onTickTimeout();
+    });
+    tickTimer->start();
+}
+
+LiveAnalytics::~LiveAnalytics()
+{
+    tick();
+    archive(QDateTime::currentSecsSinceEpoch() / 60 * 60 + 60); // 包括还没结束的这一分钟
+}
+
+QString LiveAnalytics::metricKey(int metric)
+{
+    switch (metric)
+    {
+    case Come: return "come";
+    case PeopleNum: return "people_num";
+    case Danmaku: return "danmaku";
+    case NewbieMsg: return "newbie_msg";
+    case NewFans: return "new_fans";
+    case TotalFans: return "total_fans";
+    case GiftSilver: return "gift_silver";
+    case GiftGold: return "gift_gold";
+    case Guard: return "guard";
+    case GuardCount: return "guard_count";
+    case Popularity: return "popularity";
+    case DanmuPopul: return "danmu_popularity";
+    }
+    return "";
+}
+
+int LiveAnalytics::metricFromKey(const QString &key)
+{
+    for (int i = 0; i < METRIC_COUNT; i++)
+        if (metricKey(i) == key)
+            return i;
+    return -1;
+}
+
+/**
+ * 记录值：同一个桶里取最大，其余的是累加的计数
+ */
+bool LiveAnalytics::isGauge(int metric)
+{
+    return metric == PeopleNum || metric == TotalFans || metric == GuardCount || metric == Popularity;
+}
+
+int LiveAnalytics::resolutionFromKey(const QString &key)
+{
+    if (key == "second")
+        return Second;
+    if (key == "minute")
+        return Minute;
+    if (key == "hour")
+        return Hour;
+    return -1;
+}
+
+/**
+ * 切换房间：归档上一个房间的数据，读取这个房间今天的数据
+ */
+void LiveAnalytics::setRoomId(const QString &roomId)
+{
+    if (this->roomId == roomId)
+        return ;
+
+    tick();
+    archive(QDateTime::currentSecsSinceEpoch() / 60 * 60 + 60);
+
+    this->roomId = roomId;
+    resetRings();
+    today = DayRow();
+    currentDate = QDate::currentDate();
+    archivedUntil = 0;
+    if (roomId.isEmpty())
+        return ;
+
+    // 恢复今天已经归档的（以及旧版本保存的）
+    readLegacyDay(dayPath(".ini", currentDate), today);
+    qint64 last = 0;
+    readArchive(dayPath(".stats", currentDate), [&](qint64 start, const qint64* values){
+        record(minutes, start, values);
+        record(hours, start, values);
+        addToDay(today, values);
+        last = qMax(last, start + 60);
+    });
+    archivedUntil = last;
+}
+
+/**
+ * 关闭后只在内存里统计，不写入文件
+ */
+void LiveAnalytics::setArchiveEnabled(bool enable)
+{
+    if (archiveEnabled == enable)
+        return ;
+    if (!enable)
+        archive(QDateTime::currentSecsSinceEpoch() / 60 * 60);
+    archiveEnabled = enable;
+}
+
+/**
+ * 立即归档已经结束的分钟
+ */
+void LiveAnalytics::flush()
+{
+    tick();
+    archive(QDateTime::currentSecsSinceEpoch() / 60 * 60);
+}
+
+/**
+ * 累加计数，可在任意线程调用
+ */
+void LiveAnalytics::add(LiveAnalytics::Metric metric, qint64 value)
+{
+    pendingCounts[metric].fetch_add(value, std::memory_order_relaxed);
+    wake();
+}
+
+/**
+ * 记录当前值，一秒内多次记录时保留最大的
+ */
+void LiveAnalytics::setGauge(LiveAnalytics::Metric metric, qint64 value)
+{
+    qint64 old = pendingGauges[metric].load(std::memory_order_relaxed);
+    while (old < value && !pendingGauges[metric].compare_exchange_weak(old, value, std::memory_order_relaxed));
+    wake();
+}
+
+/**
+ * 今天的总数（记录值为今天的最大值），包括还没汇总的这一秒
+ */
+qint64 LiveAnalytics::getToday(LiveAnalytics::Metric metric) const
+{
+    if (isGauge(metric))
+        return qMax(today.values[metric], pendingGauges[metric].load(std::memory_order_relaxed));
+    return today.values[metric] + pendingCounts[metric].load(std::memory_order_relaxed);
+}
+
+qint64 LiveAnalytics::getTodayAveragePopularity() const
+{
+    return averagePopularity(today);
+}
+
+/**
+ * 最近 count 个桶的值，旧的在前，最后一个是当前的桶
+ */
+QVector<qint64> LiveAnalytics::series(LiveAnalytics::Metric metric, LiveAnalytics::Resolution resolution, int count) const
+{
+    const Ring& r = ring(resolution);
+    const int size = r.buckets.size();
+    count = qBound(0, count, size);
+    QVector<qint64> values(count, 0);
+    qint64 end = QDateTime::currentSecsSinceEpoch() / r.span * r.span;
+    for (int i = 0; i < count; i++)
+    {
+        qint64 t = end - qint64(count - 1 - i) * r.span;
+        const Bucket& bucket = r.buckets.at(int((t / r.span) % size));
+        if (bucket.start == t)
+            values[i] = qMax(0LL, bucket.values[metric]);
+    }
+    return values;
+}
+
+qint64 LiveAnalytics::sum(LiveAnalytics::Metric metric, LiveAnalytics::Resolution resolution, int count) const
+{
+    qint64 total = 0;
+    foreach (qint64 value, series(metric, resolution, count))
+        total += value;
+    return total;
+}
+
+/**
+ * {"metric":"danmaku", "step":60, "start":秒, "values":[...]}
+ */
+MyJson LiveAnalytics::seriesJson(LiveAnalytics::Metric metric, LiveAnalytics::Resolution resolution, int count) const
+{
+    QVector<qint64> values = series(metric, resolution, count);
+    const Ring& r = ring(resolution);
+    QJsonArray array;
+    foreach (qint64 value, values)
+        array.append(value);
+
+    MyJson json;
+    json.insert("metric", metricKey(metric));
+    json.insert("step", r.span);
+    json.insert("start", QDateTime::currentSecsSinceEpoch() / r.span * r.span - qint64(values.size() - 1) * r.span);
+    json.insert("values", array);
+    return json;
+}
+
+/**
+ * 每天一行，列和旧版本导出的相同
+ */
+void LiveAnalytics::exportDailyCsv(QTextStream &stream)
+{
+    stream << QString("日期,进入人次,进入人数,弹幕数量,新人弹幕,新增关注,关注总数,总金瓜子,总银瓜子,上船人数,船员总数,平均人气,最高人气\n").toUtf8();
+    forEachDay([&](const QDate& date, const DayRow& row){
+        stream << date.toString("yyyy-MM-dd") << ","
+               << row.values[Come] << ","
+               << row.values[PeopleNum] << ","
+               << row.values[Danmaku] << ","
+               << row.values[NewbieMsg] << ","
+               << row.values[NewFans] << ","
+               << row.values[TotalFans] << ","
+               << row.values[GiftGold] << ","
+               << row.values[GiftSilver] << ","
+               << row.values[Guard] << ","
+               << row.values[GuardCount] << ","
+               << averagePopularity(row) << ","
+               << row.values[Popularity]
+               << "\n";
+    });
+}
+
+/**
+ * [{"date":"2021-01-01", "come":0, ...}, ...]，逐行写入
+ */
+void LiveAnalytics::exportDailyJson(QTextStream &stream)
+{
+    bool first = true;
+    stream << "[";
+    forEachDay([&](const QDate& date, const DayRow& row){
+        QJsonObject json;
+        json.insert("date", date.toString("yyyy-MM-dd"));
+        for (int i = 0; i < METRIC_COUNT; i++)
+            if (i != Popularity)
+                json.insert(metricKey(i), row.values[i]);
+        json.insert("average_popularity", averagePopularity(row));
+        json.insert("max_popularity", row.values[Popularity]);
+        stream << (first ? "\n" : ",\n") << QJsonDocument(json).toJson(QJsonDocument::Compact);
+        first = false;
+    });
+    stream << "\n]\n";
+}
+
+/**
+ * 有新数据时恢复每秒汇总，可在任意线程调用
+ * 已经醒着时只有一次原子读
+ */
+void LiveAnalytics::wake()
+{
+    if (awake.load(std::memory_order_relaxed) || awake.exchange(true))
+        return ;
+    QMetaObject::invokeMethod(this, [=]{
+        tickTimer->start(ANALYTICS_TICK_INTERVAL);
+    }, Qt::QueuedConnection);
+}
+
+bool LiveAnalytics::hasPending() const
+{
+    for (int i = 0; i < METRIC_COUNT; i++)
+    {
+        if (isGauge(i) ? pendingGauges[i].load(std::memory_order_relaxed) >= 0
+                       : pendingCounts[i].load(std::memory_order_relaxed) != 0)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * 每秒汇总；有数据的那一分钟结束后还没有新数据，就归档并休眠到零点（换日）
+ * 先清除 awake 再检查一遍，休眠前刚加进来的数据会由 wake() 重新唤醒
+ */
+void LiveAnalytics::onTickTimeout()
+{
+    tick();
+    qint64 now = QDateTime::currentSecsSinceEpoch();
+    if (now / 60 * 60 <= lastDataSecond)
+        return ; // 有数据的这一分钟还没结束
+
+    archive(now / 60 * 60);
+    awake = false;
+    if (hasPending())
+    {
+        awake = true;
+        return ;
+    }
+    QDateTime midnight(QDate::currentDate().addDays(1), QTime(0, 0));
+    tickTimer->start(int(qBound(qint64(ANALYTICS_TICK_INTERVAL), QDateTime::currentDateTime().msecsTo(midnight) + 1000, qint64(INT_MAX))));
+}
+
+/**
+ * 把这一秒的计数汇总到各个环里，定期归档
+ */
+void LiveAnalytics::tick()
+{
+    qint64 now = QDateTime::currentSecsSinceEpoch();
+    QDate date = QDate::currentDate();
+    if (date != currentDate)
+    {
+        archive(now / 60 * 60);
+        rollDay(date);
+    }
+
+    qint64 values[METRIC_COUNT];
+    bool any = false;
+    for (int i = 0; i < METRIC_COUNT; i++)
+    {
+        if (isGauge(i))
+        {
+            values[i] = pendingGauges[i].exchange(-1, std::memory_order_relaxed);
+            any |= values[i] >= 0;
+        }
+        else
+        {
+            values[i] = pendingCounts[i].exchange(0, std::memory_order_relaxed);
+            any |= values[i] != 0;
+        }
+    }
+
+    if (any)
+    {
+        record(seconds, now, values);
+        record(minutes, now, values);
+        record(hours, now, values);
+        addToDay(today, values);
+        lastDataSecond = now;
+    }
+
+    if (now - lastFlushSecond >= ANALYTICS_FLUSH_INTERVAL)
+    {
+        lastFlushSecond = now;
+        archive(now / 60 * 60);
+    }
+}
+
+void LiveAnalytics::rollDay(const QDate &date)
+{
+    currentDate = date;
+    today = DayRow();
+}
+
+void LiveAnalytics::resetRings()
+{
+    initRing(seconds, 1, ANALYTICS_SECOND_BUCKETS);
+    initRing(minutes, 60, ANALYTICS_MINUTE_BUCKETS);
+    initRing(hours, 3600, ANALYTICS_HOUR_BUCKETS);
+}
+
+void LiveAnalytics::initRing(LiveAnalytics::Ring &ring, int span, int size)
+{
+    ring.span = span;
+    ring.buckets.fill(Bucket(), size);
+}
+
+/**
+ * 记录到 time 所在的桶，桶里是更早的数据时先清空
+ */
+void LiveAnalytics::record(LiveAnalytics::Ring &ring, qint64 time, const qint64 *values)
+{
+    qint64 start = time / ring.span * ring.span;
+    Bucket& bucket = ring.buckets[int((start / ring.span) % ring.buckets.size())];
+    if (bucket.start != start)
+    {
+        bucket.start = start;
+        for (int i = 0; i < METRIC_COUNT; i++)
+            bucket.values[i] = isGauge(i) ? -1 : 0;
+    }
+    merge(bucket.values, values);
+}
+
+void LiveAnalytics::merge(qint64 *to, const qint64 *values)
+{
+    for (int i = 0; i < METRIC_COUNT; i++)
+    {
+        if (isGauge(i))
+            to[i] = qMax(to[i], values[i]);
+        else
+            to[i] += values[i];
+    }
+}
+
+const LiveAnalytics::Ring &LiveAnalytics::ring(LiveAnalytics::Resolution resolution) const
+{
+    switch (resolution)
+    {
+    case Second:
+        return seconds;
+    case Minute:
+        return minutes;
+    case Hour:
+        return hours;
+    }
+    return minutes;
+}
+
+/**
+ * 把 until 之前、还没归档的分钟追加到对应日期的文件
+ */
+void LiveAnalytics::archive(qint64 until)
+{
+    if (roomId.isEmpty() || !archiveEnabled || until <= archivedUntil)
+    {
+        archivedUntil = qMax(archivedUntil, until);
+        return ;
+    }
+
+    const int size = minutes.buckets.size();
+    qint64 from = qMax(archivedUntil, until - qint64(size) * 60);
+    QMap<QDate, QList<const Bucket*>> days;
+    for (qint64 t = from; t < until; t += 60)
+    {
+        const Bucket& bucket = minutes.buckets.at(int((t / 60) % size));
+        if (bucket.start == t)
+            days[QDateTime::fromSecsSinceEpoch(t).date()].append(&bucket);
+    }
+    archivedUntil = until;
+    if (days.isEmpty())
+        return ;
+
+    QDir dir;
+    dir.mkpath(dirPath);
+    for (auto it = days.constBegin(); it != days.constEnd(); ++it)
+        appendArchive(dayPath(".stats", it.key()), it.value());
+}
+
+QString LiveAnalytics::dayPath(const QString &suffix, const QDate &date) const
+{
+    return dirPath + roomId + "_" + date.toString("yyyy-MM-dd") + suffix;
+}
+
+/**
+ * 顺序读取归档，每个有数据的分钟调用一次 func
+ * 文件格式：若干个块，每块为
+ *   magic, 第一分钟的时间戳, 分钟数 n, 列数 m
+ *   n 个相对第一分钟的偏移
+ *   m 列，每列 n 个值
+ * @param validEnd 最后一个完整的块的结尾
+ * @return 是否所有的块都完整
+ */
+bool LiveAnalytics::readArchive(const QString &path, LiveAnalytics::MinuteFunc func, qint64 *validEnd) const
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_0);
+    QVector<quint16> offsets;
+    QVector<qint64> columns;
+    qint64 values[METRIC_COUNT];
+    while (!in.atEnd())
+    {
+        quint32 magic = 0;
+        qint64 first = 0;
+        quint16 count = 0, metricCount = 0;
+        in >> magic >> first >> count >> metricCount;
+        if (in.status() != QDataStream::Ok || magic != ANALYTICS_MAGIC)
+            return false;
+
+        offsets.resize(count);
+        for (int i = 0; i < count; i++)
+            in >> offsets[i];
+        columns.fill(0, count * METRIC_COUNT);
+        for (int m = 0; m < metricCount; m++)
+        {
+            for (int i = 0; i < count; i++)
+            {
+                qint32 v = 0;
+                in >> v;
+                if (m < METRIC_COUNT) // 新版本增加的列直接跳过
+                    columns[m * count + i] = v;
+            }
+        }
+        if (in.status() != QDataStream::Ok)
+            return false;
+        if (validEnd)
+            *validEnd = file.pos();
+
+        if (!func)
+            continue;
+        for (int i = 0; i < count; i++)
+        {
+            for (int m = 0; m < METRIC_COUNT; m++)
+                values[m] = m < metricCount ? columns[m * count + i] : (isGauge(m) ? -1 : 0);
+            func(first + qint64(offsets.at(i)) * 60, values);
+        }
+    }
+    return true;
+}
+
+/**
+ * 追加一个块，整块一次写入
+ * 第一次写入某个文件前，截掉上次异常退出时写了一半的块
+ */
+bool LiveAnalytics::appendArchive(const QString &path, const QList<const LiveAnalytics::Bucket *> &minutes)
+{
+    QFile file(path);
+    if (!checkedFiles.contains(path))
+    {
+        checkedFiles.insert(path);
+        qint64 validEnd = 0;
+        if (file.exists() && !readArchive(path, nullptr, &validEnd) && file.size() > validEnd)
+        {
+            qWarning() << "统计归档不完整，截断到" << validEnd << path;
+            file.resize(validEnd);
+        }
+    }
+
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append))
+    {
+        qWarning() << "无法写入统计归档：" << path;
+        return false;
+    }
+
+    const qint64 first = minutes.first()->start;
+    QByteArray ba;
+    QDataStream out(&ba, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << quint32(ANALYTICS_MAGIC) << first << quint16(minutes.size()) << quint16(METRIC_COUNT);
+    foreach (const Bucket* bucket, minutes)
+        out << quint16((bucket->start - first) / 60);
+    for (int m = 0; m < METRIC_COUNT; m++)
+        foreach (const Bucket* bucket, minutes)
+            out << qint32(qBound(qint64(INT_MIN), bucket->values[m], qint64(INT_MAX)));
+
+    bool ok = file.write(ba) == ba.size();
+    file.close();
+    return ok;
+}
+
+/**
+ * 旧版本每天一个 ini 的统计
+ */
+void LiveAnalytics::readLegacyDay(const QString &path, LiveAnalytics::DayRow &row) const
+{
+    if (!QFile::exists(path))
+        return ;
+
+    QSettings st(path, QSettings::Format::IniFormat);
+    for (int i = 0; i < METRIC_COUNT; i++)
+    {
+        if (i == Popularity || i == DanmuPopul)
+            continue;
+        qint64 value = st.value(metricKey(i), 0).toLongLong();
+        if (isGauge(i))
+            row.values[i] = qMax(row.values[i], value);
+        else
+            row.values[i] += value;
+    }
+    row.values[Popularity] = qMax(row.values[Popularity], st.value("max_popularity", 0).toLongLong());
+    if (st.contains("average_popularity"))
+        row.averagePopular = st.value("average_popularity").toLongLong();
+}
+
+/**
+ * 按日期顺序，每天读取一次（归档和旧版本的 ini 合并）
+ * 当前房间的今天直接用内存里的
+ */
+void LiveAnalytics::forEachDay(std::function<void (const QDate &, const LiveAnalytics::DayRow &)> func) const
+{
+    if (roomId.isEmpty())
+        return ;
+
+    QDir dir(dirPath);
+    QStringList files = dir.entryList(QStringList{roomId + "_*.stats", roomId + "_*.ini"}, QDir::Files | QDir::NoDotAndDotDot);
+    QList<QDate> dates;
+    foreach (QString name, files)
+    {
+        QString day = name.mid(roomId.length() + 1);
+        day = day.left(day.lastIndexOf("."));
+        QDate date = QDate::fromString(day, "yyyy-MM-dd");
+        if (date.isValid() && !dates.contains(date))
+            dates.append(date);
+    }
+    if (!dates.contains(currentDate))
+        dates.append(currentDate);
+    std::sort(dates.begin(), dates.end());
+
+    foreach (QDate date, dates)
+    {
+        if (date == currentDate)
+        {
+            DayRow row = today;
+            for (int i = 0; i < METRIC_COUNT; i++)
+                row.values[i] = getToday(Metric(i));
+            func(date, row);
+            continue;
+        }
+
+        DayRow row;
+        readLegacyDay(dayPath(".ini", date), row);
+        readArchive(dayPath(".stats", date), [&](qint64, const qint64* values){
+            addToDay(row, values);
+        });
+        func(date, row);
+    }
+}
+
+void LiveAnalytics::addToDay(LiveAnalytics::DayRow &row, const qint64 *values)
+{
+    merge(row.values, values);
+    if (values[Popularity] > 0)
+    {
+        row.popularSum += values[Popularity];
+        row.popularCount++;
+    }
+}
+
+qint64 LiveAnalytics::averagePopularity(const LiveAnalytics::DayRow &row)
+{
+    if (row.popularCount)
+        return row.popularSum / row.popularCount;
+    return qMax(0LL, row.averagePopular);
+}
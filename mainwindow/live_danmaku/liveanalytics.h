@@ -0,0 +1,137 @@
+#ifndef LIVEANALYTICS_H
+#define LIVEANALYTICS_H
+
+#include <QObject>
+#include <QVector>
+#include <QSet>
+#include <QDate>
+#include <QTextStream>
+#include <atomic>
+#include "myjson.h"
+#include "timerwheel.h"
+
+/**
+ * 直播数据的时间序列
+ * 事件只累加到当前秒的原子计数上，每秒汇总一次到秒、分钟、小时的环形桶里；
+ * 没有数据时不再每秒汇总，等到新的数据（或者零点换日）再唤醒；
+ * 有数据的分钟按天追加到 live_daily/房间号_日期.stats，按列存储，只追加不修改。
+ * 查询最近一段时间只读环形桶，导出时顺序读取归档文件。
+ */
+class LiveAnalytics : public QObject
+{
+    Q_OBJECT
+public:
+    enum Metric
+    {
+        Come,         // 进来人次
+        PeopleNum,    // 进来人数（记录值）
+        Danmaku,      // 弹幕数量
+        NewbieMsg,    // 新人弹幕
+        NewFans,      // 新增关注
+        TotalFans,    // 粉丝总数（记录值）
+        GiftSilver,   // 银瓜子
+        GiftGold,     // 金瓜子
+        Guard,        // 上船人次
+        GuardCount,   // 船员总数（记录值）
+        Popularity,   // 人气（记录值）
+        DanmuPopul,   // 弹幕人气（不含不回复的弹幕）
+        METRIC_COUNT
+    };
+
+    enum Resolution
+    {
+        Second,
+        Minute,
+        Hour
+    };
+
+    LiveAnalytics(const QString& dirPath, QObject* parent = nullptr);
+    ~LiveAnalytics() override;
+
+    static QString metricKey(int metric);
+    static int metricFromKey(const QString& key);
+    static bool isGauge(int metric);
+    static int resolutionFromKey(const QString& key);
+
+    void setRoomId(const QString& roomId);
+    void setArchiveEnabled(bool enable);
+    void flush();
+
+    void add(Metric metric, qint64 value = 1);
+    void setGauge(Metric metric, qint64 value);
+
+    qint64 getToday(Metric metric) const;
+    qint64 getTodayAveragePopularity() const;
+    QVector<qint64> series(Metric metric, Resolution resolution, int count) const;
+    qint64 sum(Metric metric, Resolution resolution, int count) const;
+    MyJson seriesJson(Metric metric, Resolution resolution, int count) const;
+
+    void exportDailyCsv(QTextStream& stream);
+    void exportDailyJson(QTextStream& stream);
+
+private:
+    struct Bucket
+    {
+        qint64 start = -1;
+        qint64 values[METRIC_COUNT];
+    };
+
+    struct Ring
+    {
+        int span = 1; // 每个桶的秒数
+        QVector<Bucket> buckets;
+    };
+
+    struct DayRow
+    {
+        qint64 values[METRIC_COUNT] = {};
+        qint64 popularSum = 0;
+        qint64 popularCount = 0;
+        qint64 averagePopular = -1; // 旧版本直接保存的平均人气
+    };
+
+    typedef std::function<void(qint64 start, const qint64* values)> MinuteFunc;
+
+    void tick();
+    void onTickTimeout();
+    void wake();
+    bool hasPending() const;
+    void rollDay(const QDate& date);
+    void resetRings();
+    static void initRing(Ring& ring, int span, int size);
+    static void record(Ring& ring, qint64 time, const qint64* values);
+    static void merge(qint64* to, const qint64* values);
+    const Ring& ring(Resolution resolution) const;
+
+    void archive(qint64 until);
+    QString dayPath(const QString& suffix, const QDate& date) const;
+    bool readArchive(const QString& path, MinuteFunc func, qint64* validEnd = nullptr) const;
+    bool appendArchive(const QString& path, const QList<const Bucket*>& minutes);
+    void readLegacyDay(const QString& path, DayRow& row) const;
+    void forEachDay(std::function<void(const QDate& date, const DayRow& row)> func) const;
+    static void addToDay(DayRow& row, const qint64* values);
+    static qint64 averagePopularity(const DayRow& row);
+
+private:
+    QString dirPath;
+    QString roomId;
+    bool archiveEnabled = false;
+    WheelTimer* tickTimer;
+    std::atomic<bool> awake; // 每秒汇总中，为 false 时有新数据需要唤醒
+    qint64 lastDataSecond = 0; // 最后一次有数据的秒
+
+    std::atomic<qint64> pendingCounts[METRIC_COUNT];
+    std::atomic<qint64> pendingGauges[METRIC_COUNT]; // -1 表示这一秒没有记录
+
+    Ring seconds;
+    Ring minutes;
+    Ring hours;
+
+    QDate currentDate;
+    DayRow today;
+    qint64 archivedUntil = 0; // 之前的分钟都已经归档
+    qint64 lastFlushSecond = 0;
+    QSet<QString> checkedFiles; // 已经检查过结尾是否完整的归档
+};
+
+#endif // LIVEANALYTICS_H
@@ -4,6 +4,7 @@
 #include "livedanmakuwindow.h"
 #include "facilemenu.h"
 #include "guardonlinedialog.h"
+#include "moderationstate.h"
 
 QT_BEGIN_NAMESPACE
     extern Q_WIDGETS_EXPORT void qt_blurImage( QPainter *p, QImage &blurImage, qreal radius, bool quality, bool alphaOnly, int transposed = 0 );
@@ -1252,11 +1253,11 @@ void LiveDanmakuWindow::showMenu()
     if (enableBlock && uid)
     {
         menu->addSeparator();
-        if (!userBlockIds.contains(uid) && danmaku.getMsgType() != MSG_BLOCK)
+        if (!moderation->isBlocked(uid) && danmaku.getMsgType() != MSG_BLOCK)
         {
             menu->addAction(actionAddBlockTemp);
             menu->addAction(actionAddBlock);
-            if (eternalBlockUsers.contains(EternalBlockUser(uid, roomId)))
+            if (moderation->isEternalBlocked(uid, roomId))
                 menu->addAction(actionCancelEternalBlock);
             else
                 menu->addAction(actionEternalBlock);
@@ -0,0 +1,360 @@
+#include <QThread>
+#include <QDir>
+#include <QFile>
+#include <QHash>
+#include <QPair>
+#include <QStringList>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QJsonValue>
+#include <QCoreApplication>
+#include "livelog.h"
+
+std::atomic<bool> LiveLog::running(false);
+std::atomic<quint32> LiveLog::categoryMask(LiveLog::defaultMask());
+
+namespace
+{
+
+/**
+ * 多写单读的有界无锁队列（Vyukov）
+ * 每格的序号表示当前归谁：等于写位置可写，等于写位置+1可读
+ */
+class LogRing
+{
+public:
+    LogRing()
+    {
+        for (size_t i = 0; i < LIVE_LOG_CAPACITY; i++)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    bool push(LiveLog::Record&& record)
+    {
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true)
+        {
+            cell = &cells[pos & (LIVE_LOG_CAPACITY - 1)];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            qintptr diff = qintptr(seq) - qintptr(pos);
+            if (diff == 0)
+            {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0) // 满了
+            {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            else
+            {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->record = std::move(record);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// 只在后台线程调用
+    bool pop(LiveLog::Record* record)
+    {
+        Cell* cell = &cells[dequeuePos & (LIVE_LOG_CAPACITY - 1)];
+        size_t seq = cell->sequence.load(std::memory_order_acquire);
+        if (seq != dequeuePos + 1)
+            return false;
+        *record = std::move(cell->record);
+        cell->record = LiveLog::Record();
+        cell->sequence.store(dequeuePos + LIVE_LOG_CAPACITY, std::memory_order_release);
+        dequeuePos++;
+        return true;
+    }
+
+    quint64 takeDropped()
+    {
+        return dropped.exchange(0, std::memory_order_relaxed);
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        LiveLog::Record record;
+    };
+
+    Cell cells[LIVE_LOG_CAPACITY];
+    std::atomic<size_t> enqueuePos{0};
+    size_t dequeuePos = 0;
+    std::atomic<quint64> dropped{0};
+};
+
+/**
+ * 后台写入线程：格式化、按调用处限流、按天分文件
+ */
+class LogWriter : public QThread
+{
+public:
+    LogWriter(const QString& dirPath) : dirPath(dirPath)
+    {
+    }
+
+    void requestStop()
+    {
+        stopping.store(true, std::memory_order_relaxed);
+    }
+
+protected:
+    void run() override
+    {
+        QDir().mkpath(dirPath);
+        LiveLog::Record record;
+        while (true)
+        {
+            bool stop = stopping.load(std::memory_order_relaxed);
+            int count = 0;
+            while (ring.pop(&record))
+            {
+                write(record);
+                count++;
+            }
+            quint64 dropped = ring.takeDropped();
+            if (dropped)
+                writeNote(LIVE_LOG_WAR, "日志缓冲已满，丢弃" + QString::number(dropped) + "条");
+            flushSuppressed(false);
+            if (count || dropped)
+                file.flush();
+            if (stop)
+                break;
+            if (!count)
+                msleep(LIVE_LOG_IDLE);
+        }
+        flushSuppressed(true);
+        file.close();
+    }
+
+private:
+    struct SiteState
+    {
+        qint64 windowStart = 0;
+        int count = 0;
+        int suppressed = 0;
+        int category = 0;
+    };
+
+    void write(const LiveLog::Record& record)
+    {
+        // 同一处每秒超过上限的只计数
+        QPair<const char*, int> site(record.file, record.line);
+        SiteState& state = sites[site];
+        if (record.time - state.windowStart >= 1000)
+        {
+            writeSuppressed(site, state);
+            state.windowStart = record.time;
+            state.count = 0;
+        }
+        state.category = record.category;
+        if (++state.count > LIVE_LOG_SITE_LIMIT)
+        {
+            state.suppressed++;
+            return ;
+        }
+
+        QStringList parts;
+        foreach (const QVariant& arg, record.args)
+            parts.append(format(arg));
+
+        QJsonObject json;
+        json.insert("time", QDateTime::fromMSecsSinceEpoch(record.time).toString("yyyy-MM-dd hh:mm:ss.zzz"));
+        json.insert("level", levelKey(record.level));
+        json.insert("category", LiveLog::categoryKey(record.category));
+        json.insert("source", sourceName(record.file) + ":" + QString::number(record.line));
+        json.insert("message", parts.join(" "));
+        writeLine(json, record.time);
+    }
+
+    void writeNote(int level, const QString& message, int category = -1, const QString& source = QString())
+    {
+        qint64 time = QDateTime::currentMSecsSinceEpoch();
+        QJsonObject json;
+        json.insert("time", QDateTime::fromMSecsSinceEpoch(time).toString("yyyy-MM-dd hh:mm:ss.zzz"));
+        json.insert("level", levelKey(level));
+        if (category >= 0)
+            json.insert("category", LiveLog::categoryKey(category));
+        if (!source.isEmpty())
+            json.insert("source", source);
+        json.insert("message", message);
+        writeLine(json, time);
+    }
+
+    void writeSuppressed(const QPair<const char*, int>& site, SiteState& state)
+    {
+        if (!state.suppressed)
+            return ;
+        writeNote(LIVE_LOG_INF, "省略了" + QString::number(state.suppressed) + "条重复日志", state.category,
+                  sourceName(site.first) + ":" + QString::number(site.second));
+        state.suppressed = 0;
+    }
+
+    /// 窗口已经过去、但之后没有再写的调用处，补上省略的数量
+    void flushSuppressed(bool all)
+    {
+        qint64 now = QDateTime::currentMSecsSinceEpoch();
+        for (auto it = sites.begin(); it != sites.end(); ++it)
+        {
+            if (it.value().suppressed && (all || now - it.value().windowStart >= 1000))
+                writeSuppressed(it.key(), it.value());
+        }
+    }
+
+    void writeLine(const QJsonObject& json, qint64 time)
+    {
+        QString date = QDateTime::fromMSecsSinceEpoch(time).toString("yyyy-MM-dd");
+        if (date != fileDate || !file.isOpen())
+        {
+            file.close();
+            file.setFileName(QDir(dirPath).absoluteFilePath("live_" + date + ".log"));
+            if (!file.open(QIODevice::WriteOnly | QIODevice::Append))
+                return ;
+            fileDate = date;
+        }
+        file.write(QJsonDocument(json).toJson(QJsonDocument::Compact));
+        file.write("\n");
+    }
+
+    static QString format(const QVariant& value)
+    {
+        switch (int(value.type()))
+        {
+        case QMetaType::QJsonObject:
+            return QJsonDocument(value.toJsonObject()).toJson(QJsonDocument::Compact);
+        case QMetaType::QJsonArray:
+            return QJsonDocument(value.toJsonArray()).toJson(QJsonDocument::Compact);
+        case QMetaType::QJsonValue:
+            return value.toJsonValue().toVariant().toString();
+        case QMetaType::QStringList:
+            return "(" + value.toStringList().join(", ") + ")";
+        case QMetaType::QByteArray:
+            return QString::fromUtf8(value.toByteArray());
+        default:
+            if (value.canConvert<QString>())
+                return value.toString();
+            return QString("<") + value.typeName() + ">";
+        }
+    }
+
+    static QString levelKey(int level)
+    {
+        switch (level)
+        {
+        case LIVE_LOG_DEB:
+            return "debug";
+        case LIVE_LOG_INF:
+            return "info";
+        default:
+            return "warning";
+        }
+    }
+
+    static QString sourceName(const char* file)
+    {
+        QString path = QString::fromUtf8(file ? file : "");
+        int index = qMax(path.lastIndexOf('/'), path.lastIndexOf('\\'));
+        return path.mid(index + 1);
+    }
+
+public:
+    LogRing ring;
+
+private:
+    QString dirPath;
+    std::atomic<bool> stopping{false};
+    QFile file;
+    QString fileDate;
+    QHash<QPair<const char*, int>, SiteState> sites;
+};
+
+// 其它线程随时可能在 push 中读取，停止后也不释放，直到进程结束
+std::atomic<LogWriter*> writer{nullptr};
+
+}
+
+/**
+ * 启动后台写入线程，重复调用无效果
+ * 程序退出前自动停止，写完缓冲中剩下的日志
+ */
+void LiveLog::start(const QString &dirPath)
+{
+    if (writer.load(std::memory_order_acquire))
+        return ;
+    LogWriter* w = new LogWriter(dirPath);
+    w->start(QThread::LowPriority);
+    writer.store(w, std::memory_order_release);
+    running.store(true, std::memory_order_release);
+    if (qApp)
+        QObject::connect(qApp, &QCoreApplication::aboutToQuit, [=]{ stop(); });
+}
+
+/**
+ * 先让后续的 push 直接返回，再等待后台线程写完
+ * 写入对象不释放：停止前已经取到指针的线程仍可能往环形缓冲里放，放进去的只是不会再写出
+ */
+void LiveLog::stop()
+{
+    running.store(false, std::memory_order_release);
+    LogWriter* w = writer.exchange(nullptr, std::memory_order_acq_rel);
+    if (!w)
+        return ;
+    w->requestStop();
+    w->wait();
+}
+
+bool LiveLog::isRunning()
+{
+    return running.load(std::memory_order_relaxed);
+}
+
+void LiveLog::setCategoryEnabled(int category, bool enable)
+{
+    if (enable)
+        categoryMask.fetch_or(1u << category, std::memory_order_relaxed);
+    else
+        categoryMask.fetch_and(~(1u << category), std::memory_order_relaxed);
+}
+
+QString LiveLog::categoryKey(int category)
+{
+    static const char* keys[CATEGORY_COUNT] = { "socket", "cmd", "func", "reply", "send", "net" };
+    if (category < 0 || category >= CATEGORY_COUNT)
+        return "";
+    return keys[category];
+}
+
+QString LiveLog::categoryName(int category)
+{
+    static const char* names[CATEGORY_COUNT] = { "数据包", "消息命令", "执行命令", "自动回复", "发送弹幕", "网络请求" };
+    if (category < 0 || category >= CATEGORY_COUNT)
+        return "";
+    return QString::fromUtf8(names[category]);
+}
+
+/**
+ * 默认开启量少的分类；数据包和每条消息命令量大，需要时再打开
+ */
+quint32 LiveLog::defaultMask()
+{
+    return (1u << Func) | (1u << Send) | (1u << Net);
+}
+
+/**
+ * 没有启动时直接丢弃
+ */
+void LiveLog::push(LiveLog::Record &&record)
+{
+    LogWriter* w = writer.load(std::memory_order_acquire);
+    if (!w || !running.load(std::memory_order_acquire))
+        return ;
+    w->ring.push(std::move(record));
+}
@@ -0,0 +1,155 @@
+#ifndef LIVELOG_H
+#define LIVELOG_H
+
+#include <QString>
+#include <QVariant>
+#include <QVector>
+#include <QDateTime>
+#include <atomic>
+
+#define LIVE_LOG_DEB 0
+#define LIVE_LOG_INF 1
+#define LIVE_LOG_WAR 2
+
+// 编译进程序的最低级别，低于它的日志语句整句不会生成代码；可以在 DEFINES 中覆盖
+#ifndef LIVE_LOG_LEVEL
+#ifdef QT_DEBUG
+#define LIVE_LOG_LEVEL LIVE_LOG_DEB
+#else
+#define LIVE_LOG_LEVEL LIVE_LOG_INF
+#endif
+#endif
+
+#define LIVE_LOG_CAPACITY 8192 // 环形缓冲的条数，必须是2的幂；满了直接丢弃
+#define LIVE_LOG_IDLE 50 // 后台线程没有日志时的等待，毫秒
+#define LIVE_LOG_SITE_LIMIT 30 // 同一处每秒最多写入的条数，超过的只记录省略数量
+#define LIVE_LOG_KEEP_DAYS 7 // 日志文件保留的天数，关闭程序时清理
+
+/**
+ * 结构化日志
+ * 写日志时只保存参数（隐式共享，复制很便宜），放进无锁的环形缓冲；
+ * 格式化、重复抑制和写文件都在后台线程进行，不占用界面线程。
+ * 每条日志一行 JSON，按天写入 logs/live_yyyy-MM-dd.log。
+ *
+ * 用法：LOG_INF(LiveLog::Cmd) << "消息命令" << cmd;
+ * 分类关闭时只判断一次位掩码，后面的参数不会求值。
+ */
+class LiveLog
+{
+public:
+    enum Category
+    {
+        Socket,  // 数据包内容
+        Cmd,     // 收到的消息命令
+        Func,    // 执行的代码命令
+        Reply,   // 自动回复、事件匹配
+        Send,    // 发送弹幕
+        Net,     // 网络请求
+        CATEGORY_COUNT
+    };
+
+    struct Record
+    {
+        qint64 time = 0;
+        int level = LIVE_LOG_INF;
+        int category = Cmd;
+        const char* file = nullptr;
+        int line = 0;
+        QVector<QVariant> args; // 字符串也复制一份，写入线程处理时原来的缓冲区可能已经释放
+    };
+
+    static void start(const QString& dirPath);
+    static void stop();
+    static bool isRunning();
+
+    static bool isEnabled(int category, int level)
+    {
+        if (!running.load(std::memory_order_relaxed))
+            return false;
+        return level >= LIVE_LOG_WAR || isCategoryEnabled(category);
+    }
+    static bool isCategoryEnabled(int category)
+    {
+        return categoryMask.load(std::memory_order_relaxed) & (1u << category);
+    }
+    static void setCategoryEnabled(int category, bool enable);
+    static QString categoryKey(int category);
+    static QString categoryName(int category);
+    static quint32 defaultMask();
+
+    static void push(Record&& record);
+
+private:
+    static std::atomic<bool> running;
+    static std::atomic<quint32> categoryMask;
+};
+
+/**
+ * 一条日志，析构时放进环形缓冲
+ */
+class LiveLogLine
+{
+public:
+    LiveLogLine(int category, int level, const char* file, int line)
+    {
+        record.time = QDateTime::currentMSecsSinceEpoch();
+        record.category = category;
+        record.level = level;
+        record.file = file;
+        record.line = line;
+        record.args.reserve(4);
+    }
+
+    ~LiveLogLine()
+    {
+        LiveLog::push(std::move(record));
+    }
+
+    LiveLogLine& operator<<(const char* text)
+    {
+        record.args.append(QString::fromUtf8(text));
+        return *this;
+    }
+
+    template<typename T>
+    LiveLogLine& operator<<(const T& value)
+    {
+        record.args.append(QVariant::fromValue(value));
+        return *this;
+    }
+
+private:
+    LiveLog::Record record;
+};
+
+/**
+ * 把整条日志变成 void 表达式，用在 ?: 中
+ * & 的优先级低于 <<、高于 ?:，后面的参数都会先接到 LiveLogLine 上
+ */
+class LiveLogVoidify
+{
+public:
+    void operator&(const LiveLogLine&) {}
+};
+
+// 整句是一个表达式，不会和外面的 if/else 错配
+#define LIVE_LOG_LINE(category, level) \
+    !LiveLog::isEnabled(category, level) ? (void)0 : LiveLogVoidify() & LiveLogLine(category, level, __FILE__, __LINE__)
+#define LIVE_LOG_NONE(category, level) \
+    true ? (void)0 : LiveLogVoidify() & LiveLogLine(category, level, __FILE__, __LINE__)
+
+#if LIVE_LOG_LEVEL <= LIVE_LOG_DEB
+#define LOG_DEB(category) LIVE_LOG_LINE(category, LIVE_LOG_DEB)
+#else
+#define LOG_DEB(category) LIVE_LOG_NONE(category, LIVE_LOG_DEB)
+#endif
+
+#if LIVE_LOG_LEVEL <= LIVE_LOG_INF
+#define LOG_INF(category) LIVE_LOG_LINE(category, LIVE_LOG_INF)
+#else
+#define LOG_INF(category) LIVE_LOG_NONE(category, LIVE_LOG_INF)
+#endif
+
+#define LOG_WAR(category) LIVE_LOG_LINE(category, LIVE_LOG_WAR)
+
+#endif // LIVELOG_H
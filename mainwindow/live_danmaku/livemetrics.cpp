@@ -0,0 +1,397 @@
+#include <QMutex>
+#include <QMutexLocker>
+#include <QHash>
+#include <QList>
+#include <QVector>
+#include <QStringList>
+#include <QDateTime>
+#include <QTextStream>
+#include <QJsonObject>
+#include <QtAlgorithms>
+#include <atomic>
+#include <cmath>
+#include "livemetrics.h"
+
+namespace
+{
+
+/**
+ * 单个直方图
+ * 只由所属线程写入，读取的线程可能看到写到一半的数据，统计上可以忽略
+ */
+struct HistogramData
+{
+    HistogramData()
+    {
+        for (int i = 0; i < METRICS_BUCKET_COUNT; i++)
+            buckets[i].store(0, std::memory_order_relaxed);
+        count.store(0, std::memory_order_relaxed);
+        sum.store(0, std::memory_order_relaxed);
+        max.store(0, std::memory_order_relaxed);
+    }
+
+    std::atomic<quint32> buckets[METRICS_BUCKET_COUNT];
+    std::atomic<quint64> count;
+    std::atomic<quint64> sum; // 纳秒
+    std::atomic<quint64> max;
+};
+
+/**
+ * 每个线程一份，线程结束后保留，数据仍然计入总数
+ */
+struct Shard
+{
+    Shard()
+    {
+        for (int i = 0; i < LiveMetrics::COUNTER_COUNT; i++)
+            counters[i].store(0, std::memory_order_relaxed);
+        for (int i = 0; i < METRICS_MAX_CMD; i++)
+            commands[i].store(nullptr, std::memory_order_relaxed);
+    }
+
+    std::atomic<quint64> counters[LiveMetrics::COUNTER_COUNT];
+    HistogramData histograms[LiveMetrics::HISTOGRAM_COUNT];
+    std::atomic<HistogramData*> commands[METRICS_MAX_CMD]; // 用到时才创建
+};
+
+/**
+ * 合并后的直方图
+ */
+struct HistogramSnapshot
+{
+    quint64 buckets[METRICS_BUCKET_COUNT] = {};
+    quint64 count = 0;
+    quint64 sum = 0;
+    quint64 max = 0;
+
+    void merge(const HistogramData& data)
+    {
+        for (int i = 0; i < METRICS_BUCKET_COUNT; i++)
+            buckets[i] += data.buckets[i].load(std::memory_order_relaxed);
+        count += data.count.load(std::memory_order_relaxed);
+        sum += data.sum.load(std::memory_order_relaxed);
+        max = qMax(max, data.max.load(std::memory_order_relaxed));
+    }
+
+    /// 分位数，取所在区间的中点，纳秒
+    double percentile(double q) const
+    {
+        if (!count)
+            return 0;
+        quint64 target = qMax(quint64(1), quint64(std::ceil(q * count)));
+        quint64 seen = 0;
+        for (int i = 0; i < METRICS_BUCKET_COUNT; i++)
+        {
+            seen += buckets[i];
+            if (seen >= target)
+            {
+                double low = LiveMetrics::bucketLowest(i);
+                double high = LiveMetrics::bucketLowest(i + 1);
+                return qMin((low + high) / 2, double(max));
+            }
+        }
+        return max;
+    }
+};
+
+/// 只有所属线程写入，读改写不需要原子加
+template<typename T>
+inline void bump(std::atomic<T>& value, T delta)
+{
+    value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+inline void recordTo(HistogramData& data, quint64 nsecs)
+{
+    bump(data.buckets[LiveMetrics::bucketIndex(nsecs)], quint32(1));
+    bump(data.count, quint64(1));
+    bump(data.sum, nsecs);
+    if (nsecs > data.max.load(std::memory_order_relaxed))
+        data.max.store(nsecs, std::memory_order_relaxed);
+}
+
+QMutex& shardMutex()
+{
+    static QMutex mutex;
+    return mutex;
+}
+
+QList<Shard*>& allShards()
+{
+    static QList<Shard*> shards;
+    return shards;
+}
+
+QStringList& commandNames()
+{
+    static QStringList names{"OTHER"};
+    return names;
+}
+
+QElapsedTimer& uptimeClock()
+{
+    static QElapsedTimer clock;
+    if (!clock.isValid())
+        clock.start();
+    return clock;
+}
+
+thread_local Shard* localShard = nullptr;
+thread_local QHash<QString, int>* localCommandIndex = nullptr;
+
+Shard* shard()
+{
+    if (!localShard)
+    {
+        Shard* s = new Shard();
+        QMutexLocker locker(&shardMutex());
+        allShards().append(s);
+        uptimeClock();
+        localShard = s;
+    }
+    return localShard;
+}
+
+/**
+ * 命令名对应的序号，所有线程一致
+ * 线程内缓存，只有第一次遇到某个命令时才加锁
+ */
+int commandIndex(const QString& cmd)
+{
+    if (!localCommandIndex)
+        localCommandIndex = new QHash<QString, int>();
+    auto it = localCommandIndex->constFind(cmd);
+    if (it != localCommandIndex->constEnd())
+        return it.value();
+
+    QMutexLocker locker(&shardMutex());
+    QStringList& names = commandNames();
+    int index = names.indexOf(cmd);
+    if (index < 0)
+    {
+        if (names.size() < METRICS_MAX_CMD)
+        {
+            index = names.size();
+            names.append(cmd);
+        }
+        else
+        {
+            index = 0;
+        }
+    }
+    localCommandIndex->insert(cmd, index);
+    return index;
+}
+
+const char* counterKey(int counter)
+{
+    static const char* keys[LiveMetrics::COUNTER_COUNT] = {
+        "frames_in", "bytes_in", "bytes_inflated", "json_parsed", "cmd_handled",
+        "rules_evaluated", "rules_matched", "msg_queued", "msg_sent", "socket_messages"
+    };
+    return keys[counter];
+}
+
+const char* histogramKey(int histogram)
+{
+    static const char* keys[LiveMetrics::HISTOGRAM_COUNT] = {
+        "inflate", "json_parse", "handler", "reply_match", "template", "send_queue", "socket_fanout"
+    };
+    return keys[histogram];
+}
+
+/**
+ * 合并所有线程的分片
+ */
+void snapshot(quint64* counters, HistogramSnapshot* histograms, QList<QPair<QString, HistogramSnapshot>>* commands)
+{
+    QMutexLocker locker(&shardMutex());
+    const QStringList& names = commandNames();
+    QVector<HistogramSnapshot> cmds(names.size());
+    QVector<bool> used(names.size(), false);
+    foreach (Shard* s, allShards())
+    {
+        for (int i = 0; i < LiveMetrics::COUNTER_COUNT; i++)
+            counters[i] += s->counters[i].load(std::memory_order_relaxed);
+        for (int i = 0; i < LiveMetrics::HISTOGRAM_COUNT; i++)
+            histograms[i].merge(s->histograms[i]);
+        for (int i = 0; i < names.size(); i++)
+        {
+            HistogramData* data = s->commands[i].load(std::memory_order_acquire);
+            if (!data)
+                continue;
+            cmds[i].merge(*data);
+            used[i] = true;
+        }
+    }
+    for (int i = 0; i < names.size(); i++)
+    {
+        if (used[i])
+            commands->append(qMakePair(names.at(i), cmds.at(i)));
+    }
+}
+
+MyJson histogramJson(const HistogramSnapshot& h)
+{
+    MyJson json;
+    json.insert("count", qint64(h.count));
+    json.insert("sum_us", h.sum / 1000.0);
+    json.insert("mean_us", h.count ? h.sum / 1000.0 / h.count : 0.0);
+    json.insert("p50_us", h.percentile(0.5) / 1000);
+    json.insert("p90_us", h.percentile(0.9) / 1000);
+    json.insert("p99_us", h.percentile(0.99) / 1000);
+    json.insert("p999_us", h.percentile(0.999) / 1000);
+    json.insert("max_us", h.max / 1000.0);
+    return json;
+}
+
+/**
+ * Prometheus 的累计区间，只统计上界不超过 le 的细分区间，结果略偏小
+ */
+void writePrometheusHistogram(QTextStream& stream, const QString& name, const QString& labels, const HistogramSnapshot& h)
+{
+    static const double bounds[] = { 1e-6, 5e-6, 1e-5, 5e-5, 1e-4, 5e-4, 1e-3, 5e-3, 1e-2, 5e-2, 0.1, 0.5, 1, 5 };
+    QString prefix = labels.isEmpty() ? QString() : labels + ",";
+    int bucket = 0;
+    quint64 cumulative = 0;
+    for (double bound : bounds)
+    {
+        while (bucket < METRICS_BUCKET_COUNT && LiveMetrics::bucketLowest(bucket + 1) <= bound * 1e9)
+            cumulative += h.buckets[bucket++];
+        stream << name << "_bucket{" << prefix << "le=\"" << bound << "\"} " << cumulative << "\n";
+    }
+    stream << name << "_bucket{" << prefix << "le=\"+Inf\"} " << h.count << "\n";
+    QString suffix = labels.isEmpty() ? QString() : "{" + labels + "}";
+    stream << name << "_sum" << suffix << " " << (h.sum / 1e9) << "\n";
+    stream << name << "_count" << suffix << " " << h.count << "\n";
+}
+
+}
+
+void LiveMetrics::add(LiveMetrics::Counter counter, quint64 value)
+{
+    bump(shard()->counters[counter], value);
+}
+
+void LiveMetrics::record(LiveMetrics::Histogram histogram, qint64 nsecs)
+{
+    if (histogram == NoHistogram)
+        return ;
+    recordTo(shard()->histograms[histogram], quint64(qMax(0ll, nsecs)));
+}
+
+/**
+ * 按命令分开的处理耗时；总的 Handler 由调用处的计时记录
+ */
+void LiveMetrics::recordCommand(const QString &cmd, qint64 nsecs)
+{
+    Shard* s = shard();
+    quint64 value = quint64(qMax(0ll, nsecs));
+    bump(s->counters[CmdHandled], quint64(1));
+
+    int index = commandIndex(cmd);
+    HistogramData* data = s->commands[index].load(std::memory_order_relaxed);
+    if (!data)
+    {
+        data = new HistogramData();
+        s->commands[index].store(data, std::memory_order_release);
+    }
+    recordTo(*data, value);
+}
+
+MyJson LiveMetrics::toJson()
+{
+    quint64 counters[COUNTER_COUNT] = {};
+    HistogramSnapshot histograms[HISTOGRAM_COUNT];
+    QList<QPair<QString, HistogramSnapshot>> commands;
+    snapshot(counters, histograms, &commands);
+
+    MyJson json;
+    json.insert("timestamp", QDateTime::currentMSecsSinceEpoch());
+    json.insert("uptime_ms", uptimeClock().elapsed());
+
+    MyJson counterJson;
+    for (int i = 0; i < COUNTER_COUNT; i++)
+        counterJson.insert(counterKey(i), qint64(counters[i]));
+    json.insert("counters", counterJson);
+
+    MyJson histogramsJson;
+    for (int i = 0; i < HISTOGRAM_COUNT; i++)
+        histogramsJson.insert(histogramKey(i), histogramJson(histograms[i]));
+    json.insert("histograms", histogramsJson);
+
+    MyJson commandsJson;
+    for (int i = 0; i < commands.size(); i++)
+        commandsJson.insert(commands.at(i).first, histogramJson(commands.at(i).second));
+    json.insert("commands", commandsJson);
+    return json;
+}
+
+/**
+ * Prometheus 文本格式（0.0.4）
+ */
+QByteArray LiveMetrics::toPrometheus()
+{
+    quint64 counters[COUNTER_COUNT] = {};
+    HistogramSnapshot histograms[HISTOGRAM_COUNT];
+    QList<QPair<QString, HistogramSnapshot>> commands;
+    snapshot(counters, histograms, &commands);
+
+    QByteArray ba;
+    QTextStream stream(&ba);
+    stream.setCodec("UTF-8");
+    stream.setRealNumberPrecision(9);
+    for (int i = 0; i < COUNTER_COUNT; i++)
+    {
+        QString name = QString(METRICS_PROMETHEUS_PREFIX) + counterKey(i) + "_total";
+        stream << "# TYPE " << name << " counter\n";
+        stream << name << " " << counters[i] << "\n";
+    }
+    for (int i = 0; i < HISTOGRAM_COUNT; i++)
+    {
+        QString name = QString(METRICS_PROMETHEUS_PREFIX) + histogramKey(i) + "_seconds";
+        stream << "# TYPE " << name << " histogram\n";
+        writePrometheusHistogram(stream, name, "", histograms[i]);
+    }
+    if (!commands.isEmpty())
+    {
+        QString name = QString(METRICS_PROMETHEUS_PREFIX) + "command_seconds";
+        stream << "# TYPE " << name << " histogram\n";
+        for (int i = 0; i < commands.size(); i++)
+        {
+            QString cmd = commands.at(i).first;
+            cmd.replace("\\", "\\\\").replace("\"", "\\\"").replace("\n", "\\n");
+            writePrometheusHistogram(stream, name, "cmd=\"" + cmd + "\"", commands.at(i).second);
+        }
+    }
+    stream.flush();
+    return ba;
+}
+
+/**
+ * 对数分段：小于 2^(SUB_BITS+1) 的直接对应，
+ * 之后每个2的幂分成 2^SUB_BITS 段
+ */
+int LiveMetrics::bucketIndex(quint64 nsecs)
+{
+    const quint64 sub = 1 << METRICS_SUB_BITS;
+    if (nsecs < sub * 2)
+        return int(nsecs);
+    int msb = 63 - qCountLeadingZeroBits(nsecs);
+    int shift = msb - METRICS_SUB_BITS;
+    int index = shift * int(sub) + int(nsecs >> shift);
+    return qMin(index, METRICS_BUCKET_COUNT - 1);
+}
+
+/**
+ * 区间的下界（包含）
+ */
+quint64 LiveMetrics::bucketLowest(int index)
+{
+    const int sub = 1 << METRICS_SUB_BITS;
+    if (index < sub * 2)
+        return quint64(index);
+    int shift = index / sub - 1;
+    quint64 mantissa = quint64(index % sub + sub);
+    return mantissa << shift;
+}
@@ -0,0 +1,91 @@
+#ifndef LIVEMETRICS_H
+#define LIVEMETRICS_H
+
+#include <QString>
+#include <QElapsedTimer>
+#include "myjson.h"
+
+#define METRICS_SUB_BITS 3 // 每个2的幂再分成 2^3 段，误差约12%
+#define METRICS_BUCKET_COUNT 264 // 纳秒，最后一格的上界是 2^35（约34秒），超过的也计入最后一格
+#define METRICS_MAX_CMD 128 // 单独统计耗时的 CMD 种类，超过的计入 OTHER
+#define METRICS_PROMETHEUS_PREFIX "magical_danmaku_"
+
+/**
+ * 常驻的热路径统计：计数器和耗时直方图
+ * 每个线程写自己的分片（thread_local），只有本线程写入，不加锁也不用原子加；
+ * 读取时合并所有线程的分片，得到近似的分位数，供 /api/metrics 使用。
+ */
+class LiveMetrics
+{
+public:
+    enum Counter
+    {
+        FramesIn,        // 收到的 WebSocket 帧
+        BytesIn,         // 收到的字节
+        BytesInflated,   // 解压后的字节
+        JsonParsed,      // 解析的 JSON 数量
+        CmdHandled,      // 处理的命令数量
+        RulesEvaluated,  // 匹配过的自动回复规则
+        RulesMatched,    // 匹配成功的自动回复规则
+        MsgQueued,       // 加入发送队列的弹幕
+        MsgSent,         // 发送的弹幕
+        SocketMessages,  // 推送给 WebSocket 客户端的消息
+        COUNTER_COUNT
+    };
+
+    enum Histogram
+    {
+        NoHistogram = -1,
+        Inflate,         // 解压
+        JsonParse,       // 解析JSON
+        Handler,         // 单条命令的处理，每种命令另外统计
+        ReplyMatch,      // 匹配自动回复
+        Template,        // 填充变量、判断条件
+        SendQueue,       // 加入发送队列、从队列发送
+        SocketFanout,    // 推送给所有 WebSocket 客户端
+        HISTOGRAM_COUNT
+    };
+
+    static void add(Counter counter, quint64 value = 1);
+    static void record(Histogram histogram, qint64 nsecs);
+    static void recordCommand(const QString& cmd, qint64 nsecs);
+
+    static MyJson toJson();
+    static QByteArray toPrometheus();
+
+    static int bucketIndex(quint64 nsecs);
+    static quint64 bucketLowest(int index);
+};
+
+/**
+ * 记录所在作用域的耗时到指定的直方图
+ */
+class MetricScope
+{
+public:
+    MetricScope(LiveMetrics::Histogram histogram) : histogram(histogram)
+    {
+        timer.start();
+    }
+
+    ~MetricScope()
+    {
+        finish();
+    }
+
+    qint64 finish()
+    {
+        if (histogram == LiveMetrics::NoHistogram)
+            return 0;
+        qint64 nsecs = timer.nsecsElapsed();
+        LiveMetrics::record(histogram, nsecs);
+        histogram = LiveMetrics::NoHistogram;
+        return nsecs;
+    }
+
+private:
+    LiveMetrics::Histogram histogram;
+    QElapsedTimer timer;
+};
+
+#endif // LIVEMETRICS_H
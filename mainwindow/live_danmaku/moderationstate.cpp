@@ -0,0 +1,317 @@
+#include <QDataStream>
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QDebug>
+#include <algorithm>
+#include "moderationstate.h"
+
+#define MODERATION_MAGIC 0x4D4F4431 // MOD1
+#define MODERATION_SAVE_DELAY 1000 // 修改后延迟保存，毫秒
+
+ModerationState::ModerationState(const QString &path, QObject *parent) : QObject(parent), path(path)
+{
+    saveTimer.setSingleShot(true);
+    saveTimer.setInterval(MODERATION_SAVE_DELAY);
+    connect(&saveTimer, &QTimer::timeout, this, [=]{
+        save();
+    });
+}
+
+ModerationState::~ModerationState()
+{
+    if (saveTimer.isActive())
+        save();
+}
+
+void ModerationState::load()
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return ;
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_0);
+    quint32 magic = 0;
+    in >> magic;
+    if (magic != MODERATION_MAGIC)
+    {
+        qWarning() << "管理数据格式错误：" << path;
+        return ;
+    }
+
+    qint32 count = 0;
+    in >> roomId >> count;
+    for (int i = 0; i < count && in.status() == QDataStream::Ok; i++)
+    {
+        qint64 uid = 0, id = 0;
+        in >> uid >> id;
+        if (in.status() == QDataStream::Ok)
+            setBlocked(uid, id);
+    }
+
+    count = 0;
+    in >> count;
+    for (int i = 0; i < count && in.status() == QDataStream::Ok; i++)
+    {
+        EternalBlockUser user;
+        in >> user.uid >> user.roomId >> user.uname >> user.upName >> user.roomTitle >> user.time;
+        if (in.status() == QDataStream::Ok && user.uid && user.roomId)
+            eternalUsers.insert(UserKey(user.uid, user.roomId), user);
+    }
+    rebuildHeap();
+    saveTimer.stop(); // 读取的过程不用保存
+}
+
+/**
+ * 从旧版本保存在设置里的永久禁言列表导入
+ * 只在还没有快照时进行，导入后移除设置里的列表
+ */
+bool ModerationState::migrateFrom(QSettings *settings, const QString &key)
+{
+    if (QFileInfo(path).exists() || !settings->contains(key))
+        return false;
+
+    QJsonArray array = settings->value(key).toJsonArray();
+    for (int i = 0; i < array.size(); i++)
+    {
+        EternalBlockUser user = EternalBlockUser::fromJson(array.at(i).toObject());
+        if (user.uid && user.roomId)
+            eternalUsers.insert(UserKey(user.uid, user.roomId), user);
+    }
+    rebuildHeap();
+    save();
+    if (QFileInfo(path).exists())
+        settings->remove(key);
+    qInfo() << "导入永久禁言：" << eternalUsers.size();
+    return true;
+}
+
+void ModerationState::save()
+{
+    saveTimer.stop();
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        qWarning() << "无法保存管理数据：" << path;
+        return ;
+    }
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << quint32(MODERATION_MAGIC);
+    out << roomId << qint32(blockIds.size());
+    for (auto it = blockIds.constBegin(); it != blockIds.constEnd(); ++it)
+        out << it.key() << it.value();
+    out << qint32(eternalUsers.size());
+    foreach (const EternalBlockUser& user, eternalUsers)
+        out << user.uid << user.roomId << user.uname << user.upName << user.roomTitle << user.time;
+
+    if (!file.commit())
+        qWarning() << "无法保存管理数据：" << path;
+}
+
+/**
+ * 禁言列表只属于一个房间，切换房间时清空
+ */
+void ModerationState::setRoomId(qint64 roomId)
+{
+    if (this->roomId == roomId)
+        return ;
+    this->roomId = roomId;
+    blockIds.clear();
+    blockUids.clear();
+    scheduleSave();
+}
+
+bool ModerationState::isBlocked(qint64 uid) const
+{
+    return blockIds.contains(uid);
+}
+
+qint64 ModerationState::getBlockId(qint64 uid) const
+{
+    return blockIds.value(uid, 0);
+}
+
+void ModerationState::setBlocked(qint64 uid, qint64 id)
+{
+    qint64 old = blockIds.value(uid, 0);
+    if (old == id)
+        return ;
+    if (old)
+        blockUids.remove(old);
+    blockIds.insert(uid, id);
+    blockUids.insert(id, uid);
+    scheduleSave();
+}
+
+void ModerationState::removeBlocked(qint64 uid)
+{
+    if (!blockIds.contains(uid))
+        return ;
+    blockUids.remove(blockIds.take(uid));
+    scheduleSave();
+}
+
+void ModerationState::removeBlockId(qint64 id)
+{
+    if (!blockUids.contains(id))
+        return ;
+    blockIds.remove(blockUids.take(id));
+    scheduleSave();
+}
+
+/**
+ * 用完整的禁言列表替换，只改动有差异的部分
+ */
+ModerationState::BlockDiff ModerationState::applyBlockList(const QHash<qint64, qint64> &blocks)
+{
+    BlockDiff diff;
+    foreach (qint64 uid, blockIds.keys())
+    {
+        if (!blocks.contains(uid))
+        {
+            removeBlocked(uid);
+            diff.removed++;
+        }
+    }
+    for (auto it = blocks.constBegin(); it != blocks.constEnd(); ++it)
+    {
+        qint64 old = blockIds.value(it.key(), 0);
+        if (old == it.value())
+            continue;
+        if (old)
+            diff.changed++;
+        else
+            diff.added++;
+        setBlocked(it.key(), it.value());
+    }
+    return diff;
+}
+
+int ModerationState::getBlockedCount() const
+{
+    return blockIds.size();
+}
+
+bool ModerationState::isEternalBlocked(qint64 uid, qint64 roomId) const
+{
+    return eternalUsers.contains(UserKey(uid, roomId));
+}
+
+bool ModerationState::addEternalBlock(const EternalBlockUser &user)
+{
+    UserKey key(user.uid, user.roomId);
+    if (eternalUsers.contains(key))
+        return false;
+    eternalUsers.insert(key, user);
+    pushHeap(user);
+    scheduleSave();
+    return true;
+}
+
+bool ModerationState::removeEternalBlock(qint64 uid, qint64 roomId)
+{
+    if (!eternalUsers.remove(UserKey(uid, roomId)))
+        return false;
+    if (eternalHeap.size() > eternalUsers.size() * 2 + 16) // 失效的条目太多
+        rebuildHeap();
+    scheduleSave();
+    return true;
+}
+
+/**
+ * 所有永久禁言，按上次禁言的时间排序
+ */
+QList<EternalBlockUser> ModerationState::getEternalBlockUsers() const
+{
+    QList<EternalBlockUser> users = eternalUsers.values();
+    std::sort(users.begin(), users.end(), [](const EternalBlockUser& a, const EternalBlockUser& b){
+        return a.time < b.time;
+    });
+    return users;
+}
+
+int ModerationState::getEternalBlockCount() const
+{
+    return eternalUsers.size();
+}
+
+/**
+ * 取出上次禁言时间早于 deadline 的用户，续期到 now
+ * 返回需要重新禁言的用户
+ */
+QList<EternalBlockUser> ModerationState::renewDueEternalBlocks(qint64 deadline, qint64 now)
+{
+    QList<EternalBlockUser> due;
+    while (!eternalHeap.isEmpty() && eternalHeap.first().time < deadline)
+    {
+        HeapEntry entry = eternalHeap.first();
+        std::pop_heap(eternalHeap.begin(), eternalHeap.end(), heapLater);
+        eternalHeap.removeLast();
+
+        auto it = eternalUsers.find(UserKey(entry.uid, entry.roomId));
+        if (it == eternalUsers.end() || it.value().time != entry.time) // 已移除或已续期
+            continue;
+        due.append(it.value());
+        it.value().time = now;
+    }
+
+    foreach (const EternalBlockUser& user, due)
+        pushHeap(eternalUsers.value(UserKey(user.uid, user.roomId)));
+    if (!due.isEmpty())
+        scheduleSave();
+    return due;
+}
+
+void ModerationState::setFans(const QList<qint64> &uids)
+{
+    fans = QSet<qint64>::fromList(uids);
+}
+
+void ModerationState::addFan(qint64 uid)
+{
+    fans.insert(uid);
+}
+
+void ModerationState::removeFan(qint64 uid)
+{
+    fans.remove(uid);
+}
+
+void ModerationState::clearFans()
+{
+    fans.clear();
+}
+
+bool ModerationState::isFan(qint64 uid) const
+{
+    return fans.contains(uid);
+}
+
+bool ModerationState::heapLater(const HeapEntry &a, const HeapEntry &b)
+{
+    return a.time > b.time;
+}
+
+void ModerationState::pushHeap(const EternalBlockUser &user)
+{
+    eternalHeap.append(HeapEntry{user.time, user.uid, user.roomId});
+    std::push_heap(eternalHeap.begin(), eternalHeap.end(), heapLater);
+}
+
+void ModerationState::rebuildHeap()
+{
+    eternalHeap.clear();
+    eternalHeap.reserve(eternalUsers.size());
+    foreach (const EternalBlockUser& user, eternalUsers)
+        eternalHeap.append(HeapEntry{user.time, user.uid, user.roomId});
+    std::make_heap(eternalHeap.begin(), eternalHeap.end(), heapLater);
+}
+
+void ModerationState::scheduleSave()
+{
+    if (!saveTimer.isActive())
+        saveTimer.start();
+}
@@ -0,0 +1,84 @@
+#ifndef MODERATIONSTATE_H
+#define MODERATIONSTATE_H
+
+#include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QVector>
+#include <QTimer>
+#include <QSettings>
+#include "eternalblockdialog.h"
+
+/**
+ * 直播间的管理状态：禁言列表、永久禁言、最近的粉丝
+ * 禁言以 uid 索引到禁言ID（取消禁言时要用），整表同步时只改动有差异的；
+ * 永久禁言按下次需要续期的时间放在小顶堆中，每次只取出到期的；
+ * 禁言和永久禁言保存在同一个二进制快照里。
+ */
+class ModerationState : public QObject
+{
+    Q_OBJECT
+public:
+    ModerationState(const QString& path, QObject* parent = nullptr);
+    ~ModerationState() override;
+
+    struct BlockDiff
+    {
+        int added = 0;
+        int removed = 0;
+        int changed = 0; // 禁言ID变了（重新禁言）
+    };
+
+    void load();
+    bool migrateFrom(QSettings* settings, const QString& key);
+    void save();
+
+    void setRoomId(qint64 roomId);
+    bool isBlocked(qint64 uid) const;
+    qint64 getBlockId(qint64 uid) const;
+    void setBlocked(qint64 uid, qint64 id);
+    void removeBlocked(qint64 uid);
+    void removeBlockId(qint64 id);
+    BlockDiff applyBlockList(const QHash<qint64, qint64>& blocks);
+    int getBlockedCount() const;
+
+    bool isEternalBlocked(qint64 uid, qint64 roomId) const;
+    bool addEternalBlock(const EternalBlockUser& user);
+    bool removeEternalBlock(qint64 uid, qint64 roomId);
+    QList<EternalBlockUser> getEternalBlockUsers() const;
+    int getEternalBlockCount() const;
+    QList<EternalBlockUser> renewDueEternalBlocks(qint64 deadline, qint64 now);
+
+    void setFans(const QList<qint64>& uids);
+    void addFan(qint64 uid);
+    void removeFan(qint64 uid);
+    void clearFans();
+    bool isFan(qint64 uid) const;
+
+private:
+    typedef QPair<qint64, qint64> UserKey; // uid, roomId
+
+    struct HeapEntry
+    {
+        qint64 time;
+        qint64 uid;
+        qint64 roomId;
+    };
+
+    static bool heapLater(const HeapEntry& a, const HeapEntry& b);
+    void pushHeap(const EternalBlockUser& user);
+    void rebuildHeap();
+    void scheduleSave();
+
+private:
+    QString path;
+    qint64 roomId = 0; // 禁言列表所属的房间
+    QHash<qint64, qint64> blockIds; // uid -> 禁言ID
+    QHash<qint64, qint64> blockUids; // 禁言ID -> uid
+    QHash<UserKey, EternalBlockUser> eternalUsers;
+    QVector<HeapEntry> eternalHeap; // 按上次禁言时间的小顶堆；移除、续期后旧的条目留在堆里，取出时跳过
+    QSet<qint64> fans; // 最近关注的粉丝，不保存
+    QTimer saveTimer;
+};
+
+#endif // MODERATIONSTATE_H
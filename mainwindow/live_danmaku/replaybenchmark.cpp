@@ -0,0 +1,431 @@
+#include <QFile>
+#include <QTimer>
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QRandomGenerator>
+#include <QtEndian>
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+#include "replaybenchmark.h"
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#define REPLAY_TIME_PREFIX "__bmd__t__" // 录制时间的前缀：__bmd__t__毫秒__帧
+#define REPLAY_MAX_SPEED_BATCH 200 // 最快速度时每轮回放的帧数，之间让出事件循环
+
+static ReplayBenchmark* activeBenchmark = nullptr;
+
+ReplayBenchmark::ReplayBenchmark(const Options &options, QObject *parent) : QObject(parent), options(options)
+{
+}
+
+ReplayBenchmark::~ReplayBenchmark()
+{
+    if (activeBenchmark == this)
+        activeBenchmark = nullptr;
+}
+
+/**
+ * --benchmark <CMDS文件|synth:场景> [--speed max|N] [--frames N] [--report 路径]
+ */
+ReplayBenchmark::Options ReplayBenchmark::parseArguments(const QStringList &args)
+{
+    Options options;
+    for (int i = 0; i < args.size() - 1; i++)
+    {
+        const QString& arg = args.at(i);
+        const QString& value = args.at(i + 1);
+        if (arg == "--benchmark")
+            options.source = value;
+        else if (arg == "--speed")
+            options.speed = value == "max" ? 0 : qMax(0.0, value.toDouble());
+        else if (arg == "--frames")
+            options.frames = qMax(1, value.toInt());
+        else if (arg == "--report")
+            options.reportPath = value;
+    }
+    return options;
+}
+
+/**
+ * 正在回放的测试，没有时为空
+ */
+ReplayBenchmark *ReplayBenchmark::active()
+{
+    return activeBenchmark;
+}
+
+QStringList ReplayBenchmark::profiles()
+{
+    return QStringList{"danmaku", "gift", "mixed"};
+}
+
+/**
+ * 生成高流量场景的数据，格式和弹幕服务器推送的一致（zlib 压缩的多条命令）
+ * danmaku：弹幕刷屏；gift：礼物刷屏；mixed：进场、弹幕、礼物混合
+ * 使用固定的随机种子，每次生成的数据相同
+ */
+QList<ReplayBenchmark::Frame> ReplayBenchmark::synthesize(const QString &profile, int count)
+{
+    QRandomGenerator random(20210601);
+    const qint64 roomId = 11584296;
+    const int userCount = 5000;
+    const QStringList texts{"主播好", "晚上好", "哈哈哈哈哈", "？？？", "666", "来了来了", "好听", "点歌 晴天",
+                            "这是一条比较长的弹幕，用来测试长文本的匹配和变量替换耗时", "草", "awsl", "下播了吗"};
+    const QStringList gifts{"辣条", "小心心", "牛哇牛哇", "小花花", "打call"};
+
+    int danmakuWeight = 90, giftWeight = 0, interval = 20;
+    if (profile == "gift")
+        danmakuWeight = 25, giftWeight = 60, interval = 30;
+    else if (profile == "mixed")
+        danmakuWeight = 35, giftWeight = 15, interval = 25;
+
+    auto packet = [](const QByteArray& body, quint16 protover) {
+        QByteArray header(16, 0);
+        qToBigEndian<quint32>(quint32(body.size() + 16), header.data());
+        qToBigEndian<quint16>(16, header.data() + 4);
+        qToBigEndian<quint16>(protover, header.data() + 6);
+        qToBigEndian<quint32>(5, header.data() + 8); // SEND_MSG_REPLY
+        qToBigEndian<quint32>(1, header.data() + 12);
+        return header + body;
+    };
+
+    QList<Frame> frames;
+    qint64 time = QDateTime::currentMSecsSinceEpoch();
+    for (int i = 0; i < count; i++)
+    {
+        QByteArray inner;
+        int packets = 1 + random.bounded(4);
+        for (int j = 0; j < packets; j++)
+        {
+            qint64 uid = 10000 + random.bounded(userCount);
+            QString uname = "测试用户" + QString::number(uid);
+            int roll = random.bounded(100);
+            QJsonObject json;
+            if (roll < danmakuWeight)
+            {
+                QJsonArray info{
+                    QJsonArray{0, 1, 25, 16777215, double(time), random.bounded(100000), 0, "", 0, 0, 0},
+                    texts.at(random.bounded(texts.size())),
+                    QJsonArray{double(uid), uname, 0, 0, 0, 10000, 1, ""},
+                    QJsonArray{random.bounded(21), "测试", "主播", double(roomId), 6067854, "", 0},
+                    QJsonArray{random.bounded(40), 0, 6406234, ">50000"},
+                    QJsonArray{"", ""},
+                    0,
+                    random.bounded(20) ? 0 : 3
+                };
+                json.insert("cmd", "DANMU_MSG");
+                json.insert("info", info);
+            }
+            else if (roll < danmakuWeight + giftWeight)
+            {
+                int gift = random.bounded(gifts.size());
+                int num = 1 + random.bounded(10);
+                bool gold = gift >= 2;
+                QJsonObject data;
+                data.insert("uid", double(uid));
+                data.insert("uname", uname);
+                data.insert("giftId", 30600 + gift);
+                data.insert("giftName", gifts.at(gift));
+                data.insert("num", num);
+                data.insert("price", gold ? 100 : 0);
+                data.insert("total_coin", gold ? 100 * num : 100);
+                data.insert("coin_type", gold ? "gold" : "silver");
+                data.insert("action", "投喂");
+                data.insert("timestamp", double(time / 1000));
+                data.insert("guard_level", 0);
+                data.insert("batch_combo_id", "batch:gift:combo_id:" + QString::number(uid) + ":" + QString::number(30600 + gift));
+                data.insert("medal_info", QJsonObject{{"medal_level", 0}, {"medal_name", ""}, {"target_id", 0}});
+                json.insert("cmd", "SEND_GIFT");
+                json.insert("data", data);
+            }
+            else
+            {
+                QJsonObject data;
+                data.insert("uid", double(uid));
+                data.insert("uname", uname);
+                data.insert("msg_type", 1);
+                data.insert("timestamp", double(time / 1000));
+                data.insert("fans_medal", QJsonObject{{"anchor_roomid", 0}, {"medal_level", 0}, {"medal_name", ""}});
+                json.insert("cmd", "INTERACT_WORD");
+                json.insert("data", data);
+            }
+            inner += packet(QJsonDocument(json).toJson(QJsonDocument::Compact), 0);
+        }
+
+        Frame frame;
+        frame.time = time;
+        frame.data = packet(qCompress(inner).mid(4), 2); // 去掉 Qt 加的长度
+        frames.append(frame);
+        time += random.bounded(interval * 2);
+    }
+    return frames;
+}
+
+/**
+ * 转换成保存的一行（不包括换行）
+ */
+QByteArray ReplayBenchmark::encodeLine(const QByteArray &frame, qint64 time)
+{
+    QByteArray ba = frame;
+    ba.replace("\n", "__bmd__n__").replace("\r", "__bmd__r__");
+    return REPLAY_TIME_PREFIX + QByteArray::number(time) + "__" + ba;
+}
+
+/**
+ * 读取保存的一行，兼容没有时间的旧格式
+ * 帧以包长度开头，首字节不可能是下划线，所以前缀不会和数据混淆
+ */
+QByteArray ReplayBenchmark::decodeLine(QByteArray line, qint64 *time)
+{
+    if (line.endsWith("\n"))
+        line.chop(1);
+    qint64 t = 0;
+    if (line.startsWith(REPLAY_TIME_PREFIX))
+    {
+        int start = int(strlen(REPLAY_TIME_PREFIX));
+        int end = line.indexOf("__", start);
+        if (end > start)
+        {
+            t = line.mid(start, end - start).toLongLong();
+            line = line.mid(end + 2);
+        }
+    }
+    if (time)
+        *time = t;
+    return line.replace("__bmd__n__", "\n").replace("__bmd__r__", "\r");
+}
+
+/**
+ * 进程的内存峰值，字节
+ */
+qint64 ReplayBenchmark::peakMemory()
+{
+#ifdef Q_OS_WIN
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return qint64(counters.PeakWorkingSetSize);
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef Q_OS_MAC
+    return qint64(usage.ru_maxrss); // 字节
+#else
+    return qint64(usage.ru_maxrss) * 1024; // KB
+#endif
+#endif
+}
+
+bool ReplayBenchmark::load(QString *error)
+{
+    frames.clear();
+    if (options.source.startsWith("synth:"))
+    {
+        QString profile = options.source.mid(6);
+        if (!profiles().contains(profile))
+        {
+            *error = "未知的场景：" + profile + "，可用：" + profiles().join(" ");
+            return false;
+        }
+        frames = synthesize(profile, options.frames);
+    }
+    else
+    {
+        QFile file(options.source);
+        if (!file.open(QIODevice::ReadOnly))
+        {
+            *error = "无法读取CMDS文件：" + options.source;
+            return false;
+        }
+        while (!file.atEnd())
+        {
+            Frame frame;
+            frame.data = decodeLine(file.readLine(), &frame.time);
+            if (frame.data.size() >= 16)
+                frames.append(frame);
+        }
+        file.close();
+    }
+
+    if (frames.isEmpty())
+    {
+        *error = "没有可回放的数据";
+        return false;
+    }
+    if (options.speed > 0 && !frames.first().time)
+    {
+        qWarning() << "CMDS文件没有录制时间，改为最快速度回放";
+        options.speed = 0;
+    }
+    return true;
+}
+
+void ReplayBenchmark::start(std::function<void (const QByteArray &)> push)
+{
+    this->push = push;
+    index = 0;
+    bytes = sent = elapsed = 0;
+    for (int i = 0; i < STAGE_COUNT; i++)
+    {
+        samples[i].clear();
+        samples[i].reserve(frames.size() * 2);
+    }
+    activeBenchmark = this;
+    clock.start();
+    QTimer::singleShot(0, this, [=]{
+        pushNext();
+    });
+}
+
+void ReplayBenchmark::record(ReplayBenchmark::Stage stage, qint64 nsecs)
+{
+    samples[stage].append(nsecs);
+}
+
+/**
+ * 被替换掉的发送弹幕
+ */
+void ReplayBenchmark::addSent()
+{
+    sent++;
+}
+
+/**
+ * 最快速度：一轮回放一批，之间让出事件循环，让定时发送等任务也能执行；
+ * 倍速：回放到期的帧，再等待到下一帧的时间
+ */
+void ReplayBenchmark::pushNext()
+{
+    if (options.speed <= 0)
+    {
+        for (int i = 0; i < REPLAY_MAX_SPEED_BATCH && index < frames.size(); i++, index++)
+        {
+            bytes += frames.at(index).data.size();
+            push(frames.at(index).data);
+        }
+        if (index >= frames.size())
+            finish();
+        else
+            QTimer::singleShot(0, this, [=]{ pushNext(); });
+        return ;
+    }
+
+    const qint64 firstTime = frames.first().time;
+    auto due = [=](int i) {
+        return qint64((frames.at(i).time - firstTime) / options.speed);
+    };
+    while (index < frames.size() && due(index) <= clock.elapsed())
+    {
+        bytes += frames.at(index).data.size();
+        push(frames.at(index).data);
+        index++;
+    }
+    if (index >= frames.size())
+    {
+        finish();
+        return ;
+    }
+    QTimer::singleShot(int(qMax(qint64(0), due(index) - clock.elapsed())), Qt::PreciseTimer, this, [=]{
+        pushNext();
+    });
+}
+
+void ReplayBenchmark::finish()
+{
+    elapsed = clock.elapsed();
+    if (activeBenchmark == this)
+        activeBenchmark = nullptr;
+    emit signalFinished();
+}
+
+QString ReplayBenchmark::stageKey(int stage)
+{
+    switch (stage)
+    {
+    case Decode: return "decode";
+    case Dispatch: return "dispatch";
+    case ReplyMatch: return "reply_match";
+    case Template: return "template";
+    case SendQueue: return "send_queue";
+    }
+    return "";
+}
+
+MyJson ReplayBenchmark::report() const
+{
+    const double seconds = qMax(qint64(1), elapsed) / 1000.0;
+    MyJson json;
+    json.insert("source", options.source);
+    json.insert("speed", options.speed > 0 ? QJsonValue(options.speed) : QJsonValue("max"));
+    json.insert("frames", frames.size());
+    json.insert("bytes", double(bytes));
+    json.insert("commands", samples[Dispatch].size());
+    json.insert("sent", double(sent));
+    json.insert("elapsed_ms", double(elapsed));
+    json.insert("frames_per_second", frames.size() / seconds);
+    json.insert("commands_per_second", samples[Dispatch].size() / seconds);
+    json.insert("peak_memory", double(peakMemory()));
+
+    MyJson stages;
+    for (int i = 0; i < STAGE_COUNT; i++)
+    {
+        QVector<qint64> sorted = samples[i];
+        std::sort(sorted.begin(), sorted.end());
+        auto percentile = [&](double p) -> double {
+            if (sorted.isEmpty())
+                return 0;
+            int pos = qMin(sorted.size() - 1, int(sorted.size() * p));
+            return sorted.at(pos) / 1000.0;
+        };
+        qint64 total = 0;
+        for (qint64 v : sorted)
+            total += v;
+
+        MyJson stage;
+        stage.insert("count", sorted.size());
+        stage.insert("mean_us", sorted.isEmpty() ? 0 : total / 1000.0 / sorted.size());
+        stage.insert("p50_us", percentile(0.5));
+        stage.insert("p90_us", percentile(0.9));
+        stage.insert("p99_us", percentile(0.99));
+        stage.insert("max_us", sorted.isEmpty() ? 0 : sorted.last() / 1000.0);
+        stage.insert("total_ms", total / 1000000.0);
+        stages.insert(stageKey(i), stage);
+    }
+    json.insert("stages", stages);
+    return json;
+}
+
+QString ReplayBenchmark::reportText() const
+{
+    MyJson json = report();
+    QStringList lines;
+    lines << QString("来源：%1  速度：%2").arg(options.source).arg(options.speed > 0 ? QString::number(options.speed) + "x" : "最快");
+    lines << QString("帧：%1  命令：%2  发送：%3  耗时：%4 ms")
+             .arg(frames.size()).arg(samples[Dispatch].size()).arg(sent).arg(elapsed);
+    lines << QString("吞吐：%1 帧/秒  %2 命令/秒")
+             .arg(json.value("frames_per_second").toDouble(), 0, 'f', 1)
+             .arg(json.value("commands_per_second").toDouble(), 0, 'f', 1);
+    lines << QString("内存峰值：%1 MB").arg(peakMemory() / 1024.0 / 1024.0, 0, 'f', 1);
+    lines << QString("%1 %2 %3 %4 %5 %6").arg("阶段", -12).arg("次数", 8).arg("p50(us)", 10)
+             .arg("p90(us)", 10).arg("p99(us)", 10).arg("max(us)", 10);
+    MyJson stages = json.o("stages");
+    for (int i = 0; i < STAGE_COUNT; i++)
+    {
+        MyJson stage = stages.o(stageKey(i));
+        lines << QString("%1 %2 %3 %4 %5 %6").arg(stageKey(i), -12).arg(stage.i("count"), 8)
+                 .arg(stage.value("p50_us").toDouble(), 10, 'f', 1)
+                 .arg(stage.value("p90_us").toDouble(), 10, 'f', 1)
+                 .arg(stage.value("p99_us").toDouble(), 10, 'f', 1)
+                 .arg(stage.value("max_us").toDouble(), 10, 'f', 1);
+    }
+    return lines.join("\n");
+}
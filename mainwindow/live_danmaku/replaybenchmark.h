@@ -0,0 +1,124 @@
+#ifndef REPLAYBENCHMARK_H
+#define REPLAYBENCHMARK_H
+
+#include <QObject>
+#include <QVector>
+#include <QElapsedTimer>
+#include <functional>
+#include "myjson.h"
+#include "livemetrics.h"
+
+/**
+ * 回放保存的 CMDS，统计处理速度
+ * 来源是“保存CMDS”录制的文件，或按场景生成的高流量数据（synth:场景名）；
+ * 可以最快速度回放，也可以按录制时的间隔以 N 倍速回放。
+ * 回放期间各阶段通过 BenchScope 记录耗时，结束后输出吞吐、分位数和内存峰值。
+ */
+class ReplayBenchmark : public QObject
+{
+    Q_OBJECT
+public:
+    enum Stage
+    {
+        Decode,     // 解包、解压、解析JSON
+        Dispatch,   // 单条命令的处理（包含后面的阶段）
+        ReplyMatch, // 匹配自动回复
+        Template,   // 填充变量、判断条件
+        SendQueue,  // 加入发送队列、从队列发送
+        STAGE_COUNT
+    };
+
+    struct Options
+    {
+        QString source; // CMDS 文件，或 synth:danmaku / synth:gift / synth:mixed
+        double speed = 0; // 0 为最快速度，否则为录制时间的倍数
+        int frames = 20000; // 生成的帧数
+        QString reportPath; // 保存 JSON 报告
+    };
+
+    struct Frame
+    {
+        qint64 time = 0; // 录制时的毫秒时间戳，没有为0
+        QByteArray data;
+    };
+
+    ReplayBenchmark(const Options& options, QObject* parent = nullptr);
+    ~ReplayBenchmark() override;
+
+    static Options parseArguments(const QStringList& args);
+    static ReplayBenchmark* active();
+    static QStringList profiles();
+    static QList<Frame> synthesize(const QString& profile, int count);
+    static QByteArray encodeLine(const QByteArray& frame, qint64 time);
+    static QByteArray decodeLine(QByteArray line, qint64* time = nullptr);
+    static qint64 peakMemory();
+
+    bool load(QString* error);
+    void start(std::function<void(const QByteArray& frame)> push);
+    void record(Stage stage, qint64 nsecs);
+    void addSent();
+
+    MyJson report() const;
+    QString reportText() const;
+
+signals:
+    void signalFinished();
+
+private:
+    static QString stageKey(int stage);
+    void pushNext();
+    void finish();
+
+private:
+    Options options;
+    QList<Frame> frames;
+    int index = 0;
+    std::function<void(const QByteArray&)> push;
+    QElapsedTimer clock;
+    qint64 elapsed = 0; // 结束时的耗时，毫秒
+    qint64 bytes = 0;
+    qint64 sent = 0;
+    QVector<qint64> samples[STAGE_COUNT]; // 纳秒
+};
+
+/**
+ * 记录所在作用域的耗时，同时计入常驻统计的直方图（如果有）；
+ * 两者都不需要时只判断一次空指针
+ */
+class BenchScope
+{
+public:
+    BenchScope(ReplayBenchmark::Stage stage, LiveMetrics::Histogram metric = LiveMetrics::NoHistogram)
+        : stage(stage), metric(metric), bench(ReplayBenchmark::active())
+    {
+        if (bench || metric != LiveMetrics::NoHistogram)
+            timer.start();
+    }
+
+    ~BenchScope()
+    {
+        finish();
+    }
+
+    /// @return 耗时，纳秒；没有计时为0
+    qint64 finish()
+    {
+        if (!bench && metric == LiveMetrics::NoHistogram)
+            return 0;
+        qint64 nsecs = timer.nsecsElapsed();
+        if (bench)
+            bench->record(stage, nsecs);
+        LiveMetrics::record(metric, nsecs);
+        bench = nullptr;
+        metric = LiveMetrics::NoHistogram;
+        return nsecs;
+    }
+
+private:
+    ReplayBenchmark::Stage stage;
+    LiveMetrics::Histogram metric;
+    ReplayBenchmark* bench;
+    QElapsedTimer timer;
+};
+
+#endif // REPLAYBENCHMARK_H
@@ -0,0 +1,160 @@
+#include <QRegExp>
+#include "wordssnapshot.h"
+
+/**
+ * 编译候选弹幕
+ * 和 processDanmakuVariants 一样先去掉注释和软换行，再按行区分：
+ * 含有 %、开头有 [条件]、或者包含自定义变量/翻译的为动态行，其余为静态行
+ * @param variantKeys 自定义变量和翻译的键，出现在行内的需要每次替换
+ * @param longest 过长的候选要去掉，0 表示不去掉
+ */
+WordsSnapshot::Ptr WordsSnapshot::compile(const QString &text, const QStringList &variantKeys, int longest)
+{
+    WordsSnapshot* words = new WordsSnapshot();
+    words->source = text;
+    words->longest = longest;
+
+    QString plainText = text;
+    plainText.replace(QRegularExpression("(?<!:)//.*?(?=\\n|$|\\\\n)"), ""); // 去掉注释
+    plainText.replace(QRegularExpression("\\s*\\\\\\s*\\n\\s*"), ""); // 软换行符
+
+    QRegularExpression headerRe("^\\s*\\[");
+    foreach (const QString& line, plainText.split("\n", QString::SkipEmptyParts))
+    {
+        bool dynamic = line.contains("%") || line.indexOf(headerRe) > -1;
+        for (int i = 0; i < variantKeys.size() && !dynamic; i++)
+            if (line.contains(variantKeys.at(i)))
+                dynamic = true;
+
+        if (dynamic)
+        {
+            Line dynamicLine;
+            dynamicLine.text = line;
+            dynamicLine.dynamic = true;
+            words->lines.append(dynamicLine);
+            words->dynamic = true;
+        }
+        else
+        {
+            words->lines.append(makeLine(line.trimmed(), longest));
+        }
+    }
+
+    if (!words->dynamic)
+        words->staticCandidates = select(words->lines);
+    return Ptr(words);
+}
+
+/**
+ * 已经处理好变量和条件的一行
+ */
+WordsSnapshot::Line WordsSnapshot::makeLine(const QString &text, int longest)
+{
+    Line line;
+    line.text = text;
+    line.priority = priorityOf(text);
+    line.tooLong = longest > 0 && isTooLong(text, longest);
+    return line;
+}
+
+/**
+ * 从处理好的行中筛选候选，和原来逐条处理的结果相同：
+ * 按顺序去掉过长的，但至少保留一条（全部过长时留下最后一条）；
+ * 再只保留优先级最高的，并去掉开头的*
+ * @param removed 去掉的过长候选
+ */
+QStringList WordsSnapshot::select(QVector<Line> lines, QStringList *removed)
+{
+    for (int i = 0; i < lines.size() && lines.size() > 1; i++)
+    {
+        if (lines.at(i).tooLong)
+        {
+            if (removed)
+                removed->append(lines.at(i).text);
+            lines.remove(i--);
+        }
+    }
+
+    int priority = 0;
+    foreach (const Line& line, lines)
+        priority = qMax(priority, line.priority);
+    QStringList result;
+    foreach (const Line& line, lines)
+    {
+        if (line.priority == priority)
+            result.append(line.text.mid(priority));
+    }
+    return result;
+}
+
+/**
+ * 开头 * 的数量，越多越优先
+ */
+int WordsSnapshot::priorityOf(const QString &line)
+{
+    int count = 0;
+    while (count < line.length() && line.at(count) == '*')
+        count++;
+    return count;
+}
+
+bool WordsSnapshot::isTooLong(QString line, int longest)
+{
+    line = line.replace(QRegExp("\\(\\s*cd\\d+\\s*:\\s*\\d+\\s*\\)"), "").replace("*", "").trimmed();
+    return !line.contains(">") && !line.contains("\\n") && line.length() > longest && !line.contains("%");
+}
+
+const QString &WordsSnapshot::getSource() const
+{
+    return source;
+}
+
+bool WordsSnapshot::isEmpty() const
+{
+    return lines.isEmpty();
+}
+
+bool WordsSnapshot::hasDynamic() const
+{
+    return dynamic;
+}
+
+int WordsSnapshot::getLongest() const
+{
+    return longest;
+}
+
+const QVector<WordsSnapshot::Line> &WordsSnapshot::getLines() const
+{
+    return lines;
+}
+
+const QStringList &WordsSnapshot::getStaticCandidates() const
+{
+    return staticCandidates;
+}
+
+/**
+ * 编译关键词正则，兼容末尾多写的 |
+ */
+KeywordsSnapshot::Ptr KeywordsSnapshot::compile(const QString &text)
+{
+    KeywordsSnapshot* keys = new KeywordsSnapshot();
+    QString reStr = text;
+    if (reStr.endsWith("|"))
+        reStr = reStr.left(reStr.length() - 1);
+    keys->empty = text.trimmed().isEmpty();
+    keys->regex = QRegularExpression(reStr);
+    keys->regex.optimize();
+    return Ptr(keys);
+}
+
+bool KeywordsSnapshot::isEmpty() const
+{
+    return empty;
+}
+
+const QRegularExpression &KeywordsSnapshot::getRegex() const
+{
+    return regex;
+}
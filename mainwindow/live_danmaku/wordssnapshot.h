@@ -0,0 +1,74 @@
+#ifndef WORDSSNAPSHOT_H
+#define WORDSSNAPSHOT_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QSharedPointer>
+#include <QRegularExpression>
+
+/**
+ * 候选弹幕编辑框（欢迎、答谢、关注、禁言通知）编译后的只读快照
+ * 只在文字、自定义变量或长度设置改变时重新生成，事件处理时只读快照，不再读取控件；
+ * 不含变量和条件的行在编译时就完成了去注释、计算优先级和是否过长，
+ * 每次事件只需要计算含有变量或条件的行，再按原来的顺序一起筛选。
+ */
+class WordsSnapshot
+{
+public:
+    typedef QSharedPointer<const WordsSnapshot> Ptr;
+
+    struct Line
+    {
+        QString text;
+        bool dynamic = false; // 含有变量或条件，每次都要计算
+        bool tooLong = false;
+        int priority = 0; // 开头*的数量
+    };
+
+    static Ptr compile(const QString& text, const QStringList& variantKeys, int longest);
+    static Line makeLine(const QString& text, int longest);
+    static QStringList select(QVector<Line> lines, QStringList* removed = nullptr);
+    static int priorityOf(const QString& line);
+    static bool isTooLong(QString line, int longest);
+
+    const QString& getSource() const;
+    bool isEmpty() const;
+    bool hasDynamic() const;
+    int getLongest() const;
+    const QVector<Line>& getLines() const;
+    const QStringList& getStaticCandidates() const;
+
+private:
+    WordsSnapshot() {}
+
+private:
+    QString source;
+    int longest = 0; // 超过的候选去掉，0 表示不去掉
+    QVector<Line> lines; // 去掉注释和软换行后的所有行，静态行已经 trimmed
+    bool dynamic = false;
+    QStringList staticCandidates; // 没有动态行时，筛选后的结果
+};
+
+/**
+ * 关键词编辑框（新人禁言、提示拉黑）编译后的正则表达式
+ */
+class KeywordsSnapshot
+{
+public:
+    typedef QSharedPointer<const KeywordsSnapshot> Ptr;
+
+    static Ptr compile(const QString& text);
+
+    bool isEmpty() const;
+    const QRegularExpression& getRegex() const;
+
+private:
+    KeywordsSnapshot() {}
+
+private:
+    bool empty = true;
+    QRegularExpression regex;
+};
+
+#endif // WORDSSNAPSHOT_H
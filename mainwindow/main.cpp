@@ -1,6 +1,9 @@
 #include "mainwindow.h"
 #include <QApplication>
+#include <QTextStream>
 #include "dlog.h"
+#include "selftest.h"
+#include "componentbenchmark.h"
 
 #ifdef Q_OS_WIN32
 // 崩溃前操作
@@ -22,6 +25,34 @@ int main(int argc, char *argv[])
     font.setFamily("微软雅黑");
     a.setFont(font);
 
+    // 无界面回放测试：--benchmark <CMDS文件|synth:场景> [--speed max|N] [--frames N] [--report 路径]
+    // 单个组件的测试：--benchmark screen|button|cover [--count N] [--covers 目录]
+    if (a.arguments().contains("--benchmark"))
+    {
+        ReplayBenchmark::Options options = ReplayBenchmark::parseArguments(a.arguments());
+        if (ComponentBenchmark::isComponent(options.source))
+        {
+            bool ok = false;
+            QTextStream(stdout) << ComponentBenchmark::run(options.source, a.arguments(), &ok) << "\n";
+            return ok ? 0 : 1;
+        }
+
+        MainWindow::headless = true;
+        MainWindow w;
+        if (!w.startReplayBenchmark(options))
+            return 1;
+        return a.exec();
+    }
+
+    // 自检：--selftest [名称]，不指定名称时全部运行，全部通过时返回0
+    int selfTestIndex = a.arguments().indexOf("--selftest");
+    if (selfTestIndex > -1)
+    {
+        bool passed = false;
+        QTextStream(stdout) << SelfTest::run(a.arguments().value(selfTestIndex + 1), &passed) << "\n";
+        return passed ? 0 : 1;
+    }
+
     MainWindow w;
     if (w.getSettings()->value("runtime/debugToFile", false).toBool())
         qInstallMessageHandler(myMsgOutput);
@@ -1,10 +1,12 @@
 #include <zlib.h>
 #include <QListView>
 #include <QMovie>
+#include <QSharedPointer>
 #include <QClipboard>
 #include <QTableView>
 #include <QStandardItemModel>
 #include <QHeaderView>
+#include <QTemporaryDir>
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 #include "videolyricscreator.h"
@@ -24,7 +26,6 @@
 
 QHash<qint64, QString> CommonValues::localNicknames; // 本地昵称
 QHash<qint64, qint64> CommonValues::userComeTimes;   // 用户进来的时间（客户端时间戳为准）
-QHash<qint64, qint64> CommonValues::userBlockIds;    // 本次用户屏蔽的ID
 QSettings* CommonValues::danmakuCounts = nullptr;    // 每个用户的统计
 QSettings* CommonValues::userMarks = nullptr;        // 每个用户的备注
 QList<LiveDanmaku> CommonValues::allDanmakus;        // 本次启动的所有弹幕
@@ -37,8 +38,9 @@ QList<QPair<QString, QString>> CommonValues::replaceVariant; // 替换变量
 QList<qint64> CommonValues::notWelcomeUsers;         // 不自动欢迎
 QList<qint64> CommonValues::notReplyUsers;           // 不自动回复
 QHash<int, QString> CommonValues::giftNames;         // 自定义礼物名字
-QList<EternalBlockUser> CommonValues::eternalBlockUsers; // 永久禁言
+ModerationState* CommonValues::moderation = nullptr; // 禁言、永久禁言、粉丝
 QHash<qint64, QString> CommonValues::currentGuards;  // 当前船员
+bool MainWindow::headless = false;
 QHash<qint64, QPixmap> CommonValues::giftImages;     // 礼物图片
 QString CommonValues::browserCookie;
 QString CommonValues::browserData;
@@ -58,6 +60,7 @@ MainWindow::MainWindow(QWidget *parent)
     initPath();
     readConfig();
     initEvent();
+    initLog();
 
     // 彩蛋
     warmWish = WarmWishUtil::getWarmWish(":/documents/warm_wish");
@@ -457,11 +460,27 @@ void MainWindow::readConfig()
         ensureDirExist(dataPath + "backup");
         QString ts = QDateTime::currentDateTime().toString("yyyy_MM_dd_hh_mm");
         copyFile(dataPath + "settings.ini", dataPath + "/backup/settings_" + ts + ".ini");
-        copyFile(dataPath + "heaps.ini", dataPath + "/backup/heaps_" + ts + ".ini");
+        copyFile(dataPath + "heaps.kv", dataPath + "/backup/heaps_" + ts + ".kv");
+        copyFile(dataPath + "heaps.kvlog", dataPath + "/backup/heaps_" + ts + ".kvlog");
+        copyFile(dataPath + "moderation.dat", dataPath + "/backup/moderation_" + ts + ".dat");
     }
 
     settings = new QSettings(dataPath + "settings.ini", QSettings::Format::IniFormat);
-    heaps = new QSettings(dataPath + "heaps.ini", QSettings::Format::IniFormat);
+    if (!heaps)
+    {
+        heaps = new KVStore(dataPath + "heaps.kv", dataPath + "heaps.kvlog", this);
+        QSettings legacyHeaps(dataPath + "heaps.ini", QSettings::Format::IniFormat);
+        heaps->migrateFrom(&legacyHeaps);
+        heaps->load();
+    }
+    if (!moderation)
+    {
+        moderation = new ModerationState(dataPath + "moderation.dat", this);
+        moderation->load();
+        moderation->migrateFrom(settings, "danmaku/eternalBlockUsers");
+    }
+    if (!analytics)
+        analytics = new LiveAnalytics(dataPath + "live_daily/", this);
     robotRecord = new QSettings(dataPath + "robots.ini", QSettings::Format::IniFormat);
     wwwDir = QDir(dataPath + "www");
 
@@ -505,11 +524,10 @@ void MainWindow::readConfig()
         });
     }
 
-    // 移除间隔
-    removeTimer = new QTimer(this);
-    removeTimer->setInterval(200);
+    // 移除间隔：只在最早的一条到期时唤醒
+    removeTimer = new WheelTimer("移除过期弹幕", this);
+    removeTimer->setSingleShot(true);
     connect(removeTimer, SIGNAL(timeout()), this, SLOT(removeTimeoutDanmaku()));
-    removeTimer->start();
 
     int removeIv = settings->value("danmaku/removeInterval", 60).toInt();
     ui->removeDanmakuIntervalSpin->setValue(removeIv); // 自动引发改变事件
@@ -531,9 +549,9 @@ void MainWindow::readConfig()
     ui->retryFailedDanmuCheck->setChecked(settings->value("danmaku/retryFailedDanmu", true).toBool());
 
     // 发送队列
-    autoMsgTimer = new QTimer(this) ;
+    autoMsgTimer = new WheelTimer("发送队列", this);
     autoMsgTimer->setInterval(1500); // 1.5秒发一次弹幕
-    connect(autoMsgTimer, &QTimer::timeout, this, [=]{
+    connect(autoMsgTimer, &WheelTimer::timeout, this, [=]{
         slotSendAutoMsg(true);
     });
 
@@ -604,9 +622,9 @@ void MainWindow::readConfig()
         ui->recordCheck->setChecked(true);
     int recordSplit = settings->value("danmaku/recordSplit", 30).toInt();
     ui->recordSplitSpin->setValue(recordSplit);
-    recordTimer = new QTimer(this);
+    recordTimer = new WheelTimer("录播分段", this);
     recordTimer->setInterval(recordSplit * 60000); // 默认30分钟断开一次
-    connect(recordTimer, &QTimer::timeout, this, [=]{
+    connect(recordTimer, &WheelTimer::timeout, this, [=]{
         if (!recordLoop) // 没有正在录制
             return ;
 
@@ -712,7 +730,7 @@ void MainWindow::readConfig()
     ui->giftComboDelaySpin->setValue(settings->value("danmaku/giftComboDelay",  5).toInt());
     ui->giftComboTopCheck->setChecked(settings->value("danmaku/giftComboTop", false).toBool());
     ui->giftComboMergeCheck->setChecked(settings->value("danmaku/giftComboMerge", false).toBool());
-    comboTimer = new QTimer(this);
+    comboTimer = new WheelTimer("礼物连击", this);
     comboTimer->setInterval(500);
     connect(comboTimer, SIGNAL(timeout()), this, SLOT(slotComboSend()));
 
@@ -832,13 +850,34 @@ void MainWindow::readConfig()
 
     // 定时任务
     srand((unsigned)time(0));
+    QElapsedTimer ruleClock;
+    ruleClock.start();
     restoreTaskList();
 
     // 自动回复
     restoreReplyList();
+    connect(this, &MainWindow::signalNewDanmaku, this, &MainWindow::triggerAutoReply);
 
     // 事件动作
     restoreEventList();
+    qInfo() << "加载规则：" << ui->taskListWidget->count() + ui->replyListWidget->count() + ui->eventListWidget->count()
+            << "条，耗时" << ruleClock.elapsed() << "ms";
+
+    // 只为可见的行创建编辑控件
+    foreach (QListWidget* listWidget, QList<QListWidget*>{ui->taskListWidget, ui->replyListWidget, ui->eventListWidget})
+    {
+        connect(listWidget->verticalScrollBar(), &QScrollBar::valueChanged, this, [=]{
+            loadVisibleRuleWidgets(listWidget);
+        });
+        connect(listWidget->verticalScrollBar(), &QScrollBar::rangeChanged, this, [=]{
+            loadVisibleRuleWidgets(listWidget);
+        });
+    }
+
+    // 预先合成列表中固定的语音
+    QTimer::singleShot(SPEECH_PREPARE_DELAY, this, [=]{
+        prepareSpeechTexts();
+    });
 
     // 保存舰长
     ui->saveEveryGuardCheck->setChecked(settings->value("danmaku/saveEveryGuard", false).toBool());
@@ -869,6 +908,7 @@ void MainWindow::readConfig()
     ui->sendAttentionVoiceCheck->setEnabled(ui->autoSendAttentionCheck->isChecked());
 
     // 文字转语音
+    speechCache = new SpeechCache(dataPath + "speech_cache", settings->value("voice/cacheSize", 64).toLongLong() * 1024 * 1024, this);
     ui->autoSpeekDanmakuCheck->setChecked(settings->value("danmaku/autoSpeek", false).toBool());
     if (ui->sendWelcomeVoiceCheck->isChecked() || ui->sendGiftVoiceCheck->isChecked()
             || ui->sendAttentionVoiceCheck->isChecked() || ui->autoSpeekDanmakuCheck->isChecked())
@@ -928,7 +968,8 @@ void MainWindow::readConfig()
 
     // WS连接
     initWS();
-    startConnectRoom();
+    if (!headless)
+        startConnectRoom();
 
     // 10秒内不进行自动化操作
     QTimer::singleShot(3000, [=]{
@@ -1029,16 +1070,6 @@ void MainWindow::readConfig()
     // 自动赠送过期礼物
     ui->sendExpireGiftCheck->setChecked(settings->value("danmaku/sendExpireGift", false).toBool());
 
-    // 永久禁言
-    QJsonArray eternalBlockArray = settings->value("danmaku/eternalBlockUsers").toJsonArray();
-    int eternalBlockSize = eternalBlockArray.size();
-    for (int i = 0; i < eternalBlockSize; i++)
-    {
-        EternalBlockUser eb = EternalBlockUser::fromJson(eternalBlockArray.at(i).toObject());
-        if (eb.uid && eb.roomId)
-            eternalBlockUsers.append(eb);
-    }
-
     // 开机自启
     if (settings->value("runtime/startOnReboot", false).toBool())
         ui->startOnRebootCheck->setChecked(true);
@@ -1049,28 +1080,10 @@ void MainWindow::readConfig()
     connect(minuteTimer, &QTimer::timeout, this, [=]{
         // 直播间人气
         if (currentPopul > 1 && isLiving()) // 为0的时候不计入内；为1时可能机器人在线
-        {
-            sumPopul += currentPopul;
-            countPopul++;
-
-            dailyAvePopul = int(sumPopul / countPopul);
-            if (dailySettings)
-                dailySettings->setValue("average_popularity", dailyAvePopul);
-        }
-        if (dailyMaxPopul < currentPopul)
-        {
-            dailyMaxPopul = currentPopul;
-            if (dailySettings)
-                dailySettings->setValue("max_popularity", dailyMaxPopul);
-        }
+            analytics->setGauge(LiveAnalytics::Popularity, currentPopul);
 
         // 弹幕人气
-        danmuPopulValue += minuteDanmuPopul;
-        danmuPopulQueue.append(minuteDanmuPopul);
-        minuteDanmuPopul = 0;
-        if (danmuPopulQueue.size() > 5)
-            danmuPopulValue -= danmuPopulQueue.takeFirst();
-        ui->danmuCountLabel->setToolTip("5分钟弹幕人气：" + snum(danmuPopulValue) + "，平均人气：" + snum(dailyAvePopul));
+        ui->danmuCountLabel->setToolTip("5分钟弹幕人气：" + snum(getDanmuPopularity()) + "，平均人气：" + snum(analytics->getTodayAveragePopularity()));
 
         triggerCmdEvent("DANMU_POPULARITY", LiveDanmaku(), false);
     });
@@ -1173,8 +1186,6 @@ void MainWindow::readConfig()
         if (danmuLogFile && !isLiving())
             startSaveDanmakuToFile();
         userComeTimes.clear();
-        sumPopul = 0;
-        countPopul = 0;
 
         // 触发每天事件
         triggerCmdEvent("NEW_DAY", LiveDanmaku(), true);
@@ -1299,6 +1310,53 @@ void MainWindow::readConfig()
 
 void MainWindow::initEvent()
 {
+    // 事件处理中用到的开关
+    foreach (QCheckBox* check, QList<QCheckBox*>{ui->allowAdminControlCheck, ui->blockNotOnlyNewbieCheck,
+             ui->autoBlockNewbieCheck, ui->autoBlockNewbieNotifyCheck, ui->promptBlockNewbieCheck, ui->notOnlyNewbieCheck,
+             ui->sendWelcomeTextCheck, ui->sendWelcomeVoiceCheck})
+        connect(check, &QCheckBox::toggled, this, [=]{ updateHandlerOptions(); });
+    foreach (QSpinBox* spin, QList<QSpinBox*>{ui->autoBlockTimeSpin, ui->sendWelcomeCDSpin})
+        connect(spin, QOverload<int>::of(&QSpinBox::valueChanged), this, [=]{ updateHandlerOptions(); });
+    updateHandlerOptions();
+}
+
+/**
+ * 启动结构化日志，并在调试菜单中添加分类开关
+ */
+void MainWindow::initLog()
+{
+    LiveLog::start(dataPath + "logs");
+
+    QStringList enabled;
+    for (int i = 0; i < LiveLog::CATEGORY_COUNT; i++)
+    {
+        if (LiveLog::defaultMask() & (1u << i))
+            enabled.append(LiveLog::categoryKey(i));
+    }
+    enabled = settings->value("debug/logCategories", enabled).toStringList();
+
+    QMenu* menu = new QMenu("日志分类", this);
+    for (int i = 0; i < LiveLog::CATEGORY_COUNT; i++)
+    {
+        QString key = LiveLog::categoryKey(i);
+        bool enable = enabled.contains(key);
+        LiveLog::setCategoryEnabled(i, enable);
+
+        QAction* action = menu->addAction(LiveLog::categoryName(i));
+        action->setCheckable(true);
+        action->setChecked(enable);
+        connect(action, &QAction::triggered, this, [=](bool checked){
+            LiveLog::setCategoryEnabled(i, checked);
+            QStringList keys;
+            for (int j = 0; j < LiveLog::CATEGORY_COUNT; j++)
+            {
+                if (LiveLog::isCategoryEnabled(j))
+                    keys.append(LiveLog::categoryKey(j));
+            }
+            settings->setValue("debug/logCategories", keys);
+        });
+    }
+    ui->menu_6->insertMenu(ui->actionLast_Candidate, menu);
 }
 
 void MainWindow::adjustPageSize(int page)
@@ -1355,6 +1413,7 @@ void MainWindow::adjustPageSize(int page)
                 taskWidget->resize(size);
                 taskWidget->autoResizeEdit();
             }
+            loadVisibleRuleWidgets(ui->taskListWidget);
         }
         else if (tabIndex == TAB_AUTO_REPLY)
         {
@@ -1369,6 +1428,7 @@ void MainWindow::adjustPageSize(int page)
                 replyWidget->resize(size);
                 replyWidget->autoResizeEdit();
             }
+            loadVisibleRuleWidgets(ui->replyListWidget);
         }
         else if (tabIndex == TAB_EVENT_ACTION)
         {
@@ -1383,6 +1443,7 @@ void MainWindow::adjustPageSize(int page)
                 eventWidget->resize(size);
                 eventWidget->autoResizeEdit();
             }
+            loadVisibleRuleWidgets(ui->eventListWidget);
         }
     }
     else if (page == PAGE_PREFENCE)
@@ -1520,6 +1581,12 @@ MainWindow::~MainWindow()
         danmakuWindow = nullptr;
     }
 
+    if (screenDanmakuOverlay)
+    {
+        delete screenDanmakuOverlay; // 没有父对象，退出事件循环后 deleteLater 不会再执行
+        screenDanmakuOverlay = nullptr;
+    }
+
     /*if (playerWindow)
     {
         settings->setValue("danmaku/playerWindow", !playerWindow->isHidden());
@@ -1535,9 +1602,20 @@ MainWindow::~MainWindow()
     if (isFileExist(webCache("")))
         deleteDir(webCache(""));
 
-    // 清理过期备份
+    // 清理过期备份（ui 已经删除，从配置读取天数）
     auto files = QDir(dataPath + "backup").entryInfoList(QDir::NoDotAndDotDot | QDir::Files);
-    qint64 overdue = QDateTime::currentSecsSinceEpoch() - 3600 * 24 * qMax(ui->autoClearComeIntervalSpin->value(), 7); // 至少备份7天
+    qint64 overdue = QDateTime::currentSecsSinceEpoch() - 3600 * 24 * qMax(settings->value("danmaku/clearDidntComeInterval", 7).toInt(), 7); // 至少备份7天
+    foreach (auto info, files)
+    {
+        if (info.lastModified().toSecsSinceEpoch() < overdue)
+        {
+            deleteFile(info.absoluteFilePath());
+        }
+    }
+
+    // 清理过期日志
+    files = QDir(dataPath + "logs").entryInfoList(QStringList{"live_*.log"}, QDir::Files);
+    overdue = QDateTime::currentSecsSinceEpoch() - 3600 * 24 * LIVE_LOG_KEEP_DAYS;
     foreach (auto info, files)
     {
         if (info.lastModified().toSecsSinceEpoch() < overdue)
@@ -1661,7 +1739,7 @@ void MainWindow::pullLiveDanmaku()
 
 void MainWindow::removeTimeoutDanmaku()
 {
-    if (pushCmdsFile && roomDanmakus.size() < 1000) // 不移除弹幕
+    if (pushCmdsFile && roomDanmakus.size() < 1000) // 不移除弹幕，新弹幕到来时再检查
         return ;
 
     // 移除过期队列
@@ -1682,12 +1760,7 @@ void MainWindow::removeTimeoutDanmaku()
     for (int i = 0; i < roomDanmakus.size(); i++)
     {
         auto danmaku = roomDanmakus.at(i);
-        auto type = danmaku.getMsgType();
-        if (type == MSG_ATTENTION || type == MSG_WELCOME || type == MSG_FANS
-                || (type == MSG_GIFT && (!danmaku.isGoldCoin() || danmaku.getTotalCoin() < 1000))
-                || (type == MSG_DANMAKU && danmaku.isNoReply())
-                || type == MSG_MSG
-                || danmaku.isToView() || danmaku.isPkLink())
+        if (isTipDanmaku(danmaku))
         {
             QDateTime dateTime = danmaku.getTimeline();
             if (dateTime.toMSecsSinceEpoch() < removeTime)
@@ -1698,6 +1771,48 @@ void MainWindow::removeTimeoutDanmaku()
             // break; // 不break，就是一次性删除多个
         }
     }
+
+    scheduleRemoveDanmaku();
+}
+
+/**
+ * 较快移除的提示类消息
+ */
+bool MainWindow::isTipDanmaku(const LiveDanmaku &danmaku) const
+{
+    auto type = danmaku.getMsgType();
+    return type == MSG_ATTENTION || type == MSG_WELCOME || type == MSG_FANS
+            || (type == MSG_GIFT && (!danmaku.isGoldCoin() || danmaku.getTotalCoin() < 1000))
+            || (type == MSG_DANMAKU && danmaku.isNoReply())
+            || type == MSG_MSG
+            || danmaku.isToView() || danmaku.isPkLink();
+}
+
+/**
+ * 在下一条弹幕到期时移除，没有弹幕时不唤醒
+ * 每次最多移除一条普通弹幕，间隔至少200毫秒，和以前轮询时的节奏一致
+ */
+void MainWindow::scheduleRemoveDanmaku()
+{
+    if (roomDanmakus.isEmpty())
+    {
+        removeTimer->stop();
+        return ;
+    }
+
+    qint64 next = roomDanmakus.first().getTimeline().toMSecsSinceEpoch() + removeDanmakuInterval;
+    foreach (const LiveDanmaku& danmaku, roomDanmakus)
+    {
+        if (isTipDanmaku(danmaku))
+        {
+            next = qMin(next, danmaku.getTimeline().toMSecsSinceEpoch() + removeDanmakuTipInterval);
+            break; // 按时间排列，第一条提示最早到期
+        }
+    }
+
+    int delay = int(qMax(200LL, next - QDateTime::currentMSecsSinceEpoch()));
+    if (!removeTimer->isActive() || removeTimer->remainingTime() > delay)
+        removeTimer->start(delay);
 }
 
 void MainWindow::appendNewLiveDanmakus(QList<LiveDanmaku> danmakus)
@@ -1705,6 +1820,8 @@ void MainWindow::appendNewLiveDanmakus(QList<LiveDanmaku> danmakus)
     // 添加到队列
     roomDanmakus.append(danmakus);
     allDanmakus.append(danmakus);
+    if (!removeTimer->isActive())
+        scheduleRemoveDanmaku();
 }
 
 void MainWindow::appendNewLiveDanmaku(LiveDanmaku danmaku)
@@ -1713,6 +1830,8 @@ void MainWindow::appendNewLiveDanmaku(LiveDanmaku danmaku)
     lastDanmaku = danmaku;
     allDanmakus.append(danmaku);
     newLiveDanmakuAdded(danmaku);
+    if (!removeTimer->isActive())
+        scheduleRemoveDanmaku();
 }
 
 void MainWindow::newLiveDanmakuAdded(LiveDanmaku danmaku)
@@ -1773,6 +1892,14 @@ void MainWindow::sendMsg(QString msg)
 
 void MainWindow::sendRoomMsg(QString roomId, QString msg)
 {
+    LiveMetrics::add(LiveMetrics::MsgSent);
+    if (headless) // 回放测试，只计数
+    {
+        if (ReplayBenchmark::active())
+            ReplayBenchmark::active()->addSent();
+        return ;
+    }
+
     if (browserCookie.isEmpty() || browserData.isEmpty())
     {
         showError("未设置Cookie信息");
@@ -1870,6 +1997,7 @@ void MainWindow::sendAutoMsg(QString msgs, const LiveDanmaku &danmaku)
 
     // 分割与发送
     QStringList sl = msgs.split("\\n", QString::SkipEmptyParts);
+    LiveMetrics::add(LiveMetrics::MsgQueued, quint64(sl.size()));
     autoMsgQueues.append(qMakePair(sl, danmaku));
     if (!autoMsgTimer->isActive() || !inDanmakuCd)
     {
@@ -1887,6 +2015,7 @@ void MainWindow::sendAutoMsgInFirst(QString msgs, const LiveDanmaku &danmaku, in
         return ;
     }
     QStringList sl = msgs.split("\\n", QString::SkipEmptyParts);
+    LiveMetrics::add(LiveMetrics::MsgQueued, quint64(sl.size()));
     autoMsgQueues.insert(0, qMakePair(sl, danmaku));
     if (interval > 0)
     {
@@ -1906,6 +2035,7 @@ void MainWindow::sendAutoMsgInFirst(QString msgs, const LiveDanmaku &danmaku, in
  */
 void MainWindow::slotSendAutoMsg(bool timeout)
 {
+    BenchScope benchScope(ReplayBenchmark::SendQueue, LiveMetrics::SendQueue);
     if (timeout) // 全部发完之后 timer 一定还开着的，最后一次 timeout 清除弹幕发送冷却
         inDanmakuCd = false;
 
@@ -1991,9 +2121,10 @@ void MainWindow::slotSendAutoMsg(bool timeout)
  */
 void MainWindow::sendCdMsg(QString msg, const LiveDanmaku &danmaku, int cd, int channel, bool enableText, bool enableVoice, bool manual)
 {
+    BenchScope benchScope(ReplayBenchmark::SendQueue, LiveMetrics::SendQueue);
     if (!manual && !shallAutoMsg()) // 不在直播中
     {
-        qInfo() << "未开播，不做操作(cd)" << msg;
+        LOG_INF(LiveLog::Send) << "未开播，不做操作(cd)" << msg;
         if (debugPrint)
             localNotify("[未开播，不做操作]");
         return ;
@@ -2060,7 +2191,7 @@ void MainWindow::slotComboSend()
     int delta = ui->giftComboDelaySpin->value();
 
     auto thankGift = [=](LiveDanmaku danmaku) -> bool {
-        QStringList words = getEditConditionStringList(ui->autoThankWordsEdit->toPlainText(), danmaku);
+        QStringList words = getEditConditionStringList(thankWords, danmaku);
         if (words.size())
         {
             int r = qrand() % words.size();
@@ -2185,7 +2316,7 @@ void MainWindow::on_testDanmakuButton_clicked()
         if (ui->saveEveryGiftCheck->isChecked())
             saveEveryGift(danmaku);
 
-        QStringList words = getEditConditionStringList(ui->autoThankWordsEdit->toPlainText(), danmaku);
+        QStringList words = getEditConditionStringList(thankWords, danmaku);
         qInfo() << "条件替换结果：" << words;
 
         triggerCmdEvent("SEND_GIFT", danmaku, true);
@@ -2264,7 +2395,7 @@ void MainWindow::on_testDanmakuButton_clicked()
 
         if (!justStart && ui->autoSendGiftCheck->isChecked())
         {
-            QStringList words = getEditConditionStringList(ui->autoThankWordsEdit->toPlainText(), danmaku);
+            QStringList words = getEditConditionStringList(thankWords, danmaku);
             if (words.size())
             {
                 int r = qrand() % words.size();
@@ -2338,7 +2469,7 @@ void MainWindow::on_testDanmakuButton_clicked()
     }
     else if (text == "测试对面舰长")
     {
-        getPkOnlineGuardPage(0);
+        getPkOnlineGuards();
     }
     else if (text == "测试偷塔")
     {
@@ -2363,6 +2494,7 @@ void MainWindow::on_removeDanmakuIntervalSpin_valueChanged(int arg1)
 {
     this->removeDanmakuInterval = arg1 * 1000;
     settings->setValue("danmaku/removeInterval", arg1);
+    scheduleRemoveDanmaku();
 }
 
 void MainWindow::on_roomIdEdit_editingFinished()
@@ -2444,236 +2576,60 @@ void MainWindow::on_SendMsgEdit_returnPressed()
     ui->SendMsgEdit->clear();
 }
 
-TaskWidget* MainWindow::addTimerTask(bool enable, int second, QString text, int index)
+RuleListItem* MainWindow::addTimerTask(bool enable, int second, QString text, int index)
 {
-    TaskWidget* tw = new TaskWidget(this);
-    QListWidgetItem* item;
-
-    if (index == -1)
-    {
-        item = new QListWidgetItem(ui->taskListWidget);
-        ui->taskListWidget->addItem(item);
-        ui->taskListWidget->setItemWidget(item, tw);
-        // ui->taskListWidget->setCurrentRow(ui->taskListWidget->count()-1);
-    }
-    else
-    {
-        item = new QListWidgetItem();
-        ui->taskListWidget->insertItem(index, item);
-        ui->taskListWidget->setItemWidget(item, tw);
-        ui->taskListWidget->setCurrentRow(index);
-    }
-
-    // 连接信号
-    connect(tw->check, &QCheckBox::stateChanged, this, [=](int){
-        bool enable = tw->check->isChecked();
-        int row = ui->taskListWidget->row(item);
-        settings->setValue("task/r"+QString::number(row)+"Enable", enable);
-    });
-
-    connect(tw, &TaskWidget::spinChanged, this, [=](int val){
-        int row = ui->taskListWidget->row(item);
-        settings->setValue("task/r"+QString::number(row)+"Interval", val);
-    });
-
-    connect(tw->edit, &ConditionEditor::textChanged, this, [=]{
-        item->setSizeHint(tw->sizeHint());
-
-        QString content = tw->edit->toPlainText();
-        int row = ui->taskListWidget->row(item);
-        settings->setValue("task/r"+QString::number(row)+"Msg", content);
-    });
-
-    connect(tw, &TaskWidget::signalSendMsgs, this, [=](QString sl, bool manual){
-        if (!manual && !shallAutoMsg(sl, manual)) // 没有开播，不进行定时任务
-        {
-            qInfo() << "未开播，不做回复(timer)" << sl;
-            if (debugPrint)
-                localNotify("[未开播，不做回复]");
-            return ;
-        }
-        QStringList msgs = getEditConditionStringList(sl, LiveDanmaku());
-        if (msgs.size())
-        {
-            int r = qrand() % msgs.size();
-            QString s = msgs.at(r);
-            if (!s.trimmed().isEmpty())
-            {
-                sendAutoMsg(s, LiveDanmaku());
-            }
-        }
-    });
-
-    connect(tw, &TaskWidget::signalResized, tw, [=]{
-        item->setSizeHint(tw->size());
-    });
-
-    remoteControl = settings->value("danmaku/remoteControl", remoteControl).toBool();
-
-    // 设置属性
-    tw->check->setChecked(enable);
-    tw->spin->setValue(second);
-    tw->slotSpinChanged(second);
-    tw->edit->setPlainText(text);
-    tw->autoResizeEdit();
-    tw->adjustSize();
-
-    return tw;
+    RuleListItem* item = new RuleListItem(RuleListItem::TimerTask);
+    item->setEnabled(enable);
+    item->setInterval(second);
+    item->setBody(text);
+    insertRuleItem(ui->taskListWidget, item, index);
+    return item;
 }
 
-TaskWidget *MainWindow::addTimerTask(MyJson json)
+RuleListItem *MainWindow::addTimerTask(MyJson json)
 {
-    auto item = addTimerTask(false, 1800, "");
+    RuleListItem* item = new RuleListItem(RuleListItem::TimerTask);
     item->fromJson(json);
+    insertRuleItem(ui->taskListWidget, item, -1);
     return item;
 }
 
 void MainWindow::saveTaskList()
 {
-    settings->setValue("task/count", ui->taskListWidget->count());
-    for (int row = 0; row < ui->taskListWidget->count(); row++)
-    {
-        auto widget = ui->taskListWidget->itemWidget(ui->taskListWidget->item(row));
-        auto tw = static_cast<TaskWidget*>(widget);
-        settings->setValue("task/r"+QString::number(row)+"Enable", tw->check->isChecked());
-        settings->setValue("task/r"+QString::number(row)+"Interval", tw->spin->value());
-        settings->setValue("task/r"+QString::number(row)+"Msg", tw->edit->toPlainText());
-    }
+    saveRuleList(ui->taskListWidget, "task");
 }
 
 void MainWindow::restoreTaskList()
 {
-    int count = settings->value("task/count", 0).toInt();
-    for (int row = 0; row < count; row++)
-    {
-        bool enable = settings->value("task/r"+QString::number(row)+"Enable", false).toBool();
-        int interval = settings->value("task/r"+QString::number(row)+"Interval", 1800).toInt();
-        QString msg = settings->value("task/r"+QString::number(row)+"Msg", "").toString();
-        addTimerTask(enable, interval, msg);
-    }
+    restoreRuleList(ui->taskListWidget, RuleListItem::TimerTask, "task");
 }
 
-ReplyWidget* MainWindow::addAutoReply(bool enable, QString key, QString reply, int index)
+RuleListItem* MainWindow::addAutoReply(bool enable, QString key, QString reply, int index)
 {
-    ReplyWidget* rw = new ReplyWidget(this);
-    QListWidgetItem* item;
-
-    if (index == -1)
-    {
-        item = new QListWidgetItem(ui->replyListWidget);
-        ui->replyListWidget->addItem(item);
-        ui->replyListWidget->setItemWidget(item, rw);
-        // ui->replyListWidget->setCurrentRow(ui->replyListWidget->count()-1);
-    }
-    else
-    {
-        item = new QListWidgetItem();
-        ui->replyListWidget->insertItem(index, item);
-        ui->replyListWidget->setItemWidget(item, rw);
-        ui->replyListWidget->setCurrentRow(index);
-    }
-
-    // 连接信号
-    connect(rw->check, &QCheckBox::stateChanged, this, [=](int){
-        bool enable = rw->check->isChecked();
-        int row = ui->replyListWidget->row(item);
-        settings->setValue("reply/r"+QString::number(row)+"Enable", enable);
-    });
-
-    connect(rw->keyEdit, &QLineEdit::textChanged, this, [=](const QString& text){
-        int row = ui->replyListWidget->row(item);
-        settings->setValue("reply/r"+QString::number(row)+"Key", text);
-    });
-
-    connect(rw->replyEdit, &ConditionEditor::textChanged, this, [=]{
-        item->setSizeHint(rw->sizeHint());
-
-        QString content = rw->replyEdit->toPlainText();
-        int row = ui->replyListWidget->row(item);
-        settings->setValue("reply/r"+QString::number(row)+"Reply", content);
-    });
-
-    connect(this, SIGNAL(signalNewDanmaku(LiveDanmaku)), rw, SLOT(slotNewDanmaku(LiveDanmaku)));
-
-    connect(rw, &ReplyWidget::signalReplyMsgs, this, [=](QString sl, LiveDanmaku danmaku, bool manual){
-        if (!hasPermission())
-            return ;
-        if (isFilterRejected("FILTER_AUTO_REPLY", danmaku))
-            return ;
-        if ((!manual && !shallAutoMsg(sl, manual)) || danmaku.isPkLink()) // 没有开播，不进行自动回复
-        {
-            if (!danmaku.isPkLink())
-                qInfo() << "未开播，不做回复(reply)" << sl;
-            if (debugPrint)
-                localNotify("[未开播，不做回复]");
-            return ;
-        }
-        QStringList msgs = getEditConditionStringList(sl, danmaku);
-        if (msgs.size())
-        {
-            int r = qrand() % msgs.size();
-            QString s = msgs.at(r);
-            if (!s.trimmed().isEmpty())
-            {
-                if (QString::number(danmaku.getUid()) == this->cookieUid) // 自己发的，自己回复，必须要延迟一会儿
-                {
-                    if (s.contains(QRegExp("\\(\\s*cd\\d+\\s*:\\s*\\d+\\s*\\)"))) // 带冷却通道，不能放前面
-                        autoMsgTimer->start(); // 先启动，避免立即发送
-                    else
-                        s = "\\n" + s; // 延迟一次发送的时间
-                }
-                sendCdMsg(s, danmaku, 0, REPLY_CD_CN, true, false, manual);
-            }
-        }
-    });
-
-    connect(rw, &ReplyWidget::signalResized, rw, [=]{
-        item->setSizeHint(rw->size());
-    });
-
-    remoteControl = settings->value("danmaku/remoteControl", remoteControl).toBool();
-
-    // 设置属性
-    rw->check->setChecked(enable);
-    rw->keyEdit->setText(key);
-    rw->replyEdit->setPlainText(reply);
-    rw->autoResizeEdit();
-    rw->adjustSize();
-    item->setSizeHint(rw->sizeHint());
-
-    return rw;
+    RuleListItem* item = new RuleListItem(RuleListItem::AutoReply);
+    item->setEnabled(enable);
+    item->setTitle(key);
+    item->setBody(reply);
+    insertRuleItem(ui->replyListWidget, item, index);
+    return item;
 }
 
-ReplyWidget *MainWindow::addAutoReply(MyJson json)
+RuleListItem *MainWindow::addAutoReply(MyJson json)
 {
-    auto item = addAutoReply(false, "", "");
+    RuleListItem* item = new RuleListItem(RuleListItem::AutoReply);
     item->fromJson(json);
+    insertRuleItem(ui->replyListWidget, item, -1);
     return item;
 }
 
 void MainWindow::saveReplyList()
 {
-    settings->setValue("reply/count", ui->replyListWidget->count());
-    for (int row = 0; row < ui->replyListWidget->count(); row++)
-    {
-        auto widget = ui->replyListWidget->itemWidget(ui->replyListWidget->item(row));
-        auto tw = static_cast<ReplyWidget*>(widget);
-        settings->setValue("reply/r"+QString::number(row)+"Enable", tw->check->isChecked());
-        settings->setValue("reply/r"+QString::number(row)+"Key", tw->keyEdit->text());
-        settings->setValue("reply/r"+QString::number(row)+"Reply", tw->replyEdit->toPlainText());
-    }
+    saveRuleList(ui->replyListWidget, "reply");
 }
 
 void MainWindow::restoreReplyList()
 {
-    int count = settings->value("reply/count", 0).toInt();
-    for (int row = 0; row < count; row++)
-    {
-        bool enable = settings->value("reply/r"+QString::number(row)+"Enable", false).toBool();
-        QString key = settings->value("reply/r"+QString::number(row)+"Key").toString();
-        QString reply = settings->value("reply/r"+QString::number(row)+"Reply").toString();
-        addAutoReply(enable, key, reply);
-    }
+    restoreRuleList(ui->replyListWidget, RuleListItem::AutoReply, "reply");
 }
 
 void MainWindow::addListItemOnCurrentPage()
@@ -2681,10 +2637,10 @@ void MainWindow::addListItemOnCurrentPage()
     auto w = ui->tabWidget->currentWidget();
     if (w == ui->tabTimer)
     {
-        addTimerTask(false, 1800, "");
+        auto item = addTimerTask(false, 1800, "");
+        ui->taskListWidget->setCurrentItem(item); // 新行保持控件，不被滚动释放
         saveTaskList();
-        auto widget = ui->taskListWidget->itemWidget(ui->taskListWidget->item(ui->taskListWidget->count()-1));
-        auto tw = static_cast<TaskWidget*>(widget);
+        auto tw = static_cast<TaskWidget*>(ensureRuleWidget(item));
         QTimer::singleShot(0, [=]{
             ui->taskListWidget->scrollToBottom();
         });
@@ -2692,10 +2648,10 @@ void MainWindow::addListItemOnCurrentPage()
     }
     else if (w == ui->tabReply)
     {
-        addAutoReply(false, "", "");
+        auto item = addAutoReply(false, "", "");
+        ui->replyListWidget->setCurrentItem(item); // 新行保持控件，不被滚动释放
         saveReplyList();
-        auto widget = ui->replyListWidget->itemWidget(ui->replyListWidget->item(ui->replyListWidget->count()-1));
-        auto rw = static_cast<ReplyWidget*>(widget);
+        auto rw = static_cast<ReplyWidget*>(ensureRuleWidget(item));
         QTimer::singleShot(0, [=]{
             ui->replyListWidget->scrollToBottom();
         });
@@ -2703,10 +2659,10 @@ void MainWindow::addListItemOnCurrentPage()
     }
     else if (w == ui->tabEvent)
     {
-        addEventAction(false, "", "");
+        auto item = addEventAction(false, "", "");
+        ui->eventListWidget->setCurrentItem(item); // 新行保持控件，不被滚动释放
         saveEventList();
-        auto widget = ui->eventListWidget->itemWidget(ui->eventListWidget->item(ui->eventListWidget->count()-1));
-        auto ew = static_cast<EventWidget*>(widget);
+        auto ew = static_cast<EventWidget*>(ensureRuleWidget(item));
         QTimer::singleShot(0, [=]{
             ui->eventListWidget->scrollToBottom();
         });
@@ -2714,139 +2670,402 @@ void MainWindow::addListItemOnCurrentPage()
     }
 }
 
-EventWidget* MainWindow::addEventAction(bool enable, QString cmd, QString action, int index)
+RuleListItem* MainWindow::addEventAction(bool enable, QString cmd, QString action, int index)
+{
+    RuleListItem* item = new RuleListItem(RuleListItem::EventAction);
+    item->setEnabled(enable);
+    item->setTitle(cmd);
+    item->setBody(action);
+    insertRuleItem(ui->eventListWidget, item, index);
+    return item;
+}
+
+RuleListItem* MainWindow::addEventAction(MyJson json)
+{
+    RuleListItem* item = new RuleListItem(RuleListItem::EventAction);
+    item->fromJson(json);
+    insertRuleItem(ui->eventListWidget, item, -1);
+    return item;
+}
+
+void MainWindow::saveEventList()
+{
+    saveRuleList(ui->eventListWidget, "event");
+}
+
+void MainWindow::restoreEventList()
+{
+    restoreRuleList(ui->eventListWidget, RuleListItem::EventAction, "event");
+}
+
+bool MainWindow::hasEvent(QString cmd) const
 {
-    EventWidget* rw = new EventWidget(this);
-    QListWidgetItem* item;
+    for (int row = 0; row < ui->eventListWidget->count(); row++)
+    {
+        auto item = RuleListItem::from(ui->eventListWidget->item(row));
+        if (item->getTitle() == cmd && item->isEnabled())
+            return true;
+    }
+    return false;
+}
 
+/**
+ * 添加一行规则，只放数据，控件等滚动到可见时再创建
+ * @param index -1 表示添加到末尾
+ */
+void MainWindow::insertRuleItem(QListWidget *listWidget, RuleListItem *item, int index)
+{
+    item->setSizeHint(estimateRuleItemSize(listWidget, item));
     if (index == -1)
     {
-        item = new QListWidgetItem(ui->eventListWidget);
-        ui->eventListWidget->addItem(item);
-        ui->eventListWidget->setItemWidget(item, rw);
-        // ui->eventListWidget->setCurrentRow(ui->eventListWidget->count()-1);
+        listWidget->addItem(item);
     }
     else
     {
-        item = new QListWidgetItem();
-        ui->eventListWidget->insertItem(index, item);
-        ui->eventListWidget->setItemWidget(item, rw);
-        ui->eventListWidget->setCurrentRow(index);
+        listWidget->insertItem(index, item);
+        listWidget->setCurrentRow(index);
+    }
+
+    if (item->getKind() == RuleListItem::TimerTask)
+        updateTaskTimer(item);
+}
+
+void MainWindow::saveRuleList(QListWidget *listWidget, QString group)
+{
+    settings->setValue(group + "/count", listWidget->count());
+    for (int row = 0; row < listWidget->count(); row++)
+        RuleListItem::from(listWidget->item(row))->writeSettings(settings, row);
+}
+
+void MainWindow::restoreRuleList(QListWidget *listWidget, RuleListItem::RuleKind kind, QString group)
+{
+    int count = settings->value(group + "/count", 0).toInt();
+    for (int row = 0; row < count; row++)
+    {
+        RuleListItem* item = new RuleListItem(kind);
+        item->readSettings(settings, row);
+        insertRuleItem(listWidget, item, -1);
     }
+}
 
-    // 连接信号
-    connect(rw->check, &QCheckBox::stateChanged, this, [=](int){
-        bool enable = rw->check->isChecked();
-        int row = ui->eventListWidget->row(item);
-        settings->setValue("event/r"+QString::number(row)+"Enable", enable);
+/**
+ * 保存单独一行（编辑控件修改后）
+ */
+void MainWindow::saveRuleItem(RuleListItem *item)
+{
+    QListWidget* listWidget = item->listWidget();
+    if (!listWidget)
+        return ;
+    item->writeSettings(settings, listWidget->row(item));
+}
+
+/**
+ * 代码中修改了规则的数据后，同步到控件、配置和定时器
+ */
+void MainWindow::refreshRuleItem(RuleListItem *item)
+{
+    QListWidget* listWidget = item->listWidget();
+    if (listWidget)
+    {
+        auto widget = listWidget->itemWidget(item);
+        if (widget)
+            item->fillWidget(static_cast<ListItemInterface*>(widget));
+    }
+    saveRuleItem(item);
+    if (item->getKind() == RuleListItem::TimerTask)
+        updateTaskTimer(item);
+}
+
+/**
+ * 还没有创建控件的行，按文本的行数估计高度
+ * 和各控件 autoResizeEdit 的算法大致相同，创建控件后以实际大小为准
+ */
+QSize MainWindow::estimateRuleItemSize(QListWidget *listWidget, const RuleListItem *item) const
+{
+    QFontMetrics fm(listWidget->font());
+    int line = fm.lineSpacing();
+    int header = line + 12; // 启用、发送按钮
+    if (item->getKind() != RuleListItem::TimerTask)
+        header += line + 12; // 关键词、事件命令
+    int lines = item->getBody().count("\n") + 1;
+    int margin = 9 * 2 + 9 * 2 + 6 * 2; // 卡片边距、布局边距、间距
+    int width = listWidget->contentsRect().width() - listWidget->verticalScrollBar()->width();
+    return QSize(width, header + line * (lines + 1) + margin);
+}
+
+/**
+ * 获取一行的编辑控件，还没有时创建
+ */
+ListItemInterface *MainWindow::ensureRuleWidget(RuleListItem *item)
+{
+    QListWidget* listWidget = item->listWidget();
+    auto exists = listWidget->itemWidget(item);
+    if (exists)
+        return static_cast<ListItemInterface*>(exists);
+
+    ListItemInterface* widget = item->createWidget(listWidget);
+    widget->resize(listWidget->contentsRect().width() - listWidget->verticalScrollBar()->width(), widget->height());
+    widget->autoResizeEdit();
+    listWidget->setItemWidget(item, widget);
+    item->setSizeHint(widget->sizeHint());
+
+    // 控件的修改写回数据
+    connect(widget->check, &QCheckBox::stateChanged, this, [=](int){
+        item->setEnabled(widget->check->isChecked());
+        saveRuleItem(item);
+        if (item->getKind() == RuleListItem::TimerTask)
+            updateTaskTimer(item);
     });
 
-    connect(rw->eventEdit, &QLineEdit::textChanged, this, [=](const QString& text){
-        int row = ui->eventListWidget->row(item);
-        settings->setValue("event/r"+QString::number(row)+"Cmd", text);
+    connect(widget, &ListItemInterface::signalResized, widget, [=]{
+        item->setSizeHint(widget->size());
     });
 
-    connect(rw->actionEdit, &ConditionEditor::textChanged, this, [=]{
-        item->setSizeHint(rw->sizeHint());
+    if (item->getKind() == RuleListItem::TimerTask)
+    {
+        auto tw = static_cast<TaskWidget*>(widget);
+        connect(tw, &TaskWidget::spinChanged, this, [=](int val){
+            item->setInterval(val);
+            saveRuleItem(item);
+            updateTaskTimer(item);
+        });
+
+        connect(tw->edit, &ConditionEditor::textChanged, this, [=]{
+            item->setSizeHint(tw->sizeHint());
+            item->setBody(tw->edit->toPlainText());
+            saveRuleItem(item);
+        });
 
-        QString content = rw->actionEdit->toPlainText();
-        int row = ui->eventListWidget->row(item);
-        settings->setValue("event/r"+QString::number(row)+"Action", content);
+        connect(tw, &TaskWidget::signalSendMsgs, this, [=](QString sl, bool manual){
+            sendTaskMsgs(sl, manual);
+        });
+    }
+    else if (item->getKind() == RuleListItem::AutoReply)
+    {
+        auto rw = static_cast<ReplyWidget*>(widget);
+        connect(rw->keyEdit, &QLineEdit::textChanged, this, [=](const QString& text){
+            item->setTitle(text);
+            saveRuleItem(item);
+        });
 
-        /* // 处理特殊操作，比如过滤器
-        QString event = rw->title();
-        if (!event.isEmpty())
-        {
-            setFilter(event, content);
-        } */
-    });
+        connect(rw->replyEdit, &ConditionEditor::textChanged, this, [=]{
+            item->setSizeHint(rw->sizeHint());
+            item->setBody(rw->replyEdit->toPlainText());
+            saveRuleItem(item);
+        });
 
-    connect(this, SIGNAL(signalCmdEvent(QString, LiveDanmaku)), rw, SLOT(triggerCmdEvent(QString,LiveDanmaku)));
+        connect(rw, &ReplyWidget::signalReplyMsgs, this, [=](QString sl, LiveDanmaku danmaku, bool manual){
+            sendReplyMsgs(sl, danmaku, manual);
+        });
+    }
+    else if (item->getKind() == RuleListItem::EventAction)
+    {
+        auto ew = static_cast<EventWidget*>(widget);
+        connect(ew->eventEdit, &QLineEdit::textChanged, this, [=](const QString& text){
+            item->setTitle(text);
+            saveRuleItem(item);
+        });
 
-    connect(rw, &EventWidget::signalEventMsgs, this, [=](QString sl, LiveDanmaku danmaku, bool manual){
-        if (!hasPermission())
-            return ;
-        if (!manual && !shallAutoMsg(sl, manual)) // 没有开播，不进行自动回复
-        {
-            qInfo() << "未开播，不做操作(event)" << sl;
-            if (debugPrint)
-                localNotify("[未开播，不做操作]");
-            return ;
-        }
-        if (!isLiving() && !manual)
-            manual = true;
+        connect(ew->actionEdit, &ConditionEditor::textChanged, this, [=]{
+            item->setSizeHint(ew->sizeHint());
+            item->setBody(ew->actionEdit->toPlainText());
+            saveRuleItem(item);
+        });
 
-        QStringList msgs = getEditConditionStringList(sl, danmaku);
-        if (msgs.size())
-        {
-            int r = qrand() % msgs.size();
-            QString s = msgs.at(r);
-            if (!s.trimmed().isEmpty())
-            {
-                sendCdMsg(s, danmaku, 0, EVENT_CD_CN, true, false, manual);
-            }
-        }
-    });
+        connect(ew, &EventWidget::signalEventMsgs, this, [=](QString sl, LiveDanmaku danmaku, bool manual){
+            sendEventMsgs(sl, danmaku, manual);
+        });
+    }
 
-    connect(rw, &EventWidget::signalResized, rw, [=]{
-        item->setSizeHint(rw->size());
-    });
+    return widget;
+}
 
-    remoteControl = settings->value("danmaku/remoteControl", remoteControl).toBool();
+/**
+ * 为列表中可见的行创建编辑控件，并释放滚出可见范围的
+ * 上下各多保留一屏，来回小幅滚动时不用反复创建；
+ * 控件的修改都已实时写回 RuleListItem，释放后数据不丢，行高沿用控件最后的大小
+ */
+void MainWindow::loadVisibleRuleWidgets(QListWidget *listWidget)
+{
+    if (!listWidget->isVisible())
+        return ;
 
-    // 设置属性
-    rw->check->setChecked(enable);
-    rw->eventEdit->setText(cmd);
-    rw->actionEdit->setPlainText(action);
-    rw->autoResizeEdit();
-    rw->adjustSize();
-    item->setSizeHint(rw->sizeHint());
+    QRect visible = listWidget->viewport()->rect();
+    QListWidgetItem* first = listWidget->itemAt(visible.topLeft() + QPoint(1, 1));
+    for (int row = first ? listWidget->row(first) : 0; row < listWidget->count(); row++)
+    {
+        QListWidgetItem* item = listWidget->item(row);
+        QRect rect = listWidget->visualItemRect(item);
+        if (rect.top() > visible.bottom())
+            break;
+        if (rect.bottom() < visible.top() || listWidget->itemWidget(item))
+            continue;
+        ensureRuleWidget(RuleListItem::from(item));
+    }
+
+    // 释放范围外的控件，正在编辑的（有焦点或当前行）保留
+    QRect keep = visible.adjusted(0, -visible.height(), 0, visible.height());
+    QWidget* focus = QApplication::focusWidget();
+    for (int row = 0; row < listWidget->count(); row++)
+    {
+        QListWidgetItem* item = listWidget->item(row);
+        QWidget* widget = listWidget->itemWidget(item);
+        if (!widget || item == listWidget->currentItem())
+            continue;
+        if (focus && (focus == widget || widget->isAncestorOf(focus)))
+            continue;
+        if (listWidget->visualItemRect(item).intersects(keep))
+            continue;
+        listWidget->removeItemWidget(item); // 会删除控件，连接随之断开
+    }
+}
 
-    return rw;
+/**
+ * 开启的定时任务按当前间隔重新计时，关闭的停止
+ */
+void MainWindow::updateTaskTimer(RuleListItem *item)
+{
+    if (item->isEnabled())
+        startTaskTimer(item);
+    else
+        item->stopTimer();
 }
 
-EventWidget* MainWindow::addEventAction(MyJson json)
+void MainWindow::startTaskTimer(RuleListItem *item)
 {
-    auto item = addEventAction(false, "", "");
-    item->fromJson(json);
-    return item;
+    item->startTimer(this, [=]{
+        sendTaskMsgs(item->getBody(), false);
+    });
 }
 
-void MainWindow::saveEventList()
+void MainWindow::sendTaskMsgs(QString sl, bool manual)
 {
-    settings->setValue("event/count", ui->eventListWidget->count());
-    for (int row = 0; row < ui->eventListWidget->count(); row++)
+    if (!manual && !shallAutoMsg(sl, manual)) // 没有开播，不进行定时任务
     {
-        auto widget = ui->eventListWidget->itemWidget(ui->eventListWidget->item(row));
-        auto tw = static_cast<EventWidget*>(widget);
-        settings->setValue("event/r"+QString::number(row)+"Enable", tw->check->isChecked());
-        settings->setValue("event/r"+QString::number(row)+"Cmd", tw->eventEdit->text());
-        settings->setValue("event/r"+QString::number(row)+"Action", tw->actionEdit->toPlainText());
+        LOG_INF(LiveLog::Reply) << "未开播，不做回复(timer)" << sl;
+        if (debugPrint)
+            localNotify("[未开播，不做回复]");
+        return ;
+    }
+    QStringList msgs = getEditConditionStringList(sl, LiveDanmaku());
+    if (msgs.size())
+    {
+        int r = qrand() % msgs.size();
+        QString s = msgs.at(r);
+        if (!s.trimmed().isEmpty())
+        {
+            sendAutoMsg(s, LiveDanmaku());
+        }
     }
 }
 
-void MainWindow::restoreEventList()
+void MainWindow::sendReplyMsgs(QString sl, LiveDanmaku danmaku, bool manual)
 {
-    int count = settings->value("event/count", 0).toInt();
-    for (int row = 0; row < count; row++)
+    if (!hasPermission())
+        return ;
+    if (isFilterRejected("FILTER_AUTO_REPLY", danmaku))
+        return ;
+    if ((!manual && !shallAutoMsg(sl, manual)) || danmaku.isPkLink()) // 没有开播，不进行自动回复
     {
-        bool enable = settings->value("event/r"+QString::number(row)+"Enable", false).toBool();
-        QString key = settings->value("event/r"+QString::number(row)+"Cmd").toString();
-        QString event = settings->value("event/r"+QString::number(row)+"Action").toString();
-        addEventAction(enable, key, event);
+        if (!danmaku.isPkLink())
+            LOG_INF(LiveLog::Reply) << "未开播，不做回复(reply)" << sl;
+        if (debugPrint)
+            localNotify("[未开播，不做回复]");
+        return ;
+    }
+    QStringList msgs = getEditConditionStringList(sl, danmaku);
+    if (msgs.size())
+    {
+        int r = qrand() % msgs.size();
+        QString s = msgs.at(r);
+        if (!s.trimmed().isEmpty())
+        {
+            if (QString::number(danmaku.getUid()) == this->cookieUid) // 自己发的，自己回复，必须要延迟一会儿
+            {
+                if (s.contains(QRegExp("\\(\\s*cd\\d+\\s*:\\s*\\d+\\s*\\)"))) // 带冷却通道，不能放前面
+                    autoMsgTimer->start(); // 先启动，避免立即发送
+                else
+                    s = "\\n" + s; // 延迟一次发送的时间
+            }
+            sendCdMsg(s, danmaku, 0, REPLY_CD_CN, true, false, manual);
+        }
     }
 }
 
-bool MainWindow::hasEvent(QString cmd) const
+void MainWindow::sendEventMsgs(QString sl, LiveDanmaku danmaku, bool manual)
+{
+    if (!hasPermission())
+        return ;
+    if (!manual && !shallAutoMsg(sl, manual)) // 没有开播，不进行自动回复
+    {
+        LOG_INF(LiveLog::Reply) << "未开播，不做操作(event)" << sl;
+        if (debugPrint)
+            localNotify("[未开播，不做操作]");
+        return ;
+    }
+    if (!isLiving() && !manual)
+        manual = true;
+
+    QStringList msgs = getEditConditionStringList(sl, danmaku);
+    if (msgs.size())
+    {
+        int r = qrand() % msgs.size();
+        QString s = msgs.at(r);
+        if (!s.trimmed().isEmpty())
+        {
+            sendCdMsg(s, danmaku, 0, EVENT_CD_CN, true, false, manual);
+        }
+    }
+}
+
+/**
+ * 新弹幕匹配所有开启的自动回复
+ */
+void MainWindow::triggerAutoReply(LiveDanmaku danmaku)
+{
+    if (!danmaku.is(MSG_DANMAKU) || danmaku.isNoReply())
+        return ;
+
+    // 先匹配完，再逐个回复
+    BenchScope matchScope(ReplayBenchmark::ReplyMatch, LiveMetrics::ReplyMatch);
+    QList<QPair<RuleListItem*, QStringList>> matched;
+    int evaluated = 0;
+    for (int row = 0; row < ui->replyListWidget->count(); row++)
+    {
+        auto item = RuleListItem::from(ui->replyListWidget->item(row));
+        if (!item->isEnabled())
+            continue;
+        evaluated++;
+        QStringList args;
+        if (!item->matchReply(danmaku.getText(), &args))
+            continue;
+        matched.append(qMakePair(item, args));
+    }
+    matchScope.finish();
+    LiveMetrics::add(LiveMetrics::RulesEvaluated, quint64(evaluated));
+    LiveMetrics::add(LiveMetrics::RulesMatched, quint64(matched.size()));
+
+    for (int i = 0; i < matched.size(); i++)
+    {
+        LiveDanmaku dm = danmaku;
+        dm.setArgs(matched.at(i).second);
+        sendReplyMsgs(matched.at(i).first->getBody(), dm, false);
+    }
+}
+
+/**
+ * 执行所有开启的、命令相同的事件动作
+ */
+void MainWindow::triggerEventActions(QString cmd, LiveDanmaku danmaku)
 {
     for (int row = 0; row < ui->eventListWidget->count(); row++)
     {
-        auto widget = ui->eventListWidget->itemWidget(ui->eventListWidget->item(row));
-        auto tw = static_cast<EventWidget*>(widget);
-        if (tw->eventEdit->text() == cmd && tw->check->isChecked())
-            return true;
+        auto item = RuleListItem::from(ui->eventListWidget->item(row));
+        if (!item->isEnabled() || item->getTitle() != cmd)
+            continue;
+        LOG_DEB(LiveLog::Reply) << "响应事件：" << cmd;
+        sendEventMsgs(item->getBody(), danmaku, false);
     }
-    return false;
 }
 
 void MainWindow::autoSetCookie(QString s)
@@ -3177,7 +3396,6 @@ void MainWindow::getRoomUserInfo()
     });
 }
 
-template<class T>
 void MainWindow::showListMenu(QListWidget *listWidget, QString listKey, VoidFunc saveFunc)
 {
     QListWidgetItem* item = listWidget->currentItem();
@@ -3209,24 +3427,13 @@ void MainWindow::showListMenu(QListWidget *listWidget, QString listKey, VoidFunc
     }
 
     auto moveToRow = [=](int newRow){
-        auto widget = listWidget->itemWidget(item);
-        auto tw = static_cast<ListItemInterface*>(widget);
-        MyJson json = tw->toJson();
+        // 移出列表时控件会被删除，数据还在，插入后重新创建
         listWidget->takeItem(row);
-        delete item;
-        tw->deleteLater();
-
-        auto newTw = new T(listWidget);
-        newTw->fromJson(json);
-
-        QListWidgetItem* newItem = new QListWidgetItem;
-        listWidget->insertItem(newRow, newItem);
-        listWidget->setItemWidget(newItem, newTw);
-        newTw->autoResizeEdit();
-        newItem->setSizeHint(newTw->sizeHint());
+        listWidget->insertItem(newRow, item);
 
         (this->*saveFunc)();
         listWidget->setCurrentRow(newRow);
+        loadVisibleRuleWidgets(listWidget);
     };
 
     auto menu = new FacileMenu(this);
@@ -3246,14 +3453,10 @@ void MainWindow::showListMenu(QListWidget *listWidget, QString listKey, VoidFunc
         moveToRow(row + 1);
     })->disable(!item || row >= listWidget->count()-1);
     menu->split()->addAction("复制 (&c)", [=]{
-        auto widget = listWidget->itemWidget(item);
-        auto tw = static_cast<ListItemInterface*>(widget);
-        QApplication::clipboard()->setText(tw->toJson().toBa());
+        QApplication::clipboard()->setText(RuleListItem::from(item)->toJson().toBa());
     })->disable(!item);
     menu->addAction("继续复制", [=]{
-        auto widget = listWidget->itemWidget(item);
-        auto tw = static_cast<ListItemInterface*>(widget);
-        MyJson twJson = tw->toJson();
+        MyJson twJson = RuleListItem::from(item)->toJson();
         if (!clipArray.isEmpty()) // 已经是JSON数组了，继续复制
         {
             QJsonArray array = clipArray;
@@ -3269,44 +3472,42 @@ void MainWindow::showListMenu(QListWidget *listWidget, QString listKey, VoidFunc
         }
     })->disable(!item)->hide(!canContinueCopy);
     menu->addAction("粘贴 (&v)", [=]{
-        auto widget = listWidget->itemWidget(item);
-        auto tw = static_cast<ListItemInterface*>(widget);
-        tw->fromJson(clipJson);
+        auto ruleItem = RuleListItem::from(item);
+        ruleItem->fromJson(clipJson);
+        refreshRuleItem(ruleItem);
 
         (this->*saveFunc)();
     })->disable(!canPaste);
     menu->split()->addAction("删除 (&d)", [=]{
-        auto widget = listWidget->itemWidget(item);
-        auto tw = static_cast<ListItemInterface*>(widget);
-
         // 特殊操作
         /* if (listKey == CODE_EVENT_ACTION_KEY)
         {
-            setFilter(tw->title(), "");
+            setFilter(RuleListItem::from(item)->getTitle(), "");
         } */
 
         listWidget->removeItemWidget(item);
-        listWidget->takeItem(listWidget->currentRow());
+        listWidget->takeItem(listWidget->row(item));
+        delete item; // 同时停止定时任务
 
         (this->*saveFunc)();
-        tw->deleteLater();
+        loadVisibleRuleWidgets(listWidget);
     })->disable(!item);
     menu->exec();
 }
 
 void MainWindow::on_taskListWidget_customContextMenuRequested(const QPoint &)
 {
-    showListMenu<TaskWidget>(ui->taskListWidget, CODE_TIMER_TASK_KEY, &MainWindow::saveTaskList);
+    showListMenu(ui->taskListWidget, CODE_TIMER_TASK_KEY, &MainWindow::saveTaskList);
 }
 
 void MainWindow::on_replyListWidget_customContextMenuRequested(const QPoint &)
 {
-    showListMenu<ReplyWidget>(ui->replyListWidget, CODE_AUTO_REPLY_KEY, &MainWindow::saveReplyList);
+    showListMenu(ui->replyListWidget, CODE_AUTO_REPLY_KEY, &MainWindow::saveReplyList);
 }
 
 void MainWindow::on_eventListWidget_customContextMenuRequested(const QPoint &)
 {
-    showListMenu<EventWidget>(ui->eventListWidget, CODE_EVENT_ACTION_KEY, &MainWindow::saveEventList);
+    showListMenu(ui->eventListWidget, CODE_EVENT_ACTION_KEY, &MainWindow::saveEventList);
 }
 
 void MainWindow::slotDiange(LiveDanmaku danmaku)
@@ -3441,9 +3642,7 @@ void MainWindow::initWS()
             // 保存到CMDS里
             if (saveRecvCmds && saveCmdsFile)
             {
-                QByteArray ba = message;
-                ba.replace("\n", "__bmd__n__").replace("\r", "__bmd__r__");
-                saveCmdsFile->write(ba);
+                saveCmdsFile->write(ReplayBenchmark::encodeLine(message, QDateTime::currentMSecsSinceEpoch()));
                 saveCmdsFile->write("\n");
             }
         } catch (...) {
@@ -3509,9 +3708,9 @@ void MainWindow::initWS()
         }
     });
 
-    xliveHeartBeatTimer = new QTimer(this);
+    xliveHeartBeatTimer = new WheelTimer("直播心跳", this);
     xliveHeartBeatTimer->setInterval(60000);
-    connect(xliveHeartBeatTimer, &QTimer::timeout, this, [=]{
+    connect(xliveHeartBeatTimer, &WheelTimer::timeout, this, [=]{
         if (isLiving())
             sendXliveHeartBeatX();
     });
@@ -3533,6 +3732,7 @@ void MainWindow::startConnectRoom()
     QDir dir;
     dir.mkdir(dataPath+"danmaku_counts");
     danmakuCounts = new QSettings(dataPath+"danmaku_counts/" + roomId + ".ini", QSettings::Format::IniFormat);
+    analytics->setRoomId(roomId);
     if (ui->calculateDailyDataCheck->isChecked())
         startCalculateDailyData();
 
@@ -3560,7 +3760,7 @@ void MainWindow::sendXliveHeartBeatE()
     // 设置数据（JSON的ByteArray）
     QStringList datas;
     datas << "id=" + QString("[%1,%2,%3,%4]").arg(parentAreaId).arg(areaId).arg(xliveHeartBeatIndex).arg(roomId);
-    datas << "device=[\"AUTO4115984068636104\",\"f5f08e2f-e4e3-4156-8127-616f79a17e1a\"]";
+    datas << "device=" + QString("[\"%1\",\"%2\"]").arg(HEARTBEAT_BUVID).arg(HEARTBEAT_UUID);
     datas << "ts=" + snum(QDateTime::currentMSecsSinceEpoch());
     datas << "is_patch=0";
     datas << "heart_beat=[]";
@@ -3604,13 +3804,30 @@ void MainWindow::sendXliveHeartBeatE()
     });
 }
 
-void MainWindow::sendXliveHeartBeatX()
-{
-    qint64 timestamp = QDateTime::currentMSecsSinceEpoch();
-    // 获取加密的数据
+void MainWindow::sendXliveHeartBeatX()
+{
+    qint64 timestamp = QDateTime::currentMSecsSinceEpoch();
+
+    // 本地计算签名
+    if (HeartbeatSigner::isRuleSupported(xliveHeartBeatSecretRule))
+    {
+        HeartbeatSigner::Payload payload;
+        payload.parentAreaId = parentAreaId.toLongLong();
+        payload.areaId = areaId.toLongLong();
+        payload.seq = ++xliveHeartBeatIndex;
+        payload.roomId = roomId.toLongLong();
+        payload.ets = xliveHeartBeatEts;
+        payload.time = xliveHeartBeatInterval;
+        payload.ts = timestamp;
+        sendXliveHeartBeatX(HeartbeatSigner::sign(payload, xliveHeartBeatBenchmark, xliveHeartBeatSecretRule), timestamp);
+        return ;
+    }
+
+    // 出现未知的加密方式，才交给服务端计算
+    qWarning() << "未知的直播心跳加密方式：" << xliveHeartBeatSecretRule;
     QJsonObject postData;
     postData.insert("id",  QString("[%1,%2,%3,%4]").arg(parentAreaId).arg(areaId).arg(++xliveHeartBeatIndex).arg(roomId));
-    postData.insert("device", "[\"AUTO4115984068636104\",\"f5f08e2f-e4e3-4156-8127-616f79a17e1a\"]");
+    postData.insert("device", QString("[\"%1\",\"%2\"]").arg(HEARTBEAT_BUVID).arg(HEARTBEAT_UUID));
     postData.insert("ts", timestamp);
     postData.insert("ets", xliveHeartBeatEts);
     postData.insert("benchmark", xliveHeartBeatBenchmark);
@@ -3639,7 +3856,7 @@ void MainWindow::sendXliveHeartBeatX(QString s, qint64 timestamp)
     datas << "s=" + s; // 生成的签名
     datas << "id=" + QString("[%1,%2,%3,%4]")
              .arg(parentAreaId).arg(areaId).arg(xliveHeartBeatIndex).arg(roomId);
-    datas << "device=[\"AUTO4115984068636104\",\"f5f08e2f-e4e3-4156-8127-616f79a17e1a\"]";
+    datas << "device=" + QString("[\"%1\",\"%2\"]").arg(HEARTBEAT_BUVID).arg(HEARTBEAT_UUID);
     datas << "ets=" + snum(xliveHeartBeatEts);
     datas << "benchmark=" + xliveHeartBeatBenchmark;
     datas << "time=" + snum(xliveHeartBeatInterval);
@@ -4085,21 +4302,34 @@ void MainWindow::setRoomCover(const QPixmap& pixmap)
     ui->roomCoverLabel->setPixmap(getRoundedPixmap(pixmap));
     ui->roomCoverLabel->setMinimumSize(1, 1); */
 
-    // 设置程序主题
-    QColor bg, fg, sbg, sfg;
-    auto colors = ImageUtil::extractImageThemeColors(roomCover.toImage(), 7);
-    ImageUtil::getBgFgSgColor(colors, &bg, &fg, &sbg, &sfg);
-    prevPa = BFSColor::fromPalette(palette());
-    currentPa = BFSColor(QList<QColor>{bg, fg, sbg, sfg});
-    QPropertyAnimation* ani = new QPropertyAnimation(this, "paletteProg");
-    ani->setStartValue(0);
-    ani->setEndValue(1.0);
-    ani->setDuration(500);
-    connect(ani, &QPropertyAnimation::valueChanged, this, [=](const QVariant& val){
-        setRoomThemeByCover(val.toDouble());
+    // 设置程序主题（子线程提取主题色）
+    const QImage coverImage = roomCover.toImage();
+    const int serial = ++roomThemeSerial;
+    QFutureWatcher<QList<QColor>>* watcher = new QFutureWatcher<QList<QColor>>(this);
+    connect(watcher, &QFutureWatcher<QList<QColor>>::finished, this, [=]{
+        QList<QColor> colors = watcher->result();
+        watcher->deleteLater();
+        if (serial != roomThemeSerial) // 已经换了别的封面
+            return ;
+
+        prevPa = BFSColor::fromPalette(palette());
+        currentPa = BFSColor(colors);
+        QPropertyAnimation* ani = new QPropertyAnimation(this, "paletteProg");
+        ani->setStartValue(0);
+        ani->setEndValue(1.0);
+        ani->setDuration(500);
+        connect(ani, &QPropertyAnimation::valueChanged, this, [=](const QVariant& val){
+            setRoomThemeByCover(val.toDouble());
+        });
+        connect(ani, SIGNAL(finished()), ani, SLOT(deleteLater()));
+        ani->start();
     });
-    connect(ani, SIGNAL(finished()), ani, SLOT(deleteLater()));
-    ani->start();
+    watcher->setFuture(QtConcurrent::run([=]{
+        QColor bg, fg, sbg, sfg;
+        auto colors = ImageUtil::extractImageThemeColors(coverImage, 7);
+        ImageUtil::getBgFgSgColor(colors, &bg, &fg, &sbg, &sfg);
+        return QList<QColor>{bg, fg, sbg, sfg};
+    }));
 
     // 设置主要界面主题
     ui->tabWidget->setBg(roomCover);
@@ -4410,7 +4640,7 @@ void MainWindow::getDanmuInfo()
 
         startMsgLoop();
 
-        updateExistGuards(0);
+        updateExistGuards();
         updateOnlineGoldRank();
     });
     manager->get(*request);
@@ -4443,6 +4673,10 @@ void MainWindow::getFansAndUpdate()
         if (!fansList.size())
         {
             fansList = newFans;
+            QList<qint64> uids;
+            foreach (FanBean fan, newFans)
+                uids.append(fan.mid);
+            moderation->setFans(uids);
             return ;
         }
 
@@ -4482,7 +4716,7 @@ void MainWindow::getFansAndUpdate()
                 appendNewLiveDanmaku(LiveDanmaku(fan.uname, fan.mid, false, QDateTime::fromSecsSinceEpoch(fan.mtime)));
             }
             while (index--)
-                fansList.removeFirst();
+                moderation->removeFan(fansList.takeFirst().mid);
         }
 
         // 新增关注
@@ -4510,6 +4744,7 @@ void MainWindow::getFansAndUpdate()
             }
 
             fansList.insert(0, fan);
+            moderation->addFan(fan.mid);
         }
 
     });
@@ -4880,6 +5115,7 @@ QString MainWindow::processTimeVariants(QString msg) const
 
 QStringList MainWindow::getEditConditionStringList(QString plainText, LiveDanmaku user)
 {
+    BenchScope benchScope(ReplayBenchmark::Template, LiveMetrics::Template);
     plainText = processDanmakuVariants(plainText, user);
     CALC_DEB << "处理变量之后：" << plainText;
     lastConditionDanmu = plainText;
@@ -4932,11 +5168,105 @@ QStringList MainWindow::getEditConditionStringList(QString plainText, LiveDanmak
         }
     }
     CALC_DEB << "condition result:" << result;
-    lastCandidateDanmaku = result.join("\n");
+    lastCandidateDanmaku = result;
+
+    return result;
+}
+
+/**
+ * 从编译好的快照中获取候选弹幕
+ * 静态行已经在编译时处理好，只需要替换含有变量或条件的行；
+ * 所有行按原来的顺序一起筛选过长和优先级，结果和直接处理整段文字一致
+ */
+QStringList MainWindow::getEditConditionStringList(const WordsSnapshot::Ptr &words, LiveDanmaku user)
+{
+    BenchScope benchScope(ReplayBenchmark::Template, LiveMetrics::Template);
+    if (!words || words->isEmpty())
+        return QStringList();
+    if (!words->hasDynamic())
+    {
+        lastConditionDanmu = words->getSource();
+        lastCandidateDanmaku = words->getStaticCandidates();
+        return lastCandidateDanmaku;
+    }
+
+    // 替换变量，寻找条件
+    QVector<WordsSnapshot::Line> lines;
+    QStringList processed;
+    foreach (const WordsSnapshot::Line& line, words->getLines())
+    {
+        if (!line.dynamic)
+        {
+            lines.append(line);
+            processed.append(line.text);
+            continue;
+        }
+        QString text = processDanmakuVariants(line.text, user);
+        processed.append(text);
+        foreach (QString part, text.split("\n", QString::SkipEmptyParts))
+        {
+            part = processMsgHeaderConditions(part);
+            if (!part.isEmpty())
+                lines.append(WordsSnapshot::makeLine(part.trimmed(), words->getLongest()));
+        }
+    }
+    lastConditionDanmu = processed.join("\n");
+
+    // 去掉过长的，只保留优先级最高的
+    QStringList removed;
+    QStringList result = WordsSnapshot::select(lines, debugPrint ? &removed : nullptr);
+    foreach (const QString& text, removed)
+        localNotify("[去掉过长候选：" + text + "]");
+    CALC_DEB << "condition result:" << result;
+    lastCandidateDanmaku = result;
 
     return result;
 }
 
+/**
+ * 用当前的自定义变量、翻译和长度设置编译候选弹幕
+ */
+WordsSnapshot::Ptr MainWindow::compileWords(const QString &text) const
+{
+    QStringList keys;
+    for (auto it = customVariant.begin(); it != customVariant.end(); ++it)
+        keys.append(it->first);
+    for (auto it = variantTranslation.begin(); it != variantTranslation.end(); ++it)
+        keys.append(it->first);
+    return WordsSnapshot::compile(text, keys, removeLongerRandomDanmaku ? danmuLongest : 0);
+}
+
+/**
+ * 自定义变量、翻译、长度改变后，重新编译所有的快照
+ */
+void MainWindow::updateWordsSnapshots()
+{
+    welcomeWords = compileWords(ui->autoWelcomeWordsEdit->toPlainText());
+    thankWords = compileWords(ui->autoThankWordsEdit->toPlainText());
+    attentionWords = compileWords(ui->autoAttentionWordsEdit->toPlainText());
+    blockNotifyWords = compileWords(ui->autoBlockNewbieNotifyWordsEdit->toPlainText());
+    autoBlockKeys = KeywordsSnapshot::compile(ui->autoBlockNewbieKeysEdit->toPlainText());
+    promptBlockKeys = KeywordsSnapshot::compile(ui->promptBlockNewbieKeysEdit->toPlainText());
+}
+
+/**
+ * 从控件读取欢迎、新人禁言用到的开关
+ * 代码中 setChecked/setValue 也会触发 toggled/valueChanged，不会漏掉
+ */
+void MainWindow::updateHandlerOptions()
+{
+    adminControl = ui->allowAdminControlCheck->isChecked();
+    blockNotOnlyNewbie = ui->blockNotOnlyNewbieCheck->isChecked();
+    autoBlockNewbie = ui->autoBlockNewbieCheck->isChecked();
+    autoBlockNewbieNotify = ui->autoBlockNewbieNotifyCheck->isChecked();
+    autoBlockHour = ui->autoBlockTimeSpin->value();
+    promptBlockNewbie = ui->promptBlockNewbieCheck->isChecked();
+    promptNotOnlyNewbie = ui->notOnlyNewbieCheck->isChecked();
+    sendWelcomeText = ui->sendWelcomeTextCheck->isChecked();
+    sendWelcomeVoice = ui->sendWelcomeVoiceCheck->isChecked();
+    sendWelcomeCD = ui->sendWelcomeCDSpin->value();
+}
+
 /**
  * 处理用户信息中蕴含的表达式
  * 用户信息、弹幕、礼物等等
@@ -5335,15 +5665,7 @@ QString MainWindow::replaceDanmakuVariants(const LiveDanmaku& danmaku, const QSt
     // 是否新关注
     else if (key == "%new_attention%")
     {
-        bool isInFans = false;
-        qint64 uid = danmaku.getUid();
-        foreach (FanBean fan, fansList)
-            if (fan.mid == uid)
-            {
-                isInFans = true;
-                break;
-            }
-        return isInFans ? "1" : "0";
+        return moderation->isFan(danmaku.getUid()) ? "1" : "0";
     }
 
     // 是否是对面串门
@@ -5356,19 +5678,19 @@ QString MainWindow::replaceDanmakuVariants(const LiveDanmaku& danmaku, const QSt
 
     // 本次进来人次
     else if (key == "%today_come%")
-        return snum(dailyCome);
+        return snum(analytics->getToday(LiveAnalytics::Come));
 
     // 新人发言数量
     else if (key == "%today_newbie_msg%")
-        return snum(dailyNewbieMsg);
+        return snum(analytics->getToday(LiveAnalytics::NewbieMsg));
 
     // 今天弹幕总数
     else if (key == "%today_danmaku%")
-        return snum(dailyDanmaku);
+        return snum(analytics->getToday(LiveAnalytics::Danmaku));
 
     // 今天新增关注
     else if (key == "%today_fans%")
-        return snum(dailyNewFans);
+        return snum(analytics->getToday(LiveAnalytics::NewFans));
 
     // 当前粉丝数量
     else if (key == "%fans_count%")
@@ -5378,19 +5700,19 @@ QString MainWindow::replaceDanmakuVariants(const LiveDanmaku& danmaku, const QSt
 
     // 今天金瓜子总数
     else if (key == "%today_gold%")
-        return snum(dailyGiftGold);
+        return snum(analytics->getToday(LiveAnalytics::GiftGold));
 
     // 今天银瓜子总数
     else if (key == "%today_silver%")
-        return snum(dailyGiftSilver);
+        return snum(analytics->getToday(LiveAnalytics::GiftSilver));
 
     // 今天是否有新舰长
     else if (key == "%today_guard%")
-        return snum(dailyGuard);
+        return snum(analytics->getToday(LiveAnalytics::Guard));
 
     // 今日最高人气
     else if (key == "%today_max_ppl%")
-        return snum(dailyMaxPopul);
+        return snum(analytics->getToday(LiveAnalytics::Popularity));
 
     // 当前人气
     else if (key == "%popularity%")
@@ -5493,7 +5815,7 @@ QString MainWindow::replaceDanmakuVariants(const LiveDanmaku& danmaku, const QSt
         return strongNotifyUsers.contains(danmaku.getUid()) ? "1" : "0";
     // 是否被禁言
     else if (key == "%blocked%")
-        return userBlockIds.contains(danmaku.getUid()) ? "1" : "0";
+        return moderation->isBlocked(danmaku.getUid()) ? "1" : "0";
     // 不自动欢迎
     else if (key == "%not_welcome%")
         return notWelcomeUsers.contains(danmaku.getUid()) ? "1" : "0";
@@ -5503,7 +5825,7 @@ QString MainWindow::replaceDanmakuVariants(const LiveDanmaku& danmaku, const QSt
 
     // 弹幕人气
     else if (key == "%danmu_popularity%")
-        return snum(danmuPopulValue);
+        return snum(getDanmuPopularity());
 
     // 游戏用户
     else if (key == "%in_game_users%")
@@ -5872,12 +6194,11 @@ QString MainWindow::replaceDynamicVariants(const QString &funcName, const QStrin
 
         for (int row = 0; row < ui->eventListWidget->count(); row++)
         {
-            auto widget = ui->eventListWidget->itemWidget(ui->eventListWidget->item(row));
-            auto tw = static_cast<EventWidget*>(widget);
-            if (tw->eventEdit->text() != filterName || !tw->check->isChecked())
+            auto item = RuleListItem::from(ui->eventListWidget->item(row));
+            if (item->getTitle() != filterName || !item->isEnabled())
                 continue;
 
-            QStringList sl = tw->body().split(QRegularExpression("\\s+"), QString::SkipEmptyParts);
+            QStringList sl = item->getBody().split(QRegularExpression("\\s+"), QString::SkipEmptyParts);
             foreach (QString s, sl)
             {
                 if (content.contains(s))
@@ -5898,12 +6219,11 @@ QString MainWindow::replaceDynamicVariants(const QString &funcName, const QStrin
 
         for (int row = 0; row < ui->eventListWidget->count(); row++)
         {
-            auto widget = ui->eventListWidget->itemWidget(ui->eventListWidget->item(row));
-            auto tw = static_cast<EventWidget*>(widget);
-            if (tw->eventEdit->text() != filterName || !tw->check->isChecked())
+            auto item = RuleListItem::from(ui->eventListWidget->item(row));
+            if (item->getTitle() != filterName || !item->isEnabled())
                 continue;
 
-            QStringList sl = tw->body().split("\n", QString::SkipEmptyParts);
+            QStringList sl = item->getBody().split("\n", QString::SkipEmptyParts);
             foreach (QString s, sl)
             {
                 if (content.indexOf(QRegularExpression(s)) > -1)
@@ -6112,6 +6432,37 @@ bool MainWindow::processVariantConditions(QString exprs) const
     return isTrue;
 }
 
+/**
+ * 批量修改变量时，判断某一个键是否满足条件
+ * _VALUE_ 为该键的值，_$1_ 为键的正则捕获，_{key}_ 为其他变量的值
+ */
+bool MainWindow::processHeapsCondition(QString exp, const KVStore::Match &m) const
+{
+    // _VALUE_ 替换为 当前key的值
+    exp.replace("_VALUE_", heaps->value(m.key).toString());
+    // _$1_ 替换为 match的值
+    if (exp.contains("_$"))
+    {
+        auto caps = m.match.capturedTexts();
+        for (int i = 0; i < caps.size(); i++)
+            exp.replace("_$" + snum(i) + "_", caps.at(i));
+    }
+    // 替换获取配置的值 _{}_
+    if (exp.contains("_{"))
+    {
+        QRegularExpression re2("_\\{(.*?)\\}_");
+        QRegularExpressionMatch match2;
+        while (exp.indexOf(re2, 0, &match2) > -1)
+        {
+            QString _var = match2.captured(0);
+            QString key = match2.captured(1);
+            QVariant var = heaps->value("heaps/" + key);
+            exp.replace(_var, var.toString());
+        }
+    }
+    return processVariantConditions(exp);
+}
+
 /**
  * 计算纯int、运算符组成的表达式
  */
@@ -6199,14 +6550,10 @@ bool MainWindow::isFilterRejected(QString filterName, const LiveDanmaku &danmaku
     bool reject = false;
     for (int row = 0; row < ui->eventListWidget->count(); row++)
     {
-        auto rowItem = ui->eventListWidget->item(row);
-        auto widget = ui->eventListWidget->itemWidget(rowItem);
-        if (!widget)
-            continue;
-        auto eventWidget = static_cast<EventWidget*>(widget);
-        if (eventWidget->isEnabled() && eventWidget->title() == filterName)
+        auto item = RuleListItem::from(ui->eventListWidget->item(row));
+        if (item->isEnabled() && item->getTitle() == filterName)
         {
-            QString filterText = eventWidget->body();
+            QString filterText = item->getBody();
             // 判断事件
             if (!processFilter(filterText, danmaku))
                 reject = true;
@@ -6535,6 +6882,8 @@ void MainWindow::setPaletteBgProg(double x)
 
 void MainWindow::startSaveDanmakuToFile()
 {
+    if (headless) // 回放的弹幕不写入记录
+        return ;
     if (danmuLogFile)
         finishSaveDanmuToFile();
 
@@ -6560,52 +6909,36 @@ void MainWindow::finishSaveDanmuToFile()
     danmuLogStream = nullptr;
 }
 
+/**
+ * 开始把每日数据写入归档
+ * 不开启时只在内存里统计
+ */
 void MainWindow::startCalculateDailyData()
 {
-    if (dailySettings)
-    {
-        saveCalculateDailyData();
-        dailySettings->deleteLater();
-    }
-
-    QDir dir;
-    dir.mkdir(dataPath+"live_daily");
-    QString date = QDateTime::currentDateTime().toString("yyyy-MM-dd");
-    dailySettings = new QSettings(dataPath+"live_daily/" + roomId + "_" + date + ".ini", QSettings::Format::IniFormat);
-
-    dailyCome = dailySettings->value("come", 0).toInt();
-    dailyPeopleNum = dailySettings->value("people_num", 0).toInt();
-    dailyDanmaku = dailySettings->value("danmaku", 0).toInt();
-    dailyNewbieMsg = dailySettings->value("newbie_msg", 0).toInt();
-    dailyNewFans = dailySettings->value("new_fans", 0).toInt();
-    dailyTotalFans = dailySettings->value("total_fans", 0).toInt();
-    dailyGiftSilver = dailySettings->value("gift_silver", 0).toInt();
-    dailyGiftGold = dailySettings->value("gift_gold", 0).toInt();
-    dailyGuard = dailySettings->value("guard", 0).toInt();
-    dailyMaxPopul = dailySettings->value("max_popularity", 0).toInt();
-    dailyAvePopul = 0;
+    analytics->setArchiveEnabled(!headless); // 回放测试只在内存里统计
+    analytics->setRoomId(roomId);
     if (currentGuards.size())
-        dailySettings->setValue("guard_count", currentGuards.size());
+        analytics->setGauge(LiveAnalytics::GuardCount, currentGuards.size());
     else
-        updateExistGuards(0);
+        updateExistGuards();
 }
 
 void MainWindow::saveCalculateDailyData()
 {
-    if (dailySettings)
-    {
-        dailySettings->setValue("come", dailyCome);
-        dailySettings->setValue("people_num", qMax(dailySettings->value("people_num").toInt(), userComeTimes.size()));
-        dailySettings->setValue("danmaku", dailyDanmaku);
-        dailySettings->setValue("newbie_msg", dailyNewbieMsg);
-        dailySettings->setValue("new_fans", dailyNewFans);
-        dailySettings->setValue("total_fans", currentFans);
-        dailySettings->setValue("gift_silver", dailyGiftSilver);
-        dailySettings->setValue("gift_gold", dailyGiftGold);
-        dailySettings->setValue("guard", dailyGuard);
-        if (currentGuards.size())
-            dailySettings->setValue("guard_count", currentGuards.size());
-    }
+    analytics->setGauge(LiveAnalytics::PeopleNum, userComeTimes.size());
+    if (currentFans)
+        analytics->setGauge(LiveAnalytics::TotalFans, currentFans);
+    if (currentGuards.size())
+        analytics->setGauge(LiveAnalytics::GuardCount, currentGuards.size());
+    analytics->flush();
+}
+
+/**
+ * 最近5分钟的弹幕人气
+ */
+qint64 MainWindow::getDanmuPopularity() const
+{
+    return analytics->sum(LiveAnalytics::DanmuPopul, LiveAnalytics::Second, 300);
 }
 
 void MainWindow::saveTouta()
@@ -6636,6 +6969,8 @@ void MainWindow::restoreToutaGifts(QString text)
 void MainWindow::startLiveRecord()
 {
     finishLiveRecord();
+    if (headless)
+        return ;
     if (roomId.isEmpty())
         return ;
 
@@ -6883,10 +7218,9 @@ void MainWindow::processRemoteCmd(QString msg, bool response)
     {
         for (int i = 0; i < ui->taskListWidget->count(); i++)
         {
-            QListWidgetItem* item = ui->taskListWidget->item(i);
-            auto widget = ui->taskListWidget->itemWidget(item);
-            auto tw = static_cast<TaskWidget*>(widget);
-            tw->check->setChecked(false);
+            auto item = RuleListItem::from(ui->taskListWidget->item(i));
+            item->setEnabled(false);
+            refreshRuleItem(item);
         }
         saveTaskList();
         if (response)
@@ -6896,10 +7230,9 @@ void MainWindow::processRemoteCmd(QString msg, bool response)
     {
         for (int i = 0; i < ui->taskListWidget->count(); i++)
         {
-            QListWidgetItem* item = ui->taskListWidget->item(i);
-            auto widget = ui->taskListWidget->itemWidget(item);
-            auto tw = static_cast<TaskWidget*>(widget);
-            tw->check->setChecked(true);
+            auto item = RuleListItem::from(ui->taskListWidget->item(i));
+            item->setEnabled(true);
+            refreshRuleItem(item);
         }
         saveTaskList();
         if (response)
@@ -6927,11 +7260,7 @@ void MainWindow::processRemoteCmd(QString msg, bool response)
 
         LiveDanmaku danmaku = blockedQueue.takeLast();
         delBlockUser(danmaku.getUid());
-        if (eternalBlockUsers.contains(EternalBlockUser(danmaku.getUid(), roomId.toLongLong())))
-        {
-            eternalBlockUsers.removeOne(EternalBlockUser(danmaku.getUid(), roomId.toLongLong()));
-            saveEternalBlockUsers();
-        }
+        moderation->removeEternalBlock(danmaku.getUid(), roomId.toLongLong());
         if (response)
             sendNotifyMsg(">已解除禁言：" + danmaku.getNickname());
     }
@@ -6966,11 +7295,7 @@ void MainWindow::processRemoteCmd(QString msg, bool response)
             QString nick = danmaku.getNickname();
             if (nick.contains(nickname))
             {
-                if (eternalBlockUsers.contains(EternalBlockUser(danmaku.getUid(), roomId.toLongLong())))
-                {
-                    eternalBlockUsers.removeOne(EternalBlockUser(danmaku.getUid(), roomId.toLongLong()));
-                    saveEternalBlockUsers();
-                }
+                moderation->removeEternalBlock(danmaku.getUid(), roomId.toLongLong());
 
                 delBlockUser(danmaku.getUid());
                 sendNotifyMsg(">已解禁：" + nick, true);
@@ -6989,11 +7314,7 @@ void MainWindow::processRemoteCmd(QString msg, bool response)
             QString nick = danmaku.getNickname();
             if (nick.contains(nickname))
             {
-                if (eternalBlockUsers.contains(EternalBlockUser(danmaku.getUid(), roomId.toLongLong())))
-                {
-                    eternalBlockUsers.removeOne(EternalBlockUser(danmaku.getUid(), roomId.toLongLong()));
-                    saveEternalBlockUsers();
-                }
+                moderation->removeEternalBlock(danmaku.getUid(), roomId.toLongLong());
 
                 delBlockUser(danmaku.getUid());
                 sendNotifyMsg(">已解禁：" + nick, true);
@@ -7055,11 +7376,29 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
     if (msg.indexOf(re) == -1)
         return false;
 
-    qInfo() << "尝试执行命令：" << msg;
+    LOG_INF(LiveLog::Func) << "尝试执行命令：" << msg;
     auto RE = [=](QString exp) -> QRegularExpression {
         return QRegularExpression("^\\s*>\\s*" + exp + "\\s*$");
     };
 
+    // 回放测试：访问网络、读写本地文件、朗读、弹窗等有外部影响的命令只记录，视为已执行
+    if (headless)
+    {
+        static const QStringList externalFuncs {
+            "connectNet", "getData", "postData", "postJson", "downloadFile", "openUrl",
+            "sendToSockets", "sendToLastSocket", "execRemoteCommand", "sendPrivateMsg", "aiReply", "joinBattle", "orderSong",
+            "runCommandLine", "execScript", "simulateKeys", "openFile",
+            "writeTextFile", "appendFileLine", "insertFileAnchor", "removeFile", "setSetting", "removeSetting",
+            "speakText", "playSound", "messageBox", "showValueTable", "showCSV"
+        };
+        QRegularExpressionMatch funcMatch = QRegularExpression("^\\s*>\\s*(\\w+)\\s*\\(").match(msg);
+        if (funcMatch.hasMatch() && externalFuncs.contains(funcMatch.captured(1)))
+        {
+            LOG_INF(LiveLog::Func) << "回放测试，跳过命令：" << msg;
+            return true;
+        }
+    }
+
     // 过滤器
     if (msg.contains("reject"))
     {
@@ -7078,7 +7417,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
         if (msg.indexOf(re, 0, &match) > -1)
         {
             QStringList caps = match.capturedTexts();
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             qint64 uid = caps.at(1).toLongLong();
             int hour = caps.at(2).toInt();
             addBlockUser(uid, hour);
@@ -7088,7 +7427,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
         if (msg.indexOf(re, 0, &match) > -1)
         {
             QStringList caps = match.capturedTexts();
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             qint64 uid = caps.at(1).toLongLong();
             int hour = ui->autoBlockTimeSpin->value();
             addBlockUser(uid, hour);
@@ -7103,7 +7442,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
         if (msg.indexOf(re, 0, &match) > -1)
         {
             QStringList caps = match.capturedTexts();
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             qint64 uid = caps.at(1).toLongLong();
             delBlockUser(uid);
             return true;
@@ -7117,7 +7456,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
         if (msg.indexOf(re, 0, &match) > -1)
         {
             QStringList caps = match.capturedTexts();
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             qint64 uid = caps.at(1).toLongLong();
             QString uname = caps.at(2);
             eternalBlockUser(uid, uname);
@@ -7132,7 +7471,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
         if (msg.indexOf(re, 0, &match) > -1)
         {
             QStringList caps = match.capturedTexts();
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             int giftId = caps.at(1).toInt();
             int num = caps.at(2).toInt();
             sendGift(giftId, num);
@@ -7158,7 +7497,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
         if (msg.indexOf(re, 0, &match) > -1)
         {
             QStringList caps = match.capturedTexts();
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             int delay = caps.at(1).toInt(); // 单位：毫秒
             res = DelayRes;
             resVal = delay;
@@ -7345,7 +7684,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
             QStringList caps = match.capturedTexts();
             QString cmd = caps.at(1);
             int response = caps.at(2).toInt();
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             processRemoteCmd(cmd, response);
             return true;
         }
@@ -7355,7 +7694,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
         {
             QStringList caps = match.capturedTexts();
             QString cmd = caps.at(1);
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             processRemoteCmd(cmd);
             return true;
         }
@@ -7370,7 +7709,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
             QStringList caps = match.capturedTexts();
             qint64 uid = caps.at(1).toLongLong();
             QString msg = caps.at(2);
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             sendPrivateMsg(uid, msg);
             return true;
         }
@@ -7385,7 +7724,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
             QStringList caps = match.capturedTexts();
             QString roomId = caps.at(1);
             QString msg = caps.at(2);
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             sendRoomMsg(roomId, msg);
             return true;
         }
@@ -7400,7 +7739,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
             QStringList caps = match.capturedTexts();
             int time = caps.at(1).toInt();
             QString msg = caps.at(2);
-            QTimer::singleShot(time, this, [=]{
+            TimerWheel::instance()->singleShot(time, this, [=]{
                 LiveDanmaku ld = danmaku;
                 QRegularExpression re("^\\s*>");
                 if (msg.indexOf(re) > -1)
@@ -7411,7 +7750,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
                 }
                 else
                     sendAutoMsg(msg, danmaku);
-            });
+            }, "timerShot");
             return true;
         }
     }
@@ -7425,7 +7764,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
             QStringList caps = match.capturedTexts();
             QString msg = caps.at(1);
             msg.replace("%n%", "\n");
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             localNotify(msg);
             return true;
         }
@@ -7437,7 +7776,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
             QString uid = caps.at(1);
             QString msg = caps.at(2);
             msg.replace("%n%", "\n");
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             localNotify(msg, uid.toLongLong());
             return true;
         }
@@ -7451,7 +7790,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
         {
             QStringList caps = match.capturedTexts();
             QString text = caps.at(1);
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             speakText(text);
             return true;
         }
@@ -7465,7 +7804,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
         {
             QStringList caps = match.capturedTexts();
             QString url = caps.at(1);
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             openLink(url);
             return true;
         }
@@ -7478,11 +7817,11 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
         if (msg.indexOf(re, 0, &match) > -1)
         {
             QStringList caps = match.capturedTexts();
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             QString url = caps.at(1);
             get(url, [=](QNetworkReply* reply){
                 QByteArray ba(reply->readAll());
-                qInfo() << QString(ba);
+                LOG_INF(LiveLog::Net) << "网络回复：" << url << QString(ba);
             });
             return true;
         }
@@ -7498,12 +7837,12 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
         }
         {
             QStringList caps = match.capturedTexts();
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             QString url = caps.at(1);
             QString callback = caps.size() > 2 ? caps.at(2) : "";
             get(url, [=](QNetworkReply* reply){
                 QByteArray ba(reply->readAll());
-                qInfo() << QString(ba);
+                LOG_INF(LiveLog::Net) << "网络回复：" << url << QString(ba);
                 if (!callback.isEmpty())
                 {
                     triggerCmdEvent(callback, LiveDanmaku(MyJson(ba)));
@@ -7523,14 +7862,14 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
         }
         {
             QStringList caps = match.capturedTexts();
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             QString url = caps.at(1);
             QString data = caps.at(2);
             QString callback = caps.size() > 3 ? caps.at(3) : "";
             data.replace("%n%", "\n");
             post(url, data.toStdString().data(), [=](QNetworkReply* reply){
                 QByteArray ba(reply->readAll());
-                qInfo() << QString(ba);
+                LOG_INF(LiveLog::Net) << "网络回复：" << url << QString(ba);
                 if (!callback.isEmpty())
                 {
                     triggerCmdEvent(callback, LiveDanmaku(MyJson(ba)));
@@ -7550,14 +7889,14 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
         }
         {
             QStringList caps = match.capturedTexts();
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             QString url = caps.at(1);
             QString data = caps.at(2);
             data.replace("%n%", "\n");
             QString callback = caps.size() > 3 ? caps.at(3) : "";
             postJson(url, data.toStdString().data(), [=](QNetworkReply* reply){
                 QByteArray ba(reply->readAll());
-                qInfo() << QString(ba);
+                LOG_INF(LiveLog::Net) << "网络回复：" << url << QString(ba);
                 if (!callback.isEmpty())
                 {
                     triggerCmdEvent(callback, LiveDanmaku(MyJson(ba)));
@@ -7577,7 +7916,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
         }
         {
             QStringList caps = match.capturedTexts();
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             QString url = caps.at(1);
             QString path = caps.at(2);
             QString callback = caps.size() > 3 ? caps.at(3) : "";
@@ -7597,6 +7936,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
                 }
                 file.write(ba);
                 file.close();
+                LOG_INF(LiveLog::Net) << "下载文件：" << url << "->" << path << ba.size() << "字节";
                 if (!callback.isEmpty())
                 {
                     LiveDanmaku ld(danmaku);
@@ -7619,7 +7959,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
             QString data = caps.at(2);
             data.replace("%n%", "\n");
 
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             sendTextToSockets(cmd, data.toUtf8());
             return true;
         }
@@ -7634,7 +7974,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
             QString data = caps.at(2);
             data.replace("%n%", "\n");
 
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             if (danmakuSockets.size())
                 sendTextToSockets(cmd, data.toUtf8(), danmakuSockets.last());
             return true;
@@ -7650,7 +7990,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
             QStringList caps = match.capturedTexts();
             QString cmd = caps.at(1);
             cmd.replace("%n%", "\n");
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             QProcess p(nullptr);
             p.start(cmd);
             p.waitForStarted();
@@ -7668,7 +8008,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
         {
             QStringList caps = match.capturedTexts();
             QString path = caps.at(1);
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
 #ifdef Q_OS_WIN32
             path = QString("file:///") + path;
             bool is_open = QDesktopServices::openUrl(QUrl(path, QUrl::TolerantMode));
@@ -7689,7 +8029,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
         if (msg.indexOf(re, 0, &match) > -1)
         {
             QStringList caps = match.capturedTexts();
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             QString dirName = caps.at(1);
             QString fileName = caps.at(2);
             QString text = caps.at(3);
@@ -7709,7 +8049,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
         if (msg.indexOf(re, 0, &match) > -1)
         {
             QStringList caps = match.capturedTexts();
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             QString dirName = caps.at(1);
             QString fileName = caps.at(2);
             QString format = caps.at(3);
@@ -7729,7 +8069,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
         if (msg.indexOf(re, 0, &match) > -1)
         {
             QStringList caps = match.capturedTexts();
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             QString file = caps.at(1);
             QString anchor = caps.at(2);
             QString content = caps.at(3);
@@ -7750,7 +8090,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
         if (msg.indexOf(re, 0, &match) > -1)
         {
             QStringList caps = match.capturedTexts();
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             QString fileName = caps.at(1);
             if (fileName.startsWith("/"))
                 fileName.replace(0, 1, "");
@@ -7767,7 +8107,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
         if (msg.indexOf(re, 0, &match) > -1)
         {
             QStringList caps = match.capturedTexts();
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             QString file = caps.at(1);
             QString code = caps.at(2);
             code.replace("%n%", "\\n");
@@ -7792,7 +8132,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
         {
             QStringList caps = match.capturedTexts();
             QString path = caps.at(1);
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             QMediaPlayer* player = new QMediaPlayer(this);
             player->setMedia(QUrl::fromLocalFile(path));
             connect(player, &QMediaPlayer::stateChanged, this, [=](QMediaPlayer::State state) {
@@ -7815,7 +8155,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
             if (!key.contains("/"))
                 key = "heaps/" + key;
             QString value = caps.at(2);
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             settings->setValue(key, value);
             return true;
         }
@@ -7831,7 +8171,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
             QString key = caps.at(1);
             if (!key.contains("/"))
                 key = "heaps/" + key;
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
 
             settings->remove(key);
             return true;
@@ -7849,7 +8189,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
             if (!key.contains("/"))
                 key = "heaps/" + key;
             QString value = caps.at(2);
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             heaps->setValue(key, value);
             return true;
         }
@@ -7865,10 +8205,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
             QString key = caps.at(1);
             if (!key.contains("/"))
                 key = "heaps/" + key;
-            qint64 value = heaps->value(key).toLongLong();
-            qint64 modify = caps.at(2).toLongLong();
-            value += modify;
-            heaps->setValue(key, value);
+            qint64 value = heaps->add(key, caps.at(2).toLongLong());
             qInfo() << "执行命令：" << caps << key << value;
             return true;
         }
@@ -7883,19 +8220,12 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
             QStringList caps = match.capturedTexts();
             QString key = caps.at(1);
             QString value = caps.at(2);
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
 
-            heaps->beginGroup("heaps");
-            auto keys = heaps->allKeys();
-            QRegularExpression re(key);
-            for (int i = 0; i < keys.size(); i++)
+            foreach (const KVStore::Match& m, heaps->scan("heaps/", key))
             {
-                if (keys.at(i).indexOf(re) > -1)
-                {
-                    heaps->setValue(keys.at(i), value);
-                }
+                heaps->setValue(m.key, value);
             }
-            heaps->endGroup();
             return true;
         }
     }
@@ -7909,19 +8239,12 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
             QStringList caps = match.capturedTexts();
             QString key = caps.at(1);
             qint64 modify = caps.at(2).toLongLong();
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
 
-            heaps->beginGroup("heaps");
-            auto keys = heaps->allKeys();
-            QRegularExpression re(key);
-            for (int i = 0; i < keys.size(); i++)
+            foreach (const KVStore::Match& m, heaps->scan("heaps/", key))
             {
-                if (keys.at(i).indexOf(re) > -1)
-                {
-                    heaps->setValue(keys.at(i), heaps->value(keys.at(i)).toLongLong() + modify);
-                }
+                heaps->add(m.key, modify);
             }
-            heaps->endGroup();
             return true;
         }
     }
@@ -7936,67 +8259,39 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
             QString key = caps.at(1);
             QString VAL_EXP = caps.at(2);
             QString newValue = caps.at(3);
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
 
             // 开始修改
-            heaps->beginGroup("heaps");
-            auto keys = heaps->allKeys();
-            QRegularExpression re(key);
-            QRegularExpressionMatch match2;
-            for (int i = 0; i < keys.size(); i++)
+            foreach (const KVStore::Match& m, heaps->scan("heaps/", key))
             {
-                if (keys.at(i).indexOf(re, 0, &match2) > -1)
+                if (!processHeapsCondition(VAL_EXP, m))
+                    continue;
+
+                // 处理 newValue
+                QString val = newValue;
+                if (val.contains("_VALUE_"))
                 {
-                    QString exp = VAL_EXP;
                     // _VALUE_ 替换为 当前key的值
-                    exp.replace("_VALUE_", heaps->value(keys.at(i)).toString());
-                    // _$1_ 替换为 match的值
-                    if (exp.contains("_$"))
-                    {
-                        auto caps = match2.capturedTexts();
-                        for (int i = 0; i < caps.size(); i++)
-                            exp.replace("_$" + snum(i) + "_", caps.at(i));
-                    }
-                    // 替换获取配置的值 _{}_
-                    if (exp.contains("_{"))
+                    val.replace("_VALUE_", heaps->value(m.key).toString());
+
+                    // 替换计算属性 _[]_
+                    if (val.contains("_["))
                     {
-                        QRegularExpression re2("_\\{(.*?)\\}_");
-                        while (exp.indexOf(re2, 0, &match2) > -1)
+                        QRegularExpression re2("_\\[(.*?)\\]_");
+                        QRegularExpressionMatch match2;
+                        while (val.indexOf(re2, 0, &match2) > -1)
                         {
                             QString _var = match2.captured(0);
-                            QString key = match2.captured(1);
-                            QVariant var = heaps->value(key);
-                            exp.replace(_var, var.toString());
-                        }
-                    }
-                    if (processVariantConditions(exp))
-                    {
-                        // 处理 newValue
-                        if (newValue.contains("_VALUE_"))
-                        {
-                            // _VALUE_ 替换为 当前key的值
-                            newValue.replace("_VALUE_", heaps->value(keys.at(i)).toString());
-
-                            // 替换计算属性 _[]_
-                            if (newValue.contains("_["))
-                            {
-                                QRegularExpression re2("_\\[(.*?)\\]_");
-                                while (newValue.indexOf(re2, 0, &match2) > -1)
-                                {
-                                    QString _var = match2.captured(0);
-                                    QString text = match2.captured(1);
-                                    text = snum(calcIntExpression(text));
-                                    newValue.replace(_var, text); // 默认使用变量类型吧
-                                }
-                            }
+                            QString text = match2.captured(1);
+                            text = snum(calcIntExpression(text));
+                            val.replace(_var, text); // 默认使用变量类型吧
                         }
-
-                        // 真正设置
-                        heaps->setValue(keys.at(i), newValue);
                     }
                 }
+
+                // 真正设置
+                heaps->setValue(m.key, val);
             }
-            heaps->endGroup();
             return true;
         }
     }
@@ -8011,47 +8306,14 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
             QString key = caps.at(1);
             QString VAL_EXP = caps.at(2);
             qint64 modify = caps.at(3).toLongLong();
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
 
             // 开始修改
-            heaps->beginGroup("heaps");
-            auto keys = heaps->allKeys();
-            QRegularExpression re(key);
-            QRegularExpressionMatch match2;
-            for (int i = 0; i < keys.size(); i++)
+            foreach (const KVStore::Match& m, heaps->scan("heaps/", key))
             {
-                if (keys.at(i).indexOf(re, 0, &match2) > -1)
-                {
-                    QString exp = VAL_EXP;
-                    // _VALUE_ 替换为 当前key的值
-                    exp.replace("_VALUE_", heaps->value(keys.at(i)).toString());
-                    // _$1_ 替换为 match的值
-                    if (exp.contains("_$"))
-                    {
-                        auto caps = match2.capturedTexts();
-                        for (int i = 0; i < caps.size(); i++)
-                            exp.replace("_$" + snum(i) + "_", caps.at(i));
-                    }
-                    // 替换获取配置的值 _{}_
-                    if (exp.contains("_{"))
-                    {
-                        QRegularExpression re2("_\\{(.*?)\\}_");
-                        while (exp.indexOf(re2, 0, &match2) > -1)
-                        {
-                            QString _var = match2.captured(0);
-                            QString key = match2.captured(1);
-                            QVariant var = heaps->value(key);
-                            exp.replace(_var, var.toString());
-                        }
-                    }
-
-                    if (processVariantConditions(exp))
-                    {
-                        heaps->setValue(keys.at(i), heaps->value(keys.at(i)).toLongLong() + modify);
-                    }
-                }
+                if (processHeapsCondition(VAL_EXP, m))
+                    heaps->add(m.key, modify);
             }
-            heaps->endGroup();
             return true;
         }
     }
@@ -8066,7 +8328,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
             QString key = caps.at(1);
             if (!key.contains("/"))
                 key = "heaps/" + key;
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
 
             heaps->remove(key);
             return true;
@@ -8081,19 +8343,12 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
         {
             QStringList caps = match.capturedTexts();
             QString key = caps.at(1);
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
 
-            heaps->beginGroup("heaps");
-            auto keys = heaps->allKeys();
-            QRegularExpression re(key);
-            for (int i = 0; i < keys.size(); i++)
+            foreach (const KVStore::Match& m, heaps->scan("heaps/", key))
             {
-                if (keys.at(i).indexOf(re) > -1)
-                {
-                    heaps->remove(keys.takeAt(i--));
-                }
+                heaps->remove(m.key);
             }
-            heaps->endGroup();
             return true;
         }
     }
@@ -8107,45 +8362,13 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
             QStringList caps = match.capturedTexts();
             QString key = caps.at(1);
             QString VAL_EXP = caps.at(2);
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
 
-            heaps->beginGroup("heaps");
-            auto keys = heaps->allKeys();
-            QRegularExpression re(key);
-            QRegularExpressionMatch match2;
-            for (int i = 0; i < keys.size(); i++)
+            foreach (const KVStore::Match& m, heaps->scan("heaps/", key))
             {
-                if (keys.at(i).indexOf(re, 0, &match2) > -1)
-                {
-                    QString exp = VAL_EXP;
-                    // _VALUE_ 替换为 当前key的值
-                    exp.replace("_VALUE_", heaps->value(keys.at(i)).toString());
-                    // _$1_ 替换为 match的值
-                    if (exp.contains("_$"))
-                    {
-                        auto caps = match2.capturedTexts();
-                        for (int i = 0; i < caps.size(); i++)
-                            exp.replace("_$" + snum(i) + "_", caps.at(i));
-                    }
-                    // 替换获取配置的值 _{}_
-                    if (exp.contains("_{"))
-                    {
-                        QRegularExpression re2("_\\{(.*?)\\}_");
-                        while (exp.indexOf(re2, 0, &match2) > -1)
-                        {
-                            QString _var = match2.captured(0);
-                            QString key = match2.captured(1);
-                            QVariant var = heaps->value(key);
-                            exp.replace(_var, var.toString());
-                        }
-                    }
-                    if (processVariantConditions(exp))
-                    {
-                        heaps->remove(keys.takeAt(i--));
-                    }
-                }
+                if (processHeapsCondition(VAL_EXP, m))
+                    heaps->remove(m.key);
             }
-            heaps->endGroup();
             return true;
         }
     }
@@ -8159,7 +8382,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
             QStringList caps = match.capturedTexts();
             QString uname = caps.at(1);
             int promote = caps.at(2).toInt();
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             if (musicWindow)
             {
                 musicWindow->improveUserSongByOrder(uname, promote);
@@ -8181,7 +8404,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
         {
             QStringList caps = match.capturedTexts();
             QString uname = caps.at(1);
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             if (musicWindow)
             {
                 musicWindow->cutSongIfUser(uname);
@@ -8198,7 +8421,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
         if (msg.indexOf(re, 0, &match) > -1)
         {
             QStringList caps = match.capturedTexts();
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             if (musicWindow)
             {
                 musicWindow->cutSong();
@@ -8220,7 +8443,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
         {
             QStringList caps = match.capturedTexts();
             QString text = caps.at(1);
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             QMessageBox::information(this, "神奇弹幕", text);
             return true;
         }
@@ -8234,7 +8457,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
         {
             QStringList caps = match.capturedTexts();
             QString text = caps.at(1);
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             sendLongText(text);
             return true;
         }
@@ -8248,11 +8471,16 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
         {
             QStringList caps = match.capturedTexts();
             QString text = caps.at(1);
-            qInfo() << "执行命令：" << caps;
-            for (int i = 0; i < ui->replyListWidget->count(); i++)
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
+            for (int i = 0; i < ui->replyListWidget->count(); i++) // 无论是否开启
             {
-                auto rw = static_cast<ReplyWidget*>(ui->replyListWidget->itemWidget(ui->replyListWidget->item(i)));
-                rw->triggerIfMatch(text, danmaku);
+                auto item = RuleListItem::from(ui->replyListWidget->item(i));
+                QStringList args;
+                if (!item->matchReply(text, &args))
+                    continue;
+                LiveDanmaku dm = danmaku;
+                dm.setArgs(args);
+                sendReplyMsgs(item->getBody(), dm, false);
             }
             return true;
         }
@@ -8268,23 +8496,25 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
             QStringList caps = match.capturedTexts();
             QString id = caps.at(1);
             int time = caps.at(2).toInt();
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             bool find = false;
             for (int i = 0; i < ui->taskListWidget->count(); i++)
             {
-                auto tw = static_cast<TaskWidget*>(ui->taskListWidget->itemWidget(ui->taskListWidget->item(i)));
-                if (!tw->matchId(id))
+                auto item = RuleListItem::from(ui->taskListWidget->item(i));
+                if (!item->matchId(id))
                     continue;
                 if (time == 0) // 切换
-                    tw->check->setChecked(!tw->check->isChecked());
+                    item->setEnabled(!item->isEnabled());
                 else if (time == 1) // 开
-                    tw->check->setChecked(true);
+                    item->setEnabled(true);
                 else if (time == -1) // 关
-                    tw->check->setChecked(false);
+                    item->setEnabled(false);
                 else if (time > 1) // 修改时间
-                    tw->spin->setValue(time);
-                else if (time < -1) // 刷新
-                    tw->timer->start();
+                    item->setInterval(time);
+                if (time < -1) // 刷新
+                    startTaskTimer(item);
+                else
+                    refreshRuleItem(item);
                 find = true;
             }
             if (!find)
@@ -8300,7 +8530,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
         if (msg.indexOf(re, 0, &match) > -1)
         {
             QStringList caps = match.capturedTexts();
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             qint64 id = caps.at(1).toLongLong();
             QString text = caps.at(2).trimmed();
             if (text.isEmpty())
@@ -8323,7 +8553,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
         {
             QStringList caps = match.capturedTexts();
             qint64 uid = caps.at(1).toLongLong();
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
 
             if (!notWelcomeUsers.contains(uid))
             {
@@ -8347,7 +8577,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
         {
             QStringList caps = match.capturedTexts();
             qint64 uid = caps.at(1).toLongLong();
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
 
             if (notWelcomeUsers.contains(uid))
             {
@@ -8372,7 +8602,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
             QStringList caps = match.capturedTexts();
             qint64 uid = caps.at(1).toLongLong();
             QString name = caps.at(2);
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             if (name.isEmpty()) // 移除
             {
                 if (localNicknames.contains(uid))
@@ -8403,7 +8633,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
         {
             QStringList caps = match.capturedTexts();
             int type = caps.at(1).toInt();
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             joinBattle(type);
             return true;
         }
@@ -8417,7 +8647,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
         {
             QStringList caps = match.capturedTexts();
             QString text = caps.at(1);
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             triggerCmdEvent(text, danmaku);
             return true;
         }
@@ -8432,7 +8662,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
             QStringList caps = match.capturedTexts();
             QString text = caps.at(1);
             QString uname = caps.at(2);
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             if (!musicWindow)
                 on_actionShow_Order_Player_Window_triggered();
             musicWindow->slotSearchAndAutoAppend(text, uname);
@@ -8448,7 +8678,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
         {
             QStringList caps = match.capturedTexts();
             QString text = caps.at(1);
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             simulateKeys(text);
             return true;
         }
@@ -8509,7 +8739,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
         if (msg.indexOf(re, 0, &match) > -1)
         {
             QStringList caps = match.capturedTexts();
-            qInfo() << "执行命令：" << caps;
+            LOG_INF(LiveLog::Func) << "执行命令：" << caps;
             QString word = caps.at(1);
             QString anchor = caps.at(2);
             addBannedWord(word, anchor);
@@ -8535,7 +8765,7 @@ bool MainWindow::execFunc(QString msg, LiveDanmaku& danmaku, CmdResponse &res, i
                 return true;
             if (!loopKeyStr.contains("/"))
                 loopKeyStr = "heaps/" + loopKeyStr;
-            QSettings* sts = heaps;
+            QSettings* sts = nullptr; // heaps
             if (loopKeyStr.startsWith(COUNTS_PREFIX))
             {
                 loopKeyStr.remove(0, COUNTS_PREFIX.length());
@@ -8674,6 +8904,7 @@ void MainWindow::restoreCustomVariant(QString text)
         else
             qCritical() << "自定义变量读取失败：" << s;
     }
+    updateWordsSnapshots();
 }
 
 QString MainWindow::saveCustomVariant()
@@ -8756,6 +8987,7 @@ void MainWindow::restoreVariantTranslation()
     allVariants.append(">reject(");
     allVariants.append("%up_name%");
     ConditionEditor::allCompletes = allVariants;
+    updateWordsSnapshots();
 }
 
 void MainWindow::restoreReplaceVariant(QString text)
@@ -8865,7 +9097,11 @@ void MainWindow::saveOrderSongs(const SongList &songs)
 
 void MainWindow::saveSongLyrics()
 {
-    QStringList lyrics = musicWindow->getSongLyrics(ui->songLyricsToFileMaxSpin->value());
+    saveSongLyrics(musicWindow->getSongLyrics(ui->songLyricsToFileMaxSpin->value()));
+}
+
+void MainWindow::saveSongLyrics(QStringList lyrics)
+{
     if (!lyrics.size()) // 直播姬会跳过空文本文件，所以需要设置个空格
         lyrics.append(" ");
 
@@ -8886,18 +9122,30 @@ void MainWindow::saveSongLyrics()
 
 void MainWindow::slotBinaryMessageReceived(const QByteArray &message)
 {
+    LiveMetrics::add(LiveMetrics::FramesIn);
+    LiveMetrics::add(LiveMetrics::BytesIn, quint64(message.size()));
     int operation = ((uchar)message[8] << 24)
             + ((uchar)message[9] << 16)
             + ((uchar)message[10] << 8)
             + ((uchar)message[11]);
+    int bodyVersion = ((uchar)message[6] << 8) + (uchar)message[7]; // 协议版本
     QByteArray body = message.right(message.length() - 16);
     SOCKET_DEB << "操作码=" << operation << "  大小=" << body.size() << "  正文=" << (body.left(1000)) << "...";
 
+    // 压缩的包（2 zlib、3 brotli）和人气值不是 JSON，不解析也不计时；压缩的包解压后再计
     QJsonParseError error;
-    QJsonDocument document = QJsonDocument::fromJson(body, &error);
     QJsonObject json;
-    if (error.error == QJsonParseError::NoError)
-        json = document.object();
+    if (operation != HEARTBEAT_REPLY && bodyVersion != 2 && bodyVersion != 3)
+    {
+        BenchScope decodeScope(ReplayBenchmark::Decode, LiveMetrics::JsonParse);
+        QJsonDocument document = QJsonDocument::fromJson(body, &error);
+        decodeScope.finish();
+        if (error.error == QJsonParseError::NoError)
+        {
+            json = document.object();
+            LiveMetrics::add(LiveMetrics::JsonParsed);
+        }
+    }
 
     if (operation == AUTH_REPLY) // 认证包回复
     {
@@ -8927,8 +9175,8 @@ void MainWindow::slotBinaryMessageReceived(const QByteArray &message)
             if (cmd == "STOP_LIVE_ROOM_LIST" || cmd == "NOTICE_MSG")
                 return ;
 
-            qInfo() << "普通CMD：" << cmd;
-            SOCKET_INF << json;
+            LOG_INF(LiveLog::Cmd) << "普通CMD：" << cmd;
+            LOG_DEB(LiveLog::Socket) << json;
         }
 
         if (cmd == "NOTICE_MSG") // 全站广播（不用管）
@@ -8985,7 +9233,7 @@ void MainWindow::slotBinaryMessageReceived(const QByteArray &message)
                 if (cmd == "STOP_LIVE_ROOM_LIST" || cmd == "WIDGET_BANNER")
                     return ;
 
-                qInfo() << ">消息命令UNZC：" << cmd;
+                LOG_INF(LiveLog::Cmd) << ">消息命令UNZC：" << cmd;
 
                 if (cmd == "ROOM_RANK")
                 {
@@ -9007,12 +9255,8 @@ void MainWindow::slotBinaryMessageReceived(const QByteArray &message)
                     qInfo() << s8("粉丝数量：") << fans << s8("  粉丝团：") << fans_club;
                     // appendNewLiveDanmaku(LiveDanmaku(fans, fans_club, delta_fans, delta_club));
 
-                    dailyNewFans += delta_fans;
-                    if (dailySettings)
-                    {
-                        dailySettings->setValue("new_fans", dailyNewFans);
-                        dailySettings->setValue("total_fans", currentFans);
-                    }
+                    analytics->add(LiveAnalytics::NewFans, delta_fans);
+                    analytics->setGauge(LiveAnalytics::TotalFans, currentFans);
 
 //                    if (delta_fans) // 如果有变动，实时更新
 //                        getFansAndUpdate();
@@ -9120,7 +9364,11 @@ QByteArray zlibToQtUncompr(const char *pZLIBData, uLongf dataLen/*, uLongf srcDa
 
 void MainWindow::slotUncompressBytes(const QByteArray &body)
 {
-    splitUncompressedBody(zlibToQtUncompr(body.data(), body.size()+1));
+    BenchScope decodeScope(ReplayBenchmark::Decode, LiveMetrics::Inflate);
+    QByteArray unc = zlibToQtUncompr(body.data(), body.size()+1);
+    decodeScope.finish();
+    LiveMetrics::add(LiveMetrics::BytesInflated, quint64(unc.size()));
+    splitUncompressedBody(unc);
 }
 
 void MainWindow::splitUncompressedBody(const QByteArray &unc)
@@ -9133,9 +9381,11 @@ void MainWindow::splitUncompressedBody(const QByteArray &unc)
                 + ((uchar)unc[offset+1] << 16)
                 + ((uchar)unc[offset+2] << 8)
                 + (uchar)unc[offset+3];
+        BenchScope decodeScope(ReplayBenchmark::Decode, LiveMetrics::JsonParse);
         QByteArray jsonBa = unc.mid(offset + headerSize, packSize - headerSize);
         QJsonParseError error;
         QJsonDocument document = QJsonDocument::fromJson(jsonBa, &error);
+        decodeScope.finish();
         if (error.error != QJsonParseError::NoError)
         {
             qCritical() << s8("解析解压后的JSON出错：") << error.errorString();
@@ -9144,6 +9394,7 @@ void MainWindow::splitUncompressedBody(const QByteArray &unc)
             qCritical() << s8(">>解压正文") << unc;
             return ;
         }
+        LiveMetrics::add(LiveMetrics::JsonParsed);
         QJsonObject json = document.object();
         QString cmd = json.value("cmd").toString();
         SOCKET_INF << "解压后获取到CMD：" << cmd;
@@ -9151,7 +9402,9 @@ void MainWindow::splitUncompressedBody(const QByteArray &unc)
                 && cmd != "ONLINERANK")
             SOCKET_INF << "单个JSON消息：" << offset << packSize << QString(jsonBa);
         try {
+            BenchScope dispatchScope(ReplayBenchmark::Dispatch, LiveMetrics::Handler);
             handleMessage(json);
+            LiveMetrics::recordCommand(cmd, dispatchScope.finish());
         } catch (...) {
             qCritical() << s8("出错啦") << jsonBa;
         }
@@ -9166,7 +9419,7 @@ void MainWindow::splitUncompressedBody(const QByteArray &unc)
 void MainWindow::handleMessage(QJsonObject json)
 {
     QString cmd = json.value("cmd").toString();
-    qInfo() << s8(">消息命令ZCOM：") << cmd;
+    LOG_INF(LiveLog::Cmd) << ">消息命令ZCOM：" << cmd;
     if (cmd == "LIVE") // 开播？
     {
         if (ui->recordCheck->isChecked())
@@ -9261,7 +9514,7 @@ void MainWindow::handleMessage(QJsonObject json)
                      snum(static_cast<qint64>(medal[3].toDouble())) == pkRoomId));
 
         // !弹幕的时间戳是13位，其他的是10位！
-        qInfo() << s8("接收到弹幕：") << username << msg << QDateTime::fromMSecsSinceEpoch(timestamp);
+        LOG_INF(LiveLog::Cmd) << "接收到弹幕：" << username << msg << QDateTime::fromMSecsSinceEpoch(timestamp);
         /*QString localName = danmakuWindow->getLocalNickname(uid);
         if (!localName.isEmpty())
             username = localName;*/
@@ -9269,9 +9522,7 @@ void MainWindow::handleMessage(QJsonObject json)
         // 统计弹幕次数
         int danmuCount = danmakuCounts->value("danmaku/"+snum(uid), 0).toInt()+1;
         danmakuCounts->setValue("danmaku/"+snum(uid), danmuCount);
-        dailyDanmaku++;
-        if (dailySettings)
-            dailySettings->setValue("danmaku", dailyDanmaku);
+        analytics->add(LiveAnalytics::Danmaku);
 
         // 添加到列表
         QString cs = QString::number(textColor, 16);
@@ -9292,7 +9543,7 @@ void MainWindow::handleMessage(QJsonObject json)
             noReplyMsgs.removeOne(msg);
         }
         else
-            minuteDanmuPopul++;
+            analytics->add(LiveAnalytics::DanmuPopul);
         danmaku.setOpposite(opposite);
         appendNewLiveDanmaku(danmaku);
 
@@ -9302,20 +9553,15 @@ void MainWindow::handleMessage(QJsonObject json)
         // 新人发言
         if (danmuCount == 1)
         {
-            dailyNewbieMsg++;
-            if (dailySettings)
-                dailySettings->setValue("newbie_msg", dailyNewbieMsg);
+            analytics->add(LiveAnalytics::NewbieMsg);
         }
 
         // 新人小号禁言
         bool blocked = false;
         auto testTipBlock = [&]{
-            if (danmakuWindow && !ui->promptBlockNewbieKeysEdit->toPlainText().trimmed().isEmpty())
+            if (danmakuWindow && promptBlockKeys && !promptBlockKeys->isEmpty())
             {
-                QString reStr = ui->promptBlockNewbieKeysEdit->toPlainText();
-                if (reStr.endsWith("|"))
-                    reStr = reStr.left(reStr.length()-1);
-                if (msg.indexOf(QRegularExpression(reStr)) > -1) // 提示拉黑
+                if (msg.indexOf(promptBlockKeys->getRegex()) > -1) // 提示拉黑
                 {
                     blocked = true;
                     danmakuWindow->showFastBlock(uid, msg);
@@ -9327,22 +9573,18 @@ void MainWindow::handleMessage(QJsonObject json)
             // 不仅不屏蔽，反而支持主播特权
             processRemoteCmd(msg);
         }
-        else if (admin && ui->allowAdminControlCheck->isChecked())
+        else if (admin && adminControl)
         {
             // 开放给房管的特权
             processRemoteCmd(msg);
         }
-        else if (ui->blockNotOnlyNewbieCheck->isChecked() || (level == 0 && medal_level <= 1 && danmuCount <= 3) || danmuCount <= 1)
+        else if (blockNotOnlyNewbie || (level == 0 && medal_level <= 1 && danmuCount <= 3) || danmuCount <= 1)
         {
             // 尝试自动拉黑
-            if (ui->autoBlockNewbieCheck->isChecked() && !ui->autoBlockNewbieKeysEdit->toPlainText().trimmed().isEmpty())
+            if (autoBlockNewbie && autoBlockKeys && !autoBlockKeys->isEmpty())
             {
-                QString reStr = ui->autoBlockNewbieKeysEdit->toPlainText();
-                if (reStr.endsWith("|"))
-                    reStr = reStr.left(reStr.length()-1);
-                QRegularExpression re(reStr);
                 QRegularExpressionMatch match;
-                if (msg.indexOf(re, 0, &match) > -1 // 自动拉黑
+                if (msg.indexOf(autoBlockKeys->getRegex(), 0, &match) > -1 // 自动拉黑
                         && danmaku.getAnchorRoomid() != roomId // 不带有本房间粉丝牌
                         && !isInFans(uid) // 未刚关注主播（新人一般都是刚关注吧，在第一页）
                         && medal_level <= 2 // 勋章不到3级
@@ -9356,18 +9598,18 @@ void MainWindow::handleMessage(QJsonObject json)
                     qInfo() << "检测到新人违禁词，自动拉黑：" << username << msg;
 
                     // 拉黑
-                    addBlockUser(uid, ui->autoBlockTimeSpin->value());
+                    addBlockUser(uid, autoBlockHour);
                     blocked = true;
 
                     // 通知
-                    if (ui->autoBlockNewbieNotifyCheck->isChecked())
+                    if (autoBlockNewbieNotify)
                     {
                         static int prevNotifyInCount = -20; // 上次发送通知时的弹幕数量
                         if (allDanmakus.size() - prevNotifyInCount >= 20) // 最低每20条发一遍
                         {
                             prevNotifyInCount = allDanmakus.size();
 
-                            QStringList words = getEditConditionStringList(ui->autoBlockNewbieNotifyWordsEdit->toPlainText(), danmaku);
+                            QStringList words = getEditConditionStringList(blockNotifyWords, danmaku);
                             if (words.size())
                             {
                                 int r = qrand() % words.size();
@@ -9387,12 +9629,12 @@ void MainWindow::handleMessage(QJsonObject json)
             }
 
             // 没有被禁言，那么判断提示拉黑
-            if (!blocked && ui->promptBlockNewbieCheck->isChecked())
+            if (!blocked && promptBlockNewbie)
             {
                 testTipBlock();
             }
         }
-        else if (ui->promptBlockNewbieCheck->isChecked() && ui->notOnlyNewbieCheck->isChecked())
+        else if (promptBlockNewbie && promptNotOnlyNewbie)
         {
             // 判断提示拉黑
             testTipBlock();
@@ -9565,7 +9807,7 @@ void MainWindow::handleMessage(QJsonObject json)
         QString coinType = data.value("coin_type").toString();
         int totalCoin = data.value("total_coin").toInt();
 
-        qInfo() << s8("接收到送礼：") << username << giftId << giftName << num << s8("  总价值：") << totalCoin << coinType;
+        LOG_INF(LiveLog::Cmd) << "接收到送礼：" << username << giftId << giftName << num << "总价值：" << totalCoin << coinType;
         QString localName = getLocalNickname(uid);
         /*if (!localName.isEmpty())
             username = localName;*/
@@ -9606,6 +9848,8 @@ void MainWindow::handleMessage(QJsonObject json)
 
         if (!justStart && ui->autoSendGiftCheck->isChecked()) // 是否需要礼物答谢
         {
+            if (ui->sendGiftVoiceCheck->isChecked())
+                preconnectTTS(); // 连击等待期间就连接好
             QJsonValue batchComboIdVal = data.value("batch_combo_id");
             QString batchComboId = batchComboIdVal.toString();
             if (!ui->giftComboSendCheck->isChecked() || batchComboIdVal.isNull()) // 立刻发送
@@ -9613,7 +9857,7 @@ void MainWindow::handleMessage(QJsonObject json)
                 // 如果合并了，那么可能已经感谢了，就不用管了
                 if (!merged)
                 {
-                    QStringList words = getEditConditionStringList(ui->autoThankWordsEdit->toPlainText(), danmaku);
+                    QStringList words = getEditConditionStringList(thankWords, danmaku);
                     if (words.size())
                     {
                         int r = qrand() % words.size();
@@ -9660,9 +9904,7 @@ void MainWindow::handleMessage(QJsonObject json)
             userSilver += totalCoin;
             danmakuCounts->setValue("silver/"+snum(uid), userSilver);
 
-            dailyGiftSilver += totalCoin;
-            if (dailySettings)
-                dailySettings->setValue("gift_silver", dailyGiftSilver);
+            analytics->add(LiveAnalytics::GiftSilver, totalCoin);
         }
         if (coinType == "gold")
         {
@@ -9670,9 +9912,7 @@ void MainWindow::handleMessage(QJsonObject json)
             userGold += totalCoin;
             danmakuCounts->setValue("gold/"+snum(uid), userGold);
 
-            dailyGiftGold += totalCoin;
-            if (dailySettings)
-                dailySettings->setValue("gift_gold", dailyGiftGold);
+            analytics->add(LiveAnalytics::GiftGold, totalCoin);
 
             // 正在PK，保存弹幕历史
             // 因为最后的大乱斗最佳助攻只提供名字，所以这里需要保存 uname->uid 的映射
@@ -10133,11 +10373,11 @@ void MainWindow::handleMessage(QJsonObject json)
     else if (cmd == "WELCOME") // 欢迎老爷，通过vip和svip区分月费和年费老爷
     {
         QJsonObject data = json.value("data").toObject();
-        qInfo() << data;
+        LOG_DEB(LiveLog::Socket) << data;
         qint64 uid = static_cast<qint64>(data.value("uid").toDouble());
         QString username = data.value("uname").toString();
         bool isAdmin = data.value("isAdmin").toBool();
-        qInfo() << s8("欢迎观众：") << username << isAdmin;
+        LOG_INF(LiveLog::Cmd) << "欢迎观众：" << username << isAdmin;
 
         triggerCmdEvent(cmd, LiveDanmaku().with(data));
     }
@@ -10194,7 +10434,7 @@ void MainWindow::handleMessage(QJsonObject json)
         QJsonObject fansMedal = data.value("fans_medal").toObject();
         QString roomId = snum(qint64(data.value("room_id").toDouble()));
 
-        qInfo() << s8("观众交互：") << username << msgType;
+        LOG_INF(LiveLog::Cmd) << "观众交互：" << username << msgType;
         QString localName = getLocalNickname(uid);
         /*if (!localName.isEmpty())
             username = localName;*/
@@ -10329,7 +10569,7 @@ void MainWindow::handleMessage(QJsonObject json)
 
         if (!justStart && ui->autoSendGiftCheck->isChecked())
         {
-            QStringList words = getEditConditionStringList(ui->autoThankWordsEdit->toPlainText(), danmaku);
+            QStringList words = getEditConditionStringList(thankWords, danmaku);
             if (words.size())
             {
                 int r = qrand() % words.size();
@@ -10357,9 +10597,7 @@ void MainWindow::handleMessage(QJsonObject json)
         guardCount += addition;
         danmakuCounts->setValue("guard/" + snum(uid), guardCount);
 
-        dailyGuard += num;
-        if (dailySettings)
-            dailySettings->setValue("guard", dailyGuard);
+        analytics->add(LiveAnalytics::Guard, num);
 
         triggerCmdEvent(cmd, danmaku.with(data));
     }
@@ -11019,10 +11257,9 @@ void MainWindow::judgeUserRobotByUpload(LiveDanmaku danmaku, DanmakuFunc ifNot,
 void MainWindow::sendWelcome(LiveDanmaku danmaku)
 {
     if (notWelcomeUsers.contains(danmaku.getUid())
-            || (!ui->sendWelcomeTextCheck->isChecked()
-            && !ui->sendWelcomeVoiceCheck->isChecked())) // 不自动欢迎
+            || (!sendWelcomeText && !sendWelcomeVoice)) // 不自动欢迎
         return ;
-    QStringList words = getEditConditionStringList(ui->autoWelcomeWordsEdit->toPlainText(), danmaku);
+    QStringList words = getEditConditionStringList(welcomeWords, danmaku);
     if (!words.size())
     {
         if (debugPrint)
@@ -11038,18 +11275,18 @@ void MainWindow::sendWelcome(LiveDanmaku danmaku)
         if (debugPrint)
             localNotify("[强提醒]");
         sendCdMsg(msg, danmaku, 2000, NOTIFY_CD_CN,
-                  ui->sendWelcomeTextCheck->isChecked(), ui->sendWelcomeVoiceCheck->isChecked(), false);
+                  sendWelcomeText, sendWelcomeVoice, false);
     }
     else
     {
-        sendCdMsg(msg, danmaku, ui->sendWelcomeCDSpin->value() * 1000, WELCOME_CD_CN,
-                  ui->sendWelcomeTextCheck->isChecked(), ui->sendWelcomeVoiceCheck->isChecked(), false);
+        sendCdMsg(msg, danmaku, sendWelcomeCD * 1000, WELCOME_CD_CN,
+                  sendWelcomeText, sendWelcomeVoice, false);
     }
 }
 
 void MainWindow::sendAttentionThans(LiveDanmaku danmaku)
 {
-    QStringList words = getEditConditionStringList(ui->autoAttentionWordsEdit->toPlainText(), danmaku);
+    QStringList words = getEditConditionStringList(attentionWords, danmaku);
     if (!words.size())
     {
         if (debugPrint)
@@ -11105,6 +11342,7 @@ void MainWindow::initTTS()
                                 settings->value("xfytts/apikey").toString(),
                                 settings->value("xfytts/apisecret").toString(),
                                 this);
+            xfyTTS->setSpeechCache(speechCache);
             ui->xfyAppIdEdit->setText(settings->value("xfytts/appid").toString());
             ui->xfyApiKeyEdit->setText(settings->value("xfytts/apikey").toString());
             ui->xfyApiSecretEdit->setText(settings->value("xfytts/apisecret").toString());
@@ -11119,6 +11357,20 @@ void MainWindow::initTTS()
     }
 }
 
+/**
+ * 马上要朗读时提前连接语音合成服务，省掉第一句的握手时间
+ */
+void MainWindow::preconnectTTS()
+{
+    if (headless)
+        return ;
+    if (voicePlatform != VoiceXfy)
+        return ;
+    if (!xfyTTS)
+        initTTS();
+    xfyTTS->preconnect();
+}
+
 void MainWindow::speekVariantText(QString text)
 {
     // 开始播放
@@ -11127,6 +11379,9 @@ void MainWindow::speekVariantText(QString text)
 
 void MainWindow::speakText(QString text)
 {
+    if (headless) // 回放测试不朗读
+        return ;
+
     // 处理特殊字符
     text.replace("_", " ");
 
@@ -11151,16 +11406,25 @@ void MainWindow::speakText(QString text)
     }
 }
 
-void MainWindow::downloadAndSpeak(QString text)
+/**
+ * 从自定义的网址下载语音
+ * 相同的文本和网址只下载一次，保存在语音缓存中
+ */
+void MainWindow::downloadAndSpeak(QString text, bool play)
 {
     QString url = ui->voiceCustomUrlEdit->text();
     if (url.isEmpty())
         return ;
-    url = url.replace("%1", text);
-    const QString filePath = dataPath + "audios";
-    QDir dir(filePath);
-    dir.mkpath(filePath);
+    const QString key = SpeechCache::keyOf(text, "custom", url, 0, 0, 0);
+    QString path = speechCache->getFile(key);
+    if (!path.isEmpty())
+    {
+        if (play)
+            playSpeechFile(path);
+        return ;
+    }
 
+    url = url.replace("%1", text);
     get(url, [=](QNetworkReply* reply1){
         QByteArray fileData = reply1->readAll();
         if (fileData.isEmpty())
@@ -11170,28 +11434,89 @@ void MainWindow::downloadAndSpeak(QString text)
         }
 
         // 保存文件
-        QString path = filePath + "/" + snum(QDateTime::currentMSecsSinceEpoch()) + ".mp3";
-        QFile file(path);
-        file.open(QFile::WriteOnly);
-        QDataStream stream(&file);
-        stream << fileData;
-        file.flush();
-        file.close();
+        QString path = speechCache->insertFile(key, "mp3", fileData);
+        if (path.isEmpty() || !play)
+            return ;
 
         // 播放文件
-        QMediaPlayer *player = new QMediaPlayer(this);
-        player->setMedia(QUrl::fromLocalFile(path));
-        connect(player, &QMediaPlayer::stateChanged, this, [=](QMediaPlayer::State state){
-            if (state == QMediaPlayer::StoppedState)
-            {
-                player->deleteLater();
+        playSpeechFile(path);
+    });
+}
 
-                QFile file(path);
-                file.remove();
-            }
-        });
-        player->play();
+void MainWindow::playSpeechFile(QString path)
+{
+    QMediaPlayer *player = new QMediaPlayer(this);
+    player->setMedia(QUrl::fromLocalFile(path));
+    connect(player, &QMediaPlayer::stateChanged, this, [=](QMediaPlayer::State state){
+        if (state == QMediaPlayer::StoppedState)
+        {
+            player->deleteLater();
+        }
     });
+    player->play();
+}
+
+/**
+ * 预先合成到缓存，不播放
+ * 本地语音不需要网络，不用缓存
+ */
+void MainWindow::prepareSpeech(QString text)
+{
+    text.replace("_", " ");
+
+    switch (voicePlatform) {
+    case VoiceLocal:
+        break;
+    case VoiceXfy:
+        if (!xfyTTS)
+            initTTS();
+        xfyTTS->prepareText(text);
+        break;
+    case VoiceCustom:
+        downloadAndSpeak(text, false);
+        break;
+    }
+}
+
+/**
+ * 定时任务、自动回复、事件动作中不含变量的 speakText，启动后预先合成
+ */
+void MainWindow::prepareSpeechTexts()
+{
+    if (voicePlatform == VoiceLocal)
+        return ;
+    if (voicePlatform == VoiceXfy && settings->value("xfytts/apikey").toString().isEmpty())
+        return ;
+
+    QStringList texts;
+    auto collect = [&](QString msg) {
+        if (!msg.contains("speakText"))
+            return ;
+        QRegularExpression re("speakText\\s*\\(\\s*(.*?)\\s*\\)");
+        QRegularExpressionMatchIterator it = re.globalMatch(msg);
+        while (it.hasNext() && texts.size() < SPEECH_PREPARE_MAX)
+        {
+            QString text = it.next().captured(1);
+            if (text.isEmpty() || text.contains("%") || text.contains("{") || texts.contains(text))
+                continue;
+            texts.append(text);
+        }
+    };
+
+    foreach (QListWidget* listWidget, QList<QListWidget*>{ui->taskListWidget, ui->replyListWidget, ui->eventListWidget})
+    {
+        for (int row = 0; row < listWidget->count(); row++)
+        {
+            auto item = RuleListItem::from(listWidget->item(row));
+            if (item->isEnabled())
+                collect(item->getBody());
+        }
+    }
+
+    if (texts.size())
+        qInfo() << "预先合成语音：" << texts.size() << "条";
+    foreach (QString text, texts)
+        prepareSpeech(text);
 }
 
 void MainWindow::showScreenDanmaku(LiveDanmaku danmaku)
@@ -11203,82 +11528,41 @@ void MainWindow::showScreenDanmaku(LiveDanmaku danmaku)
     if (danmaku.isPkLink()) // 对面同步过来的弹幕
         return ;
 
-    // 显示动画
-    QLabel* label = new QLabel(nullptr);
-    label->setWindowFlag(Qt::FramelessWindowHint, true);
-    label->setWindowFlag(Qt::Tool, true);
-    label->setWindowFlag(Qt::WindowStaysOnTopHint, true);
-    label->setAttribute(Qt::WA_TranslucentBackground, true); // 设置窗口透明
-    label->setAttribute(Qt::WA_TransparentForMouseEvents, true);
-
+    QString text;
     if (danmaku.getMsgType() == MSG_DANMAKU || !danmaku.getText().isEmpty())
-        label->setText(danmaku.getText());
+        text = danmaku.getText();
     else
     {
-        QString text = danmaku.toString();
+        text = danmaku.toString();
         QRegularExpression re("^\\d+:\\d+:\\d+\\s+(.+)$"); // 简化表达式
         QRegularExpressionMatch match;
         if (text.indexOf(re, 0, &match) > -1)
             text = match.capturedTexts().at(1);
-        label->setText(text);
     }
-    label->setFont(screenDanmakuFont);
 
     auto isBlankColor = [=](QString c) -> bool {
         c = c.toLower();
         return c.isEmpty() || c == "#ffffff" || c == "#000000"
                 || c == "#ffffffff" || c == "#00000000";
     };
+    QColor color = screenDanmakuColor;
     if (!danmaku.getTextColor().isEmpty() && !isBlankColor(danmaku.getTextColor()))
-        label->setStyleSheet("color:" + danmaku.getTextColor() + ";");
-    else
-        label->setStyleSheet("color:" + QVariant(screenDanmakuColor).toString() + ";");
-    label->adjustSize();
-    label->show();
+        color = QColor(danmaku.getTextColor());
 
     QRect rect = getScreenRect();
     int left = rect.left() + rect.width() * ui->screenDanmakuLeftSpin->value() / 100;
     int right = rect.right() - rect.width() * ui->screenDanmakuRightSpin->value() / 100;
     int top = rect.top() + rect.height() * ui->screenDanmakuTopSpin->value() / 100;
     int bottom = rect.bottom() - rect.height() * ui->screenDanmakuBottomSpin->value() / 100;
-    int sx = right, ex = left - label->width();
-    if (left > right) // 从左往右
-    {
-        sx = right - label->width();
-        ex = left;
-    }
 
-    // 避免重叠
-    auto isOverlap = [=](int x, int y, int height){
-        foreach (QLabel* label, screenLabels)
-        {
-            if (label->geometry().contains(x, y)
-                    || label->geometry().contains(x, y+height))
-                return true;
-        }
-        return false;
-    };
-    int forCount = 0;
-    int y = 0;
-    do {
-        int ry = qrand() % (qMax(30, qAbs(bottom - top) - label->height()));
-        y = qMin(top, bottom) + label->height() + ry;
-        if (++forCount >= 32) // 最多循环32遍（如果弹幕极多，可能会必定叠在一起）
-            break;
-    } while (isOverlap(sx, y, label->height()));
-
-    label->move(QPoint(sx, y));
-    screenLabels.append(label);
-    QPropertyAnimation* ani = new QPropertyAnimation(label, "pos");
-    ani->setStartValue(QPoint(sx, y));
-    ani->setEndValue(QPoint(ex, y));
-    ani->setDuration(ui->screenDanmakuSpeedSpin->value() * 1000);
-    connect(ani, &QPropertyAnimation::finished, ani, [=]{
-        ani->deleteLater();
-        screenLabels.removeOne(label);
-        label->deleteLater();
-    });
-    ani->start();
+    // 所有弹幕在同一个透明窗口里绘制
+    if (!screenDanmakuOverlay)
+        screenDanmakuOverlay = new ScreenDanmakuOverlay(nullptr);
+    screenDanmakuOverlay->setArea(QRect(QPoint(qMin(left, right), qMin(top, bottom)),
+                                        QPoint(qMax(left, right), qMax(top, bottom))), left > right);
+    screenDanmakuOverlay->setTextFont(screenDanmakuFont);
+    screenDanmakuOverlay->setDuration(ui->screenDanmakuSpeedSpin->value() * 1000);
+    screenDanmakuOverlay->addDanmaku(text, color);
 }
 
 /**
@@ -11713,9 +11997,7 @@ void MainWindow::userComeEvent(LiveDanmaku &danmaku)
     danmakuCounts->setValue("come/"+snum(uid), userCome);
     danmakuCounts->setValue("comeTime/"+snum(uid), danmaku.getTimeline().toSecsSinceEpoch());
 
-    dailyCome++;
-    if (dailySettings)
-        dailySettings->setValue("come", dailyCome);
+    analytics->add(LiveAnalytics::Come);
     if (danmaku.isOpposite())
     {
         // 加到自己这边来，免得下次误杀（即只提醒一次）
@@ -11749,50 +12031,101 @@ void MainWindow::userComeEvent(LiveDanmaku &danmaku)
     }
 }
 
-void MainWindow::refreshBlockList()
-{
-    if (browserData.isEmpty())
-    {
-        showError("请先设置用户数据");
-        return ;
-    }
+/**
+ * 同步完整的禁言列表
+ * 多路并行分页获取（第 k 路获取 k、k+P、k+2P... 页），直到空页；
+ * 全部成功后再和本地的禁言列表比较，只改动有差异的。
+ * 任何一页失败、或者被新的同步取代，都不修改本地列表。
+ * @param finished 结束后调用（不论成功与否），参数为是否成功同步
+ */
+void MainWindow::refreshBlockList(std::function<void(bool)> finished)
+{
+    if (browserData.isEmpty())
+    {
+        showError("请先设置用户数据");
+        if (finished)
+            finished(false);
+        return ;
+    }
+
+    moderation->setRoomId(roomId.toLongLong());
+    const qint64 generation = ++blockListSyncGeneration;
+    const QString rid = roomId;
+    QSharedPointer<QHash<qint64, qint64>> remote(new QHash<qint64, qint64>); // uid -> 禁言ID
+    QSharedPointer<int> running(new int(BLOCK_LIST_PARALLEL));
+    QSharedPointer<bool> failed(new bool(false));
+    QSharedPointer<std::function<void(int)>> fetchPage(new std::function<void(int)>);
+    QElapsedTimer* timer = new QElapsedTimer;
+    timer->start();
+
+    *fetchPage = [=](int page) {
+        QString url = "https://api.live.bilibili.com/liveact/ajaxGetBlockList?roomid=" + rid + "&page=" + snum(page);
+        get(url, [=](QNetworkReply* reply){
+            if (generation != blockListSyncGeneration || rid != roomId)
+            {
+                *failed = true; // 已经有新的同步
+            }
+            else if (!*failed)
+            {
+                QJsonParseError error;
+                MyJson json(QJsonDocument::fromJson(reply->readAll(), &error).object());
+                if (error.error != QJsonParseError::NoError || json.i("code") != 0)
+                {
+                    qWarning() << "获取禁言：" << page << (error.error != QJsonParseError::NoError ? error.errorString() : json.s("message"));
+                    *failed = true;
+                }
+                else
+                {
+                    QJsonArray list = json.a("data");
+                    foreach (QJsonValue val, list)
+                    {
+                        QJsonObject obj = val.toObject();
+                        qint64 id = static_cast<qint64>(obj.value("id").toDouble());
+                        qint64 uid = static_cast<qint64>(obj.value("uid").toDouble());
+                        remote->insert(uid, id);
+                    }
+
+                    if (!list.isEmpty())
+                    {
+                        if (page + BLOCK_LIST_PARALLEL <= BLOCK_LIST_MAX_PAGE)
+                        {
+                            (*fetchPage)(page + BLOCK_LIST_PARALLEL); // 本路继续下一页
+                            return ;
+                        }
+                        qWarning() << "获取禁言：超过最大页数" << BLOCK_LIST_MAX_PAGE;
+                        *failed = true; // 列表不完整，无法判断哪些已经解除
+                    }
+                }
+            }
 
-    // 刷新被禁言的列表
-    QString url = "https://api.live.bilibili.com/liveact/ajaxGetBlockList?roomid="+roomId+"&page=1";
-    get(url, [=](QJsonObject json){
-        int code = json.value("code").toInt();
-        if (code != 0)
-        {
-            qWarning() << "获取禁言：" << json.value("message").toString();
-            /* if (code == 403)
-                showError("获取禁言", "您没有权限");
+            if (--(*running) > 0)
+                return ;
+
+            // 所有的路都结束了
+            if (!*failed)
+            {
+                ModerationState::BlockDiff diff = moderation->applyBlockList(*remote);
+                qInfo() << "同步禁言列表：" << remote->size() << "人，新增" << diff.added << "解除" << diff.removed
+                        << "变更" << diff.changed << "耗时" << timer->elapsed() << "ms";
+            }
             else
-                showError("获取禁言", json.value("message").toString()); */
-            return ;
-        }
-        QJsonArray list = json.value("data").toArray();
-        userBlockIds.clear();
-        foreach (QJsonValue val, list)
-        {
-            QJsonObject obj = val.toObject();
-            qint64 id = static_cast<qint64>(obj.value("id").toDouble());
-            qint64 uid = static_cast<qint64>(obj.value("uid").toDouble());
-            QString uname = obj.value("uname").toString();
-            userBlockIds.insert(uid, id);
-//            qInfo() << "已屏蔽:" << id << uname << uid;
-        }
+            {
+                qWarning() << "同步禁言列表失败，保留本地列表";
+            }
+            delete timer;
+            *fetchPage = nullptr; // 释放互相引用的闭包
+            if (finished)
+                finished(!*failed);
+        });
+    };
 
-    });
+    for (int i = 1; i <= BLOCK_LIST_PARALLEL; i++)
+        (*fetchPage)(i);
 }
 
 bool MainWindow::isInFans(qint64 uid)
 {
-    foreach (auto fan, fansList)
-    {
-        if (fan.mid == uid)
-            return true;
-    }
-    return false;
+    return moderation->isFan(uid);
 }
 
 void MainWindow::sendGift(int giftId, int giftNum)
@@ -12034,26 +12367,41 @@ void MainWindow::getBagList(qint64 sendExpire)
     });
 }
 
-void MainWindow::updateExistGuards(int page)
+/**
+ * 获取当前的船员列表
+ * 所有页一起获取，完整之后整体替换 currentGuards 和 guardInfos；
+ * 和上一次的列表比较，触发 GUARD_LIST_ADD（新上船）、GUARD_LIST_REMOVE（掉船）
+ */
+void MainWindow::updateExistGuards()
 {
-    if (page == 0) // 表示是入口
-    {
-        if (updateGuarding)
-            return ;
-
-        page = 1;
-        currentGuards.clear();
-        guardInfos.clear();
-        updateGuarding = true;
+    if (updateGuarding)
+        return ;
 
-        // 参数是0的话，自动判断是否需要
-        if (browserCookie.isEmpty())
-            return ;
-    }
+    // 未登录的话不获取
+    if (browserCookie.isEmpty())
+        return ;
+    updateGuarding = true;
 
     const int pageSize = 29;
+    const QString _upUid = upUid;
+    const QString rid = roomId;
+    auto pageUrl = [=](int page) {
+        return "https://api.live.bilibili.com/xlive/app-room/v2/guardTab/topList?roomid="
+                +rid+"&page="+snum(page)+"&ruid="+_upUid+"&page_size="+snum(pageSize);
+    };
+    auto pageCount = [=](const MyJson& json) {
+        MyJson info = json.data().o("info");
+        int page = info.i("page");
+        if (page > 0)
+            return page;
+        return (info.i("num") - 3 + pageSize - 1) / pageSize; // 第一页另外还有前三
+    };
+
+    PagedFetcher::fetch(this, pageUrl, pageCount, [=](bool ok, const QList<MyJson>& pages){
+        updateGuarding = false;
+        if (!ok || _upUid != upUid)
+            return ;
 
-    auto judgeGuard = [=](QJsonObject user){
         /*{
             "face": "http://i1.hdslb.com/bfs/face/29183e0e21b60c01a95bb5c281566edb22af0f43.jpg",
             "guard_level": 3,
@@ -12071,22 +12419,56 @@ void MainWindow::updateExistGuards(int page)
             "uid": 20285041,
             "username": "懒一夕智能科技"
         }*/
-        QString username = user.value("username").toString();
-        qint64 uid = static_cast<qint64>(user.value("uid").toDouble());
-        int guardLevel = user.value("guard_level").toInt();
-        guardInfos.append(LiveDanmaku(guardLevel, username, uid, QDateTime::currentDateTime()));
-        currentGuards[uid] = username;
+        QHash<qint64, QString> guards;
+        QList<LiveDanmaku> infos;
+        QHash<qint64, int> levels;
+        auto judgeGuard = [&](QJsonObject user){
+            QString username = user.value("username").toString();
+            qint64 uid = static_cast<qint64>(user.value("uid").toDouble());
+            int guardLevel = user.value("guard_level").toInt();
+            if (guards.contains(uid)) // 翻页时排名变化导致重复
+                return ;
+            infos.append(LiveDanmaku(guardLevel, username, uid, QDateTime::currentDateTime()));
+            guards.insert(uid, username);
+            levels.insert(uid, guardLevel);
+        };
+        for (int i = 0; i < pages.size(); i++)
+        {
+            MyJson data = pages.at(i).data();
+            if (i == 0)
+            {
+                foreach (QJsonValue val, data.a("top3"))
+                    judgeGuard(val.toObject());
+            }
+            foreach (QJsonValue val, data.a("list"))
+                judgeGuard(val.toObject());
+        }
+
+        QList<qint64> added, removed;
+        diffCollections(currentGuards, guards, &added, &removed);
+        const QList<LiveDanmaku> oldInfos = guardInfos;
+        const bool firstLoad = !guardListLoaded;
 
-        if (uid == this->cookieUid.toLongLong())
+        // 整体替换
+        currentGuards.swap(guards);
+        guardInfos.swap(infos);
+        guardListLoaded = true;
+        qInfo() << "船员列表：" << currentGuards.size() << "人，新增" << added.size() << "移除" << removed.size();
+
+        qint64 myUid = cookieUid.toLongLong();
+        if (levels.contains(myUid) && levels.value(myUid) != cookieGuardLevel)
         {
-            this->cookieGuardLevel = guardLevel;
+            this->cookieGuardLevel = levels.value(myUid);
             if (ui->adjustDanmakuLongestCheck->isChecked())
                 adjustDanmakuLongest();
         }
 
-        int count = danmakuCounts->value("guard/" + snum(uid), 0).toInt();
-        if (!count)
+        for (auto it = levels.constBegin(); it != levels.constEnd(); ++it)
         {
+            qint64 uid = it.key();
+            int guardLevel = it.value();
+            if (danmakuCounts->value("guard/" + snum(uid), 0).toInt())
+                continue;
             int count = 1;
             if (guardLevel == 3)
                 count = 1;
@@ -12095,55 +12477,33 @@ void MainWindow::updateExistGuards(int page)
             else if (guardLevel == 1)
                 count = 100;
             else
-                qWarning() << "错误舰长等级：" << username << uid << guardLevel;
+                qWarning() << "错误舰长等级：" << currentGuards.value(uid) << uid << guardLevel;
             danmakuCounts->setValue("guard/" + snum(uid), count);
-            // qInfo() << "设置舰长：" << username << uid << count;
-        }
-    };
-
-    QString _upUid = upUid;
-    QString url = "https://api.live.bilibili.com/xlive/app-room/v2/guardTab/topList?roomid="
-            +roomId+"&page="+snum(page)+"&ruid="+upUid+"&page_size="+snum(pageSize);
-    get(url, [=](QJsonObject json){
-        if (_upUid != upUid)
-        {
-            updateGuarding = false;
-            return ;
         }
 
-        QJsonObject data = json.value("data").toObject();
-
-        if (page == 1)
+        if (!firstLoad)
         {
-            QJsonArray top3 = data.value("top3").toArray();
-            foreach (QJsonValue val, top3)
+            foreach (qint64 uid, added)
+                triggerCmdEvent("GUARD_LIST_ADD", LiveDanmaku(levels.value(uid), currentGuards.value(uid), uid, QDateTime::currentDateTime()), true);
+            foreach (qint64 uid, removed)
             {
-                judgeGuard(val.toObject());
+                for (int i = 0; i < oldInfos.size(); i++)
+                {
+                    if (oldInfos.at(i).getUid() == uid)
+                    {
+                        triggerCmdEvent("GUARD_LIST_REMOVE", oldInfos.at(i), true);
+                        break;
+                    }
+                }
             }
         }
 
-        QJsonArray list = data.value("list").toArray();
-        foreach (QJsonValue val, list)
-        {
-            judgeGuard(val.toObject());
-        }
-
-        // 下一页
-        QJsonObject info = data.value("info").toObject();
-        int num = info.value("num").toInt();
-        if (page * pageSize + 3 < num)
-            updateExistGuards(page + 1);
-        else // 全部结束了
-        {
-            if (ui->saveMonthGuardCheck->isChecked())
-                saveMonthGuard();
+        if (ui->saveMonthGuardCheck->isChecked())
+            saveMonthGuard();
 
-            if (dailySettings)
-                dailySettings->setValue("guard_count", currentGuards.size());
-            updateGuarding = false;
-            ui->guardCountLabel->setText(snum(currentGuards.size()));
-        }
-    });
+        analytics->setGauge(LiveAnalytics::GuardCount, currentGuards.size());
+        ui->guardCountLabel->setText(snum(currentGuards.size()));
+    }, userCookies);
 }
 
 /**
@@ -12218,12 +12578,14 @@ void MainWindow::updateOnlineGoldRank()
     QString _upUid = upUid;
     QString url = "https://api.live.bilibili.com/xlive/general-interface/v1/rank/getOnlineGoldRank?roomId="
             +pkRoomId+"&page="+snum(1)+"&ruid="+upUid+"&pageSize="+snum(50);
-    onlineGoldRank.clear();
+    const qint64 generation = ++onlineGoldRankGeneration;
 
     get(url, [=](QJsonObject json){
-        if (_upUid != upUid)
+        if (_upUid != upUid || generation != onlineGoldRankGeneration) // 已经有更新的请求
             return ;
 
+        // 在旁边生成新的榜单，完整后整体替换
+        QList<LiveDanmaku> rank;
         QStringList names;
         QJsonObject data = json.value("data").toObject();
         QJsonArray array = data.value("OnlineRankItem").toArray();
@@ -12265,8 +12627,9 @@ void MainWindow::updateOnlineGoldRank()
                                  "");
             }
 
-            onlineGoldRank.append(danmaku);
+            rank.append(danmaku);
         }
+        onlineGoldRank.swap(rank);
         if (names.size())
             qInfo() << "高能榜：" << names;
     });
@@ -12334,64 +12697,56 @@ void MainWindow::getPkMatchInfo()
     });
 }
 
-void MainWindow::getPkOnlineGuardPage(int page)
+/**
+ * 统计对面直播间在线的船员，所有页一起获取
+ */
+void MainWindow::getPkOnlineGuards()
 {
-    static int guard1 = 0, guard2 = 0, guard3 = 0;
-    if (page == 0)
-    {
-        page = 1;
-        guard1 = guard2 = guard3 = 0;
-    }
+    const QString rid = pkRoomId;
+    const QString ruid = pkUid;
+    auto pageUrl = [=](int page) {
+        return "https://api.live.bilibili.com/xlive/app-room/v2/guardTab/topList?actionKey=appkey&appkey=27eb53fc9058f8c3&roomid=" + rid
+                +"&page=" + QString::number(page) + "&ruid=" + ruid + "&page_size=30";
+    };
+    auto pageCount = [=](const MyJson& json) {
+        return json.data().o("info").i("page");
+    };
 
-    auto addCount = [=](MyJson user) {
-        int alive = user.i("is_alive");
-        if (!alive)
-            return ;
-        QString username = user.s("username");
-        int guard_level = user.i("guard_level");
-        if (!alive)
+    PagedFetcher::fetch(this, pageUrl, pageCount, [=](bool ok, const QList<MyJson>& pages){
+        if (!ok)
             return ;
-        if (guard_level == 1)
-            guard1++;
-        else if (guard_level == 2)
-            guard2++;
-        else
-            guard3++;
-    };
 
-    QString url = "https://api.live.bilibili.com/xlive/app-room/v2/guardTab/topList?actionKey=appkey&appkey=27eb53fc9058f8c3&roomid=" + pkRoomId
-            +"&page=" + QString::number(page) + "&ruid=" + pkUid + "&page_size=30";
-    get(url, [=](MyJson json){
-        MyJson data = json.data();
-        // top3
-        if (page == 1)
+        int guard1 = 0, guard2 = 0, guard3 = 0;
+        auto addCount = [&](MyJson user) {
+            if (!user.i("is_alive"))
+                return ;
+            int guard_level = user.i("guard_level");
+            if (guard_level == 1)
+                guard1++;
+            else if (guard_level == 2)
+                guard2++;
+            else
+                guard3++;
+        };
+        for (int i = 0; i < pages.size(); i++)
         {
-            QJsonArray top3 = data.value("top3").toArray();
-            foreach (QJsonValue val, top3)
+            MyJson data = pages.at(i).data();
+            if (i == 0)
+            {
+                foreach (QJsonValue val, data.a("top3"))
+                    addCount(val.toObject());
+            }
+            foreach (QJsonValue val, data.a("list"))
                 addCount(val.toObject());
         }
 
-        // list
-        QJsonArray list = data.value("list").toArray();
-        foreach (QJsonValue val, list)
-            addCount(val.toObject());
-
-        // 下一页
-        QJsonObject info = data.value("info").toObject();
-        int page = info.value("page").toInt();
-        int now = info.value("now").toInt();
-        if (now < page)
-            getPkOnlineGuardPage(now+1);
-        else // 全部完成了
-        {
-            qInfo() << "舰长数量：" << guard1 << guard2 << guard3;
-            LiveDanmaku danmaku;
-            danmaku.setNumber(guard1 + guard2 + guard3);
-            danmaku.extraJson.insert("guard1", guard1);
-            danmaku.extraJson.insert("guard2", guard2);
-            danmaku.extraJson.insert("guard3", guard3);
-            triggerCmdEvent("PK_MATCH_ONLINE_GUARD", danmaku, true);
-        }
+        qInfo() << "舰长数量：" << guard1 << guard2 << guard3;
+        LiveDanmaku danmaku;
+        danmaku.setNumber(guard1 + guard2 + guard3);
+        danmaku.extraJson.insert("guard1", guard1);
+        danmaku.extraJson.insert("guard2", guard2);
+        danmaku.extraJson.insert("guard3", guard3);
+        triggerCmdEvent("PK_MATCH_ONLINE_GUARD", danmaku, true);
     });
 }
 
@@ -12412,11 +12767,13 @@ void MainWindow::on_autoSendGiftCheck_stateChanged(int arg1)
 void MainWindow::on_autoWelcomeWordsEdit_textChanged()
 {
     settings->setValue("danmaku/autoWelcomeWords", ui->autoWelcomeWordsEdit->toPlainText());
+    welcomeWords = compileWords(ui->autoWelcomeWordsEdit->toPlainText());
 }
 
 void MainWindow::on_autoThankWordsEdit_textChanged()
 {
     settings->setValue("danmaku/autoThankWords", ui->autoThankWordsEdit->toPlainText());
+    thankWords = compileWords(ui->autoThankWordsEdit->toPlainText());
 }
 
 void MainWindow::on_startLiveWordsEdit_editingFinished()
@@ -12444,6 +12801,7 @@ void MainWindow::on_autoSendAttentionCheck_stateChanged(int arg1)
 void MainWindow::on_autoAttentionWordsEdit_textChanged()
 {
     settings->setValue("danmaku/autoAttentionWords", ui->autoAttentionWordsEdit->toPlainText());
+    attentionWords = compileWords(ui->autoAttentionWordsEdit->toPlainText());
 }
 
 void MainWindow::on_sendWelcomeCDSpin_valueChanged(int arg1)
@@ -12506,7 +12864,8 @@ void MainWindow::addBlockUser(qint64 uid, qint64 roomId, int hour)
         }
         QJsonObject d = json.value("data").toObject();
         qint64 id = static_cast<qint64>(d.value("id").toDouble());
-        userBlockIds[uid] = id;
+        if (roomId == this->roomId.toLongLong()) // 禁言列表只记录当前房间的
+            moderation->setBlocked(uid, id);
     });
 }
 
@@ -12529,16 +12888,67 @@ void MainWindow::delBlockUser(qint64 uid, qint64 roomId)
         return ;
     }
 
-    if (userBlockIds.contains(uid))
+    // 本地只记录当前直播间的禁言列表，其他直播间逐页查找禁言ID
+    if (roomId != this->roomId.toLongLong())
+    {
+        findRoomBlockId(uid, roomId, 1, [=](qint64 id){
+            qInfo() << "取消禁言：" << uid << "  room =" << roomId << "  id =" << id;
+            delRoomBlockUser(id, roomId);
+        });
+        return ;
+    }
+
+    if (moderation->isBlocked(uid))
     {
-        qInfo() << "取消禁言：" << uid << "  id =" << userBlockIds.value(uid);
-        delRoomBlockUser(userBlockIds.value(uid));
-        userBlockIds.remove(uid);
+        qInfo() << "取消禁言：" << uid << "  id =" << moderation->getBlockId(uid);
+        delRoomBlockUser(moderation->getBlockId(uid), roomId);
+        moderation->removeBlocked(uid);
         return ;
     }
 
-    // 获取直播间的网络ID，再取消屏蔽
-    QString url = "https://api.live.bilibili.com/liveact/ajaxGetBlockList?roomid="+snum(roomId)+"&page=1";
+    // 同步完整的禁言列表，获取禁言ID后再取消
+    refreshBlockList([=](bool ok){
+        if (!ok)
+        {
+            showError("取消禁言", "获取禁言列表失败");
+            return ;
+        }
+        if (!moderation->isBlocked(uid))
+        {
+            qWarning() << "取消禁言：不在禁言列表中" << uid;
+            return ;
+        }
+        qInfo() << "取消禁言：" << uid << "  id =" << moderation->getBlockId(uid);
+        delRoomBlockUser(moderation->getBlockId(uid), roomId);
+        moderation->removeBlocked(uid);
+    });
+}
+
+void MainWindow::delRoomBlockUser(qint64 id, qint64 roomId)
+{
+    QString url = "https://api.live.bilibili.com/banned_service/v1/Silent/del_room_block_user";
+    QString data = QString("id=%1&roomid=%2&csrf_token=%4&csrd=%5&visit_id=")
+                    .arg(id).arg(roomId).arg(csrf_token).arg(csrf_token);
+
+    post(url, data.toStdString().data(), [=](QJsonObject json){
+        if (json.value("code").toInt() != 0)
+        {
+            showError("取消禁言", json.value("message").toString());
+            return ;
+        }
+
+        if (roomId == this->roomId.toLongLong())
+            moderation->removeBlockId(id);
+    });
+}
+
+/**
+ * 在指定直播间的禁言列表中按页查找用户的禁言ID，不修改本地列表
+ * 找到后调用 found；没找到或出错时提示
+ */
+void MainWindow::findRoomBlockId(qint64 uid, qint64 roomId, int page, std::function<void(qint64)> found)
+{
+    QString url = "https://api.live.bilibili.com/liveact/ajaxGetBlockList?roomid=" + snum(roomId) + "&page=" + snum(page);
     get(url, [=](QJsonObject json){
         int code = json.value("code").toInt();
         if (code != 0)
@@ -12555,35 +12965,23 @@ void MainWindow::delBlockUser(qint64 uid, qint64 roomId)
             QJsonObject obj = val.toObject();
             if (static_cast<qint64>(obj.value("uid").toDouble()) == uid)
             {
-                delRoomBlockUser(static_cast<qint64>(obj.value("id").toDouble())); // 获取房间ID
-                break;
+                found(static_cast<qint64>(obj.value("id").toDouble()));
+                return ;
             }
         }
 
-    });
-}
-
-void MainWindow::delRoomBlockUser(qint64 id)
-{
-    QString url = "https://api.live.bilibili.com/banned_service/v1/Silent/del_room_block_user";
-    QString data = QString("id=%1&roomid=%2&csrf_token=%4&csrd=%5&visit_id=")
-                    .arg(id).arg(roomId).arg(csrf_token).arg(csrf_token);
-
-    post(url, data.toStdString().data(), [=](QJsonObject json){
-        if (json.value("code").toInt() != 0)
+        if (list.isEmpty() || page >= BLOCK_LIST_MAX_PAGE)
         {
-            showError("取消禁言", json.value("message").toString());
+            qWarning() << "取消禁言：不在禁言列表中" << uid << "  room =" << roomId;
             return ;
         }
-
-        // if (userBlockIds.values().contains(id))
-        //    userBlockIds.remove(userBlockIds.key(id));
+        findRoomBlockId(uid, roomId, page + 1, found);
     });
 }
 
 void MainWindow::eternalBlockUser(qint64 uid, QString uname)
 {
-    if (eternalBlockUsers.contains(EternalBlockUser(uid, roomId.toLongLong())))
+    if (moderation->isEternalBlocked(uid, roomId.toLongLong()))
     {
         localNotify("该用户已经在永久禁言中");
         return ;
@@ -12591,20 +12989,15 @@ void MainWindow::eternalBlockUser(qint64 uid, QString uname)
 
     addBlockUser(uid, 720);
 
-    eternalBlockUsers.append(EternalBlockUser(uid, roomId.toLongLong(), uname, upName, roomTitle, QDateTime::currentSecsSinceEpoch()));
-    saveEternalBlockUsers();
-    qInfo() << "添加永久禁言：" << uname << "    当前人数：" << eternalBlockUsers.size();
+    moderation->addEternalBlock(EternalBlockUser(uid, roomId.toLongLong(), uname, upName, roomTitle, QDateTime::currentSecsSinceEpoch()));
+    qInfo() << "添加永久禁言：" << uname << "    当前人数：" << moderation->getEternalBlockCount();
 }
 
 void MainWindow::cancelEternalBlockUser(qint64 uid)
 {
-    EternalBlockUser user(uid, roomId.toLongLong());
-    if (!eternalBlockUsers.contains(user))
+    if (!moderation->removeEternalBlock(uid, roomId.toLongLong()))
         return ;
-
-    eternalBlockUsers.removeOne(user);
-    saveEternalBlockUsers();
-    qInfo() << "移除永久禁言：" << uid << "    当前人数：" << eternalBlockUsers.size();
+    qInfo() << "移除永久禁言：" << uid << "    当前人数：" << moderation->getEternalBlockCount();
 }
 
 void MainWindow::cancelEternalBlockUserAndUnblock(qint64 uid)
@@ -12614,18 +13007,9 @@ void MainWindow::cancelEternalBlockUserAndUnblock(qint64 uid)
     delBlockUser(uid);
 }
 
-void MainWindow::saveEternalBlockUsers()
-{
-    QJsonArray array;
-    int size = eternalBlockUsers.size();
-    for (int i = 0; i < size; i++)
-        array.append(eternalBlockUsers.at(i).toJson());
-    settings->setValue("danmaku/eternalBlockUsers", array);
-    qInfo() << "保存永久禁言，当前人数：" << eternalBlockUsers.size();
-}
-
 /**
- * 检测需要重新禁言的用户，越前面时间越早
+ * 重新禁言快要到期的永久禁言用户
+ * 只取出到期的，不遍历全部
  */
 void MainWindow::detectEternalBlockUsers()
 {
@@ -12633,24 +13017,12 @@ void MainWindow::detectEternalBlockUsers()
     const int MAX_BLOCK_HOUR = 720;
     qint64 maxBlockSecond = MAX_BLOCK_HOUR * 3600;
     const int netDelay = 5; // 5秒的屏蔽时长
-    bool blocked = false;
-    for (int i = 0; i < eternalBlockUsers.size(); i++)
+    QList<EternalBlockUser> due = moderation->renewDueEternalBlocks(currentSecond - maxBlockSecond - netDelay, currentSecond);
+    foreach (const EternalBlockUser& user, due)
     {
-        EternalBlockUser user = eternalBlockUsers.first();
-        if (user.time + maxBlockSecond + netDelay >= currentSecond) // 仍在冷却中
-            break;
-
-        // 该补上禁言啦
-        blocked = true;
         qInfo() << "永久禁言：重新禁言用户" << user.uid << user.uname << user.time << "->" << currentSecond;
         addBlockUser(user.uid, user.roomId, MAX_BLOCK_HOUR);
-
-        user.time = currentSecond;
-        eternalBlockUsers.removeFirst();
-        eternalBlockUsers.append(user);
     }
-    if (blocked)
-        saveEternalBlockUsers();
 }
 
 void MainWindow::on_enableBlockCheck_clicked()
@@ -12682,6 +13054,7 @@ void MainWindow::on_autoBlockNewbieCheck_clicked()
 void MainWindow::on_autoBlockNewbieKeysEdit_textChanged()
 {
     settings->setValue("block/autoBlockNewbieKeys", ui->autoBlockNewbieKeysEdit->toPlainText());
+    autoBlockKeys = KeywordsSnapshot::compile(ui->autoBlockNewbieKeysEdit->toPlainText());
 }
 
 void MainWindow::on_autoBlockNewbieNotifyCheck_clicked()
@@ -12692,6 +13065,7 @@ void MainWindow::on_autoBlockNewbieNotifyCheck_clicked()
 void MainWindow::on_autoBlockNewbieNotifyWordsEdit_textChanged()
 {
     settings->setValue("block/autoBlockNewbieNotifyWords", ui->autoBlockNewbieNotifyWordsEdit->toPlainText());
+    blockNotifyWords = compileWords(ui->autoBlockNewbieNotifyWordsEdit->toPlainText());
 }
 
 void MainWindow::on_saveDanmakuToFileCheck_clicked()
@@ -12712,6 +13086,7 @@ void MainWindow::on_promptBlockNewbieCheck_clicked()
 void MainWindow::on_promptBlockNewbieKeysEdit_textChanged()
 {
     settings->setValue("block/promptBlockNewbieKeys", ui->promptBlockNewbieKeysEdit->toPlainText());
+    promptBlockKeys = KeywordsSnapshot::compile(ui->promptBlockNewbieKeysEdit->toPlainText());
 }
 
 void MainWindow::on_timerConnectServerCheck_clicked()
@@ -12744,21 +13119,23 @@ void MainWindow::on_calculateDailyDataCheck_clicked()
     settings->setValue("live/calculateDaliyData", enable);
     if (enable)
         startCalculateDailyData();
+    else
+        analytics->setArchiveEnabled(false);
 }
 
 void MainWindow::on_pushButton_clicked()
 {
     QString text = QDateTime::currentDateTime().toString("yyyy-MM-dd\n");
-    text += "\n进来人次：" + snum(dailyCome);
+    text += "\n进来人次：" + snum(analytics->getToday(LiveAnalytics::Come));
     text += "\n观众人数：" + snum(userComeTimes.count());
-    text += "\n弹幕数量：" + snum(dailyDanmaku);
-    text += "\n新人弹幕：" + snum(dailyNewbieMsg);
-    text += "\n新增关注：" + snum(dailyNewFans);
-    text += "\n银瓜子数：" + snum(dailyGiftSilver);
-    text += "\n金瓜子数：" + snum(dailyGiftGold);
-    text += "\n上船次数：" + snum(dailyGuard);
-    text += "\n最高人气：" + snum(dailyMaxPopul);
-    text += "\n平均人气：" + snum(dailyAvePopul);
+    text += "\n弹幕数量：" + snum(analytics->getToday(LiveAnalytics::Danmaku));
+    text += "\n新人弹幕：" + snum(analytics->getToday(LiveAnalytics::NewbieMsg));
+    text += "\n新增关注：" + snum(analytics->getToday(LiveAnalytics::NewFans));
+    text += "\n银瓜子数：" + snum(analytics->getToday(LiveAnalytics::GiftSilver));
+    text += "\n金瓜子数：" + snum(analytics->getToday(LiveAnalytics::GiftGold));
+    text += "\n上船次数：" + snum(analytics->getToday(LiveAnalytics::Guard));
+    text += "\n最高人气：" + snum(analytics->getToday(LiveAnalytics::Popularity));
+    text += "\n平均人气：" + snum(analytics->getTodayAveragePopularity());
 
     text += "\n\n累计粉丝：" + snum(currentFans);
     QMessageBox::information(this, "今日数据", text);
@@ -12768,6 +13145,7 @@ void MainWindow::on_removeDanmakuTipIntervalSpin_valueChanged(int arg1)
 {
     this->removeDanmakuTipInterval = arg1 * 1000;
     settings->setValue("danmaku/removeTipInterval", arg1);
+    scheduleRemoveDanmaku();
 }
 
 void MainWindow::on_doveCheck_clicked()
@@ -13103,13 +13481,19 @@ void MainWindow::on_actionShow_Order_Player_Window_triggered()
             }
         });
         connect(musicWindow, &OrderPlayerWindow::signalLyricChanged, this, [=](){
-            if (ui->songLyricsToFileCheck->isChecked())
+            bool toFile = ui->songLyricsToFileCheck->isChecked();
+            if (!toFile && !sendLyricListToSockets)
+                return ;
+
+            // 文件和WebSocket使用同一次查询的结果
+            QStringList lyrics = musicWindow->getSongLyrics(ui->songLyricsToFileMaxSpin->value());
+            if (toFile)
             {
-                saveSongLyrics();
+                saveSongLyrics(lyrics);
             }
             if (sendLyricListToSockets)
             {
-                sendLyricList();
+                sendLyricList(lyrics);
             }
         });
         auto simulateMusicKey = [=]{
@@ -13445,7 +13829,7 @@ void MainWindow::pkStart(QJsonObject json)
     // 处理对面直播姬界面
     if (hasEvent("PK_MATCH_ONLINE_GUARD"))
     {
-        getPkOnlineGuardPage(0);
+        getPkOnlineGuards();
     }
 }
 
@@ -14040,8 +14424,8 @@ void MainWindow::slotPkBinaryMessageReceived(const QByteArray &message)
         if (!json.isEmpty())
         {
             cmd = json.value("cmd").toString();
-            qInfo() << "pk普通CMD：" << cmd;
-            SOCKET_INF << json;
+            LOG_INF(LiveLog::Cmd) << "pk普通CMD：" << cmd;
+            LOG_DEB(LiveLog::Socket) << json;
         }
 
         if (cmd == "NOTICE_MSG") // 全站广播（不用管）
@@ -14098,9 +14482,11 @@ void MainWindow::uncompressPkBytes(const QByteArray &body)
                 + ((uchar)unc[offset+1] << 16)
                 + ((uchar)unc[offset+2] << 8)
                 + (uchar)unc[offset+3];
+        BenchScope decodeScope(ReplayBenchmark::Decode, LiveMetrics::JsonParse);
         QByteArray jsonBa = unc.mid(offset + headerSize, packSize - headerSize);
         QJsonParseError error;
         QJsonDocument document = QJsonDocument::fromJson(jsonBa, &error);
+        decodeScope.finish();
         if (error.error != QJsonParseError::NoError)
         {
             qCritical() << s8("pk解析解压后的JSON出错：") << error.errorString();
@@ -14109,6 +14495,7 @@ void MainWindow::uncompressPkBytes(const QByteArray &body)
             qCritical() << s8(">>pk解压正文") << unc;
             return ;
         }
+        LiveMetrics::add(LiveMetrics::JsonParsed);
         QJsonObject json = document.object();
         QString cmd = json.value("cmd").toString();
         SOCKET_INF << "pk解压后获取到CMD：" << cmd;
@@ -14124,7 +14511,7 @@ void MainWindow::uncompressPkBytes(const QByteArray &body)
 void MainWindow::handlePkMessage(QJsonObject json)
 {
     QString cmd = json.value("cmd").toString();
-    qInfo() << s8(">pk消息命令：") << cmd;
+    LOG_INF(LiveLog::Cmd) << ">pk消息命令：" << cmd;
     if (cmd == "DANMU_MSG" || cmd.startsWith("DANMU_MSG:")) // 收到弹幕
     {
         if (!pkMsgSync || (pkMsgSync == 1 && !pkVideo))
@@ -14148,7 +14535,7 @@ void MainWindow::handlePkMessage(QJsonObject json)
                      snum(static_cast<qint64>(medal[3].toDouble())) == roomId));
 
         // !弹幕的时间戳是13位，其他的是10位！
-        qInfo() << s8("pk接收到弹幕：") << username << msg << QDateTime::fromMSecsSinceEpoch(timestamp);
+        LOG_INF(LiveLog::Cmd) << "pk接收到弹幕：" << username << msg << QDateTime::fromMSecsSinceEpoch(timestamp);
 
         // 添加到列表
         QString cs = QString::number(textColor, 16);
@@ -14191,7 +14578,7 @@ void MainWindow::handlePkMessage(QJsonObject json)
         QString coinType = data.value("coin_type").toString();
         int totalCoin = data.value("total_coin").toInt();
 
-        qInfo() << s8("接收到送礼：") << username << giftId << giftName << num << s8("  总价值：") << totalCoin << coinType;
+        LOG_INF(LiveLog::Cmd) << "接收到送礼：" << username << giftId << giftName << num << "总价值：" << totalCoin << coinType;
         QString localName = getLocalNickname(uid);
         /*if (!localName.isEmpty())
             username = localName;*/
@@ -14513,8 +14900,10 @@ void MainWindow::releaseLiveData(bool prepare)
         myAudience.clear();
         oppositeAudience.clear();
         fansList.clear();
+        moderation->clearFans();
         currentGuards.clear();
         guardInfos.clear();
+        guardListLoaded = false;
         currentFans = 0;
         currentFansClub = 0;
 
@@ -14546,10 +14935,6 @@ void MainWindow::releaseLiveData(bool prepare)
 
     }
 
-    danmuPopulQueue.clear();
-    minuteDanmuPopul = 0;
-    danmuPopulValue = 0;
-
     diangeHistory.clear();
     ui->diangeHistoryListWidget->clear();
 
@@ -15557,15 +15942,13 @@ void MainWindow::upgradeOneVersionData(QString beforeVersion)
     if (beforeVersion == "3.6.3")
     {
         settings->beginGroup("heaps");
-        heaps->beginGroup("heaps");
         auto keys = settings->allKeys();
         for (int i = 0; i < keys.size(); i++)
         {
             QString key = keys.at(i);
-            heaps->setValue(key, settings->value(key));
+            heaps->setValue("heaps/" + key, settings->value(key));
             settings->remove(key);
         }
-        heaps->endGroup();
         settings->endGroup();
     }
 }
@@ -15579,17 +15962,17 @@ void MainWindow::generateDefaultCode(QString path)
 
     QJsonArray array;
     for (int row = 0; row < ui->taskListWidget->count(); row++)
-        array.append(static_cast<TaskWidget*>(ui->taskListWidget->itemWidget(ui->taskListWidget->item(row)))->toJson());
+        array.append(RuleListItem::from(ui->taskListWidget->item(row))->toJson());
     json.insert("timer_task", array);
 
     array = QJsonArray();
     for (int row = 0; row < ui->replyListWidget->count(); row++)
-        array.append(static_cast<ReplyWidget*>(ui->replyListWidget->itemWidget(ui->replyListWidget->item(row)))->toJson());
+        array.append(RuleListItem::from(ui->replyListWidget->item(row))->toJson());
     json.insert("auto_reply", array);
 
     array = QJsonArray();
     for (int row = 0; row < ui->eventListWidget->count(); row++)
-        array.append(static_cast<EventWidget*>(ui->eventListWidget->itemWidget(ui->eventListWidget->item(row)))->toJson());
+        array.append(RuleListItem::from(ui->eventListWidget->item(row))->toJson());
     json.insert("event_action", array);
 
     json.insert("block_keys", ui->autoBlockNewbieKeysEdit->toPlainText());
@@ -15820,6 +16203,8 @@ void MainWindow::on_enableScreenDanmakuCheck_clicked()
 {
     settings->setValue("screendanmaku/enableDanmaku", ui->enableScreenDanmakuCheck->isChecked());
     ui->enableScreenMsgCheck->setEnabled(ui->enableScreenDanmakuCheck->isChecked());
+    if (!ui->enableScreenDanmakuCheck->isChecked() && screenDanmakuOverlay)
+        screenDanmakuOverlay->clear();
 }
 
 void MainWindow::on_enableScreenMsgCheck_clicked()
@@ -16010,7 +16395,7 @@ void MainWindow::slotStartWork()
     liveAllGifts.clear();
 
     // 获取舰长
-    updateExistGuards(0);
+    updateExistGuards();
 
     triggerCmdEvent("START_WORK", LiveDanmaku(), true);
 }
@@ -16064,6 +16449,7 @@ void MainWindow::triggerCmdEvent(QString cmd, LiveDanmaku danmaku, bool debug)
 {
     if (debug)
         qInfo() << "触发事件：" << cmd;
+    triggerEventActions(cmd, danmaku);
     emit signalCmdEvent(cmd, danmaku);
 
     sendDanmakuToSockets(cmd, danmaku);
@@ -16328,7 +16714,7 @@ void MainWindow::on_voiceCustomUrlEdit_editingFinished()
 
 void MainWindow::on_eternalBlockListButton_clicked()
 {
-    EternalBlockDialog* dialog = new EternalBlockDialog(&eternalBlockUsers, this);
+    EternalBlockDialog* dialog = new EternalBlockDialog(moderation->getEternalBlockUsers(), this);
     connect(dialog, SIGNAL(signalCancelEternalBlock(qint64)), this, SLOT(cancelEternalBlockUser(qint64)));
     connect(dialog, SIGNAL(signalCancelBlock(qint64)), this, SLOT(cancelEternalBlockUserAndUnblock(qint64)));
     dialog->exec();
@@ -16374,6 +16760,7 @@ void MainWindow::on_danmuLongestSpin_editingFinished()
 {
     danmuLongest = ui->danmuLongestSpin->value();
     settings->setValue("danmaku/danmuLongest", danmuLongest);
+    updateWordsSnapshots();
 }
 
 
@@ -16657,7 +17044,7 @@ void MainWindow::on_exportDailyButton_clicked()
         return ;
 
     QString oldPath = settings->value("danmaku/exportPath", "").toString();
-    QString path = QFileDialog::getSaveFileName(this, "选择导出位置", oldPath, "Tables (*.csv *.txt)");
+    QString path = QFileDialog::getSaveFileName(this, "选择导出位置", oldPath, "Tables (*.csv *.txt);;JSON (*.json)");
     if (path.isEmpty())
         return ;
     settings->setValue("danmaku/exportPath", path);
@@ -16667,32 +17054,11 @@ void MainWindow::on_exportDailyButton_clicked()
     if (!recordFileCodec.isEmpty())
         stream.setCodec(recordFileCodec.toUtf8());
 
-    // 拼接数据
-    QString dirPath = dataPath + "live_daily";
-    QDir dir(dirPath);
-    auto files = dir.entryList(QStringList{roomId + "_*.ini"}, QDir::Files | QDir::NoDotAndDotDot, QDir::Name);
-    stream << QString("日期,进入人次,进入人数,弹幕数量,新人弹幕,新增关注,关注总数,总金瓜子,总银瓜子,上船人数,船员总数\n").toUtf8();
-    for (int i = 0; i < files.size(); i++)
-    {
-        QStringList sl;
-        QSettings st(dirPath + "/" + files.at(i), QSettings::Format::IniFormat);
-        QString day = files.at(i);
-        day.replace(roomId + "_", "").replace(".ini", "");
-        stream << day << ","
-               << st.value("come", 0).toInt() << ","
-               << st.value("people_num", 0).toInt() << ","
-               << st.value("danmaku", 0).toInt() << ","
-               << st.value("newbie_msg", 0).toInt() << ","
-               << st.value("new_fans", 0).toInt() << ","
-               << st.value("total_fans", 0).toInt() << ","
-               << st.value("gift_gold", 0).toInt() << ","
-               << st.value("gift_silver", 0).toInt() << ","
-               << st.value("guard", 0).toInt() << ","
-               << st.value("guard_count", 0).toInt()  << ","
-               << st.value("average_popularity", 0).toInt() << ","
-               << st.value("max_popularity", 0).toInt()
-               << "\n";
-    }
+    // 从归档逐天读取
+    if (path.endsWith(".json", Qt::CaseInsensitive))
+        analytics->exportDailyJson(stream);
+    else
+        analytics->exportDailyCsv(stream);
 
     file.close();
 }
@@ -16782,7 +17148,7 @@ void MainWindow::on_actionPaste_Code_triggered()
 
     auto pasteFromJson = [&](QJsonObject json) {
         QString anchor_key = json.value("anchor_key").toString();
-        ListItemInterface* item = nullptr;
+        RuleListItem* item = nullptr;
         if (anchor_key == CODE_TIMER_TASK_KEY)
         {
             item = addTimerTask(false, 1800, "");
@@ -16829,51 +17195,23 @@ void MainWindow::on_actionPaste_Code_triggered()
         }
 
         item->fromJson(json);
-        item->autoResizeEdit();
 
         // 检查重复
-        if (anchor_key == CODE_AUTO_REPLY_KEY)
-        {
-            for (int row = 0; row < ui->replyListWidget->count() - 1; row++)
-            {
-                auto rowItem = ui->replyListWidget->item(row);
-                auto widget = ui->replyListWidget->itemWidget(rowItem);
-                if (!widget)
-                    continue;
-                QSize size(ui->replyListWidget->contentsRect().width() - ui->replyListWidget->verticalScrollBar()->width(), widget->height());
-                auto replyWidget = static_cast<ReplyWidget*>(widget);
-
-                auto rw = static_cast<ReplyWidget*>(item);
-                if (rw->keyEdit->text() == replyWidget->keyEdit->text()
-                        && rw->replyEdit->toPlainText() == replyWidget->replyEdit->toPlainText())
-                {
-                    rw->check->setChecked(false);
-                    rw->keyEdit->setText(rw->keyEdit->text() + "_重复");
-                    break;
-                }
-            }
-        }
-        else if (anchor_key == CODE_EVENT_ACTION_KEY)
+        if (anchor_key == CODE_AUTO_REPLY_KEY || anchor_key == CODE_EVENT_ACTION_KEY)
         {
-            for (int row = 0; row < ui->eventListWidget->count() - 1; row++)
+            QListWidget* listWidget = item->listWidget();
+            for (int row = 0; row < listWidget->count() - 1; row++)
             {
-                auto rowItem = ui->eventListWidget->item(row);
-                auto widget = ui->eventListWidget->itemWidget(rowItem);
-                if (!widget)
-                    continue;
-                QSize size(ui->eventListWidget->contentsRect().width() - ui->eventListWidget->verticalScrollBar()->width(), widget->height());
-                auto eventWidget = static_cast<EventWidget*>(widget);
-
-                auto rw = static_cast<EventWidget*>(item);
-                if (rw->eventEdit->text() == eventWidget->eventEdit->text()
-                        && rw->actionEdit->toPlainText() == eventWidget->actionEdit->toPlainText())
+                auto rowItem = RuleListItem::from(listWidget->item(row));
+                if (item->getTitle() == rowItem->getTitle() && item->getBody() == rowItem->getBody())
                 {
-                    rw->check->setChecked(false);
-                    rw->eventEdit->setText(rw->eventEdit->text() + "_重复");
+                    item->setEnabled(false);
+                    item->setTitle(item->getTitle() + "_重复");
                     break;
                 }
             }
         }
+        refreshRuleItem(item);
     };
 
     if (doc.isObject())
@@ -16959,7 +17297,7 @@ void MainWindow::on_pushRecvCmdsButton_clicked()
         // 定时器
         if (!pushCmdsTimer)
         {
-            pushCmdsTimer = new QTimer(this);
+            pushCmdsTimer = new WheelTimer("推送CMD", this);
             pushCmdsTimer->setInterval(ui->timerPushCmdSpin->value() * 100);
             connect(pushCmdsTimer, SIGNAL(timeout()), this, SLOT(on_pushNextCmdButton_clicked()));
         }
@@ -17008,8 +17346,73 @@ void MainWindow::on_pushNextCmdButton_clicked()
     }
 
     // 处理下一行
-    line.replace("__bmd__n__", "\n").replace("__bmd__r__", "\r");
-    slotBinaryMessageReceived(line);
+    slotBinaryMessageReceived(ReplayBenchmark::decodeLine(line));
+}
+
+/**
+ * 无界面回放测试（--benchmark）
+ * 弹幕计数写到临时目录，发送弹幕只计数；结束后输出报告并退出
+ */
+bool MainWindow::startReplayBenchmark(const ReplayBenchmark::Options &options)
+{
+    ReplayBenchmark* bench = new ReplayBenchmark(options, this);
+    QString error;
+    if (!bench->load(&error))
+    {
+        QTextStream(stderr) << "回放测试：" << error << "\n";
+        bench->deleteLater();
+        return false;
+    }
+
+    // 弹幕次数、脚本变量写到临时目录；每日统计、弹幕记录不写入
+    QTemporaryDir* tempDir = new QTemporaryDir;
+    if (danmakuCounts)
+        danmakuCounts->deleteLater();
+    danmakuCounts = new QSettings(tempDir->filePath("danmaku_counts.ini"), QSettings::Format::IniFormat);
+    delete heaps;
+    heaps = new KVStore(tempDir->filePath("heaps.kv"), tempDir->filePath("heaps.kvlog"), this);
+    heaps->load();
+    analytics->setArchiveEnabled(false);
+    finishSaveDanmuToFile();
+    saveRecvCmds = false;
+    localDebug = true; // 禁言、送礼等只在本地提示，不请求（不保存到配置）
+    liveStatus = 1; // 按直播中处理，自动回复、事件都会执行
+    justStart = false;
+
+    // 窗口销毁时（SHUT_DOWN 事件之后）再删除临时文件
+    connect(this, &QObject::destroyed, [=]{
+        delete danmakuCounts;
+        danmakuCounts = nullptr;
+        delete tempDir;
+    });
+
+    connect(bench, &ReplayBenchmark::signalFinished, this, [=]{
+        QString text = bench->reportText();
+        QTextStream(stdout) << text << "\n";
+        if (!options.reportPath.isEmpty())
+        {
+            QFile file(options.reportPath);
+            if (file.open(QIODevice::WriteOnly))
+            {
+                file.write(QJsonDocument(bench->report()).toJson());
+                file.close();
+            }
+            else
+            {
+                QTextStream(stderr) << "无法保存报告：" << options.reportPath << "\n";
+            }
+        }
+
+        qApp->exit(0);
+    });
+    bench->start([=](const QByteArray& frame){
+        try {
+            slotBinaryMessageReceived(frame);
+        } catch (...) {
+            qCritical() << "!!!!!!!error:slotBinaryMessageReceived";
+        }
+    });
+    return true;
 }
 
 void MainWindow::on_timerPushCmdCheck_clicked()
@@ -17042,7 +17445,150 @@ void MainWindow::on_pkChuanmenCheck_stateChanged(int arg1)
 
 void MainWindow::on_actionLast_Candidate_triggered()
 {
-    QMessageBox::information(this, "最后一次调试的候选弹幕", "-------- 填充变量 --------\n\n" + lastConditionDanmu + "\n\n-------- 随机发送 --------\n\n" + lastCandidateDanmaku);
+    QMessageBox::information(this, "最后一次调试的候选弹幕", "-------- 填充变量 --------\n\n" + lastConditionDanmu + "\n\n-------- 随机发送 --------\n\n" + lastCandidateDanmaku.join("\n"));
+}
+
+/**
+ * 时间轮中所有等待执行的任务
+ */
+void MainWindow::on_actionScheduled_Timers_triggered()
+{
+    QStringList sl = TimerWheel::instance()->describe();
+    QString text = sl.isEmpty() ? "没有等待执行的任务" : sl.join("\n");
+    text += "\n\n累计唤醒 " + snum(TimerWheel::instance()->getWakeupCount()) + " 次";
+    QMessageBox::information(this, "定时任务", text);
+}
+
+/**
+ * 测试加载 1000 条自动回复的耗时
+ * 分别统计：从配置读取到数据、为一屏可见的行创建控件、旧版为每一行都创建控件
+ */
+void MainWindow::on_actionRule_Load_Benchmark_triggered()
+{
+    const int count = 1000;
+    QTemporaryDir dir;
+    QString path = dir.filePath("rules.ini");
+    {
+        QSettings st(path, QSettings::Format::IniFormat);
+        st.setValue("reply/count", count);
+        for (int row = 0; row < count; row++)
+        {
+            RuleListItem item(RuleListItem::AutoReply);
+            item.setEnabled(row % 2);
+            item.setTitle("^(关键词" + snum(row) + "|测试" + snum(row) + ")$");
+            item.setBody("[%level% > 10]回复%ai_name%" + snum(row) + "\n回复第二行>speakText(测试)");
+            item.writeSettings(&st, row);
+        }
+    }
+
+    QSettings st(path, QSettings::Format::IniFormat);
+    QListWidget list;
+    list.resize(ui->replyListWidget->size());
+    QElapsedTimer timer;
+
+    // 读取到数据
+    timer.start();
+    int rows = st.value("reply/count").toInt();
+    for (int row = 0; row < rows; row++)
+    {
+        RuleListItem* item = new RuleListItem(RuleListItem::AutoReply);
+        item->readSettings(&st, row);
+        item->setSizeHint(estimateRuleItemSize(&list, item));
+        list.addItem(item);
+    }
+    qint64 loadTime = timer.elapsed();
+
+    // 一屏的控件
+    timer.restart();
+    int visible = 0, height = 0;
+    for (int row = 0; row < list.count() && height < list.viewport()->height(); row++, visible++)
+    {
+        auto item = RuleListItem::from(list.item(row));
+        auto widget = item->createWidget(&list);
+        list.setItemWidget(item, widget);
+        height += widget->height();
+    }
+    qint64 visibleTime = timer.elapsed();
+
+    // 全部控件
+    timer.restart();
+    for (int row = 0; row < list.count(); row++)
+    {
+        auto item = RuleListItem::from(list.item(row));
+        if (!list.itemWidget(item))
+            list.setItemWidget(item, item->createWidget(&list));
+    }
+    qint64 allTime = visibleTime + timer.elapsed();
+
+    QString text = QString("%1 条自动回复\n\n读取数据：%2 ms\n创建可见的 %3 个控件：%4 ms\n创建全部控件（旧版）：%5 ms")
+            .arg(count).arg(loadTime).arg(visible).arg(visibleTime).arg(allTime);
+    qInfo() << text;
+    QMessageBox::information(this, "规则加载测试", text);
+}
+
+/**
+ * 测试每次事件获取候选弹幕的耗时
+ * 旧版每次从编辑框读取整段文字再逐行处理，快照只处理含变量或条件的行；
+ * 另外用几段过长、优先级混合的文字检查两种方式的结果是否一致
+ */
+void MainWindow::on_actionWords_Snapshot_Benchmark_triggered()
+{
+    const int rounds = 1000;
+    LiveDanmaku danmaku("测试用户", "测试弹幕", 123456, 12, QDateTime::currentDateTime(), "", "");
+    QString lastCondition = lastConditionDanmu;
+    QStringList lastCandidate = lastCandidateDanmaku;
+    QStringList rows;
+    QElapsedTimer timer;
+
+    foreach (int count, QList<int>{10, 100, 1000})
+    {
+        QStringList lines;
+        for (int i = 0; i < count; i++)
+            lines.append(i % 10 ? "感谢" + snum(i) + "号的支持" : "[%level% > 10]感谢%uname%" + snum(i));
+        QPlainTextEdit edit;
+        edit.setPlainText(lines.join("\n"));
+        WordsSnapshot::Ptr words = compileWords(edit.toPlainText());
+
+        timer.start();
+        for (int i = 0; i < rounds; i++)
+            getEditConditionStringList(edit.toPlainText(), danmaku);
+        double textTime = timer.nsecsElapsed() / 1000.0 / rounds;
+
+        timer.restart();
+        for (int i = 0; i < rounds; i++)
+            getEditConditionStringList(words, danmaku);
+        double snapshotTime = timer.nsecsElapsed() / 1000.0 / rounds;
+
+        rows.append(QString("%1 行：读取文字 %2 μs，快照 %3 μs")
+                    .arg(count).arg(textTime, 0, 'f', 1).arg(snapshotTime, 0, 'f', 1));
+    }
+
+    // 过长和优先级混在静态行、动态行之间时，两种方式的结果要完全相同
+    QString longText(danmuLongest + 5, QChar(0x957F)); // 长
+    QStringList cases {
+        longText + "\n[%level% > 0]短",
+        longText + "1\n" + longText + "2\n[%level% > 0]" + longText + "3",
+        "[%level% > 0]" + longText + "\n" + longText + "\n短",
+        "*a\nb\n**%uname%c\n**d\n[%level% > 100]***e",
+        "[%level% > 100]x\ny\n%uname%z",
+    };
+    int same = 0;
+    foreach (const QString& text, cases)
+    {
+        QStringList expected = getEditConditionStringList(text, danmaku);
+        QStringList actual = getEditConditionStringList(compileWords(text), danmaku);
+        if (actual == expected)
+            same++;
+        else
+            rows.append("不一致：" + QString(text).replace("\n", " | ") + "\n  原来：" + expected.join(" | ") + "\n  快照：" + actual.join(" | "));
+    }
+    rows.append(QString("结果一致：%1 / %2").arg(same).arg(cases.size()));
+    lastConditionDanmu = lastCondition;
+    lastCandidateDanmaku = lastCandidate;
+
+    QString text = "每次事件获取候选弹幕的平均耗时（每 10 行有 1 行含变量）\n\n" + rows.join("\n");
+    qInfo() << text;
+    QMessageBox::information(this, "候选弹幕测试", text);
 }
 
 void MainWindow::on_actionLocal_Mode_triggered()
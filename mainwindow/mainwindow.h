@@ -33,15 +33,26 @@
 #include "taskwidget.h"
 #include "replywidget.h"
 #include "eventwidget.h"
+#include "rulelistitem.h"
 #include "commonvalues.h"
 #include "orderplayerwindow.h"
 #include "textinputdialog.h"
 #include "luckydrawwindow.h"
 #include "livevideoplayer.h"
 #include "xfytts.h"
+#include "kvstore.h"
+#include "moderationstate.h"
+#include "liveanalytics.h"
+#include "replaybenchmark.h"
+#include "livelog.h"
+#include "wordssnapshot.h"
+#include "heartbeatsigner.h"
+#include "screendanmakuoverlay.h"
+#include "timerwheel.h"
 #include "eternalblockdialog.h"
 #include "picturebrowser.h"
 #include "netinterface.h"
+#include "pagedfetcher.h"
 #include "waterfloatbutton.h"
 #include "custompaintwidget.h"
 #include "appendbutton.h"
@@ -60,6 +71,8 @@ QT_END_NAMESPACE
 
 #define AUTO_MSG_CD 1500
 #define NOTIFY_CD 2000
+#define SPEECH_PREPARE_DELAY 10000 // 启动后多久开始预先合成语音
+#define SPEECH_PREPARE_MAX 32 // 最多预先合成多少条，避免消耗太多额度
 
 #define CHANNEL_COUNT 100
 #define MAGICAL_SPLIT_CHAR "-bdm-split-bdm-"
@@ -87,6 +100,9 @@ QT_END_NAMESPACE
 #define TAB_AUTO_REPLY 1   // 自动回复
 #define TAB_EVENT_ACTION 2 // 事件动作
 
+#define BLOCK_LIST_PARALLEL 4 // 同步禁言列表时并行获取的页数
+#define BLOCK_LIST_MAX_PAGE 200 // 禁言列表最多获取的页数
+
 #define FILTER_MUSIC_ORDER "FILTER_MUSIC_ORDER"
 #define FILTER_DANMAKU_MSG "FILTER_DANMAKU_MSG"
 #define FILTER_DANMAKU_COME "FILTER_DANMAKU_COME"
@@ -95,7 +111,6 @@ QT_END_NAMESPACE
 class MainWindow;
 
 typedef void(MainWindow::*VoidFunc)();
-typedef ListItemInterface*(MainWindow::*InsertItemFunc)(MyJson);
 
 typedef std::function<void(LiveDanmaku)> DanmakuFunc;
 typedef std::function<void(QString)> StringFunc;
@@ -210,6 +225,9 @@ public:
     };
 
     const QSettings *getSettings() const;
+    bool startReplayBenchmark(const ReplayBenchmark::Options& options);
+
+    static bool headless; // 无界面回放测试：不连接直播间、不发送弹幕
 
 protected:
     void showEvent(QShowEvent* event) override;
@@ -313,7 +331,9 @@ private slots:
 
     void delBlockUser(qint64 uid, qint64 roomId);
 
-    void delRoomBlockUser(qint64 id);
+    void delRoomBlockUser(qint64 id, qint64 roomId);
+
+    void findRoomBlockId(qint64 uid, qint64 roomId, int page, std::function<void(qint64)> found);
 
     void eternalBlockUser(qint64 uid, QString uname);
 
@@ -321,8 +341,6 @@ private slots:
 
     void cancelEternalBlockUserAndUnblock(qint64 uid);
 
-    void saveEternalBlockUsers();
-
     void detectEternalBlockUsers();
 
     void on_enableBlockCheck_clicked();
@@ -631,6 +649,12 @@ private slots:
 
     void on_actionLast_Candidate_triggered();
 
+    void on_actionScheduled_Timers_triggered();
+
+    void on_actionRule_Load_Benchmark_triggered();
+
+    void on_actionWords_Snapshot_Benchmark_triggered();
+
     void on_actionLocal_Mode_triggered();
 
     void on_actionDebug_Mode_triggered();
@@ -702,6 +726,7 @@ private:
     void initRuntime();
     void readConfig();
     void initEvent();
+    void initLog();
     void adjustPageSize(int page);
     void switchPageAnimation(int page);
 
@@ -709,28 +734,45 @@ private:
     void appendNewLiveDanmaku(LiveDanmaku danmaku);
     void newLiveDanmakuAdded(LiveDanmaku danmaku);
     void oldLiveDanmakuRemoved(LiveDanmaku danmaku);
+    bool isTipDanmaku(const LiveDanmaku& danmaku) const;
+    void scheduleRemoveDanmaku();
     void addNoReplyDanmakuText(QString text);
     bool isLiving() const;
     void localNotify(QString text);
     void localNotify(QString text, qint64 uid);
 
-    TaskWidget *addTimerTask(bool enable, int second, QString text, int index = -1);
-    TaskWidget *addTimerTask(MyJson json);
+    RuleListItem *addTimerTask(bool enable, int second, QString text, int index = -1);
+    RuleListItem *addTimerTask(MyJson json);
     void saveTaskList();
     void restoreTaskList();
 
-    ReplyWidget *addAutoReply(bool enable, QString key, QString reply, int index= -1);
-    ReplyWidget *addAutoReply(MyJson json);
+    RuleListItem *addAutoReply(bool enable, QString key, QString reply, int index= -1);
+    RuleListItem *addAutoReply(MyJson json);
     void saveReplyList();
     void restoreReplyList();
 
-    EventWidget *addEventAction(bool enable, QString cmd, QString action, int index= -1);
-    EventWidget *addEventAction(MyJson json);
+    RuleListItem *addEventAction(bool enable, QString cmd, QString action, int index= -1);
+    RuleListItem *addEventAction(MyJson json);
     void saveEventList();
     void restoreEventList();
     bool hasEvent(QString cmd) const;
 
-    template<class T>
+    void insertRuleItem(QListWidget* listWidget, RuleListItem* item, int index);
+    void saveRuleList(QListWidget* listWidget, QString group);
+    void restoreRuleList(QListWidget* listWidget, RuleListItem::RuleKind kind, QString group);
+    void saveRuleItem(RuleListItem* item);
+    void refreshRuleItem(RuleListItem* item);
+    QSize estimateRuleItemSize(QListWidget* listWidget, const RuleListItem* item) const;
+    ListItemInterface* ensureRuleWidget(RuleListItem* item);
+    void loadVisibleRuleWidgets(QListWidget* listWidget);
+    void updateTaskTimer(RuleListItem* item);
+    void startTaskTimer(RuleListItem* item);
+    void sendTaskMsgs(QString sl, bool manual);
+    void sendReplyMsgs(QString sl, LiveDanmaku danmaku, bool manual);
+    void sendEventMsgs(QString sl, LiveDanmaku danmaku, bool manual);
+    void triggerAutoReply(LiveDanmaku danmaku);
+    void triggerEventActions(QString cmd, LiveDanmaku danmaku);
+
     void showListMenu(QListWidget* listWidget, QString listKey, VoidFunc saveFunc);
 
     void autoSetCookie(QString s);
@@ -775,7 +817,7 @@ private:
     bool mergeGiftCombo(LiveDanmaku danmaku);
     bool handlePK(QJsonObject json);
     void userComeEvent(LiveDanmaku& danmaku);
-    void refreshBlockList();
+    void refreshBlockList(std::function<void(bool)> finished = nullptr);
     bool isInFans(qint64 upUid);
     void sendGift(int giftId, int giftNum);
     void sendBagGift(int giftId, int giftNum, qint64 bagId);
@@ -783,24 +825,29 @@ private:
     void roomEntryAction();
     void sendExpireGift();
     void getBagList(qint64 sendExpire = 0);
-    void updateExistGuards(int page);
+    void updateExistGuards();
     void newGuardUpdate(const LiveDanmaku &danmaku);
     void updateOnlineGoldRank();
     void appendLiveGift(const LiveDanmaku& danmaku);
     void appendLiveGuard(const LiveDanmaku& danmaku);
     void getPkMatchInfo();
-    void getPkOnlineGuardPage(int page);
+    void getPkOnlineGuards();
 
     QString getLocalNickname(qint64 name) const;
     void analyzeMsgAndCd(QString &msg, int& cd, int& channel) const;
     QString processTimeVariants(QString msg) const;
     QStringList getEditConditionStringList(QString plainText, LiveDanmaku user);
+    QStringList getEditConditionStringList(const WordsSnapshot::Ptr& words, LiveDanmaku user);
+    WordsSnapshot::Ptr compileWords(const QString& text) const;
+    void updateWordsSnapshots();
+    void updateHandlerOptions();
     QString processDanmakuVariants(QString msg, const LiveDanmaku &danmaku);
     QString replaceDanmakuVariants(const LiveDanmaku &danmaku, const QString& key, bool* ok) const;
     QString replaceDanmakuJson(const QJsonObject& json, const QString &key_seq, bool *ok) const;
     QString replaceDynamicVariants(const QString& funcName, const QString& args, const LiveDanmaku &danmaku);
     QString processMsgHeaderConditions(QString msg) const;
     bool processVariantConditions(QString exprs) const;
+    bool processHeapsCondition(QString exp, const KVStore::Match& m) const;
     qint64 calcIntExpression(QString exp) const;
     template<typename T>
     bool isConditionTrue(T a, T b, QString op) const;
@@ -825,15 +872,20 @@ private:
     void judgeRobotAndMark(LiveDanmaku danmaku);
     void markNotRobot(qint64 uid);
     void initTTS();
+    void preconnectTTS();
     void speekVariantText(QString text);
     void speakText(QString text);
-    void downloadAndSpeak(QString text);
+    void downloadAndSpeak(QString text, bool play = true);
+    void playSpeechFile(QString path);
+    void prepareSpeech(QString text);
+    void prepareSpeechTexts();
     void showScreenDanmaku(LiveDanmaku danmaku);
 
     void startSaveDanmakuToFile();
     void finishSaveDanmuToFile();
     void startCalculateDailyData();
     void saveCalculateDailyData();
+    qint64 getDanmuPopularity() const;
     void saveTouta();
     void restoreToutaGifts(QString text);
     void startLiveRecord();
@@ -856,6 +908,7 @@ private:
     void savePlayingSong();
     void saveOrderSongs(const SongList& songs);
     void saveSongLyrics();
+    void saveSongLyrics(QStringList lyrics);
 
     void pkPre(QJsonObject json);
     void pkStart(QJsonObject json);
@@ -916,6 +969,7 @@ private:
     void sendTextToSockets(QString cmd, QByteArray data, QWebSocket* socket = nullptr);
     void sendMusicList(const SongList& songs, QWebSocket* socket = nullptr);
     void sendLyricList(QWebSocket* socket = nullptr);
+    void sendLyricList(const QStringList& lyrics, QWebSocket* socket = nullptr);
     QString webCache(QString name) const;
 
     void syncMagicalRooms();
@@ -932,7 +986,7 @@ private:
 private:
     Ui::MainWindow *ui;
     QSettings* settings;
-    QSettings* heaps;
+    KVStore* heaps = nullptr; // 脚本变量
     QString dataPath;
     QString appVersion; // 不带v
     QString appNewVersion;
@@ -969,7 +1023,7 @@ private:
     QTimer* hourTimer = nullptr;
 
     qint64 liveTimestamp = 0;
-    QTimer* xliveHeartBeatTimer = nullptr;
+    WheelTimer* xliveHeartBeatTimer = nullptr;
     int xliveHeartBeatIndex = 0;         // 发送心跳的索引（每次+1）
     qint64 xliveHeartBeatEts = 0;        // 上次心跳时间戳
     int xliveHeartBeatInterval = 60;     // 上次心时间跳间隔（实测都是60）
@@ -982,6 +1036,7 @@ private:
     double paletteProg = 0;
     BFSColor prevPa;
     BFSColor currentPa;
+    int roomThemeSerial = 0; // 子线程提取主题色的序号，只使用最新一次的结果
 
     // 颜色
     QColor themeBg = Qt::white;
@@ -994,6 +1049,7 @@ private:
     int currentFans = 0;
     int currentFansClub = 0;
     QList<FanBean> fansList; // 最近的关注，按时间排序
+    qint64 blockListSyncGeneration = 0; // 禁言列表同步的序号，新的同步会让旧的失效
     int popularVal = 2;
 
     // 弹幕信息
@@ -1004,7 +1060,7 @@ private:
     qint64 prevLastDanmakuTimestamp = 0;
     bool firstPullDanmaku = true; // 是否不加载以前的弹幕
 #endif
-    QTimer* removeTimer;
+    WheelTimer* removeTimer;
     qint64 removeDanmakuInterval = 60000;
     QFile* danmuLogFile = nullptr;
     QTextStream* danmuLogStream = nullptr;
@@ -1024,10 +1080,30 @@ private:
     QFile* saveCmdsFile = nullptr;
 
     QFile* pushCmdsFile = nullptr;
-    QTimer* pushCmdsTimer = nullptr;
+    WheelTimer* pushCmdsTimer = nullptr;
 
     QString lastConditionDanmu;
-    QString lastCandidateDanmaku;
+    QStringList lastCandidateDanmaku;
+
+    // 编辑框编译后的快照，事件处理时只读这些
+    WordsSnapshot::Ptr welcomeWords;
+    WordsSnapshot::Ptr thankWords;
+    WordsSnapshot::Ptr attentionWords;
+    WordsSnapshot::Ptr blockNotifyWords;
+    KeywordsSnapshot::Ptr autoBlockKeys;
+    KeywordsSnapshot::Ptr promptBlockKeys;
+
+    // 欢迎、新人禁言用到的开关，控件改变时更新，事件处理时不读取控件
+    bool adminControl = false;
+    bool blockNotOnlyNewbie = false;
+    bool autoBlockNewbie = false;
+    bool autoBlockNewbieNotify = false;
+    int autoBlockHour = 1;
+    bool promptBlockNewbie = false;
+    bool promptNotOnlyNewbie = false;
+    bool sendWelcomeText = true;
+    bool sendWelcomeVoice = false;
+    int sendWelcomeCD = 10; // 秒
 
     // 过滤器
     bool enableFilter = true;
@@ -1040,11 +1116,11 @@ private:
 
     // 礼物连击
     QHash<QString, LiveDanmaku> giftCombos;
-    QTimer* comboTimer = nullptr;
+    WheelTimer* comboTimer = nullptr;
 
     // 发送弹幕队列
     QList<QPair<QStringList, LiveDanmaku>> autoMsgQueues; // 待发送的自动弹幕，是一个二维列表！
-    QTimer* autoMsgTimer;
+    WheelTimer* autoMsgTimer;
     bool inDanmakuCd = false;
 
     // 点歌
@@ -1076,19 +1152,8 @@ private:
     int permissionLevel = 0;
 
     // 每日数据
-    QSettings* dailySettings = nullptr;
+    LiveAnalytics* analytics = nullptr; // 进来、弹幕、礼物等的时间序列和每日归档
     QTimer* dayTimer = nullptr;
-    int dailyCome = 0; // 进来数量人次
-    int dailyPeopleNum = 0; // 本次进来的人数（不是全程的话，不准确）
-    int dailyDanmaku = 0; // 弹幕数量
-    int dailyNewbieMsg = 0; // 新人发言数量（需要开启新人发言提示）
-    int dailyNewFans = 0; // 关注数量
-    int dailyTotalFans = 0; // 粉丝总数量（需要开启感谢关注）
-    int dailyGiftSilver = 0; // 银瓜子总价值
-    int dailyGiftGold = 0; // 金瓜子总价值
-    int dailyGuard = 0; // 上船/续船人次
-    int dailyMaxPopul = 0; // 最高人气
-    int dailyAvePopul = 0; // 平均人气
     bool todayIsEnding = false;
 
     QString recordFileCodec = ""; // 自动保存上船、礼物记录、每月船员等编码
@@ -1097,17 +1162,19 @@ private:
 
     // 船员
     bool updateGuarding = false;
+    bool guardListLoaded = false; // 已经获取过完整的列表，之后的变化才触发事件
     QList<LiveDanmaku> guardInfos;
 
     // 高能榜
     QList<LiveDanmaku> onlineGoldRank;
+    qint64 onlineGoldRankGeneration = 0; // 只使用最新一次请求的结果
     QList<LiveDanmaku> onlineGuards;
 
     // 录播
     qint64 startRecordTime = 0;
     QString recordUrl;
     QEventLoop* recordLoop = nullptr;
-    QTimer* recordTimer = nullptr;
+    WheelTimer* recordTimer = nullptr;
 
     // 大乱斗
     bool pking = false;
@@ -1159,13 +1226,6 @@ private:
     // 直播间人气
     QTimer* minuteTimer;
     int currentPopul = 0; // 当前人气
-    qint64 sumPopul = 0;     // 自启动以来的人气
-    qint64 countPopul = 0;   // 自启动以来的人气总和
-
-    // 弹幕人气
-    int minuteDanmuPopul = 0;
-    QList<int> danmuPopulQueue;
-    int danmuPopulValue = 0;
 
     // 本次直播的礼物列表
     QList<LiveDanmaku> liveAllGifts;
@@ -1195,6 +1255,7 @@ private:
     QTextToSpeech *tts = nullptr;
 #endif
     XfyTTS* xfyTTS = nullptr;
+    SpeechCache* speechCache = nullptr; // 所有语音平台共用的合成结果缓存
     int voicePitch = 50;
     int voiceSpeed = 50;
     int voiceVolume = 50;
@@ -1203,7 +1264,7 @@ private:
     // 全屏弹幕
     QFont screenDanmakuFont;
     QColor screenDanmakuColor;
-    QList<QLabel*> screenLabels;
+    ScreenDanmakuOverlay* screenDanmakuOverlay = nullptr;
 
     // 游戏列表
     QList<qint64> gameUsers[CHANNEL_COUNT];
@@ -235,17 +235,21 @@ void MainWindow::sendDanmakuToSockets(QString cmd, LiveDanmaku danmaku)
     if (!danmakuSocketServer || !danmakuSockets.size()) // 不需要发送，空着的
         return ;
 
+    MetricScope fanoutScope(LiveMetrics::SocketFanout);
     QJsonObject json;
     json.insert("cmd", cmd);
     json.insert("data", danmaku.toJson());
     QByteArray ba = QJsonDocument(json).toJson();
 
+    quint64 count = 0;
     foreach (QWebSocket* socket, danmakuSockets)
     {
         if (!danmakuCmdsMaps.contains(socket) || !danmakuCmdsMaps[socket].contains(cmd))
             continue;
        socket->sendTextMessage(ba);
+       count++;
     }
+    LiveMetrics::add(LiveMetrics::SocketMessages, count);
 }
 
 void MainWindow::sendJsonToSockets(QString cmd, QJsonValue data, QWebSocket *socket)
@@ -265,20 +269,25 @@ void MainWindow::sendTextToSockets(QString cmd, QByteArray data, QWebSocket *soc
     if (!socket && !danmakuSockets.size())
         return ;
 
+    MetricScope fanoutScope(LiveMetrics::SocketFanout);
     if (socket)
     {
         socket->sendTextMessage(data);
+        LiveMetrics::add(LiveMetrics::SocketMessages);
     }
     else
     {
         SOCKET_DEB << "发送至每个socket" << cmd << data;
+        quint64 count = 0;
         foreach (QWebSocket* socket, danmakuSockets)
         {
             if (danmakuCmdsMaps.contains(socket) && danmakuCmdsMaps[socket].contains(cmd))
             {
                 socket->sendTextMessage(data);
+                count++;
             }
         }
+        LiveMetrics::add(LiveMetrics::SocketMessages, count);
     }
 }
 
@@ -314,9 +323,15 @@ void MainWindow::sendLyricList(QWebSocket *socket)
     if (!sendLyricListToSockets || (!socket && !danmakuSockets.size()) || !musicWindow)
         return ;
 
+    sendLyricList(musicWindow->getSongLyrics(ui->songLyricsToFileMaxSpin->value()), socket);
+}
+
+void MainWindow::sendLyricList(const QStringList &lyrics, QWebSocket *socket)
+{
+    if (!sendLyricListToSockets || (!socket && !danmakuSockets.size()))
+        return ;
+
     QJsonObject json;
-    QJsonArray array;
-    QStringList lyrics = musicWindow->getSongLyrics(ui->songLyricsToFileMaxSpin->value());
     json.insert("data", lyrics.join("\n"));
     json.insert("cmd", "LYRIC_LIST");
     QByteArray ba = QJsonDocument(json).toJson();
@@ -592,6 +607,37 @@ QByteArray MainWindow::getApiContent(QString url, QHash<QString, QString> params
         ba = f.readAll();
         f.close();
     }
+    else if (url == "stats") // 最近的数据：api/stats?metric=danmaku&resolution=minute&count=180
+    {
+        *contentType = "application/json";
+        int metric = LiveAnalytics::metricFromKey(params.value("metric", "danmaku"));
+        int resolution = LiveAnalytics::resolutionFromKey(params.value("resolution", "minute"));
+        int count = params.value("count", "60").toInt();
+        if (metric < 0 || resolution < 0)
+            return ba;
+        ba = QJsonDocument(analytics->seriesJson(LiveAnalytics::Metric(metric), LiveAnalytics::Resolution(resolution), count)).toJson(QJsonDocument::Compact);
+    }
+    else if (url == "daily") // 每天的数据
+    {
+        *contentType = "application/json";
+        QTextStream stream(&ba);
+        stream.setCodec("UTF-8");
+        analytics->exportDailyJson(stream);
+        stream.flush();
+    }
+    else if (url == "metrics") // 各阶段的计数和耗时：api/metrics?format=prometheus
+    {
+        if (params.value("format") == "prometheus")
+        {
+            *contentType = "text/plain; version=0.0.4";
+            ba = LiveMetrics::toPrometheus();
+        }
+        else
+        {
+            *contentType = "application/json";
+            ba = QJsonDocument(LiveMetrics::toJson()).toJson(QJsonDocument::Compact);
+        }
+    }
 
     return ba;
 }
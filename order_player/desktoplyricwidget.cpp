@@ -34,71 +34,18 @@ DesktopLyricWidget::DesktopLyricWidget(QSettings& settings, QWidget *parent) : Q
 
 /**
  * 歌词文本设置成歌词流
- * 在这里解析格式
  */
 void DesktopLyricWidget::setLyric(QString text)
 {
-    // 检测是不是全是毫秒还是10毫秒的
-    int ms10x = 10;
-    QRegularExpression re10("\\[\\d{2}:\\d{2}(?:\\.([1-9]\\d{2}))?\\]");
-    QRegularExpressionMatch match10;
-    if (text.lastIndexOf(re10, -1, &match10) != -1)
-    {
-        int val = match10.captured(1).toInt();
-        if (val > 0) // 存在不为0的三位数
-        {
-            ms10x = 1;
-        }
-    }
-
-    // 遍历每一行
-    QStringList sl = text.split("\n", QString::SkipEmptyParts);
-    LyricBean prevLyric(false);
-    qint64 currentTime = 0;
-    lyricStream.clear();
-    foreach (QString line, sl)
-    {
-        QRegularExpression re("^\\[(\\d{2}):(\\d{2})(?:\\.(\\d{2,3}))?\\](\\[(\\d{2}):(\\d{2})\\.(\\d{2,3})\\])?(.*)$");
-        QRegularExpressionMatch match;
-        if (line.indexOf(re, 0, &match) == -1) // 不是时间格式的，可能是其他标签
-        {
-            if (line.indexOf(QRegularExpression("^\\s*\\[.+:.*\\]\\s*$")) > -1) // 是标签，无视掉
-                continue;
-            else if (line.indexOf(QRegularExpression("\\[00:00:00\\](.+)"), 0, &match) > -1)
-            {
-                LyricBean lyric;
-                lyric.start = 0;
-                lyric.end = 0;
-                lyric.text = match.captured(1);
-                lyricStream.append(lyric);
-                continue;
-            }
-
-            LyricBean lyric;
-            lyric.start = currentTime;
-            lyric.end = 0;
-            lyric.text = line;
-            lyricStream.append(lyric);
-            continue;
-        }
-        QStringList caps = match.capturedTexts();
-        LyricBean lyric;
-        int minute = caps.at(1).toInt();
-        int second = caps.at(2).toInt();
-        int ms10 = caps.at(3).toInt();
-        lyric.start = minute * 60000 + second*1000 + ms10 * ms10x;
-        if (!caps.at(4).isEmpty()) // 有终止时间
-        {
-            int minute = caps.at(5).toInt();
-            int second = caps.at(6).toInt();
-            int ms10 = caps.at(7).toInt();
-            lyric.end = minute * 60000 + second*1000 + ms10 * ms10x;
-        }
-        lyric.text = caps.at(8);
-        lyricStream.append(lyric);
-        currentTime = lyric.start;
-    }
+    setTimeline(LyricTimeline::parse(text));
+}
 
+/**
+ * 使用已经解析好的歌词（与歌词控件共用同一份）
+ */
+void DesktopLyricWidget::setTimeline(const LyricTimeline &timeline)
+{
+    this->timeline = timeline;
     currentRow = 0;
     update();
 }
@@ -234,12 +181,12 @@ void DesktopLyricWidget::paintEvent(QPaintEvent *)
     rect.setRight(rect.right() - boundaryWidth);
     rect.setBottom(rect.bottom() - boundaryWidth);
 
-    if (currentRow > -1 && currentRow < lyricStream.size())
+    if (currentRow > -1 && currentRow < timeline.size())
     {
         bool cross = lineMode != SingleLine && currentRow % 2;
 
         // 绘制当前句
-        if (currentRow + (cross ? 1 : 0) < lyricStream.size())
+        if (currentRow + (cross ? 1 : 0) < timeline.size())
         {
             painter.setPen(cross ? waitingColor : playingColor);
             QFlags<Qt::AlignmentFlag> align;
@@ -253,11 +200,11 @@ void DesktopLyricWidget::paintEvent(QPaintEvent *)
                 align |= Qt::AlignRight;
             else
                 align |= Qt::AlignLeft;
-            painter.drawText(rect, align, lyricStream.at(currentRow + (cross ? 1 : 0)).text);
+            painter.drawText(rect, align, timeline.at(currentRow + (cross ? 1 : 0)).text);
         }
 
         // 绘制下一句
-        if (currentRow - (cross ? 1 : 0) < lyricStream.size()-1 && (lineMode == SuitableLine || lineMode == DoubleLine))
+        if (currentRow - (cross ? 1 : 0) < timeline.size()-1 && (lineMode == SuitableLine || lineMode == DoubleLine))
         {
             painter.setPen(cross ? playingColor : waitingColor);
             QFlags<Qt::AlignmentFlag> align = Qt::AlignBottom;
@@ -268,7 +215,7 @@ void DesktopLyricWidget::paintEvent(QPaintEvent *)
             else
                 align |= Qt::AlignRight;
 
-            painter.drawText(rect, align, lyricStream.at(currentRow + (cross ? 0 : 1)).text);
+            painter.drawText(rect, align, timeline.at(currentRow + (cross ? 0 : 1)).text);
         }
     }
 }
@@ -341,25 +288,9 @@ void DesktopLyricWidget::showMenu()
 
 void DesktopLyricWidget::setPosition(qint64 position)
 {
-    if (!lyricStream.size())
-        return ;
-    if (currentRow < 0 || currentRow >= lyricStream.size())
-        currentRow = 0;
-
-    LyricBean lyric = lyricStream.at(currentRow);
-    if (currentRow == lyricStream.size()-1 && lyric.start <= position) // 已经到末尾了
+    int row = timeline.rowAt(position);
+    if (row < 0 || row == currentRow) // 不需要改变
         return ;
-
-    LyricBean nextLyric = currentRow == lyricStream.size()-1 ? LyricBean(false) : lyricStream.at(currentRow + 1);
-    if (lyric.start <= position && nextLyric.start >= position) // 不需要改变
-        return ;
-
-    if (lyric.start > position) // 什么情况？从头强制重新开始！
-        currentRow = 0;
-
-    while (currentRow+1 < lyricStream.size() && lyricStream.at(currentRow+1).start < position)
-    {
-        currentRow++;
-    }
+    currentRow = row;
     update();
 }
@@ -33,18 +33,7 @@
 #include <QPushButton>
 #include <QStringListModel>
 #include "facilemenu.h"
-
-struct LyricBean
-{
-    qint64 start = 0;
-    qint64 end = 0;
-    QString text;
-
-    LyricBean(){}
-    LyricBean(bool):start(-1),end(-1){}
-};
-
-typedef QList<LyricBean> LyricStream;
+#include "lyrictimeline.h"
 
 class DesktopLyricWidget : public QWidget
 {
@@ -68,6 +57,7 @@ public:
     };
 
     void setLyric(QString text);
+    void setTimeline(const LyricTimeline& timeline);
 
     void setColors(QColor p, QColor w);
 
@@ -109,7 +99,7 @@ private:
     QColor bgColor = QColor(0xf0, 0xf0, 0xf0);
 
     // 歌词显示
-    LyricStream lyricStream;
+    LyricTimeline timeline;
     int currentRow = -1; // 当前播放或即将播放的歌词row（不一定有下一行）
     int pointSize = 20;
 
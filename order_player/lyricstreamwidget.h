@@ -3,6 +3,7 @@
 
 #include <QWidget>
 #include <QPainter>
+#include <QStaticText>
 #include "desktoplyricwidget.h"
 
 class LyricStreamWidget : public QWidget
@@ -16,7 +17,10 @@ public:
         setContextMenuPolicy(Qt::CustomContextMenu);
         connect(this, SIGNAL(customContextMenuRequested(const QPoint&)), this, SLOT(showMenu()));
 
-        connect(updateTimer, SIGNAL(timeout()), this, SLOT(update()));
+        // 动画期间只重绘切换的那两行
+        connect(updateTimer, &QTimer::timeout, this, [=]{
+            update(switchingRect());
+        });
         updateTimer->setInterval(16);
     }
 
@@ -31,79 +35,22 @@ public:
 
     void updateFixedHeight()
     {
-        QFont font = this->font();
-        font.setPointSize(pointSize);
-        QFontMetrics fm(font);
+        lyricFont = this->font();
+        lyricFont.setPointSize(pointSize);
+        QFontMetrics fm(lyricFont);
         this->lineSpacing = fm.height() + (fm.lineSpacing() - fm.height() + lineSpacingPadding) * lineSpacingRatio; // 双倍行间距
-        setFixedHeight((lyricStream.size()+verticalMargin*2) * lineSpacing);
+        setFixedHeight((timeline.size()+verticalMargin*2) * lineSpacing);
+        prepareStaticTexts();
     }
 
     void setLyric(QString text)
     {
-        // 检测是不是全是毫秒还是10毫秒的
-        int ms10x = 10;
-        QRegularExpression re10("\\[\\d{2}:\\d{2}(?:\\.([1-9]\\d{2}))?\\]");
-        QRegularExpressionMatch match10;
-        if (text.lastIndexOf(re10, -1, &match10) != -1)
-        {
-            int val = match10.captured(1).toInt();
-//            qDebug() << " 匹配项：" << match10.capturedTexts() << val;
-            if (val > 0) // 存在不为0的三位数
-            {
-//                qDebug() << "检测到勉强受支持的歌词格式：第三位是毫秒";
-                ms10x = 1;
-            }
-        }
-
-        // 遍历每一行
-        QStringList sl = text.split("\n", QString::SkipEmptyParts);
-        LyricBean prevLyric(false);
-        qint64 currentTime = 0;
-        lyricStream.clear();
-        foreach (QString line, sl)
-        {
-            QRegularExpression re("^\\[(\\d{2}):(\\d{2})(?:\\.(\\d{2,3}))?\\](\\[(\\d{2}):(\\d{2})\\.(\\d{2,3})\\])?(.*)$");
-            QRegularExpressionMatch match;
-            if (line.indexOf(re, 0, &match) == -1)
-            {
-                re = QRegularExpression("^\\s*\\[.+:.*\\]\\s*$");
-                if (line.indexOf(re) > -1) // 是标签，无视掉
-                    continue;
-                else if (line.indexOf(QRegularExpression("\\[00:00:00\\](.+)"), 0, &match) > -1)
-                {
-                    LyricBean lyric;
-                    lyric.start = 0;
-                    lyric.end = 0;
-                    lyric.text = match.captured(1);
-                    lyricStream.append(lyric);
-                    continue;
-                }
-
-                LyricBean lyric;
-                lyric.start = currentTime;
-                lyric.end = 0;
-                lyric.text = line;
-                lyricStream.append(lyric);
-                continue;
-            }
-            QStringList caps = match.capturedTexts();
-            LyricBean lyric;
-            int minute = caps.at(1).toInt();
-            int second = caps.at(2).toInt();
-            int ms10 = caps.at(3).toInt();
-            lyric.start = minute * 60000 + second*1000 + ms10 * ms10x;
-            if (!caps.at(4).isEmpty()) // 有终止时间
-            {
-                int minute = caps.at(5).toInt();
-                int second = caps.at(6).toInt();
-                int ms10 = caps.at(7).toInt();
-                lyric.end = minute * 60000 + second*1000 + ms10 * ms10x;
-            }
-            lyric.text = caps.at(8);
-            lyricStream.append(lyric);
-            currentTime = lyric.start;
-        }
+        setTimeline(LyricTimeline::parse(text));
+    }
 
+    void setTimeline(const LyricTimeline& timeline)
+    {
+        this->timeline = timeline;
         currentRow = 0;
         updateFixedHeight();
         update();
@@ -114,43 +61,30 @@ public:
      */
     bool setPosition(qint64 position)
     {
-        int prevRow = currentRow;
-        if (!lyricStream.size())
-            return false;
-        if (currentRow < 0 || currentRow >= lyricStream.size())
-            currentRow = 0;
-
-        LyricBean lyric = lyricStream.at(currentRow);
-        if (currentRow == lyricStream.size()-1 && lyric.start <= position) // 已经到末尾了
-            return false;
-
-        LyricBean nextLyric = currentRow == lyricStream.size()-1 ? LyricBean(false) : lyricStream.at(currentRow + 1);
-        if (lyric.start <= position && nextLyric.start >= position) // 不需要改变
+        int row = timeline.rowAt(position);
+        if (row < 0 || row == currentRow)
             return false;
 
-        if (lyric.start > position) // 什么情况？从头强制重新开始！
-            currentRow = 0;
-
-        while (currentRow+1 < lyricStream.size() && lyricStream.at(currentRow+1).start < position)
-        {
-            currentRow++;
-        }
-        if (currentRow == prevRow)
-            return false;
+        int prevRow = currentRow;
+        currentRow = row;
         switchRowTimestamp = QDateTime::currentMSecsSinceEpoch();
         updateTimer->start();
-        update();
+        if (qAbs(currentRow - prevRow) == 1) // 顺序播放：只有相邻两行变化
+            update(switchingRect().united(rowRect(prevRow)));
+        else // 跳转：中间的行位置都变了
+            update();
         emit signalRowChanged();
         return true;
     }
 
     QStringList getLyrics(int rowCount) const
     {
-        QStringList sl;
-        int end = qMin(currentRow + rowCount, lyricStream.size());
-        for (int i = currentRow; i < end; i++)
-            sl.append(lyricStream.at(i).text);
-        return sl;
+        return timeline.texts(currentRow, rowCount);
+    }
+
+    const LyricTimeline& getTimeline() const
+    {
+        return timeline;
     }
 
     int getCurrentTop() const
@@ -170,73 +104,94 @@ protected:
     {
         QPainter painter(this);
         painter.setRenderHint(QPainter::TextAntialiasing, true);
-        QFont font(painter.font());
-        font.setPointSize(pointSize);
-        painter.setFont(font);
+        painter.setFont(lyricFont);
         painter.setPen(waitingColor);
-        QFontMetrics fm(font);
-        int lineSpacing = fm.height() + (fm.lineSpacing() - fm.height() + lineSpacingPadding) * lineSpacingRatio;
         double rowOffset = verticalMargin;
         qint64 currentTimestamp = QDateTime::currentMSecsSinceEpoch();
         qint64 aniDelta = currentTimestamp - switchRowTimestamp;
         bool animating = aniDelta < switchRowDuration;
         const double scale = 0.5;
-        for (int i = 0; i < lyricStream.size(); i++)
+        const QRect dirty = event->rect();
+
+        // 以 (中心, 缩放) 绘制预先排版好的一行
+        auto drawRow = [&](int i, double centerY, double zoom) {
+            const QStaticText& st = staticTexts.at(i);
+            QSizeF size = st.size();
+            painter.save();
+            painter.translate(width() / 2.0, centerY);
+            painter.scale(zoom, zoom);
+            painter.drawStaticText(QPointF(-size.width() / 2, -size.height() / 2), st);
+            painter.restore();
+        };
+
+        for (int i = 0; i < timeline.size(); i++)
         {
             double row = i + rowOffset;
             int top = row * lineSpacing;
+            if (top > dirty.bottom()) // 下面的都不需要绘制
+                break;
             if (i == currentRow - 1 && animating)
             {
-                painter.save();
                 double prop = scale - scale * aniDelta / switchRowDuration;
-                QFont font(painter.font());
-                font.setPointSize(pointSize * (1+prop));
-                painter.setFont(font);
-                QRect lineRect(0, top - lineSpacing*prop/2, width(), lineSpacing * (1 + prop));
-                painter.drawText(lineRect, Qt::AlignCenter, lyricStream.at(i).text);
-                painter.restore();
+                drawRow(i, top + lineSpacing / 2.0, 1 + prop);
                 rowOffset += prop;
             }
             else if (i == currentRow)
             {
-                painter.save();
-                if (animating)
-                {
-                    double prop = scale * aniDelta / switchRowDuration;
-                    QRect lineRect(0, top - lineSpacing*prop/2, width(), lineSpacing * (1 + 2 * prop));
-                    QFont font(painter.font());
-                    font.setPointSize(pointSize * (1+prop));
-                    painter.setPen(playingColor);
-                    painter.setFont(font);
-                    painter.drawText(lineRect, Qt::AlignCenter, lyricStream.at(i).text);
-                    rowOffset += prop;
-                }
-                else
-                {
-                    QRect lineRect(0, top - lineSpacing*0.25, width(), lineSpacing * (1+scale*2));
-                    QFont font(painter.font());
-                    font.setPointSize(pointSize * (1+scale));
-                    painter.setPen(playingColor);
-                    painter.setFont(font);
-                    painter.drawText(lineRect, Qt::AlignCenter, lyricStream.at(i).text);
-                    rowOffset += scale;
-
-                    if (updateTimer->isActive())
-                        updateTimer->stop();
-                }
-                painter.restore();
+                double prop = animating ? scale * aniDelta / switchRowDuration : scale;
+                painter.setPen(playingColor);
+                drawRow(i, top + lineSpacing * (1 + prop) / 2.0, 1 + prop);
+                painter.setPen(waitingColor);
+                rowOffset += prop;
+
+                if (!animating && updateTimer->isActive())
+                    updateTimer->stop();
             }
-            else
+            else if (top + lineSpacing >= dirty.top())
             {
-                QRect lineRect(0, top, width(), lineSpacing);
-                painter.drawText(lineRect, Qt::AlignCenter, lyricStream.at(i).text);
+                drawRow(i, top + lineSpacing / 2.0, 1);
             }
         }
 
     }
 
+    /**
+     * 每行歌词只排版一次，绘制时直接使用
+     */
+    void prepareStaticTexts()
+    {
+        staticTexts.clear();
+        staticTexts.reserve(timeline.size());
+        for (int i = 0; i < timeline.size(); i++)
+        {
+            QStaticText st(timeline.at(i).text);
+            st.setTextFormat(Qt::PlainText);
+            st.prepare(QTransform(), lyricFont);
+            staticTexts.append(st);
+        }
+    }
+
+    /**
+     * 某一行不放大时的位置（当前行之后的行已包含当前行放大的偏移）
+     */
+    QRect rowRect(int row) const
+    {
+        double offset = verticalMargin + (row > currentRow ? 0.5 : 0);
+        return QRect(0, int((row + offset) * lineSpacing), width(), lineSpacing);
+    }
+
+    /**
+     * 切换行时动画影响的区域：上一行缩小、当前行放大
+     */
+    QRect switchingRect() const
+    {
+        int top = int((currentRow - 1 + verticalMargin - 0.5) * lineSpacing);
+        return QRect(0, top, width(), lineSpacing * 4);
+    }
+
     void adjustLyricTime(int begin, int offset)
     {
+        LyricStream lyricStream = timeline.getLines();
         if (!lyricStream.size())
             return ;
 
@@ -361,7 +316,9 @@ private slots:
 
 private:
     QSettings* settings;
-    LyricStream lyricStream;
+    LyricTimeline timeline;
+    QVector<QStaticText> staticTexts;
+    QFont lyricFont;
     int currentRow = -1;
     qint64 switchRowTimestamp = 0;
     const int switchRowDuration = 200;
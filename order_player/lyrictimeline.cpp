@@ -0,0 +1,145 @@
+#include <algorithm>
+#include "lyrictimeline.h"
+
+/**
+ * 解析LRC歌词
+ * [mm:ss.xx]歌词 ；[mm:ss.xx][mm:ss.xx]歌词 中第二个是结束时间；
+ * 小数两位是10毫秒，三位是毫秒；[ar:xxx] 这类标签忽略；没有时间的行沿用上一行的时间
+ */
+LyricTimeline LyricTimeline::parse(const QString &text)
+{
+    LyricTimeline timeline;
+    qint64 currentTime = 0;
+    foreach (QString line, text.split("\n", QString::SkipEmptyParts))
+    {
+        if (line.endsWith('\r'))
+            line.chop(1);
+        if (line.isEmpty())
+            continue;
+
+        LyricBean lyric;
+        int pos = 0;
+        if (parseTime(line, pos, false, lyric.start))
+        {
+            int endPos = pos;
+            if (parseTime(line, endPos, true, lyric.end)) // 有终止时间
+                pos = endPos;
+            lyric.text = line.mid(pos);
+            currentTime = lyric.start;
+        }
+        else if (line.startsWith("[00:00:00]") && line.length() > 10)
+        {
+            lyric.text = line.mid(10);
+        }
+        else
+        {
+            QString trimmed = line.trimmed();
+            if (trimmed.startsWith('[') && trimmed.endsWith(']') && trimmed.indexOf(':') > 1) // 是标签，无视掉
+                continue;
+            lyric.start = currentTime;
+            lyric.text = line;
+        }
+        timeline.lines.append(lyric);
+    }
+
+    // 个别歌词时间不是递增的，排序后才能二分
+    std::stable_sort(timeline.lines.begin(), timeline.lines.end(), [](const LyricBean& a, const LyricBean& b){
+        return a.start < b.start;
+    });
+    timeline.starts.reserve(timeline.lines.size());
+    foreach (const LyricBean& lyric, timeline.lines)
+        timeline.starts.append(lyric.start);
+    return timeline;
+}
+
+bool LyricTimeline::isEmpty() const
+{
+    return lines.isEmpty();
+}
+
+int LyricTimeline::size() const
+{
+    return lines.size();
+}
+
+const LyricBean &LyricTimeline::at(int row) const
+{
+    return lines.at(row);
+}
+
+const LyricStream &LyricTimeline::getLines() const
+{
+    return lines;
+}
+
+/**
+ * 播放位置所在的行：最后一个开始时间早于 position 的行
+ * 还没开始时为第0行，没有歌词时为-1
+ */
+int LyricTimeline::rowAt(qint64 position) const
+{
+    if (starts.isEmpty())
+        return -1;
+    int row = int(std::lower_bound(starts.begin(), starts.end(), position) - starts.begin()) - 1;
+    return qMax(0, row);
+}
+
+/**
+ * 从 from 开始的 count 行歌词文本
+ */
+QStringList LyricTimeline::texts(int from, int count) const
+{
+    QStringList sl;
+    int end = qMin(from + count, lines.size());
+    for (int i = qMax(0, from); i < end; i++)
+        sl.append(lines.at(i).text);
+    return sl;
+}
+
+/**
+ * 解析 pos 处的 [mm:ss] 或 [mm:ss.xx] 或 [mm:ss.xxx]
+ * 成功时 pos 移动到 ] 之后
+ */
+bool LyricTimeline::parseTime(const QString &line, int &pos, bool needFraction, qint64 &ms)
+{
+    auto digit = [&](int i) {
+        return i < line.length() && line.at(i).unicode() >= '0' && line.at(i).unicode() <= '9';
+    };
+    auto value = [&](int i) {
+        return line.at(i).unicode() - '0';
+    };
+
+    int i = pos;
+    if (i + 6 >= line.length() || line.at(i) != '[' || !digit(i+1) || !digit(i+2)
+            || line.at(i+3) != ':' || !digit(i+4) || !digit(i+5))
+        return false;
+    qint64 minute = value(i+1) * 10 + value(i+2);
+    qint64 second = value(i+4) * 10 + value(i+5);
+    i += 6;
+
+    qint64 fraction = 0;
+    if (line.at(i) == '.')
+    {
+        int digits = 0;
+        while (digit(i + 1 + digits) && digits < 3)
+        {
+            fraction = fraction * 10 + value(i + 1 + digits);
+            digits++;
+        }
+        if (digits < 2)
+            return false;
+        if (digits == 2) // 两位小数是10毫秒
+            fraction *= 10;
+        i += 1 + digits;
+    }
+    else if (needFraction)
+    {
+        return false;
+    }
+
+    if (i >= line.length() || line.at(i) != ']')
+        return false;
+    ms = minute * 60000 + second * 1000 + fraction;
+    pos = i + 1;
+    return true;
+}
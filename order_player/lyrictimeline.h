@@ -0,0 +1,46 @@
+#ifndef LYRICTIMELINE_H
+#define LYRICTIMELINE_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+struct LyricBean
+{
+    qint64 start = 0;
+    qint64 end = 0;
+    QString text;
+
+    LyricBean(){}
+    LyricBean(bool):start(-1),end(-1){}
+};
+
+typedef QList<LyricBean> LyricStream;
+
+/**
+ * 解析好的歌词时间轴
+ * 每首歌只解析一次，按开始时间排序，播放位置 -> 行 使用二分查找；
+ * 歌词控件、桌面歌词、歌词文件、WebSocket 都通过它取当前的歌词
+ */
+class LyricTimeline
+{
+public:
+    static LyricTimeline parse(const QString& text);
+
+    bool isEmpty() const;
+    int size() const;
+    const LyricBean& at(int row) const;
+    const LyricStream& getLines() const;
+
+    int rowAt(qint64 position) const;
+    QStringList texts(int from, int count) const;
+
+private:
+    static bool parseTime(const QString& line, int& pos, bool needFraction, qint64& ms);
+
+private:
+    LyricStream lines;
+    QVector<qint64> starts; // 与 lines 一一对应，用于二分
+};
+
+#endif // LYRICTIMELINE_H
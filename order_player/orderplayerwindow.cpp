@@ -12,6 +12,9 @@ OrderPlayerWindow::OrderPlayerWindow(QString dataPath, QWidget *parent)
       ui(new Ui::OrderPlayerWindow),
       settings(dataPath + "musics.ini", QSettings::Format::IniFormat),
       musicsFileDir(dataPath+"musics"),
+      downloadManager(new QNetworkAccessManager(this)),
+      songCache(new SongCache(musicsFileDir, dataPath + "musics.cache", this)),
+      songListJournal(new SongListJournal(dataPath + "songlists", &settings, this)),
       player(new QMediaPlayer(this)),
       desktopLyric(new DesktopLyricWidget(settings, nullptr)),
       expandPlayingButton(new InteractiveButtonBase(this))
@@ -168,6 +171,13 @@ OrderPlayerWindow::OrderPlayerWindow(QString dataPath, QWidget *parent)
     connect(player, &QMediaPlayer::mediaStatusChanged, this, [=](QMediaPlayer::MediaStatus status){
         if (status == QMediaPlayer::EndOfMedia)
         {
+            // 边下边播时追上了下载进度，等下载完成后从这里继续
+            if (downloadingSongs.contains(playingSong))
+            {
+                qWarning() << "播放追上下载进度，等待下载：" << playingSong.simpleString();
+                setPlayPositionAfterLoad = player->position();
+                return ;
+            }
             slotSongPlayEnd();
         }
         else if (status == QMediaPlayer::InvalidMedia)
@@ -198,6 +208,8 @@ OrderPlayerWindow::OrderPlayerWindow(QString dataPath, QWidget *parent)
     });
 
     musicsFileDir.mkpath(musicsFileDir.absolutePath());
+    songCache->setBudget(settings.value("music/cacheSize", 1024).toLongLong() * 1024 * 1024);
+    songCache->load();
     QTime time;
     time= QTime::currentTime();
     qsrand(uint(time.msec()+time.second()*1000));
@@ -216,6 +228,8 @@ OrderPlayerWindow::OrderPlayerWindow(QString dataPath, QWidget *parent)
     restoreSongList("music/order", orderSongs);
     restoreSongList("music/favorite", favoriteSongs);
     restoreSongList("music/normal", normalSongs);
+    songSearchIndex.addSongs(favoriteSongs, SongSearchIndex::FavoriteList);
+    songSearchIndex.addSongs(normalSongs, SongSearchIndex::NormalList);
     restoreSongList("music/history", historySongs);
     setSongModelToView(orderSongs, ui->orderSongsListView);
     setSongModelToView(favoriteSongs, ui->favoriteSongsListView);
@@ -257,6 +271,8 @@ OrderPlayerWindow::OrderPlayerWindow(QString dataPath, QWidget *parent)
 
     // 读取cookie
     songBr = settings.value("music/br", 320000).toInt();
+    maxDownloadingCount = qMax(1, settings.value("music/downloadThreads", 3).toInt());
+    maxSourceDownloadingCount = qMax(1, settings.value("music/sourceDownloadThreads", 2).toInt());
     neteaseCookies = settings.value("music/neteaseCookies").toString();
     neteaseCookiesVariant = getCookies(neteaseCookies);
     qqmusicCookies = settings.value("music/qqmusicCookies").toString();
@@ -333,6 +349,7 @@ OrderPlayerWindow::OrderPlayerWindow(QString dataPath, QWidget *parent)
         desktopLyric->show();
 
     clearHoaryFiles();
+    shrinkSongCache();
 }
 
 OrderPlayerWindow::~OrderPlayerWindow()
@@ -387,7 +404,7 @@ void OrderPlayerWindow::on_searchButton_clicked()
  */
 void OrderPlayerWindow::slotSearchAndAutoAppend(QString key, QString by)
 {
-    if (!playingSong.isValid() && (!playAfterDownloaded.isValid() || !downloadingSong.isValid()))
+    if (!playingSong.isValid() && (!playAfterDownloaded.isValid() || !downloadingSongs.size()))
         emit signalOrderSongStarted();
     ui->searchEdit->setText(key);
     searchMusic(key, by, true);
@@ -438,12 +455,30 @@ void OrderPlayerWindow::cutSong()
 
 /**
  * 搜索音乐
+ * 点歌时优先从本地的收藏/空闲歌单中解析，找不到再搜索
  */
 void OrderPlayerWindow::searchMusic(QString key, QString addBy, bool notify)
 {
     if (key.trimmed().isEmpty())
         return ;
     MusicSource source = musicSource; // 需要暂存一个备份，因为可能会变回去
+
+    // 判断历史，优先 收藏 > 空闲 > 搜索
+    if (!addBy.isEmpty() && key.trimmed().length() >= 2)
+    {
+        // 换源时只找目标平台的，避免又选中播放失败的那首
+        Song song = matchLocalSong(key, insertOrderOnce ? source : UnknowMusic);
+        if (song.isValid())
+        {
+            qInfo() << "优先播放收藏/空闲歌单歌曲：" << song.name << key;
+            bool insertOnce = this->insertOrderOnce;
+            this->insertOrderOnce = false;
+            currentResultOrderBy = addBy;
+            orderSearchedSong(song, addBy, notify, insertOnce);
+            return ;
+        }
+    }
+
     QString url;
     switch (source) {
     case UnknowMusic:
@@ -525,65 +560,14 @@ void OrderPlayerWindow::searchMusic(QString key, QString addBy, bool notify)
 
         setSearchResultTable(searchResultSongs);
 
-        // 判断历史，优先 收藏 > 空闲 > 搜索
-        Song song;
-        if (!addBy.isEmpty() && key.trimmed().length() >= 2)
-        {
-            QString kk = transToReg(key);
-            QStringList words = kk.split(QRegExp("[- ]+"), QString::SkipEmptyParts);
-            QString exp = words.join(".*");
-            QRegularExpression re(exp);
-
-            SongList mySongs = favoriteSongs + normalSongs;
-            foreach (Song s, mySongs)
-            {
-                if ((s.name + s.artistNames).contains(re))
-                {
-                    song = s;
-                    qInfo() << "优先播放收藏/空闲歌单歌曲：" << song.name << exp;
-                    break;
-                }
-            }
-        }
-
-        // 没有搜索结果，也没有能播放的歌曲，直接返回
-        if (!searchResultSongs.size() && !song.isValid())
+        // 没有搜索结果，直接返回
+        if (!searchResultSongs.size())
             return ;
 
         // 从点歌的槽进来的
         if (!addBy.isEmpty())
         {
-            if (!song.isValid()) // 历史中没找到，就从搜索结果中找
-                song = getSuiableSong(key);
-            song.setAddDesc(addBy);
-            prevOrderSong = song;
-
-            // 添加到点歌列表
-            if (playingSong == song || orderSongs.contains(song)) // 重复点歌
-                return ;
-
-            if (insertOnce) // 可能是换源过来的
-            {
-                if (isNotPlaying()) // 很可能是换源过来的
-                    startPlaySong(song);
-                else
-                    appendNextSongs(SongList{song});
-            }
-            else
-                appendOrderSongs(SongList{song});
-
-            // 发送点歌成功的信号
-            if (notify)
-            {
-                qint64 sumLatency = isNotPlaying() ? 0 : player->duration() - player->position();
-                for (int i = 0; i < orderSongs.size()-1; i++)
-                {
-                    if (orderSongs.at(i).id == song.id) // 同一首歌，如果全都不同，那就是下一首
-                        break;
-                    sumLatency += orderSongs.at(i).duration;
-                }
-                emit signalOrderSongSucceed(song, sumLatency, orderSongs.size());
-            }
+            orderSearchedSong(getSuiableSong(key), addBy, notify, insertOnce);
         }
         else if (insertOnce) // 强制播放啊
         {
@@ -604,6 +588,53 @@ void OrderPlayerWindow::searchMusicBySource(QString key, MusicSource source, QSt
     musicSource = originSource;
 }
 
+/**
+ * 从收藏/空闲歌单中解析点歌关键词，不需要联网
+ */
+Song OrderPlayerWindow::matchLocalSong(QString key, MusicSource source) const
+{
+    Song song = songSearchIndex.match(key, source);
+    if (song.isValid() && !favoriteSongs.contains(song) && !normalSongs.contains(song))
+        return Song(); // 列表被直接修改过，索引里还残留着
+    return song;
+}
+
+/**
+ * 点歌确定了具体的歌曲，添加到点歌队列
+ */
+void OrderPlayerWindow::orderSearchedSong(Song song, QString addBy, bool notify, bool insertOnce)
+{
+    song.setAddDesc(addBy);
+    prevOrderSong = song;
+
+    // 添加到点歌列表
+    if (playingSong == song || orderSongs.contains(song)) // 重复点歌
+        return ;
+
+    if (insertOnce) // 可能是换源过来的
+    {
+        if (isNotPlaying()) // 很可能是换源过来的
+            startPlaySong(song);
+        else
+            appendNextSongs(SongList{song});
+    }
+    else
+        appendOrderSongs(SongList{song});
+
+    // 发送点歌成功的信号
+    if (notify)
+    {
+        qint64 sumLatency = isNotPlaying() ? 0 : player->duration() - player->position();
+        for (int i = 0; i < orderSongs.size()-1; i++)
+        {
+            if (orderSongs.at(i).id == song.id) // 同一首歌，如果全都不同，那就是下一首
+                break;
+            sumLatency += orderSongs.at(i).duration;
+        }
+        emit signalOrderSongSucceed(song, sumLatency, orderSongs.size());
+    }
+}
+
 /**
  * 搜索结果数据到Table
  */
@@ -673,6 +704,7 @@ void OrderPlayerWindow::addFavorite(SongList songs)
             continue;
         }
         favoriteSongs.append(song);
+        songSearchIndex.addSongs(SongList{song}, SongSearchIndex::FavoriteList);
         showTabAnimation(center, "+1");
         qDebug() << "添加收藏：" << song.simpleString();
     }
@@ -687,6 +719,7 @@ void OrderPlayerWindow::removeFavorite(SongList songs)
     {
         if (favoriteSongs.removeOne(song))
         {
+            songSearchIndex.removeSongs(SongList{song}, SongSearchIndex::FavoriteList);
             showTabAnimation(center, "-1");
             qDebug() << "取消收藏：" << song.simpleString();
         }
@@ -707,6 +740,7 @@ void OrderPlayerWindow::addNormal(SongList songs)
         normalSongs.insert(0, songs.at(i));
         showTabAnimation(center, "+1");
     }
+    songSearchIndex.addSongs(songs, SongSearchIndex::NormalList);
     randomSongList.clear();
     saveSongList("music/normal", normalSongs);
     setSongModelToView(normalSongs, ui->normalSongsListView);
@@ -720,6 +754,7 @@ void OrderPlayerWindow::removeNormal(SongList songs)
         if (normalSongs.removeOne(song))
             showTabAnimation(center, "-1");
     }
+    songSearchIndex.removeSongs(songs, SongSearchIndex::NormalList);
     randomSongList.clear();
     saveSongList("music/normal", normalSongs);
     setSongModelToView(normalSongs, ui->normalSongsListView);
@@ -737,36 +772,33 @@ void OrderPlayerWindow::removeOrder(SongList songs)
     setSongModelToView(orderSongs, ui->orderSongsListView);
 }
 
+/**
+ * 保存列表
+ * 不会立即写入，一段时间内的多次修改合并后只追加变化的部分
+ */
 void OrderPlayerWindow::saveSongList(QString key, const SongList &songs)
 {
-    QJsonArray array;
-    foreach (Song song, songs)
-        array.append(song.toJson());
-    settings.setValue(key, array);
+    songListJournal->save(key, songs);
 }
 
 void OrderPlayerWindow::restoreSongList(QString key, SongList &songs)
 {
-    QJsonArray array = settings.value(key).toJsonArray();
-    foreach (QJsonValue val, array)
-        songs.append(Song::fromJson(val.toObject()));
+    songs.append(songListJournal->load(key));
 }
 
 /**
  * 更新Model到ListView
+ * 同一个 View 一直使用同一个 Model，只通知变化的行
  */
 void OrderPlayerWindow::setSongModelToView(const SongList &songs, QListView *listView)
 {
-    QStringList sl;
-    foreach (Song song, songs)
+    SongListModel* model = qobject_cast<SongListModel*>(listView->model());
+    if (!model)
     {
-        sl << song.simpleString();
+        model = new SongListModel(listView);
+        listView->setModel(model);
     }
-    QAbstractItemModel *model = listView->model();
-    if (model)
-        delete model;
-    model = new QStringListModel(sl);
-    listView->setModel(model);
+    model->setSongs(songs);
 
     if (listView == ui->orderSongsListView)
         emit signalOrderSongModified(songs);
@@ -790,6 +822,15 @@ QString OrderPlayerWindow::songPath(const Song &song) const
     return "";
 }
 
+/**
+ * 下载中的临时文件路径
+ * 下载完成后才改名为 songPath，中断后保留用来续传
+ */
+QString OrderPlayerWindow::songPartPath(const Song &song) const
+{
+    return songPath(song) + ".part";
+}
+
 QString OrderPlayerWindow::lyricPath(const Song &song) const
 {
     switch (song.source) {
@@ -825,7 +866,17 @@ QString OrderPlayerWindow::coverPath(const Song &song) const
  */
 bool OrderPlayerWindow::isSongDownloaded(Song song)
 {
-    return QFileInfo(songPath(song)).exists();
+    return songCache->exists(songPath(song));
+}
+
+/**
+ * 歌曲正在下载，且已缓冲足够的数据，可以边下边播
+ */
+bool OrderPlayerWindow::isSongBuffered(Song song)
+{
+    if (!downloadingSongs.contains(song))
+        return false;
+    return QFileInfo(songPartPath(song)).size() >= SONG_PLAY_BUFFER_SIZE;
 }
 
 QString OrderPlayerWindow::msecondToString(qint64 msecond)
@@ -969,6 +1020,7 @@ void OrderPlayerWindow::closeEvent(QCloseEvent *)
     settings.setValue("orderplayerwindow/state", this->saveState());
     settings.setValue("orderplayerwindow/splitterState", ui->splitter->saveState());
     settings.setValue("music/playPosition", player->position());
+    songListJournal->flush();
 
     if (player->state() == QMediaPlayer::PlayingState)
         player->pause();
@@ -1308,13 +1360,21 @@ void OrderPlayerWindow::appendNextSongs(SongList songs)
 void OrderPlayerWindow::playLocalSong(Song song)
 {
     qDebug() << "开始播放：" << song.simpleString() << song.id << song.mid;
+    QString mediaPath = songPath(song);
     if (!isSongDownloaded(song))
     {
-        qWarning() << "error: 未下载歌曲" << song.simpleString() << "开始下载";
-        playAfterDownloaded = song;
-        downloadSong(song);
-        return ;
+        if (!isSongBuffered(song))
+        {
+            qWarning() << "error: 未下载歌曲" << song.simpleString() << "开始下载";
+            playAfterDownloaded = song;
+            toDownloadSongs.removeOne(song);
+            downloadSong(song);
+            return ;
+        }
+        mediaPath = songPartPath(song); // 边下边播，下载完成后再切换到正式文件
     }
+    if (playingSong != song && downloadingSongs.contains(playingSong))
+        setPlayPositionAfterLoad = 0; // 上一首边下边播等待中的进度，不带到这首
 
     // 设置信息
     auto max16 = [=](QString s){
@@ -1370,7 +1430,8 @@ void OrderPlayerWindow::playLocalSong(Song song)
 
     // 开始播放
     playingSong = song;
-    player->setMedia(QUrl::fromLocalFile(songPath(song)));
+    songCache->touch(songPath(song));
+    player->setMedia(QUrl::fromLocalFile(mediaPath));
     player->setPosition(0);
     player->play();
     emit signalSongPlayStarted(song);
@@ -1393,34 +1454,64 @@ void OrderPlayerWindow::playLocalSong(Song song)
  */
 void OrderPlayerWindow::addDownloadSong(Song song)
 {
-    if (isSongDownloaded(song) || toDownloadSongs.contains(song) || downloadingSong == song)
+    if (isSongDownloaded(song) || toDownloadSongs.contains(song) || downloadingSongs.contains(song))
         return ;
     toDownloadSongs.append(song);
 }
 
 /**
- * 放入下载队列、或一首歌下载完毕，开始下载下一个
+ * 放入下载队列、或一首歌下载完毕，填满空闲的下载位置
+ * 点歌队列中越靠前（越快播放）的越优先；每个平台的同时下载数量有上限
  */
 void OrderPlayerWindow::downloadNext()
 {
-    if (downloadingSong.isValid() || !toDownloadSongs.size())
-        return ;
-    Song song = toDownloadSongs.takeFirst();
-    if (!song.isValid())
-        return downloadNext();
-    downloadSong(song);
+    while (downloadingSongs.size() < maxDownloadingCount && toDownloadSongs.size())
+    {
+        int pick = -1;
+        int pickOrder = 0;
+        for (int i = 0; i < toDownloadSongs.size(); i++)
+        {
+            const Song& song = toDownloadSongs.at(i);
+            int sourceCount = 0;
+            foreach (const Song& s, downloadingSongs)
+                if (s.source == song.source)
+                    sourceCount++;
+            if (sourceCount >= maxSourceDownloadingCount)
+                continue;
+
+            int order = orderSongs.indexOf(song);
+            if (order == -1) // 不在点歌队列中的，按加入下载的先后
+                order = orderSongs.size() + i;
+            if (pick == -1 || order < pickOrder)
+            {
+                pick = i;
+                pickOrder = order;
+            }
+        }
+        if (pick == -1) // 剩下的歌曲所在平台都满了
+            return ;
+
+        Song song = toDownloadSongs.takeAt(pick);
+        if (!song.isValid())
+            continue;
+        downloadSong(song);
+    }
 }
 
 /**
  * 下载音乐
+ * 歌词和封面与音频同时下载
  */
 void OrderPlayerWindow::downloadSong(Song song)
 {
-    if (isSongDownloaded(song))
+    if (song.source == UnknowMusic || isSongDownloaded(song) || downloadingSongs.contains(song))
         return ;
-    downloadingSong = song;
+    downloadingSongs.append(song);
     bool unblockQQMusic = this->unblockQQMusic; // 保存状态，避免下载的时候改变
 
+    downloadSongLyric(song);
+    downloadSongCover(song);
+
     QString url;
     switch (song.source) {
     case UnknowMusic:
@@ -1463,6 +1554,7 @@ void OrderPlayerWindow::downloadSong(Song song)
         if (error.error != QJsonParseError::NoError)
         {
             qWarning() << "解析歌曲信息出错" << error.errorString() << baData << url;
+            releaseDownloadSong(song);
             return ;
         }
         QJsonObject json = document.object();
@@ -1475,6 +1567,7 @@ void OrderPlayerWindow::downloadSong(Song song)
             if (json.value("code").toInt() != 200)
             {
                 qWarning() << "网易云歌曲链接返回结果不为200：" << json.value("message").toString();
+                releaseDownloadSong(song);
                 return ;
             }
 
@@ -1482,8 +1575,7 @@ void OrderPlayerWindow::downloadSong(Song song)
             if (!array.size())
             {
                 qWarning() << "未找到歌曲：" << song.simpleString();
-                downloadingSong = Song();
-                downloadNext();
+                releaseDownloadSong(song);
                 return ;
             }
             json = array.first().toObject();
@@ -1541,6 +1633,7 @@ void OrderPlayerWindow::downloadSong(Song song)
                 if (json.value("result").toInt() != 100)
                 {
                     qWarning() << "QQ歌曲链接返回结果不为100：" << json;
+                    releaseDownloadSong(song);
                     switchSource(song);
                     return ;
                 }
@@ -1560,6 +1653,7 @@ void OrderPlayerWindow::downloadSong(Song song)
             if (json.value("result").toInt() != 100)
             {
                 qWarning() << "咪咕歌曲链接返回结果不为100：" << json;
+                releaseDownloadSong(song);
                 switchSource(song);
                 return ;
             }
@@ -1575,9 +1669,6 @@ void OrderPlayerWindow::downloadSong(Song song)
 
         downloadSongMp3(song, fileUrl);
     }, song.source);
-
-    downloadSongLyric(song);
-    downloadSongCover(song);
 }
 
 void OrderPlayerWindow::downloadSongFailed(Song song)
@@ -1610,40 +1701,160 @@ void OrderPlayerWindow::downloadSongFailed(Song song)
         }
     }
 
-    downloadingSong = Song();
+    releaseDownloadSong(song);
+}
+
+/**
+ * 一首歌曲下载结束（无论成功与否），空出下载位置
+ */
+void OrderPlayerWindow::releaseDownloadSong(Song song)
+{
+    downloadingSongs.removeOne(song);
     downloadNext();
 }
 
-void OrderPlayerWindow::downloadSongMp3(Song song, QString url)
+/**
+ * 流式下载音频文件
+ * 边下载边写入临时文件，已有临时文件时使用 Range 续传
+ */
+void OrderPlayerWindow::downloadSongMp3(Song song, QString url, int retry)
 {
-    fetch(url, [=](QNetworkReply* reply){
-        QByteArray mp3Ba = reply->readAll();
-        if (mp3Ba.isEmpty())
+    QFile* file = new QFile(songPartPath(song));
+    if (!file->open(QIODevice::ReadWrite))
+    {
+        qWarning() << "无法写入歌曲文件：" << file->fileName();
+        delete file;
+        releaseDownloadSong(song);
+        return ;
+    }
+    qint64 resumeOffset = file->size();
+
+    QNetworkRequest request(url);
+    request.setHeader(QNetworkRequest::UserAgentHeader, "Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/86.0.4240.111 Safari/537.36");
+    request.setAttribute(QNetworkRequest::FollowRedirectsAttribute, true);
+    if (resumeOffset > 0)
+    {
+        MUSIC_DEB << "续传歌曲：" << song.simpleString() << resumeOffset;
+        request.setRawHeader("Range", "bytes=" + QByteArray::number(resumeOffset) + "-");
+    }
+    QNetworkReply* reply = downloadManager->get(request);
+
+    // 只有 200/206 是音频内容，其余状态码返回的错误页面不能写进临时文件
+    auto isContentStatus = [=]{
+        int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        return status == 200 || status == 206;
+    };
+
+    connect(reply, &QNetworkReply::metaDataChanged, this, [=]{
+        // 服务器不支持续传时会返回完整的内容，先清空再写
+        int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        if (status == 206)
         {
-            qWarning() << "无法下载歌曲，可能缺少版权：" << song.simpleString() << song.id << song.mid;
-            downloadingSong = Song();
-            downloadNext();
+            file->seek(resumeOffset);
+        }
+        else if (status == 200)
+        {
+            file->resize(0);
+            file->seek(0);
+        }
+    });
+
+    connect(reply, &QNetworkReply::readyRead, this, [=]{
+        if (!isContentStatus())
+        {
+            reply->readAll();
             return ;
         }
+        file->write(reply->readAll());
 
-        // 保存到文件
-        QFile file(songPath(song));
-        file.open(QIODevice::WriteOnly);
-        file.write(mp3Ba);
-        file.flush();
-        file.close();
+        // 边下边播：即将播放的歌曲缓冲足够后立即开始
+        if (playAfterDownloaded == song && playingSong != song
+                && file->size() >= SONG_PLAY_BUFFER_SIZE)
+        {
+            file->flush();
+            playLocalSong(song);
+        }
+    });
 
-        emit signalSongDownloadFinished(song);
-        MUSIC_DEB << "歌曲mp3下载完成：" << song.simpleString();
+    connect(reply, &QNetworkReply::finished, this, [=]{
+        int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        bool httpError = status != 0 && !isContentStatus();
+        if (!httpError)
+            file->write(reply->readAll());
+        qint64 size = file->size();
+        file->close();
+        file->deleteLater();
+        reply->deleteLater();
 
-        if (playAfterDownloaded == song)
-            playLocalSong(song);
+        if (httpError)
+        {
+            // 临时文件里可能是之前写入的错误内容，不能再续传
+            qWarning() << "歌曲下载失败：" << song.simpleString() << "HTTP" << status;
+            QFile::remove(songPartPath(song));
+            if (status == 416 && retry < SONG_DOWNLOAD_RETRY) // 临时文件有问题，丢弃后重新下载
+                return downloadSongMp3(song, url, retry + 1);
+        }
+        else if (reply->error() != QNetworkReply::NoError)
+        {
+            qWarning() << "歌曲下载中断：" << song.simpleString() << reply->errorString() << size;
+            if (size > 0 && retry < SONG_DOWNLOAD_RETRY)
+                return downloadSongMp3(song, url, retry + 1);
+        }
 
-        downloadingSong = Song();
-        downloadNext();
+        if (httpError || reply->error() != QNetworkReply::NoError || size == 0)
+        {
+            qWarning() << "无法下载歌曲，可能缺少版权：" << song.simpleString() << song.id << song.mid;
+            if (size == 0)
+                QFile::remove(songPartPath(song));
+            releaseDownloadSong(song);
+            return ;
+        }
+
+        finishDownloadSongMp3(song);
     });
 }
 
+/**
+ * 音频下载完成，临时文件改名为正式文件
+ * 如果正在边下边播，需要先释放临时文件，再从原来的位置继续播放
+ */
+void OrderPlayerWindow::finishDownloadSongMp3(Song song)
+{
+    bool streaming = (playingSong == song);
+    qint64 position = 0;
+    bool paused = false;
+    if (streaming)
+    {
+        position = setPlayPositionAfterLoad ? setPlayPositionAfterLoad : player->position();
+        paused = (player->state() == QMediaPlayer::PausedState);
+        player->setMedia(QMediaContent());
+    }
+
+    songCache->remove(songPath(song));
+    if (!QFile::rename(songPartPath(song), songPath(song)))
+        qWarning() << "歌曲文件改名失败：" << songPartPath(song);
+    downloadingSongs.removeOne(song);
+    songCache->insert(songPath(song));
+    shrinkSongCache();
+
+    emit signalSongDownloadFinished(song);
+    MUSIC_DEB << "歌曲mp3下载完成：" << song.simpleString();
+
+    if (streaming)
+    {
+        setPlayPositionAfterLoad = position;
+        player->setMedia(QUrl::fromLocalFile(songPath(song)));
+        if (!paused)
+            player->play();
+    }
+    else if (playAfterDownloaded == song)
+    {
+        playLocalSong(song);
+    }
+
+    downloadNext();
+}
+
 void OrderPlayerWindow::downloadSongLyric(Song song)
 {
     if (QFileInfo(lyricPath(song)).exists())
@@ -1706,6 +1917,7 @@ void OrderPlayerWindow::downloadSongLyric(Song song)
             stream << lrc;
             file.flush();
             file.close();
+            songCache->insert(lyricPath(song));
 
             MUSIC_DEB << "下载歌词完成：" << song.simpleString();
             if (playAfterDownloaded == song || playingSong == song)
@@ -1799,6 +2011,7 @@ void OrderPlayerWindow::downloadSongCoverJpg(Song song, QString url)
             file.write(baData1);
             file.flush();
             file.close();
+            songCache->insert(coverPath(song));
 
             MUSIC_DEB << "封面下载完成:" << pixmap.size() << "   "
                       << (playAfterDownloaded == song) << (playingSong == song)
@@ -1829,8 +2042,9 @@ void OrderPlayerWindow::downloadSongCoverJpg(Song song, QString url)
  */
 void OrderPlayerWindow::setCurrentLyric(QString lyric)
 {
-    desktopLyric->setLyric(lyric);
-    ui->lyricWidget->setLyric(lyric);
+    lyricTimeline = LyricTimeline::parse(lyric);
+    desktopLyric->setTimeline(lyricTimeline);
+    ui->lyricWidget->setTimeline(lyricTimeline);
     emit signalLyricChanged();
 }
 
@@ -2031,12 +2245,17 @@ void OrderPlayerWindow::clearDownloadFiles()
         QFile f;
         f.remove(info.absoluteFilePath());
     }
+    songCache->clear();
 }
 
+/**
+ * 清理长时间没有续传的临时文件
+ * 已下载的歌曲由 songCache 按容量淘汰，不再按时间删除
+ */
 void OrderPlayerWindow::clearHoaryFiles()
 {
     qint64 current = QDateTime::currentSecsSinceEpoch();
-    QList<QFileInfo> files = musicsFileDir.entryInfoList(QDir::Files);
+    QList<QFileInfo> files = musicsFileDir.entryInfoList(QStringList{"*.part"}, QDir::Files);
     foreach (QFileInfo info, files)
     {
         if (info.lastModified().toSecsSinceEpoch() + 604800 < current) // 七天前的
@@ -2047,6 +2266,20 @@ void OrderPlayerWindow::clearHoaryFiles()
     }
 }
 
+/**
+ * 缓存超出容量时淘汰不常听的歌曲
+ * 收藏、点歌队列、正在播放/下载的歌曲都不会被删除
+ */
+void OrderPlayerWindow::shrinkSongCache()
+{
+    QSet<QString> pinned;
+    foreach (const Song& song, favoriteSongs + orderSongs + downloadingSongs)
+        pinned.insert(songPath(song));
+    pinned.insert(songPath(playingSong));
+    pinned.insert(songPath(playAfterDownloaded));
+    songCache->evict(pinned);
+}
+
 void OrderPlayerWindow::playNextRandomSong()
 {
     if (!normalSongs.size()) // 空闲列表没有歌曲
@@ -2137,25 +2370,8 @@ void OrderPlayerWindow::connectDesktopLyricSignals()
 
         if (playingSong.isValid())
         {
-            Song song = playingSong;
-            if (QFileInfo(lyricPath(song)).exists())
-            {
-                QFile file(lyricPath(song));
-                file.open(QIODevice::ReadOnly | QIODevice::Text);
-                QTextStream stream(&file);
-                stream.setCodec("UTF-8");
-                QString lyric;
-                QString line;
-                while (!stream.atEnd())
-                {
-                    line = stream.readLine();
-                    lyric.append(line+"\n");
-                }
-                file.close();
-
-                desktopLyric->setLyric(lyric);
-                desktopLyric->setPosition(player->position());
-            }
+            desktopLyric->setTimeline(lyricTimeline);
+            desktopLyric->setPosition(player->position());
         }
     });
 }
@@ -2182,48 +2398,42 @@ void OrderPlayerWindow::setCurrentCover(const QPixmap &pixmap)
         setBlurBackground(currentCover);
 }
 
+/**
+ * 在子线程中模糊封面，完成后再开始切换背景的动画
+ */
 void OrderPlayerWindow::setBlurBackground(const QPixmap &bg)
 {
     if (bg.isNull())
         return ;
 
-    // 当前图片变为上一张图
-    prevBgAlpha = currentBgAlpha;
-    prevBlurBg = currentBlurBg;
-
-    // 开始模糊
     const int radius = qMax(20, qMin(width(), height())/5);
-    QPixmap pixmap = bg;
-    pixmap = pixmap.scaled(this->width()+radius*2, this->height() + radius*2, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
-    QImage img = pixmap.toImage(); // img -blur-> painter(pixmap)
-    QPainter painter( &pixmap );
-    qt_blurImage( &painter, img, radius, true, false );
+    const QSize size = this->size();
+    const QImage source = bg.toImage();
+    const int serial = ++blurBgSerial;
+
+    QFutureWatcher<QImage>* watcher = new QFutureWatcher<QImage>(this);
+    connect(watcher, &QFutureWatcher<QImage>::finished, this, [=]{
+        QImage blurred = watcher->result();
+        watcher->deleteLater();
+        if (serial != blurBgSerial || blurred.isNull()) // 已经换了别的封面
+            return ;
 
-    // 裁剪掉边缘（模糊后会有黑边）
-    int c = qMin(bg.width(), bg.height());
-    c = qMin(c/2, radius);
-    QPixmap clip = pixmap.copy(c, c, pixmap.width()-c*2, pixmap.height()-c*2);
+        // 当前图片变为上一张图
+        prevBgAlpha = currentBgAlpha;
+        prevBlurBg = currentBlurBg;
 
-    // 抽样获取背景，设置之后的透明度
-    qint64 rgbSum = 0;
-    QImage image = clip.toImage();
-    int w = image.width(), h = image.height();
-    const int m = 16;
-    for (int y = 0; y < m; y++)
-    {
-        for (int x = 0; x < m; x++)
-        {
-            QColor c = image.pixelColor(w*x/m, h*x/m);
-            rgbSum += c.red() + c.green() + c.blue();
-        }
-    }
-    int addin = int(rgbSum * blurAlpha / (255*3*m*m));
+        // 根据背景亮度，设置之后的透明度
+        int addin = ImageAnalysis::averageLuma(blurred) * blurAlpha / 255;
 
-    // 半透明
-    currentBlurBg = clip;
-    currentBgAlpha = qMin(255, blurAlpha + addin);
+        // 半透明
+        currentBlurBg = QPixmap::fromImage(blurred);
+        currentBgAlpha = qMin(255, blurAlpha + addin);
 
-    startBgAnimation();
+        startBgAnimation();
+    });
+    watcher->setFuture(QtConcurrent::run([=]{
+        return ImageAnalysis::blurred(source, size, radius);
+    }));
 }
 
 void OrderPlayerWindow::startBgAnimation(int duration)
@@ -2256,12 +2466,28 @@ void OrderPlayerWindow::startBgAnimation(int duration)
 
 void OrderPlayerWindow::setThemeColor(const QPixmap &cover)
 {
-    QColor bg, fg, sbg, sfg;
-    auto colors = ImageUtil::extractImageThemeColors(cover.toImage(), 7);
-    ImageUtil::getBgFgSgColor(colors, &bg, &fg, &sbg, &sfg);
+    // 在子线程中提取主题色
+    const QImage image = cover.toImage();
+    const int serial = ++themeColorSerial;
+    QFutureWatcher<QList<QColor>>* watcher = new QFutureWatcher<QList<QColor>>(this);
+    connect(watcher, &QFutureWatcher<QList<QColor>>::finished, this, [=]{
+        QList<QColor> colors = watcher->result();
+        watcher->deleteLater();
+        if (serial == themeColorSerial)
+            startThemeColorAnimation(colors);
+    });
+    watcher->setFuture(QtConcurrent::run([=]{
+        QColor bg, fg, sbg, sfg;
+        auto colors = ImageUtil::extractImageThemeColors(image, 7);
+        ImageUtil::getBgFgSgColor(colors, &bg, &fg, &sbg, &sfg);
+        return QList<QColor>{bg, fg, sbg, sfg};
+    }));
+}
 
+void OrderPlayerWindow::startThemeColorAnimation(const QList<QColor> &colors)
+{
     prevPa = BFSColor::fromPalette(palette());
-    currentPa = BFSColor(QList<QColor>{bg, fg,sbg, sfg});
+    currentPa = BFSColor(colors);
 
     QPropertyAnimation* ani = new QPropertyAnimation(this, "paletteProg");
     ani->setStartValue(0);
@@ -2859,13 +3085,13 @@ void OrderPlayerWindow::on_favoriteSongsListView_customContextMenuRequested(cons
 
     menu->split()->addAction("上移", [=]{
         favoriteSongs.swapItemsAt(row, row-1);
-        saveSongList("music/order", favoriteSongs);
+        saveSongList("music/favorite", favoriteSongs);
         setSongModelToView(favoriteSongs, ui->favoriteSongsListView);
     })->disable(songs.size() != 1 || row < 1);
 
     menu->addAction("下移", [=]{
         favoriteSongs.swapItemsAt(row, row+1);
-        saveSongList("music/order", favoriteSongs);
+        saveSongList("music/favorite", favoriteSongs);
         setSongModelToView(favoriteSongs, ui->favoriteSongsListView);
     })->disable(songs.size() != 1 || row >= favoriteSongs.size()-1);
 
@@ -2943,14 +3169,14 @@ void OrderPlayerWindow::on_normalSongsListView_customContextMenuRequested(const
     menu->split()->addAction("上移", [=]{
         // normalSongs.swapItemsAt(row, row-1); // 5.13之前不支持
         normalSongs.insert(row - 1, normalSongs.takeAt(row));
-        saveSongList("music/order", normalSongs);
+        saveSongList("music/normal", normalSongs);
         setSongModelToView(normalSongs, ui->normalSongsListView);
     })->disable(songs.size() != 1 || row < 1);
 
     menu->addAction("下移", [=]{
         // normalSongs.swapItemsAt(row, row+1); // 5.13之前不支持
         normalSongs.insert(row, normalSongs.takeAt(row + 1));
-        saveSongList("music/order", normalSongs);
+        saveSongList("music/normal", normalSongs);
         setSongModelToView(normalSongs, ui->normalSongsListView);
     })->disable(songs.size() != 1 || row >= normalSongs.size()-1);
 
@@ -3013,15 +3239,9 @@ void OrderPlayerWindow::on_historySongsListView_customContextMenuRequested(const
     menu->split()->addAction("清理下载文件", [=]{
         foreach (Song song, songs)
         {
-            QString path = songPath(song);
-            if (QFileInfo(path).exists())
-                QFile(path).remove();
-            path = coverPath(song);
-            if (QFileInfo(path).exists())
-                QFile(path).remove();
-            path = lyricPath(song);
-            if (QFileInfo(path).exists())
-                QFile(path).remove();
+            songCache->remove(songPath(song));
+            songCache->remove(coverPath(song));
+            songCache->remove(lyricPath(song));
         }
     })->disable(!currentSong.isValid());
 
@@ -3185,9 +3405,12 @@ void OrderPlayerWindow::adjustCurrentLyricTime(QString lyric)
     file.flush();
     file.close();
 
-    // 调整桌面歌词
-    desktopLyric->setLyric(lyric);
+    // 调整后重新解析，两边的歌词控件同步
+    lyricTimeline = LyricTimeline::parse(lyric);
+    desktopLyric->setTimeline(lyricTimeline);
     desktopLyric->setPosition(player->position());
+    ui->lyricWidget->setTimeline(lyricTimeline);
+    ui->lyricWidget->setPosition(player->position());
 }
 
 void OrderPlayerWindow::on_settingsButton_clicked()
@@ -3255,6 +3478,16 @@ void OrderPlayerWindow::on_settingsButton_clicked()
         settings.setValue("music/br", songBr = br);
     })->check(songBr >= 320000);
 
+    playMenu->addAction("缓存上限", [=]{
+        bool ok = false;
+        int size = QInputDialog::getInt(this, "缓存上限", "已下载歌曲占用的最大空间（MB），超出后自动删除不常听的歌曲\n收藏和点歌队列中的歌曲不会被删除\n当前占用：" + snum(songCache->getTotalBytes() / 1024 / 1024) + " MB", int(songCache->getBudget() / 1024 / 1024), 100, 1024 * 1024, 100, &ok);
+        if (!ok)
+            return ;
+        settings.setValue("music/cacheSize", size);
+        songCache->setBudget(qint64(size) * 1024 * 1024);
+        shrinkSongCache();
+    });
+
     playMenu->addAction("双击播放", [=]{
         settings.setValue("music/doubleClickToPlay", doubleClickToPlay = !doubleClickToPlay);
     })->check(doubleClickToPlay);
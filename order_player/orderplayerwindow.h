@@ -25,7 +25,11 @@
 #include "desktoplyricwidget.h"
 #include "numberanimation.h"
 #include "imageutil.h"
+#include "imageanalysis.h"
 #include "logindialog.h"
+#include "songcache.h"
+#include "songsearchindex.h"
+#include "songlistjournal.h"
 #include "netinterface.h"
 
 QT_BEGIN_NAMESPACE
@@ -44,6 +48,9 @@ QT_END_NAMESPACE
 
 #define MUSIC_DEB if (0) qDebug()
 
+#define SONG_PLAY_BUFFER_SIZE (512 * 1024) // 边下边播：缓冲到这么多字节后开始播放
+#define SONG_DOWNLOAD_RETRY 2 // 下载中断后自动续传的次数
+
 enum MusicQuality
 {
     NormalQuality, // MP3普通品质
@@ -208,6 +215,8 @@ private slots:
 private:
     void searchMusic(QString key, QString addBy = QString(), bool notify = false);
     void searchMusicBySource(QString key, MusicSource source, QString addBy = QString());
+    Song matchLocalSong(QString key, MusicSource source) const;
+    void orderSearchedSong(Song song, QString addBy, bool notify, bool insertOnce);
     void setSearchResultTable(SongList songs);
     void setSearchResultTable(PlayListList playLists);
     void addFavorite(SongList songs);
@@ -219,9 +228,11 @@ private:
     void restoreSongList(QString key, SongList& songs);
     void setSongModelToView(const SongList& songs, QListView* listView);
     QString songPath(const Song &song) const;
+    QString songPartPath(const Song &song) const;
     QString lyricPath(const Song &song) const;
     QString coverPath(const Song &song) const;
     bool isSongDownloaded(Song song);
+    bool isSongBuffered(Song song);
     QString msecondToString(qint64 msecond);
     void activeSong(Song song);
     bool isNotPlaying() const;
@@ -237,7 +248,9 @@ private:
     void downloadNext();
     void downloadSong(Song song);
     void downloadSongFailed(Song song);
-    void downloadSongMp3(Song song, QString url);
+    void releaseDownloadSong(Song song);
+    void downloadSongMp3(Song song, QString url, int retry = 0);
+    void finishDownloadSongMp3(Song song);
     void downloadSongLyric(Song song);
     void downloadSongCover(Song song);
     void downloadSongCoverJpg(Song song, QString url);
@@ -246,6 +259,7 @@ private:
     void openPlayList(QString shareUrl);
     void clearDownloadFiles();
     void clearHoaryFiles();
+    void shrinkSongCache();
 
     void playNextRandomSong();
     void generalRandomSongList();
@@ -256,6 +270,7 @@ private:
     void setBlurBackground(const QPixmap& bg);
     void startBgAnimation(int duration = 2000);
     void setThemeColor(const QPixmap& cover);
+    void startThemeColorAnimation(const QList<QColor>& colors);
 
     void readMp3Data(const QByteArray& array);
 
@@ -325,13 +340,20 @@ private:
     SongList normalSongs;
     SongList historySongs;
     PlayListList myPlayLists;
+    SongSearchIndex songSearchIndex; // 收藏+空闲歌单的索引，点歌优先从这里找
     SongList toDownloadSongs;
     Song playAfterDownloaded;
-    Song downloadingSong;
+    SongList downloadingSongs; // 正在下载的歌曲（包括获取直链的阶段）
+    int maxDownloadingCount = 3; // 同时下载的歌曲数量
+    int maxSourceDownloadingCount = 2; // 每个平台同时下载的数量，避免被限流
+    QNetworkAccessManager* downloadManager;
+    SongCache* songCache; // 已下载文件的索引，按容量淘汰
+    SongListJournal* songListJournal; // 各个歌曲列表的保存
 
     QMediaPlayer* player;
     PlayCircleMode circleMode = OrderList;
     Song playingSong;
+    LyricTimeline lyricTimeline; // 当前歌曲解析好的歌词，各个歌词控件共用
     int lyricScroll;
 
     bool doubleClickToPlay = false; // 双击是立即播放，还是添加到列表
@@ -348,8 +370,10 @@ private:
     QPixmap currentBlurBg;
     QPixmap prevBlurBg;
     int prevBgAlpha = 0;
+    int blurBgSerial = 0; // 子线程计算的序号，只使用最新一次的结果
 
     bool themeColor = false;
+    int themeColorSerial = 0;
     BFSColor prevPa;
     BFSColor currentPa;
     double paletteAlpha;
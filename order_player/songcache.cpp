@@ -0,0 +1,282 @@
+#include <QDataStream>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QDebug>
+#include <algorithm>
+#include "songcache.h"
+
+#define SONG_CACHE_MAGIC 0x53434931 // "SCI1"
+#define SONG_CACHE_VERSION 1
+#define SONG_CACHE_PLAY_BONUS 86400 // 每播放一次，淘汰顺序相当于推迟一天
+#define SONG_CACHE_PLAY_BONUS_MAX 30
+
+static const char* songCacheSuffixes[] = { ".mp3", ".lrc", ".jpg" };
+
+SongCache::SongCache(const QDir &dir, const QString &indexPath, QObject *parent)
+    : QObject(parent), dir(dir), indexPath(indexPath)
+{
+    saveTimer.setSingleShot(true);
+    saveTimer.setInterval(3000);
+    connect(&saveTimer, &QTimer::timeout, this, [=]{
+        save();
+    });
+}
+
+SongCache::~SongCache()
+{
+    if (saveTimer.isActive())
+        save();
+}
+
+/**
+ * 读取索引文件，并与磁盘上的实际文件同步
+ * 索引中没有的文件以修改时间作为最后使用时间，磁盘上已删除的条目直接丢弃
+ */
+void SongCache::load()
+{
+    entries.clear();
+    QFile file(indexPath);
+    if (file.open(QIODevice::ReadOnly))
+    {
+        QDataStream in(&file);
+        quint32 magic = 0, version = 0, count = 0;
+        in >> magic >> version >> count;
+        if (magic == SONG_CACHE_MAGIC && version == SONG_CACHE_VERSION)
+        {
+            for (quint32 i = 0; i < count && !in.atEnd(); i++)
+            {
+                QString key;
+                Entry entry;
+                in >> key >> entry.files >> entry.bytes >> entry.lastUsed >> entry.playCount;
+                entries.insert(key, entry);
+            }
+        }
+        else
+        {
+            qWarning() << "歌曲缓存索引格式不匹配，重新扫描：" << indexPath;
+        }
+    }
+
+    rescan();
+    save();
+}
+
+void SongCache::save()
+{
+    saveTimer.stop();
+    QFile file(indexPath);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        qWarning() << "无法保存歌曲缓存索引：" << indexPath;
+        return ;
+    }
+    QDataStream out(&file);
+    out << quint32(SONG_CACHE_MAGIC) << quint32(SONG_CACHE_VERSION) << quint32(entries.size());
+    for (auto it = entries.constBegin(); it != entries.constEnd(); ++it)
+    {
+        const Entry& entry = it.value();
+        out << it.key() << entry.files << entry.bytes << entry.lastUsed << entry.playCount;
+    }
+}
+
+void SongCache::setBudget(qint64 bytes)
+{
+    budget = bytes;
+}
+
+qint64 SongCache::getBudget() const
+{
+    return budget;
+}
+
+qint64 SongCache::getTotalBytes() const
+{
+    return totalBytes;
+}
+
+/**
+ * 文件是否在缓存中，只查内存不访问磁盘
+ */
+bool SongCache::exists(const QString &path) const
+{
+    quint8 type = typeOf(path);
+    auto it = entries.find(keyOf(path));
+    return type && it != entries.end() && (it.value().files & type);
+}
+
+/**
+ * 新下载的文件写入磁盘后加入缓存
+ */
+void SongCache::insert(const QString &path)
+{
+    quint8 type = typeOf(path);
+    if (!type || !QFileInfo(path).exists())
+        return ;
+
+    QString key = keyOf(path);
+    Entry& entry = entries[key];
+    entry.files |= type;
+    entry.lastUsed = QDateTime::currentSecsSinceEpoch();
+
+    qint64 bytes = 0;
+    for (int i = 0; i < 3; i++)
+        if (entry.files & (1 << i))
+            bytes += QFileInfo(dir.absoluteFilePath(key + songCacheSuffixes[i])).size();
+    totalBytes += bytes - entry.bytes;
+    entry.bytes = bytes;
+    saveLater();
+}
+
+/**
+ * 删除单个文件，并从条目中去掉这个类型
+ * 不经过这里删除的文件，exists() 会一直认为还在
+ */
+void SongCache::remove(const QString &path)
+{
+    QFile::remove(path);
+    quint8 type = typeOf(path);
+    auto it = entries.find(keyOf(path));
+    if (!type || it == entries.end() || !(it.value().files & type))
+        return ;
+
+    Entry& entry = it.value();
+    entry.files &= quint8(~type);
+    qint64 bytes = 0;
+    for (int i = 0; i < 3; i++)
+        if (entry.files & (1 << i))
+            bytes += QFileInfo(dir.absoluteFilePath(it.key() + songCacheSuffixes[i])).size();
+    totalBytes += bytes - entry.bytes;
+    entry.bytes = bytes;
+    if (!entry.files)
+        entries.erase(it);
+    saveLater();
+}
+
+/**
+ * 播放了一次，更新最后使用时间和次数
+ */
+void SongCache::touch(const QString &path)
+{
+    auto it = entries.find(keyOf(path));
+    if (it == entries.end())
+        return ;
+    it.value().lastUsed = QDateTime::currentSecsSinceEpoch();
+    it.value().playCount++;
+    saveLater();
+}
+
+void SongCache::clear()
+{
+    entries.clear();
+    totalBytes = 0;
+    save();
+}
+
+/**
+ * 超出容量时淘汰最不常用的歌曲，返回淘汰的数量
+ * @param pinnedPaths 不能淘汰的文件（收藏、点歌队列、正在播放）
+ */
+int SongCache::evict(const QSet<QString> &pinnedPaths)
+{
+    if (totalBytes <= budget)
+        return 0;
+
+    QSet<QString> pinned;
+    foreach (const QString& path, pinnedPaths)
+        pinned.insert(keyOf(path));
+
+    QList<QPair<qint64, QString>> candidates;
+    candidates.reserve(entries.size());
+    for (auto it = entries.constBegin(); it != entries.constEnd(); ++it)
+    {
+        if (pinned.contains(it.key()))
+            continue;
+        const Entry& entry = it.value();
+        qint64 score = entry.lastUsed
+                + qMin(entry.playCount, quint32(SONG_CACHE_PLAY_BONUS_MAX)) * SONG_CACHE_PLAY_BONUS;
+        candidates.append(qMakePair(score, it.key()));
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    int count = 0;
+    for (int i = 0; i < candidates.size() && totalBytes > budget; i++)
+    {
+        removeEntry(candidates.at(i).second);
+        count++;
+    }
+    if (count)
+    {
+        qInfo() << "歌曲缓存超出容量，淘汰" << count << "首，剩余" << totalBytes / 1024 / 1024 << "MB";
+        save();
+    }
+    return count;
+}
+
+/**
+ * 文件对应的缓存键：文件名去掉所有后缀
+ * 例如 netease_123.mp3、netease_123.mp3.part 都是 netease_123
+ */
+QString SongCache::keyOf(const QString &path)
+{
+    QString name = QFileInfo(path).fileName();
+    int pos = name.indexOf('.');
+    return pos == -1 ? name : name.left(pos);
+}
+
+quint8 SongCache::typeOf(const QString &path)
+{
+    for (int i = 0; i < 3; i++)
+        if (path.endsWith(songCacheSuffixes[i]))
+            return quint8(1 << i);
+    return 0;
+}
+
+/**
+ * 以磁盘为准，修正索引中的文件与大小
+ */
+void SongCache::rescan()
+{
+    QHash<QString, Entry> disk;
+    foreach (const QFileInfo& info, dir.entryInfoList(QDir::Files))
+    {
+        quint8 type = typeOf(info.fileName());
+        if (!type)
+            continue;
+        Entry& entry = disk[keyOf(info.fileName())];
+        entry.files |= type;
+        entry.bytes += info.size();
+        entry.lastUsed = qMax(entry.lastUsed, info.lastModified().toSecsSinceEpoch());
+    }
+
+    totalBytes = 0;
+    for (auto it = disk.begin(); it != disk.end(); ++it)
+    {
+        auto old = entries.constFind(it.key());
+        if (old != entries.constEnd())
+        {
+            it.value().lastUsed = old.value().lastUsed;
+            it.value().playCount = old.value().playCount;
+        }
+        totalBytes += it.value().bytes;
+    }
+    entries.swap(disk);
+}
+
+void SongCache::removeEntry(const QString &key)
+{
+    auto it = entries.find(key);
+    if (it == entries.end())
+        return ;
+    for (int i = 0; i < 3; i++)
+        if (it.value().files & (1 << i))
+            QFile::remove(dir.absoluteFilePath(key + songCacheSuffixes[i]));
+    totalBytes -= it.value().bytes;
+    entries.erase(it);
+}
+
+void SongCache::saveLater()
+{
+    if (!saveTimer.isActive())
+        saveTimer.start();
+}
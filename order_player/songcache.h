@@ -0,0 +1,69 @@
+#ifndef SONGCACHE_H
+#define SONGCACHE_H
+
+#include <QObject>
+#include <QDir>
+#include <QHash>
+#include <QSet>
+#include <QTimer>
+
+/**
+ * 歌曲文件缓存索引
+ * 同一首歌的 mp3/lrc/jpg 作为一个条目（以文件名去掉后缀为键），
+ * 记录大小、最后播放时间、播放次数，持久化到一个二进制索引文件。
+ * 超出容量时按 最近使用+使用频率 淘汰，收藏/点歌队列中的歌曲不会被淘汰。
+ */
+class SongCache : public QObject
+{
+    Q_OBJECT
+public:
+    SongCache(const QDir& dir, const QString& indexPath, QObject* parent = nullptr);
+    ~SongCache() override;
+
+    struct Entry
+    {
+        quint8 files = 0; // 拥有的文件类型，见 FileType
+        qint64 bytes = 0; // 所有文件的总大小
+        qint64 lastUsed = 0; // 秒
+        quint32 playCount = 0;
+    };
+
+    enum FileType
+    {
+        SongFile = 1,
+        LyricFile = 2,
+        CoverFile = 4
+    };
+
+    void load();
+    void save();
+
+    void setBudget(qint64 bytes);
+    qint64 getBudget() const;
+    qint64 getTotalBytes() const;
+
+    bool exists(const QString& path) const;
+    void insert(const QString& path);
+    void remove(const QString& path);
+    void touch(const QString& path);
+    void clear();
+    int evict(const QSet<QString>& pinnedPaths);
+
+    static QString keyOf(const QString& path);
+
+private:
+    static quint8 typeOf(const QString& path);
+    void rescan();
+    void removeEntry(const QString& key);
+    void saveLater();
+
+private:
+    QDir dir;
+    QString indexPath;
+    QHash<QString, Entry> entries;
+    qint64 totalBytes = 0;
+    qint64 budget = 1024LL * 1024 * 1024;
+    QTimer saveTimer;
+};
+
+#endif // SONGCACHE_H
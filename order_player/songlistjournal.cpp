@@ -0,0 +1,283 @@
+#include <QFile>
+#include <QSaveFile>
+#include <QDebug>
+#include "songlistjournal.h"
+
+#define SONG_JOURNAL_FLUSH_DELAY 1000 // 合并多次修改，毫秒
+#define SONG_JOURNAL_MIN_RECORDS 256 // 修改行数超过 max(这个, 列表长度) 时压缩
+
+SongListJournal::SongListJournal(const QString &dirPath, QSettings *legacySettings, QObject *parent)
+    : QObject(parent), dir(dirPath), legacySettings(legacySettings)
+{
+    dir.mkpath(dir.absolutePath());
+    flushTimer.setSingleShot(true);
+    flushTimer.setInterval(SONG_JOURNAL_FLUSH_DELAY);
+    connect(&flushTimer, &QTimer::timeout, this, [=]{
+        flush();
+    });
+}
+
+SongListJournal::~SongListJournal()
+{
+    flush();
+}
+
+/**
+ * 回放日志得到列表
+ * 没有日志文件时，从旧版本的 QSettings 中迁移，写入日志成功后才删除旧的
+ * 遇到损坏的行就停止回放（视为写了一半的结尾），后面的修改基于错误的位置，不能再用
+ */
+SongList SongListJournal::load(const QString &key)
+{
+    SongList songs;
+    QFile file(filePath(key));
+    if (!file.exists())
+    {
+        if (legacySettings && legacySettings->contains(key))
+        {
+            QJsonArray array = legacySettings->value(key).toJsonArray();
+            foreach (QJsonValue val, array)
+                songs.append(Song::fromJson(val.toObject()));
+            if (!compact(key, songs))
+                retryCompact(key, songs);
+            return songs;
+        }
+        saved.insert(key, songs);
+        return songs;
+    }
+
+    int count = 0;
+    bool torn = false;
+    if (file.open(QIODevice::ReadOnly))
+    {
+        while (!file.atEnd())
+        {
+            QByteArray line = file.readLine().trimmed();
+            if (line.isEmpty())
+                continue;
+            SongListOp op;
+            if (!jsonToOp(QJsonDocument::fromJson(line).object(), op))
+            {
+                qWarning() << "歌曲列表日志损坏，停止读取：" << key << "第" << (count + 1) << "条" << line.left(64);
+                torn = true;
+                break;
+            }
+            if (op.type != SongListOp::Reset && (op.row < 0 || op.row > songs.size()
+                    || (op.type != SongListOp::Insert && op.row >= songs.size())
+                    || (op.type == SongListOp::Move && (op.from <= op.row || op.from >= songs.size()))))
+            {
+                qWarning() << "歌曲列表日志位置错误，停止读取：" << key << "第" << (count + 1) << "条" << line.left(64);
+                torn = true;
+                break;
+            }
+            op.apply(songs);
+            count++;
+        }
+        file.close();
+    }
+
+    // 损坏的行之后不能再追加，重写成已读取的内容
+    if (torn)
+    {
+        if (!compact(key, songs))
+            retryCompact(key, songs);
+        return songs;
+    }
+
+    saved.insert(key, songs);
+    records.insert(key, count);
+    if (count > 1 && count > qMax(SONG_JOURNAL_MIN_RECORDS, songs.size()))
+        compact(key, songs);
+    return songs;
+}
+
+/**
+ * 记录列表的最新状态，稍后一起写入
+ */
+void SongListJournal::save(const QString &key, const SongList &songs)
+{
+    pending.insert(key, songs);
+    if (!flushTimer.isActive())
+        flushTimer.start();
+}
+
+/**
+ * 把等待中的修改追加到各自的日志
+ * saved 只在写入成功后更新，写入失败的列表留在 pending 中稍后重试
+ */
+void SongListJournal::flush()
+{
+    flushTimer.stop();
+    QHash<QString, SongList> failed;
+    for (auto it = pending.constBegin(); it != pending.constEnd(); ++it)
+    {
+        const QString& key = it.key();
+        const SongList& songs = it.value();
+        QList<SongListOp> ops = SongListOp::diff(saved.value(key), songs);
+        if (ops.isEmpty())
+            continue;
+
+        if (ops.first().type == SongListOp::Reset)
+        {
+            if (!compact(key, songs))
+                failed.insert(key, songs);
+            continue;
+        }
+
+        QByteArray data;
+        foreach (const SongListOp& op, ops)
+            data += QJsonDocument(opToJson(op)).toJson(QJsonDocument::Compact) + "\n";
+
+        QFile file(filePath(key));
+        if (!file.open(QIODevice::Append))
+        {
+            qWarning() << "无法写入歌曲列表日志：" << file.fileName();
+            failed.insert(key, songs);
+            continue;
+        }
+        bool written = file.write(data) == data.size() && file.flush();
+        file.close();
+        if (!written)
+        {
+            // 可能只写了一部分，整个重写
+            qWarning() << "写入歌曲列表日志失败：" << file.fileName() << file.errorString();
+            if (!compact(key, songs))
+                failed.insert(key, songs);
+            continue;
+        }
+
+        saved.insert(key, songs);
+        int count = records.value(key) + ops.size();
+        records.insert(key, count);
+        if (count > qMax(SONG_JOURNAL_MIN_RECORDS, songs.size()))
+            compact(key, songs);
+    }
+
+    pending = failed;
+    if (!pending.isEmpty())
+        flushTimer.start();
+}
+
+QString SongListJournal::filePath(const QString &key) const
+{
+    QString name = key;
+    name.replace('/', '_');
+    return dir.absoluteFilePath(name + ".journal");
+}
+
+/**
+ * 把整个列表写成一条记录，替换原来的日志
+ * 成功后才更新已保存的状态，并删除旧版本 QSettings 中的同名列表
+ * @return 是否写入成功
+ */
+bool SongListJournal::compact(const QString &key, const SongList &songs)
+{
+    SongListOp op;
+    op.type = SongListOp::Reset;
+    op.songs = songs;
+
+    QSaveFile file(filePath(key));
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        qWarning() << "无法写入歌曲列表日志：" << file.fileName();
+        return false;
+    }
+    file.write(QJsonDocument(opToJson(op)).toJson(QJsonDocument::Compact) + "\n");
+    if (!file.commit())
+    {
+        qWarning() << "写入歌曲列表日志失败：" << file.fileName() << file.errorString();
+        return false;
+    }
+
+    saved.insert(key, songs);
+    records.insert(key, 1);
+    if (legacySettings && legacySettings->contains(key))
+        legacySettings->remove(key);
+    return true;
+}
+
+/**
+ * 重写失败时，日志文件和读到的列表不一致
+ * 已保存的状态留空，下次写入时会整个重写
+ */
+void SongListJournal::retryCompact(const QString &key, const SongList &songs)
+{
+    saved.insert(key, SongList());
+    records.insert(key, 0);
+    if (!pending.contains(key))
+        pending.insert(key, songs);
+    if (!flushTimer.isActive())
+        flushTimer.start();
+}
+
+QJsonObject SongListJournal::opToJson(const SongListOp &op)
+{
+    QJsonObject json;
+    switch (op.type) {
+    case SongListOp::Insert:
+        json.insert("t", "i");
+        json.insert("r", op.row);
+        json.insert("s", op.song.toJson());
+        break;
+    case SongListOp::Remove:
+        json.insert("t", "d");
+        json.insert("r", op.row);
+        break;
+    case SongListOp::Move:
+        json.insert("t", "m");
+        json.insert("f", op.from);
+        json.insert("r", op.row);
+        break;
+    case SongListOp::Update:
+        json.insert("t", "u");
+        json.insert("r", op.row);
+        json.insert("s", op.song.toJson());
+        break;
+    case SongListOp::Reset:
+    {
+        QJsonArray array;
+        foreach (const Song& song, op.songs)
+            array.append(song.toJson());
+        json.insert("t", "r");
+        json.insert("s", array);
+        break;
+    }
+    }
+    return json;
+}
+
+bool SongListJournal::jsonToOp(const QJsonObject &json, SongListOp &op)
+{
+    QString type = json.value("t").toString();
+    op.row = json.value("r").toInt();
+    op.from = json.value("f").toInt();
+    if (type == "i")
+    {
+        op.type = SongListOp::Insert;
+        op.song = Song::fromJson(json.value("s").toObject());
+    }
+    else if (type == "d")
+    {
+        op.type = SongListOp::Remove;
+    }
+    else if (type == "m")
+    {
+        op.type = SongListOp::Move;
+    }
+    else if (type == "u")
+    {
+        op.type = SongListOp::Update;
+        op.song = Song::fromJson(json.value("s").toObject());
+    }
+    else if (type == "r")
+    {
+        op.type = SongListOp::Reset;
+        foreach (QJsonValue val, json.value("s").toArray())
+            op.songs.append(Song::fromJson(val.toObject()));
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
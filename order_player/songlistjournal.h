@@ -0,0 +1,44 @@
+#ifndef SONGLISTJOURNAL_H
+#define SONGLISTJOURNAL_H
+
+#include <QObject>
+#include <QDir>
+#include <QHash>
+#include <QTimer>
+#include <QSettings>
+#include "songlistmodel.h"
+
+/**
+ * 歌曲列表的持久化
+ * 每个列表一个日志文件，每行一条修改（JSON），只追加不重写；
+ * 修改积累过多时压缩成一条完整列表。
+ * 保存会合并一段时间内的多次修改，避免每次点歌都写一遍完整的列表。
+ */
+class SongListJournal : public QObject
+{
+    Q_OBJECT
+public:
+    SongListJournal(const QString& dirPath, QSettings* legacySettings, QObject* parent = nullptr);
+    ~SongListJournal() override;
+
+    SongList load(const QString& key);
+    void save(const QString& key, const SongList& songs);
+    void flush();
+
+private:
+    QString filePath(const QString& key) const;
+    bool compact(const QString& key, const SongList& songs);
+    void retryCompact(const QString& key, const SongList& songs);
+    static QJsonObject opToJson(const SongListOp& op);
+    static bool jsonToOp(const QJsonObject& json, SongListOp& op);
+
+private:
+    QDir dir;
+    QSettings* legacySettings; // 旧版本保存在 QSettings 里的列表，读取后迁移
+    QHash<QString, SongList> saved; // 已经写入文件的状态
+    QHash<QString, SongList> pending; // 等待写入的最新状态
+    QHash<QString, int> records; // 上次压缩后追加的行数
+    QTimer flushTimer;
+};
+
+#endif // SONGLISTJOURNAL_H
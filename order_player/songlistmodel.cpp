@@ -0,0 +1,184 @@
+#include <QSet>
+#include "songlistmodel.h"
+
+#define SONG_LIST_MAX_OPS 64 // 变化太多时直接整体重置，比逐条通知更快
+
+/**
+ * 计算把 from 变成 to 的最少（近似）修改
+ * 先删除 to 中没有的，再从前往后对齐：相同则跳过，在后面则移动，都没有则插入
+ * 常见的 追加/置顶/删除/交换 都只会产生一两条修改
+ */
+QList<SongListOp> SongListOp::diff(const SongList &from, const SongList &to)
+{
+    QList<SongListOp> ops;
+    auto reset = [&]{
+        ops.clear();
+        SongListOp op;
+        op.type = Reset;
+        op.songs = to;
+        ops.append(op);
+        return ops;
+    };
+    if (from.isEmpty() || to.isEmpty())
+        return from.isEmpty() && to.isEmpty() ? ops : reset();
+
+    SongList cur = from;
+    QSet<qint64> ids;
+    foreach (const Song& song, to)
+        ids.insert(song.id);
+    for (int i = cur.size() - 1; i >= 0; i--)
+    {
+        if (ids.contains(cur.at(i).id))
+            continue;
+        SongListOp op;
+        op.type = Remove;
+        op.row = i;
+        op.apply(cur);
+        ops.append(op);
+        if (ops.size() > SONG_LIST_MAX_OPS)
+            return reset();
+    }
+
+    for (int i = 0; i < to.size(); i++)
+    {
+        const Song& song = to.at(i);
+        if (i >= cur.size() || cur.at(i).id != song.id)
+        {
+            int j = i + 1;
+            while (j < cur.size() && cur.at(j).id != song.id)
+                j++;
+
+            SongListOp op;
+            if (j < cur.size())
+            {
+                op.type = Move;
+                op.from = j;
+            }
+            else
+            {
+                op.type = Insert;
+                op.song = song;
+            }
+            op.row = i;
+            op.apply(cur);
+            ops.append(op);
+        }
+
+        if (!sameContent(cur.at(i), song))
+        {
+            SongListOp op;
+            op.type = Update;
+            op.row = i;
+            op.song = song;
+            op.apply(cur);
+            ops.append(op);
+        }
+        if (ops.size() > SONG_LIST_MAX_OPS)
+            return reset();
+    }
+
+    while (cur.size() > to.size()) // 重复的歌曲
+    {
+        SongListOp op;
+        op.type = Remove;
+        op.row = cur.size() - 1;
+        op.apply(cur);
+        ops.append(op);
+        if (ops.size() > SONG_LIST_MAX_OPS)
+            return reset();
+    }
+    return ops;
+}
+
+void SongListOp::apply(SongList &list) const
+{
+    switch (type) {
+    case Insert:
+        list.insert(row, song);
+        break;
+    case Remove:
+        list.removeAt(row);
+        break;
+    case Move:
+        list.move(from, row);
+        break;
+    case Update:
+        list[row] = song;
+        break;
+    case Reset:
+        list = songs;
+        break;
+    }
+}
+
+/**
+ * 显示或保存的内容是否相同（ID相同的歌曲，点歌人等信息可能不同）
+ */
+bool SongListOp::sameContent(const Song &a, const Song &b)
+{
+    return a.id == b.id && a.source == b.source && a.mid == b.mid
+            && a.name == b.name && a.artistNames == b.artistNames
+            && a.addBy == b.addBy && a.addTime == b.addTime
+            && a.url == b.url && a.album.name == b.album.name;
+}
+
+SongListModel::SongListModel(QObject *parent) : QAbstractListModel(parent)
+{
+}
+
+int SongListModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid())
+        return 0;
+    return songs.size();
+}
+
+QVariant SongListModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= songs.size())
+        return QVariant();
+    if (role == Qt::DisplayRole || role == Qt::ToolTipRole)
+        return songs.at(index.row()).simpleString();
+    return QVariant();
+}
+
+/**
+ * 设置新的列表，只通知变化的行，保留选中和滚动位置
+ */
+void SongListModel::setSongs(const SongList &songs)
+{
+    foreach (const SongListOp& op, SongListOp::diff(this->songs, songs))
+    {
+        switch (op.type) {
+        case SongListOp::Insert:
+            beginInsertRows(QModelIndex(), op.row, op.row);
+            op.apply(this->songs);
+            endInsertRows();
+            break;
+        case SongListOp::Remove:
+            beginRemoveRows(QModelIndex(), op.row, op.row);
+            op.apply(this->songs);
+            endRemoveRows();
+            break;
+        case SongListOp::Move:
+            beginMoveRows(QModelIndex(), op.from, op.from, QModelIndex(), op.row);
+            op.apply(this->songs);
+            endMoveRows();
+            break;
+        case SongListOp::Update:
+            op.apply(this->songs);
+            emit dataChanged(index(op.row), index(op.row));
+            break;
+        case SongListOp::Reset:
+            beginResetModel();
+            op.apply(this->songs);
+            endResetModel();
+            break;
+        }
+    }
+}
+
+const SongList &SongListModel::getSongs() const
+{
+    return songs;
+}
@@ -0,0 +1,53 @@
+#ifndef SONGLISTMODEL_H
+#define SONGLISTMODEL_H
+
+#include <QAbstractListModel>
+#include "songbeans.h"
+
+/**
+ * 歌曲列表的一次修改
+ * 由两个列表的差异得出，Model 据此发出细粒度的信号，日志据此只追加变化的部分
+ */
+struct SongListOp
+{
+    enum Type
+    {
+        Insert, // 在 row 插入 song
+        Remove, // 删除 row
+        Move,   // 把 from 移动到 row（from > row）
+        Update, // row 的内容变为 song
+        Reset   // 整个列表变为 songs
+    };
+
+    Type type;
+    int row = 0;
+    int from = 0;
+    Song song;
+    SongList songs;
+
+    static QList<SongListOp> diff(const SongList& from, const SongList& to);
+    void apply(SongList& list) const;
+    static bool sameContent(const Song& a, const Song& b);
+};
+
+/**
+ * 点歌、收藏、空闲等列表的 Model
+ * 每次设置新列表时只通知变化的行，不再重建整个 Model
+ */
+class SongListModel : public QAbstractListModel
+{
+    Q_OBJECT
+public:
+    SongListModel(QObject* parent = nullptr);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+
+    void setSongs(const SongList& songs);
+    const SongList& getSongs() const;
+
+private:
+    SongList songs;
+};
+
+#endif // SONGLISTMODEL_H
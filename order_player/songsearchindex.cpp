@@ -0,0 +1,307 @@
+#include <QFile>
+#include <QTextStream>
+#include <QSet>
+#include <QtMath>
+#include <QDebug>
+#include <algorithm>
+#include "songsearchindex.h"
+
+#define SONG_INDEX_FUZZY_RATIO 0.75 // 模糊匹配时至少命中的二元组比例
+
+/**
+ * 汉字 -> 拼音（不带声调，多音字取第一个）
+ * 与主程序共用资源文件 :/documents/pinyin ，只读取一次
+ */
+static const QHash<QChar, QString>& pinyinTable()
+{
+    static const QHash<QChar, QString> table = []{
+        QHash<QChar, QString> table;
+        QFile file(":/documents/pinyin");
+        if (!file.open(QIODevice::ReadOnly))
+        {
+            qWarning() << "无法读取拼音表，本地点歌不支持拼音匹配";
+            return table;
+        }
+        QTextStream in(&file);
+        in.setCodec("UTF-8");
+        QString line;
+        while (!(line = in.readLine()).isNull())
+        {
+            if (line.length() < 2)
+                continue;
+            QString pinyin = line.mid(1).section(',', 0, 0);
+            pinyin.remove(QRegExp("[0-9]"));
+            table.insert(line.at(0), pinyin);
+        }
+        return table;
+    }();
+    return table;
+}
+
+/**
+ * 添加到索引；已经在其他列表里的只增加标记
+ */
+void SongSearchIndex::addSongs(const SongList &songs, ListFlag list)
+{
+    foreach (const Song& song, songs)
+    {
+        auto it = docIds.find(song.id);
+        if (it != docIds.end())
+        {
+            Document& doc = documents[it.value()];
+            if (!doc.lists)
+                removedCount--;
+            doc.lists |= list;
+            continue;
+        }
+
+        Document doc;
+        doc.song = song;
+        doc.lists = list;
+        doc.name = normalize(song.name).remove(' ');
+        doc.artist = normalize(song.artistNames).remove(' ');
+        doc.pinyin = toPinyin(doc.name + doc.artist, &doc.initials);
+        documents.append(doc);
+        docIds.insert(song.id, documents.size() - 1);
+        indexDocument(documents.size() - 1);
+    }
+}
+
+/**
+ * 从某个列表移除；两个列表都不存在时才真正失效
+ * 失效的文档过多时重建索引
+ */
+void SongSearchIndex::removeSongs(const SongList &songs, ListFlag list)
+{
+    foreach (const Song& song, songs)
+    {
+        auto it = docIds.find(song.id);
+        if (it == docIds.end())
+            continue;
+        Document& doc = documents[it.value()];
+        if (!(doc.lists & list))
+            continue;
+        doc.lists &= ~list;
+        if (!doc.lists)
+            removedCount++;
+    }
+
+    if (removedCount > 32 && removedCount * 2 > documents.size())
+        compact();
+}
+
+void SongSearchIndex::clear()
+{
+    documents.clear();
+    docIds.clear();
+    postings.clear();
+    removedCount = 0;
+}
+
+/**
+ * 在本地歌单中解析点歌关键词
+ * 所有词都要出现在 歌名/歌手/拼音/首字母 中；都不满足时按二元组命中比例模糊匹配
+ * @param source 只匹配指定平台的歌曲，UnknowMusic 为不限
+ * @return 没有合适的歌曲则返回无效的 Song
+ */
+Song SongSearchIndex::match(QString key, MusicSource source) const
+{
+    QStringList terms = normalize(key).split(' ', QString::SkipEmptyParts);
+    if (terms.isEmpty())
+        return Song();
+
+    auto usable = [&](const Document& doc) {
+        return doc.lists && (source == UnknowMusic || doc.song.source == source);
+    };
+    auto better = [&](int score, int docId, int bestScore, int bestId) {
+        if (bestId == -1)
+            return true;
+        if (score != bestScore)
+            return score > bestScore;
+        bool fav = documents.at(docId).lists & FavoriteList;
+        bool bestFav = documents.at(bestId).lists & FavoriteList;
+        if (fav != bestFav) // 同分时收藏优先，其次先加入的
+            return fav;
+        return docId < bestId;
+    };
+
+    // 倒排表求交，缩小候选范围
+    QVector<int> candidates;
+    bool narrowed = false;
+    QStringList queryGrams;
+    foreach (const QString& term, terms)
+    {
+        if (term.length() < 2)
+            continue;
+        foreach (const QString& gram, gramsOf(term))
+        {
+            queryGrams.append(gram);
+            const QVector<int> list = postings.value(gram);
+            if (!narrowed)
+            {
+                candidates = list;
+                narrowed = true;
+                continue;
+            }
+            QVector<int> merged;
+            std::set_intersection(candidates.begin(), candidates.end(),
+                                  list.begin(), list.end(), std::back_inserter(merged));
+            candidates.swap(merged);
+        }
+    }
+    if (!narrowed) // 全都是单字，只能逐个比较
+    {
+        candidates.resize(documents.size());
+        for (int i = 0; i < documents.size(); i++)
+            candidates[i] = i;
+    }
+
+    int bestId = -1, bestScore = 0;
+    foreach (int docId, candidates)
+    {
+        const Document& doc = documents.at(docId);
+        if (!usable(doc))
+            continue;
+        int score = 0;
+        foreach (const QString& term, terms)
+        {
+            int s = termScore(doc, term);
+            if (!s)
+            {
+                score = 0;
+                break;
+            }
+            score += s;
+        }
+        if (score && better(score, docId, bestScore, bestId))
+        {
+            bestId = docId;
+            bestScore = score;
+        }
+    }
+    if (bestId > -1)
+        return documents.at(bestId).song;
+
+    // 模糊匹配：错别字、多字少字
+    if (queryGrams.isEmpty())
+        return Song();
+    queryGrams.removeDuplicates();
+    QHash<int, int> votes;
+    foreach (const QString& gram, queryGrams)
+        foreach (int docId, postings.value(gram))
+            votes[docId]++;
+    int need = qCeil(queryGrams.size() * SONG_INDEX_FUZZY_RATIO);
+    for (auto it = votes.constBegin(); it != votes.constEnd(); ++it)
+    {
+        if (it.value() < need || !usable(documents.at(it.key())))
+            continue;
+        if (better(it.value(), it.key(), bestScore, bestId))
+        {
+            bestId = it.key();
+            bestScore = it.value();
+        }
+    }
+    if (bestId > -1)
+    {
+        qInfo() << "本地歌单模糊匹配：" << key << documents.at(bestId).song.simpleString();
+        return documents.at(bestId).song;
+    }
+    return Song();
+}
+
+/**
+ * 统一大小写、全角半角，标点当做分隔符
+ */
+QString SongSearchIndex::normalize(QString text)
+{
+    text = text.normalized(QString::NormalizationForm_KC).toLower();
+    for (int i = 0; i < text.length(); i++)
+        if (!text.at(i).isLetterOrNumber())
+            text[i] = ' ';
+    return text.simplified();
+}
+
+QStringList SongSearchIndex::gramsOf(const QString &text)
+{
+    QStringList grams;
+    if (text.length() == 1)
+        grams.append(text);
+    for (int i = 0; i + 1 < text.length(); i++)
+        grams.append(text.mid(i, 2));
+    grams.removeDuplicates();
+    return grams;
+}
+
+QString SongSearchIndex::toPinyin(const QString &text, QString *initials)
+{
+    const QHash<QChar, QString>& table = pinyinTable();
+    QString pinyin;
+    foreach (const QChar& ch, text)
+    {
+        auto it = table.find(ch);
+        if (it != table.end() && !it.value().isEmpty())
+        {
+            pinyin += it.value();
+            initials->append(it.value().at(0));
+        }
+        else
+        {
+            pinyin += ch;
+            initials->append(ch);
+        }
+    }
+    return pinyin;
+}
+
+/**
+ * 一个词与歌曲的匹配程度，0 为不匹配
+ */
+int SongSearchIndex::termScore(const Document &doc, const QString &term) const
+{
+    if (doc.name == term)
+        return 8;
+    if (doc.artist == term)
+        return 6;
+    if (doc.name.contains(term))
+        return 4;
+    if (doc.artist.contains(term))
+        return 3;
+    if ((doc.name + doc.artist).contains(term))
+        return 2;
+    if (doc.pinyin.contains(term) || doc.initials.contains(term))
+        return 1;
+    return 0;
+}
+
+void SongSearchIndex::indexDocument(int docId)
+{
+    const Document& doc = documents.at(docId);
+    QSet<QString> grams;
+    foreach (const QString& gram, gramsOf(doc.name + doc.artist))
+        grams.insert(gram);
+    foreach (const QString& gram, gramsOf(doc.pinyin))
+        grams.insert(gram);
+    foreach (const QString& gram, gramsOf(doc.initials))
+        grams.insert(gram);
+    foreach (const QString& gram, grams)
+        postings[gram].append(docId); // 文档下标递增，倒排表天然有序
+}
+
+/**
+ * 丢弃失效的文档，重建倒排表
+ */
+void SongSearchIndex::compact()
+{
+    QVector<Document> alive;
+    foreach (const Document& doc, documents)
+        if (doc.lists)
+            alive.append(doc);
+
+    clear();
+    documents = alive;
+    for (int i = 0; i < documents.size(); i++)
+    {
+        docIds.insert(documents.at(i).song.id, i);
+        indexDocument(i);
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef SONGSEARCHINDEX_H
+#define SONGSEARCHINDEX_H
+
+#include <QHash>
+#include <QVector>
+#include "songbeans.h"
+
+/**
+ * 本地歌单（收藏、空闲）的倒排索引
+ * 歌名、歌手分别按 原文/拼音/首字母 切成二元组建立索引，
+ * 点歌时先在本地解析，命中则不再请求搜索接口。
+ */
+class SongSearchIndex
+{
+public:
+    enum ListFlag
+    {
+        FavoriteList = 1,
+        NormalList = 2
+    };
+
+    void addSongs(const SongList& songs, ListFlag list);
+    void removeSongs(const SongList& songs, ListFlag list);
+    void clear();
+
+    Song match(QString key, MusicSource source = UnknowMusic) const;
+
+    static QString normalize(QString text);
+
+private:
+    struct Document
+    {
+        Song song;
+        int lists = 0;
+        QString name; // 规范化后的歌名
+        QString artist;
+        QString pinyin; // 歌名+歌手的拼音
+        QString initials; // 拼音首字母
+    };
+
+    static QStringList gramsOf(const QString& text);
+    static QString toPinyin(const QString& text, QString* initials);
+    int termScore(const Document& doc, const QString& term) const;
+    void indexDocument(int docId);
+    void compact();
+
+private:
+    QVector<Document> documents;
+    QHash<qint64, int> docIds; // 歌曲ID -> 文档下标
+    QHash<QString, QVector<int>> postings; // 二元组 -> 文档下标（递增）
+    int removedCount = 0;
+};
+
+#endif // SONGSEARCHINDEX_H
@@ -0,0 +1,355 @@
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include "imageanalysis.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define IMAGE_ANALYSIS_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define IMAGE_ANALYSIS_SSE2
+#endif
+
+/**
+ * 累加一行 ARGB32 像素（内存中为 B G R A）的三个通道
+ * 用掩码取出单个通道后，_mm_sad_epu8 与 0 求差即为字节和
+ */
+static void sumRowChannels(const uint8_t *row, int width, uint64_t *sums)
+{
+    int x = 0;
+#if defined(IMAGE_ANALYSIS_AVX2)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i maskB = _mm256_set1_epi32(0x000000ff);
+        const __m256i maskG = _mm256_set1_epi32(0x0000ff00);
+        const __m256i maskR = _mm256_set1_epi32(0x00ff0000);
+        __m256i accB = zero, accG = zero, accR = zero;
+        for (; x + 8 <= width; x += 8)
+        {
+            __m256i px = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + x * 4));
+            accB = _mm256_add_epi64(accB, _mm256_sad_epu8(_mm256_and_si256(px, maskB), zero));
+            accG = _mm256_add_epi64(accG, _mm256_sad_epu8(_mm256_and_si256(px, maskG), zero));
+            accR = _mm256_add_epi64(accR, _mm256_sad_epu8(_mm256_and_si256(px, maskR), zero));
+        }
+        uint64_t lanes[4];
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), accB);
+        sums[2] += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), accG);
+        sums[1] += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), accR);
+        sums[0] += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+#endif
+#if defined(IMAGE_ANALYSIS_SSE2)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i maskB = _mm_set1_epi32(0x000000ff);
+        const __m128i maskG = _mm_set1_epi32(0x0000ff00);
+        const __m128i maskR = _mm_set1_epi32(0x00ff0000);
+        __m128i accB = zero, accG = zero, accR = zero;
+        for (; x + 4 <= width; x += 4)
+        {
+            __m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x * 4));
+            accB = _mm_add_epi64(accB, _mm_sad_epu8(_mm_and_si128(px, maskB), zero));
+            accG = _mm_add_epi64(accG, _mm_sad_epu8(_mm_and_si128(px, maskG), zero));
+            accR = _mm_add_epi64(accR, _mm_sad_epu8(_mm_and_si128(px, maskR), zero));
+        }
+        uint64_t lanes[2];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), accB);
+        sums[2] += lanes[0] + lanes[1];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), accG);
+        sums[1] += lanes[0] + lanes[1];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), accR);
+        sums[0] += lanes[0] + lanes[1];
+    }
+#endif
+    const uint32_t *px = reinterpret_cast<const uint32_t*>(row);
+    for (; x < width; x++)
+    {
+        sums[0] += (px[x] >> 16) & 0xff;
+        sums[1] += (px[x] >> 8) & 0xff;
+        sums[2] += px[x] & 0xff;
+    }
+}
+
+/**
+ * 统计一行像素的 RGB555 直方图
+ * 四路交错写入不同的子直方图，减少相邻相同颜色造成的写后读依赖
+ */
+static void histogramRow(const uint8_t *row, int width, uint32_t *hists)
+{
+    const uint32_t *px = reinterpret_cast<const uint32_t*>(row);
+    int x = 0;
+    for (; x + 4 <= width; x += 4)
+    {
+        uint32_t c0 = px[x], c1 = px[x + 1], c2 = px[x + 2], c3 = px[x + 3];
+        hists[((c0 >> 9) & 0x7c00) | ((c0 >> 6) & 0x3e0) | ((c0 >> 3) & 0x1f)]++;
+        hists[32768 + (((c1 >> 9) & 0x7c00) | ((c1 >> 6) & 0x3e0) | ((c1 >> 3) & 0x1f))]++;
+        hists[65536 + (((c2 >> 9) & 0x7c00) | ((c2 >> 6) & 0x3e0) | ((c2 >> 3) & 0x1f))]++;
+        hists[98304 + (((c3 >> 9) & 0x7c00) | ((c3 >> 6) & 0x3e0) | ((c3 >> 3) & 0x1f))]++;
+    }
+    for (; x < width; x++)
+    {
+        uint32_t c = px[x];
+        hists[((c >> 9) & 0x7c00) | ((c >> 6) & 0x3e0) | ((c >> 3) & 0x1f)]++;
+    }
+}
+
+/**
+ * 一个方向上的滑动窗口均值（box blur），每个像素 O(1)
+ * 超出边缘的部分取边缘像素，所以模糊后没有黑边
+ * @param stride 相邻像素间隔的字节数（横向为4，纵向为 bytesPerLine）
+ */
+static void boxBlurLine(uint8_t *line, int count, int stride, int radius, uint8_t *buffer)
+{
+    if (count <= 1 || radius <= 0)
+        return ;
+    for (int i = 0; i < count; i++)
+        memcpy(buffer + i * 4, line + i * stride, 4);
+
+    const int window = radius * 2 + 1;
+    uint32_t sum[4] = {0, 0, 0, 0};
+    for (int i = -radius; i <= radius; i++)
+    {
+        const uint8_t *p = buffer + (i < 0 ? 0 : (i >= count ? count - 1 : i)) * 4;
+        for (int c = 0; c < 4; c++)
+            sum[c] += p[c];
+    }
+    for (int i = 0; i < count; i++)
+    {
+        uint8_t *out = line + i * stride;
+        for (int c = 0; c < 4; c++)
+            out[c] = static_cast<uint8_t>((sum[c] + window / 2) / window);
+
+        int addIndex = i + radius + 1, subIndex = i - radius;
+        const uint8_t *add = buffer + (addIndex >= count ? count - 1 : addIndex) * 4;
+        const uint8_t *sub = buffer + (subIndex < 0 ? 0 : subIndex) * 4;
+        for (int c = 0; c < 4; c++)
+            sum[c] += add[c] - sub[c];
+    }
+}
+
+/**
+ * 大图按比例缩小到最大边长，并统一为 ARGB32 格式
+ * 统计类的计算不需要原图的精度
+ */
+QImage ImageAnalysis::downscaled(const QImage &image, int maxSize)
+{
+    QImage img = image;
+    if (maxSize > 0 && (img.width() > maxSize || img.height() > maxSize))
+        img = img.scaled(maxSize, maxSize, Qt::KeepAspectRatio, Qt::FastTransformation);
+    if (img.format() != QImage::Format_ARGB32 && img.format() != QImage::Format_RGB32)
+        img = img.convertToFormat(QImage::Format_ARGB32);
+    return img;
+}
+
+void ImageAnalysis::sumChannels(const QImage &image, quint64 *sums)
+{
+    uint64_t s[3] = {0, 0, 0};
+    const int w = image.width(), h = image.height();
+    for (int y = 0; y < h; y++)
+        sumRowChannels(image.constScanLine(y), w, s);
+    sums[0] = s[0];
+    sums[1] = s[1];
+    sums[2] = s[2];
+}
+
+/**
+ * 平均颜色
+ */
+QColor ImageAnalysis::averageColor(const QImage &image, int maxSize)
+{
+    QImage img = downscaled(image, maxSize);
+    const quint64 count = static_cast<quint64>(img.width()) * static_cast<quint64>(img.height());
+    if (!count)
+        return QColor();
+    quint64 sums[3];
+    sumChannels(img, sums);
+    return QColor(static_cast<int>(sums[0] / count),
+                  static_cast<int>(sums[1] / count),
+                  static_cast<int>(sums[2] / count));
+}
+
+/**
+ * 平均亮度 0~255（BT.601 权重）
+ * 亮度是通道的线性组合，所以等于平均颜色的亮度
+ */
+int ImageAnalysis::averageLuma(const QImage &image, int maxSize)
+{
+    QImage img = downscaled(image, maxSize);
+    const quint64 count = static_cast<quint64>(img.width()) * static_cast<quint64>(img.height());
+    if (!count)
+        return 0;
+    quint64 sums[3];
+    sumChannels(img, sums);
+    return static_cast<int>((sums[0] * 299 + sums[1] * 587 + sums[2] * 114) / 1000 / count);
+}
+
+/**
+ * RGB555 颜色直方图，下标为 (r>>3)<<10 | (g>>3)<<5 | (b>>3)
+ */
+QVector<quint32> ImageAnalysis::histogram555(const QImage &image, int maxSize)
+{
+    QImage img = downscaled(image, maxSize);
+    std::vector<uint32_t> hists(32768 * 4, 0);
+    for (int y = 0; y < img.height(); y++)
+        histogramRow(img.constScanLine(y), img.width(), hists.data());
+
+    QVector<quint32> result(32768);
+    for (int i = 0; i < 32768; i++)
+        result[i] = hists[i] + hists[32768 + i] + hists[65536 + i] + hists[98304 + i];
+    return result;
+}
+
+/**
+ * 中位切分提取主题色，替代八叉树
+ * 只处理直方图中非空的格子（缩小后的封面通常只有几千种），不逐像素建树
+ * 每次把像素最多的盒子沿最长的颜色轴按像素数的中位数一分为二
+ * @return 与 ColorOctree::result() 相同，按数量从多到少排序
+ */
+QList<ColorOctree::ColorCount> ImageAnalysis::medianCut(const QImage &image, int maxCount, int maxSize)
+{
+    struct Bin
+    {
+        quint8 c[3];
+        quint32 count;
+    };
+    struct Box
+    {
+        int begin, end;
+        quint64 count;
+        int axis;  // 最长的轴
+        int range; // 该轴的跨度，0表示不能再分
+    };
+
+    QList<ColorOctree::ColorCount> result;
+    QVector<quint32> hist = histogram555(image, maxSize);
+    std::vector<Bin> bins;
+    for (int i = 0; i < 32768; i++)
+    {
+        if (!hist.at(i))
+            continue;
+        Bin bin;
+        bin.c[0] = static_cast<quint8>((i >> 10) & 31);
+        bin.c[1] = static_cast<quint8>((i >> 5) & 31);
+        bin.c[2] = static_cast<quint8>(i & 31);
+        bin.count = hist.at(i);
+        bins.push_back(bin);
+    }
+    if (bins.empty() || maxCount <= 0)
+        return result;
+
+    auto measure = [&](Box& box) {
+        int mins[3] = {31, 31, 31}, maxs[3] = {0, 0, 0};
+        box.count = 0;
+        for (int i = box.begin; i < box.end; i++)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                mins[k] = qMin(mins[k], int(bins[i].c[k]));
+                maxs[k] = qMax(maxs[k], int(bins[i].c[k]));
+            }
+            box.count += bins[i].count;
+        }
+        box.axis = 0;
+        box.range = 0;
+        for (int k = 0; k < 3; k++)
+        {
+            if (maxs[k] - mins[k] > box.range)
+            {
+                box.range = maxs[k] - mins[k];
+                box.axis = k;
+            }
+        }
+    };
+
+    QList<Box> boxes;
+    Box all{0, static_cast<int>(bins.size()), 0, 0, 0};
+    measure(all);
+    boxes.append(all);
+    while (boxes.size() < maxCount)
+    {
+        int target = -1;
+        for (int i = 0; i < boxes.size(); i++)
+        {
+            if (boxes.at(i).range > 0 && (target == -1 || boxes.at(i).count > boxes.at(target).count))
+                target = i;
+        }
+        if (target == -1) // 全部都不能再分了
+            break;
+
+        Box box = boxes.at(target);
+        const int axis = box.axis;
+        std::sort(bins.begin() + box.begin, bins.begin() + box.end, [=](const Bin& a, const Bin& b) {
+            return a.c[axis] < b.c[axis];
+        });
+        quint64 half = box.count / 2, acc = 0;
+        int mid = box.begin;
+        while (mid < box.end - 1 && acc + bins[mid].count <= half)
+            acc += bins[mid++].count;
+        if (mid == box.begin)
+            mid++;
+
+        Box left{box.begin, mid, 0, 0, 0}, right{mid, box.end, 0, 0, 0};
+        measure(left);
+        measure(right);
+        boxes[target] = left;
+        boxes.append(right);
+    }
+
+    foreach (const Box& box, boxes)
+    {
+        quint64 sum[3] = {0, 0, 0};
+        for (int i = box.begin; i < box.end; i++)
+            for (int k = 0; k < 3; k++) // 5位还原到8位
+                sum[k] += quint64((bins[i].c[k] << 3) | (bins[i].c[k] >> 2)) * bins[i].count;
+
+        ColorOctree::ColorCount cnt;
+        cnt.count = static_cast<int>(box.count);
+        cnt.red = static_cast<int>(sum[0] / box.count);
+        cnt.green = static_cast<int>(sum[1] / box.count);
+        cnt.blue = static_cast<int>(sum[2] / box.count);
+        cnt.colorValue = (cnt.red << 16) + (cnt.green << 8) + cnt.blue;
+        sprintf(cnt.color, "%.2X%.2X%.2X", cnt.red, cnt.green, cnt.blue);
+        result.append(cnt);
+    }
+    std::sort(result.begin(), result.end(), [=](const ColorOctree::ColorCount& a, const ColorOctree::ColorCount& b) {
+        if (a.count != b.count)
+            return a.count > b.count;
+        return strcmp(a.color, b.color) < 0;
+    });
+    return result;
+}
+
+/**
+ * 模糊图片并缩放到指定尺寸
+ * 先缩小到模糊半径约为4像素的尺寸，在小图上做三次横纵可分离的均值模糊（近似高斯），再放大
+ * 计算量与原图大小、模糊半径无关
+ */
+QImage ImageAnalysis::blurred(const QImage &image, QSize size, int radius)
+{
+    if (image.isNull() || size.isEmpty())
+        return QImage();
+
+    const int factor = qMax(1, radius / 4);
+    const int r = qMax(1, radius / factor);
+    QImage small = image.scaled(qMax(1, size.width() / factor), qMax(1, size.height() / factor),
+                                Qt::IgnoreAspectRatio, Qt::SmoothTransformation)
+            .convertToFormat(QImage::Format_ARGB32_Premultiplied);
+
+    const int w = small.width(), h = small.height();
+    const int bpl = small.bytesPerLine();
+    uchar* bits = small.bits();
+    std::vector<uint8_t> buffer(static_cast<size_t>(qMax(w, h)) * 4);
+    for (int pass = 0; pass < 3; pass++)
+    {
+        for (int y = 0; y < h; y++)
+            boxBlurLine(bits + y * bpl, w, 4, r, buffer.data());
+        for (int x = 0; x < w; x++)
+            boxBlurLine(bits + x * 4, h, bpl, r, buffer.data());
+    }
+
+    return small.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+}
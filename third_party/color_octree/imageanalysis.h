@@ -0,0 +1,35 @@
+#ifndef IMAGEANALYSIS_H
+#define IMAGEANALYSIS_H
+
+#include <QImage>
+#include <QColor>
+#include <QList>
+#include <QVector>
+#include "coloroctree.h"
+
+#define IMAGE_ANALYSIS_MAX_SIZE 128 // 统计颜色时先缩小到的最大边长
+
+/**
+ * 图片统计相关的计算
+ * 平均色/亮度、直方图使用 SSE2/AVX2 向量化（编译器不支持时使用普通循环）
+ * 主题色使用基于直方图的中位切分，模糊先缩小再做可分离的均值模糊
+ * 都是纯计算，可以放在子线程中运行
+ */
+class ImageAnalysis
+{
+public:
+    static QImage downscaled(const QImage& image, int maxSize = IMAGE_ANALYSIS_MAX_SIZE);
+
+    static QColor averageColor(const QImage& image, int maxSize = IMAGE_ANALYSIS_MAX_SIZE);
+    static int averageLuma(const QImage& image, int maxSize = IMAGE_ANALYSIS_MAX_SIZE);
+    static QVector<quint32> histogram555(const QImage& image, int maxSize = IMAGE_ANALYSIS_MAX_SIZE);
+
+    static QList<ColorOctree::ColorCount> medianCut(const QImage& image, int maxCount, int maxSize = IMAGE_ANALYSIS_MAX_SIZE);
+
+    static QImage blurred(const QImage& image, QSize size, int radius);
+
+private:
+    static void sumChannels(const QImage& image, quint64* sums);
+};
+
+#endif // IMAGEANALYSIS_H
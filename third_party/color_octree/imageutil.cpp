@@ -1,40 +1,13 @@
 #include <math.h>
 #include "imageutil.h"
+#include "imageanalysis.h"
 
 /**
- * 图片转换为颜色集
+ * 图片的平均颜色（先缩小到 maxSize）
  */
 QColor ImageUtil::getImageAverageColor(QImage image, int maxSize)
 {
-    int hCount = image.width();
-    int vCount = image.height();
-
-    if (hCount > maxSize || vCount > maxSize) // 数量过大，按比例缩减
-    {
-        double prop = (double)maxSize / qMax(hCount, vCount);
-        image.scaledToWidth(image.width() * prop); // 缩放到最大大小
-    }
-
-    long long sumr = 0, sumg = 0, sumb = 0;
-
-    int w = image.width(), h = image.height();
-    int sumSize = w * h;
-    for (int y = 0; y < h; y++)
-    {
-        QRgb *line = (QRgb *)image.scanLine(y);
-        for (int x = 0; x < w; x++)
-        {
-            int r = qRed(line[x]), g = qGreen(line[x]), b = qBlue(line[x]);
-            sumr += r;
-            sumg += g;
-            sumb += b;
-        }
-    }
-
-    sumr /= sumSize;
-    sumg /= sumSize;
-    sumb /= sumSize;
-    return QColor(sumr, sumg, sumb);
+    return ImageAnalysis::averageColor(image, maxSize);
 }
 
 /** 
@@ -42,8 +15,7 @@ QColor ImageUtil::getImageAverageColor(QImage image, int maxSize)
  */
 QList<ColorOctree::ColorCount> ImageUtil::extractImageThemeColors(QImage image, int count)
 {
-    auto octree = ColorOctree(image, IMAGE_CALC_PIXEL_MAX_SIZE, count);
-    auto result = octree.result();
+    auto result = ImageAnalysis::medianCut(image, count, IMAGE_CALC_PIXEL_MAX_SIZE);
 
     if (!result.size() || result.first().count <= 0)
         return result;
@@ -65,8 +37,7 @@ QList<ColorOctree::ColorCount> ImageUtil::extractImageThemeColors(QImage image,
  */
 QList<QColor> ImageUtil::extractImageThemeColorsInPalette(QImage image, QList<QColor> paletteColors, int needCount)
 {
-    auto octree = ColorOctree(image, IMAGE_CALC_PIXEL_MAX_SIZE, paletteColors.size());
-    auto result = octree.result();
+    auto result = ImageAnalysis::medianCut(image, paletteColors.size(), IMAGE_CALC_PIXEL_MAX_SIZE);
 
     QList<QColor> colors;
     for (int i = 0; i < result.size(); i++)
@@ -135,6 +135,37 @@ void GifGetClosestPaletteColor(GifPalette* pPal, int r, int g, int b, int& bestI
     }
 }
 
+// Memoizes GifGetClosestPaletteColor for one palette, keyed by the color truncated to RGB555.
+// Consecutive frames of a clip share most of their colors, so with a shared palette
+// nearly every lookup becomes a single table read instead of a k-d tree walk.
+struct GifColorCache
+{
+    uint8_t index[32768];
+    uint8_t valid[32768];
+};
+
+void GifResetColorCache(GifColorCache* cache)
+{
+    memset(cache->valid, 0, sizeof(cache->valid));
+}
+
+int GifCachedClosestColor(GifPalette* pPal, GifColorCache* cache, int r, int g, int b)
+{
+    r = GifIMin(GifIMax(r, 0), 255);
+    g = GifIMin(GifIMax(g, 0), 255);
+    b = GifIMin(GifIMax(b, 0), 255);
+    int key = ((r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3);
+    if(!cache->valid[key])
+    {
+        int bestInd = 1;
+        int bestDiff = 1000000;
+        GifGetClosestPaletteColor(pPal, r, g, b, bestInd, bestDiff);
+        cache->index[key] = (uint8_t)bestInd;
+        cache->valid[key] = 1;
+    }
+    return cache->index[key];
+}
+
 void GifSwapPixels(uint8_t* image, int pixA, int pixB)
 {
     uint8_t rA = image[pixA*4];
@@ -380,8 +411,77 @@ void GifMakePalette( const uint8_t* lastFrame, const uint8_t* nextFrame, uint32_
     pPal->r[0] = pPal->g[0] = pPal->b[0] = 0;
 }
 
+// Creates one palette from pixels sampled evenly out of several frames.
+// Every frame of the animation can then share it, which keeps colors stable
+// between frames and skips the per-frame median split entirely.
+void GifMakeSharedPalette( const uint8_t* const* frames, int frameCount, uint32_t width, uint32_t height, int bitDepth, bool buildForDither, GifPalette* pPal )
+{
+    pPal->bitDepth = bitDepth;
+
+    // about one million samples are plenty for 255 colors
+    const int numPixels = (int)(width * height);
+    const int step = GifIMax(1, (int)((int64_t)numPixels * frameCount / (1 << 20)));
+    const int perFrame = (numPixels + step - 1) / step;
+    uint8_t* samples = (uint8_t*)GIF_TEMP_MALLOC((size_t)perFrame * (size_t)frameCount * 4);
+
+    int numSamples = 0;
+    for(int ff=0; ff<frameCount; ++ff)
+    {
+        const uint8_t* frame = frames[ff];
+        for(int ii=0; ii<numPixels; ii+=step)
+        {
+            memcpy(samples + numSamples*4, frame + ii*4, 4);
+            ++numSamples;
+        }
+    }
+
+    const int lastElt = 1 << bitDepth;
+    const int splitElt = lastElt/2;
+    const int splitDist = splitElt/2;
+
+    GifSplitPalette(samples, numSamples, 1, lastElt, splitElt, splitDist, 1, buildForDither, pPal);
+
+    GIF_TEMP_FREE(samples);
+
+    pPal->treeSplit[1 << (bitDepth-1)] = 0;
+    pPal->treeSplitElt[1 << (bitDepth-1)] = 0;
+
+    pPal->r[0] = pPal->g[0] = pPal->b[0] = 0;
+}
+
+// Finds the bounding rectangle of the pixels whose color differs from the last frame.
+// Returns false when the frames are identical.
+bool GifChangedRect( const uint8_t* lastFrame, const uint8_t* nextFrame, uint32_t width, uint32_t height, uint32_t& left, uint32_t& top, uint32_t& right, uint32_t& bottom )
+{
+    left = width; top = height; right = 0; bottom = 0;
+    for(uint32_t yy=0; yy<height; ++yy)
+    {
+        const uint8_t* lastRow = lastFrame + 4*yy*width;
+        const uint8_t* nextRow = nextFrame + 4*yy*width;
+        uint32_t first = width, last = 0;
+        for(uint32_t xx=0; xx<width; ++xx)
+        {
+            // gif has no partial alpha, only compare RGB
+            if(lastRow[xx*4] != nextRow[xx*4]
+                    || lastRow[xx*4+1] != nextRow[xx*4+1]
+                    || lastRow[xx*4+2] != nextRow[xx*4+2])
+            {
+                if(first == width) first = xx;
+                last = xx;
+            }
+        }
+        if(first == width)
+            continue;
+        if(top == height) top = yy;
+        bottom = yy + 1;
+        left = (uint32_t)GifIMin((int)left, (int)first);
+        right = (uint32_t)GifIMax((int)right, (int)last + 1);
+    }
+    return bottom > 0;
+}
+
 // Implements Floyd-Steinberg dithering, writes palette value to alpha
-void GifDitherImage( const uint8_t* lastFrame, const uint8_t* nextFrame, uint8_t* outFrame, uint32_t width, uint32_t height, GifPalette* pPal )
+void GifDitherImage( const uint8_t* lastFrame, const uint8_t* nextFrame, uint8_t* outFrame, uint32_t width, uint32_t height, GifPalette* pPal, GifColorCache* cache = NULL )
 {
     int numPixels = (int)(width * height);
 
@@ -427,7 +527,10 @@ void GifDitherImage( const uint8_t* lastFrame, const uint8_t* nextFrame, uint8_t
             int32_t bestInd = kGifTransIndex;
 
             // Search the palete
-            GifGetClosestPaletteColor(pPal, rr, gg, bb, bestInd, bestDiff);
+            if(cache)
+                bestInd = GifCachedClosestColor(pPal, cache, rr, gg, bb);
+            else
+                GifGetClosestPaletteColor(pPal, rr, gg, bb, bestInd, bestDiff);
 
             // Write the result to the temp buffer
             int32_t r_err = nextPix[0] - int32_t(pPal->r[bestInd]) * 256;
@@ -490,7 +593,7 @@ void GifDitherImage( const uint8_t* lastFrame, const uint8_t* nextFrame, uint8_t
 }
 
 // Picks palette colors for the image using simple thresholding, no dithering
-void GifThresholdImage( const uint8_t* lastFrame, const uint8_t* nextFrame, uint8_t* outFrame, uint32_t width, uint32_t height, GifPalette* pPal )
+void GifThresholdImage( const uint8_t* lastFrame, const uint8_t* nextFrame, uint8_t* outFrame, uint32_t width, uint32_t height, GifPalette* pPal, GifColorCache* cache = NULL )
 {
     uint32_t numPixels = width*height;
     for( uint32_t ii=0; ii<numPixels; ++ii )
@@ -512,7 +615,10 @@ void GifThresholdImage( const uint8_t* lastFrame, const uint8_t* nextFrame, uint
             // palettize the pixel
             int32_t bestDiff = 1000000;
             int32_t bestInd = 1;
-            GifGetClosestPaletteColor(pPal, nextFrame[0], nextFrame[1], nextFrame[2], bestInd, bestDiff);
+            if(cache)
+                bestInd = GifCachedClosestColor(pPal, cache, nextFrame[0], nextFrame[1], nextFrame[2]);
+            else
+                GifGetClosestPaletteColor(pPal, nextFrame[0], nextFrame[1], nextFrame[2], bestInd, bestDiff);
 
             // Write the resulting color to the output buffer
             outFrame[0] = pPal->r[bestInd];
@@ -723,7 +829,8 @@ void GifWriteLzwImage(FILE* f, uint8_t* image, uint32_t left, uint32_t top,  uin
 struct GifWriter
 {
     FILE* f;
-    uint8_t* oldImage;
+    uint8_t* oldImage;    // quantized previous frame, palette index in alpha; only for the quantizer
+    uint8_t* lastSource;  // previous input frame as given, for finding the changed rectangle
     bool firstFrame;
 };
 
@@ -745,6 +852,7 @@ bool GifBegin( GifWriter* writer, const char* filename, uint32_t width, uint32_t
 
     // allocate
     writer->oldImage = (uint8_t*)GIF_MALLOC(width*height*4);
+    writer->lastSource = (uint8_t*)GIF_MALLOC(width*height*4);
 
     fputs("GIF89a", writer->f);
 
@@ -807,7 +915,71 @@ bool GifWriteFrame( GifWriter* writer, const uint8_t* image, uint32_t width, uin
         GifThresholdImage(oldImage, image, writer->oldImage, width, height, &pal);
 
     GifWriteLzwImage(writer->f, writer->oldImage, 0, 0, width, height, delay, &pal);
+    memcpy(writer->lastSource, image, (size_t)width * height * 4);
+
+    return true;
+}
+
+// Writes out a new frame using a palette shared by the whole animation
+// (see GifMakeSharedPalette). Only the rectangle that changed since the
+// previous frame is quantized and encoded.
+bool GifWriteFrameShared( GifWriter* writer, const uint8_t* image, uint32_t width, uint32_t height, uint32_t delay, GifPalette* pPal, GifColorCache* cache, bool dither = false )
+{
+    if(!writer->f) return false;
+
+    const uint8_t* oldImage = writer->firstFrame? NULL : writer->oldImage;
+    writer->firstFrame = false;
+
+    // diff the raw input against the raw previous input: the quantized oldImage
+    // has palette colors in place of the source RGB and would differ almost everywhere
+    uint32_t left = 0, top = 0, right = width, bottom = height;
+    if(oldImage && !GifChangedRect(writer->lastSource, image, width, height, left, top, right, bottom))
+    {
+        // nothing changed, still emit one transparent pixel to keep the delay
+        left = top = 0;
+        right = bottom = 1;
+    }
+
+    if(left == 0 && top == 0 && right == width && bottom == height)
+    {
+        if(dither)
+            GifDitherImage(oldImage, image, writer->oldImage, width, height, pPal, cache);
+        else
+            GifThresholdImage(oldImage, image, writer->oldImage, width, height, pPal, cache);
+        GifWriteLzwImage(writer->f, writer->oldImage, 0, 0, width, height, delay, pPal);
+        memcpy(writer->lastSource, image, (size_t)width * height * 4);
+        return true;
+    }
+
+    const uint32_t subWidth = right - left;
+    const uint32_t subHeight = bottom - top;
+    const size_t rowBytes = subWidth * 4;
+    uint8_t* subLast = (uint8_t*)GIF_TEMP_MALLOC(rowBytes * subHeight);
+    uint8_t* subNext = (uint8_t*)GIF_TEMP_MALLOC(rowBytes * subHeight);
+    for(uint32_t yy=0; yy<subHeight; ++yy)
+    {
+        size_t offset = ((top + yy) * width + left) * 4;
+        memcpy(subLast + yy*rowBytes, writer->oldImage + offset, rowBytes);
+        memcpy(subNext + yy*rowBytes, image + offset, rowBytes);
+    }
+
+    // the quantizers read lastFrame and write outFrame pixel by pixel, so they can share the buffer
+    if(dither)
+        GifDitherImage(subLast, subNext, subLast, subWidth, subHeight, pPal, cache);
+    else
+        GifThresholdImage(subLast, subNext, subLast, subWidth, subHeight, pPal, cache);
+
+    for(uint32_t yy=0; yy<subHeight; ++yy)
+    {
+        size_t offset = ((top + yy) * width + left) * 4;
+        memcpy(writer->oldImage + offset, subLast + yy*rowBytes, rowBytes);
+        memcpy(writer->lastSource + offset, subNext + yy*rowBytes, rowBytes);
+    }
+
+    GifWriteLzwImage(writer->f, subLast, left, top, subWidth, subHeight, delay, pPal);
 
+    GIF_TEMP_FREE(subNext);
+    GIF_TEMP_FREE(subLast);
     return true;
 }
 
@@ -821,9 +993,11 @@ bool GifEnd( GifWriter* writer )
     fputc(0x3b, writer->f); // end of file
     fclose(writer->f);
     GIF_FREE(writer->oldImage);
+    GIF_FREE(writer->lastSource);
 
     writer->f = NULL;
     writer->oldImage = NULL;
+    writer->lastSource = NULL;
 
     return true;
 }
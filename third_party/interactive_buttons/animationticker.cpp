@@ -0,0 +1,110 @@
+#include <QGuiApplication>
+#include <QScreen>
+#include <QPointer>
+#include "animationticker.h"
+#include "interactivebuttonbase.h"
+
+AnimationTicker::AnimationTicker(QObject *parent) : QObject(parent)
+{
+    timer = new QTimer(this);
+    timer->setTimerType(Qt::PreciseTimer);
+    connect(timer, SIGNAL(timeout()), this, SLOT(tick()));
+    updateInterval();
+}
+
+AnimationTicker *AnimationTicker::instance()
+{
+    static AnimationTicker* ticker = new AnimationTicker(qApp);
+    return ticker;
+}
+
+/**
+ * 按钮开始动画，加入时钟
+ * 如果时钟在休眠，则唤醒
+ */
+void AnimationTicker::registerButton(InteractiveButtonBase *button)
+{
+    if (buttons.contains(button))
+        return ;
+    buttons.append(button);
+
+    if (!timer->isActive())
+    {
+        updateInterval();
+        elapsed.start();
+        lastStepTime = -STEP_INTERVAL; // 唤醒后的第一帧至少走一步
+        timer->start();
+    }
+}
+
+/**
+ * 按钮动画结束，或者按钮被删除
+ * 没有按钮需要动画时，停止时钟
+ */
+void AnimationTicker::unregisterButton(InteractiveButtonBase *button)
+{
+    buttons.removeOne(button);
+    if (buttons.isEmpty())
+        timer->stop();
+}
+
+bool AnimationTicker::isRegistered(InteractiveButtonBase *button) const
+{
+    return buttons.contains(button);
+}
+
+int AnimationTicker::activeCount() const
+{
+    return buttons.size();
+}
+
+/**
+ * 启动以来实际触发的帧数，用来检查空闲时是否真的没有唤醒
+ */
+qint64 AnimationTicker::getFrameCount() const
+{
+    return frameCount;
+}
+
+/**
+ * 间隔与主屏幕刷新率一致，通常为 16ms
+ */
+void AnimationTicker::updateInterval()
+{
+    qreal rate = 60;
+    if (QGuiApplication::primaryScreen())
+        rate = QGuiApplication::primaryScreen()->refreshRate();
+    if (rate < 24 || rate > 240)
+        rate = 60;
+    timer->setInterval(qMax(STEP_INTERVAL / 2, qRound(1000 / rate)));
+}
+
+void AnimationTicker::tick()
+{
+    frameCount++;
+    qint64 now = elapsed.elapsed();
+    int steps = static_cast<int>((now - lastStepTime) / STEP_INTERVAL);
+    if (steps <= 0)
+        return ;
+    lastStepTime += steps * STEP_INTERVAL;
+    if (steps > MAX_STEPS_PER_FRAME)
+    {
+        steps = MAX_STEPS_PER_FRAME;
+        lastStepTime = now;
+    }
+
+    // 动画结束的按钮会在 anchorTimeOut 中移除自己，信号槽里也可能删除按钮，所以遍历副本
+    QList<QPointer<InteractiveButtonBase>> list;
+    foreach (InteractiveButtonBase* button, buttons)
+        list.append(button);
+    foreach (QPointer<InteractiveButtonBase> button, list)
+    {
+        if (button.isNull())
+            continue;
+        button->anchor_dirty = false;
+        for (int i = 0; i < steps && !button.isNull() && buttons.contains(button); i++)
+            button->anchorTimeOut();
+        if (!button.isNull() && button->anchor_dirty)
+            button->update();
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef ANIMATIONTICKER_H
+#define ANIMATIONTICKER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QList>
+
+class InteractiveButtonBase;
+
+/**
+ * 所有 InteractiveButtonBase 共用的动画时钟
+ * 按屏幕刷新率触发一次，没有按钮在动画时停止，不再唤醒
+ *
+ * 按钮的动画逻辑是按 10ms 一步写的（每步 hover_progress += hover_speed 等），
+ * 这里根据实际流逝的时间换算成步数，保证刷新率不同时动画速度不变；
+ * 一帧内执行多步后只重绘一次，且只有状态真的变化了才重绘
+ */
+class AnimationTicker : public QObject
+{
+    Q_OBJECT
+public:
+    static AnimationTicker* instance();
+
+    void registerButton(InteractiveButtonBase* button);
+    void unregisterButton(InteractiveButtonBase* button);
+    bool isRegistered(InteractiveButtonBase* button) const;
+
+    int activeCount() const;
+    qint64 getFrameCount() const;
+
+    static const int STEP_INTERVAL = 10; // 按钮动画一步的时长（毫秒）
+    static const int MAX_STEPS_PER_FRAME = 10; // 卡顿后不一次性补太多步
+
+private:
+    AnimationTicker(QObject* parent = nullptr);
+
+    void updateInterval();
+
+private slots:
+    void tick();
+
+private:
+    QTimer* timer;
+    QElapsedTimer elapsed;
+    qint64 lastStepTime = 0;
+    qint64 frameCount = 0;
+    QList<InteractiveButtonBase*> buttons;
+};
+
+#endif // ANIMATIONTICKER_H
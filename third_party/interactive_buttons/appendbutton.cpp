@@ -65,6 +65,7 @@ void AppendButton::anchorTimeOut()
                 rotate_speed++;
             }
         }
+        anchor_dirty = true;
     }
 
     InteractiveButtonBase::anchorTimeOut();
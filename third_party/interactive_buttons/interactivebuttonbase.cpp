@@ -35,9 +35,7 @@ InteractiveButtonBase::InteractiveButtonBase(QWidget *parent)
 
     model = PaintModel::None;
 
-    anchor_timer = new QTimer(this);
-    anchor_timer->setInterval(10);
-    connect(anchor_timer, SIGNAL(timeout()), this, SLOT(anchorTimeOut()));
+    anchor_dirty = false;
 
     setWaterRipple();
 
@@ -46,6 +44,11 @@ InteractiveButtonBase::InteractiveButtonBase(QWidget *parent)
     setFocusPolicy(Qt::NoFocus); // 避免一个按钮还获取Tab键焦点
 }
 
+InteractiveButtonBase::~InteractiveButtonBase()
+{
+    stopAnchorAnimation();
+}
+
 /**
  * 文字类型的按钮
  */
@@ -878,8 +881,7 @@ void InteractiveButtonBase::showForeground()
     if (!show_animation)
         return;
     waters.clear();
-    if (!anchor_timer->isActive())
-        anchor_timer->start();
+    startAnchorAnimation();
     if (show_ani_disappearing)
         show_ani_disappearing = false;
     show_ani_appearing = true;
@@ -912,8 +914,7 @@ void InteractiveButtonBase::hideForeground()
 {
     if (!show_animation)
         return;
-    if (!anchor_timer->isActive())
-        anchor_timer->start();
+    startAnchorAnimation();
     if (show_ani_appearing)
         show_ani_appearing = false;
     show_ani_disappearing = true;
@@ -1080,10 +1081,7 @@ void InteractiveButtonBase::enterEvent(QEvent *event)
         return;
     }
 
-    if (!anchor_timer->isActive())
-    {
-        anchor_timer->start();
-    }
+    startAnchorAnimation();
     hovering = true;
     hover_timestamp = getTimestamp();
     leave_timestamp = 0;
@@ -1872,6 +1870,9 @@ QIcon::Mode InteractiveButtonBase::getIconMode()
 void InteractiveButtonBase::anchorTimeOut()
 {
     qint64 timestamp = getTimestamp();
+    const int prev_hover_progress = hover_progress, prev_press_progress = press_progress;
+    const int prev_click_progress = click_ani_progress, prev_show_progress = show_ani_progress;
+    const QPointF prev_offset_pos = offset_pos;
     // ==== 背景色 ====
     /*if (hovering) // 在框内：加深
     {
@@ -2120,7 +2121,8 @@ void InteractiveButtonBase::anchorTimeOut()
     }
     else if (!pressing && !hovering && !hover_progress && !press_progress && !click_ani_appearing && !click_ani_disappearing && !jitters.size() && !waters.size() && !show_ani_appearing && !show_ani_disappearing) // 没有需要加载的项，暂停（节约资源）
     {
-        anchor_timer->stop();
+        stopAnchorAnimation();
+        anchor_dirty = true; // 停止前再画一次最终状态
     }
 
     // ==== 统一坐标的出现动画 ====
@@ -2129,7 +2131,27 @@ void InteractiveButtonBase::anchorTimeOut()
         updateUnifiedGeometry();
     }
 
-    update();
+    // 只有状态真的变化了才重绘（由 AnimationTicker 在一帧的所有步骤后统一 update）
+    if (hover_progress != prev_hover_progress || press_progress != prev_press_progress
+            || click_ani_progress != prev_click_progress || show_ani_progress != prev_show_progress
+            || offset_pos != prev_offset_pos || waters.size() || jitters.size())
+        anchor_dirty = true;
+}
+
+/**
+ * 开始动画，加入共用的动画时钟
+ */
+void InteractiveButtonBase::startAnchorAnimation()
+{
+    AnimationTicker::instance()->registerButton(this);
+}
+
+/**
+ * 没有需要计算的动画了，移出动画时钟
+ */
+void InteractiveButtonBase::stopAnchorAnimation()
+{
+    AnimationTicker::instance()->unregisterButton(this);
 }
 
 /**
@@ -14,6 +14,7 @@
 #include <QList>
 #include <QBitmap>
 #include <QtMath>
+#include "animationticker.h"
 
 #define PI 3.1415926
 #define GOLDEN_RATIO 0.618
@@ -38,6 +39,7 @@
 class InteractiveButtonBase : public QPushButton
 {
     Q_OBJECT
+    friend class AnimationTicker;
     Q_PROPERTY(bool self_enabled READ getSelfEnabled WRITE setSelfEnabled)                      // 是否启用自定义的按钮（true）
     Q_PROPERTY(bool parent_enabled READ getParentEnabled WRITE setParentEnabled)                // 是否启用父类按钮（false）
     Q_PROPERTY(bool fore_enabled READ getForeEnabled WRITE setForeEnabled)                      // 是否绘制自定义按钮前景色（true）
@@ -69,6 +71,7 @@ public:
     InteractiveButtonBase(QPixmap pixmap, QWidget *parent = nullptr);
     InteractiveButtonBase(QIcon icon, QString text, QWidget *parent = nullptr);
     InteractiveButtonBase(QPixmap pixmap, QString text, QWidget *parent = nullptr);
+    ~InteractiveButtonBase() override;
 
     /**
      * 前景实体
@@ -272,6 +275,8 @@ protected:
     int min(int a, int b) const;
     int quick_sqrt(long X) const;
     qint64 getTimestamp() const;
+    void startAnchorAnimation();
+    void stopAnchorAnimation();
     bool isLightColor(QColor color);
     int getSpringBackProgress(int x, int max);
     QColor getOpacityColor(QColor color, double level = 0.5);
@@ -334,8 +339,8 @@ protected:
     qint64 hover_timestamp, leave_timestamp, press_timestamp, release_timestamp; // 各种事件的时间戳
     int hover_bg_duration, press_bg_duration, click_ani_duration;                // 各种动画时长
 
-    // 定时刷新界面（保证动画持续）
-    QTimer *anchor_timer;
+    // 定时刷新界面（保证动画持续），所有按钮共用 AnimationTicker
+    bool anchor_dirty; // 这一帧的动画状态有变化，需要重绘
     int move_speed;
 
     // 背景与前景
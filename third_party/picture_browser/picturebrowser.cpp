@@ -33,6 +33,7 @@ PictureBrowser::PictureBrowser(QSettings *settings, QWidget *parent) :
         QSize size(ui->listWidget->iconSize());
         ui->listWidget->setIconSize(QSize(1, 1));
         ui->listWidget->setIconSize(size);
+        thumbTimer->start();
     });
 
     readSortFlags();
@@ -202,9 +203,12 @@ PictureBrowser::PictureBrowser(QSettings *settings, QWidget *parent) :
             if (name.contains(" "))
                 name = name.right(name.length() - name.indexOf(" ") - 1);
 
-            QListWidgetItem* item = new QListWidgetItem(QIcon(path), info.fileName(), ui->listWidget);
+            QListWidgetItem* item = new QListWidgetItem(info.fileName(), ui->listWidget);
             item->setData(FilePathRole, info.absoluteFilePath());
+            item->setData(ThumbStateRole, ThumbNone);
             item->setToolTip(info.fileName());
+            thumbItems.insert(info.absoluteFilePath(), item);
+            thumbTimer->start();
         }
 
         // 操作对话框
@@ -233,6 +237,29 @@ PictureBrowser::PictureBrowser(QSettings *settings, QWidget *parent) :
         }
     });
 
+    // 缩略图
+    thumbPool = new QThreadPool(this);
+    thumbPool->setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
+    thumbTimer = new QTimer(this);
+    thumbTimer->setSingleShot(true);
+    thumbTimer->setInterval(30);
+    connect(thumbTimer, &QTimer::timeout, this, [=]{
+        requestVisibleThumbnails();
+    });
+    connect(ui->listWidget->verticalScrollBar(), &QScrollBar::valueChanged, this, [=]{
+        thumbTimer->start();
+    });
+    connect(this, &PictureBrowser::signalThumbnailLoaded, this, [=](int generation, QString path, QImage image, int dirCount, QString firstPath, qint64 modified){
+        if (generation != thumbGeneration)
+            return ;
+        if (dirCount >= 0)
+            dirThumbs.insert(path, DirectoryThumb{modified, dirCount, firstPath});
+        QListWidgetItem* item = thumbItems.value(path, nullptr);
+        if (!item || ui->listWidget->row(item) < 0)
+            return ;
+        setItemThumbnail(item, image, dirCount);
+    });
+
     // 预览设置
     bool resizeAutoInit = settings->value("picturebrowser/resizeAutoInit", true).toBool();
     ui->actionResize_Auto_Init->setChecked(resizeAutoInit);
@@ -268,6 +295,8 @@ PictureBrowser::PictureBrowser(QSettings *settings, QWidget *parent) :
 
 PictureBrowser::~PictureBrowser()
 {
+    thumbPool->clear();
+    thumbPool->waitForDone();
     delete ui;
 
     QDir tempDir(tempDirPath);
@@ -290,9 +319,21 @@ void PictureBrowser::readDirectory(QString targetDir)
     tempDirPath = QDir(targetDir).absoluteFilePath(TEMP_DIRECTORY);
     recycleDir = QDir(QDir(tempDirPath).absoluteFilePath(RECYCLE_DIRECTORY));
     recycleDir.mkpath(recycleDir.absolutePath());
+    thumbDirPath = QFileInfo(targetDir).absoluteDir().absoluteFilePath(THUMBNAIL_DIRECTORY);
+    QDir(thumbDirPath).mkpath(thumbDirPath);
     enterDirectory(targetDir);
+
+    // 在进入目录之后，否则会被切换目录时的 clear() 取消
+    const QString cacheDir = thumbDirPath;
+    QtConcurrent::run(thumbPool, [=]{
+        pruneThumbnails(cacheDir);
+    });
 }
 
+/**
+ * 进入目录
+ * 只创建列表项，缩略图由 requestVisibleThumbnails 在后台加载可见的部分
+ */
 void PictureBrowser::enterDirectory(QString targetDir)
 {
     currentDirPath = targetDir;
@@ -304,6 +345,11 @@ void PictureBrowser::enterDirectory(QString targetDir)
     ui->actionDelete_Up_Files->setEnabled(isSubDir);
     ui->actionDelete_Down_Files->setEnabled(isSubDir);
 
+    // 丢弃上一个目录还没开始的缩略图任务
+    thumbGeneration++;
+    thumbPool->clear();
+    thumbItems.clear();
+
     ui->listWidget->clear();
     if (targetDir.isEmpty())
         return ;
@@ -314,6 +360,7 @@ void PictureBrowser::enterDirectory(QString targetDir)
     {
         QListWidgetItem* item = new QListWidgetItem(QIcon(":/icons/cd_up"), BACK_PREV_DIRECTORY, ui->listWidget);
         item->setData(FilePathRole, BACK_PREV_DIRECTORY);
+        item->setData(ThumbStateRole, ThumbLoaded);
     }
 
     // 尺寸大小
@@ -322,26 +369,22 @@ void PictureBrowser::enterDirectory(QString targetDir)
         maxIconSize = QSize(32, 32);
 
     // 目录角标
-    QPixmap dirIcon(":/icons/directory");
-    dirIcon = dirIcon.scaled(QSize(maxIconSize.width()/3, maxIconSize.height()/3),
+    thumbDirIcon = QPixmap(":/icons/directory");
+    thumbDirIcon = thumbDirIcon.scaled(QSize(maxIconSize.width()/3, maxIconSize.height()/3),
                                  Qt::AspectRatioMode::KeepAspectRatio);
-
-    // 绘制工具
-    QFont dirCountFont = this->font();
-    dirCountFont.setPointSize(dirIcon.height()/4);
-    dirCountFont.setBold(true);
-    QFont gifMarkFont = this->font();
-    gifMarkFont.setBold(true);
+    thumbCountFont = this->font();
+    thumbCountFont.setPointSize(qMax(1, thumbDirIcon.height()/4));
+    thumbCountFont.setBold(true);
 
     // 读取目录的图片和文件夹
     QDir dir(targetDir);
+    QStringList filters = getImageFilters();
     QList<QFileInfo> infos = dir.entryInfoList(
                 QDir::Dirs | QDir::Files | QDir::NoDotAndDotDot | QDir::NoSymLinks,
                                               sortFlags);
     foreach (QFileInfo info, infos)
     {
         QString name = info.fileName();
-        QString suffix = info.suffix();
         if (name == TEMP_DIRECTORY || name == GENERAL_DIRECTORY)
             continue;
         if (name.contains(" "))
@@ -349,81 +392,152 @@ void PictureBrowser::enterDirectory(QString targetDir)
         QListWidgetItem* item;
         if (info.isDir())
         {
-            // 获取文件夹下第一张图
-            QString path;
-            auto infos = QDir(info.absoluteFilePath()).entryInfoList(getImageFilters(),
-                                                  QDir::Files | QDir::NoSymLinks,
-                                                  sortFlags);
-            if (infos.size())
-                path = infos.first().absoluteFilePath();
-
-            // 目录显示数量
-            QPixmap myDirIcon = dirIcon;
-            QPainter dirPainter(&myDirIcon);
-            dirPainter.setFont(dirCountFont);
-            dirPainter.setPen(QColor::fromHsl(rand() % 360, rand() % 256, rand() % 200)); // 随机颜色
-            dirPainter.drawText(QRect(0, myDirIcon.height()/8,myDirIcon.width(),myDirIcon.height()*7/8), Qt::AlignCenter, QString::number(infos.size()));
-            dirPainter.end();
-
-            // 如果有图，则同时合并pixmap和icon
-            QPixmap pixmap(path);
-            if (!path.isEmpty())
-            {
-                pixmap = pixmap.scaled(maxIconSize, Qt::AspectRatioMode::KeepAspectRatio);
-
-                // 画目录Icon到Pixmap上
-                QPainter painter(&pixmap);
-                painter.drawPixmap(QRect(pixmap.width() - myDirIcon.width(),
-                                         pixmap.height() - myDirIcon.height(),
-                                         myDirIcon.width(),
-                                         myDirIcon.height()),
-                                   myDirIcon);
-            }
-            else // 如果没有path，则只显示一个空文件夹图标
-            {
-                pixmap = myDirIcon;
-            }
-            item = new QListWidgetItem(QIcon(pixmap), name, ui->listWidget);
+            item = new QListWidgetItem(QIcon(thumbDirIcon), name, ui->listWidget);
         }
         else if (info.isFile())
         {
-            // gif后缀显示出来
-            QString suffix = info.suffix();
-            if (!getImageFilters().contains("*." + suffix))
+            if (!filters.contains("*." + info.suffix()))
                 continue;
             if (name.contains("."))
                 name = name.left(name.lastIndexOf("."));
-            QPixmap pixmap(info.absoluteFilePath());
-            if (pixmap.width() > maxIconSize.width() || pixmap.height() > maxIconSize.height())
-                pixmap = pixmap.scaled(maxIconSize, Qt::AspectRatioMode::KeepAspectRatio);
-            // 绘制标记
-            if (suffix == "gif")
-            {
-                QPainter painter(&pixmap);
-                painter.setFont(gifMarkFont);
-                QFontMetrics fm(gifMarkFont);
-                QSize size(fm.horizontalAdvance("GIF "), fm.lineSpacing());
-                int padding = qMin(size.width(), size.height()) / 5;
-                QRect rect(pixmap.width() - size.width() + padding,
-                           padding,
-                           size.width() - padding*2,
-                           size.height() - padding*2);
-                QPainterPath path;
-                path.addRoundedRect(rect, 3, 3);
-                painter.fillPath(path, QColor(255, 255, 255, 128));
-                // painter.setPen(QColor(32, 32, 32, 192));
-                painter.setPen(QColor::fromHsl(rand() % 360, rand() % 256, rand() % 200)); // 随机颜色
-                painter.drawText(rect, Qt::AlignCenter, tr("GIF"));
-            }
-            item = new QListWidgetItem(QIcon(pixmap), name, ui->listWidget);
+            item = new QListWidgetItem(name, ui->listWidget);
         }
         else
             continue;
         item->setData(FilePathRole, info.absoluteFilePath());
+        item->setData(ThumbStateRole, ThumbNone);
         item->setToolTip(info.fileName());
+        thumbItems.insert(info.absoluteFilePath(), item);
     }
 
     restoreCurrentViewPos();
+    thumbTimer->start();
+}
+
+/**
+ * 给可见范围（上下各多预读一屏）内还没有缩略图的项提交后台任务
+ */
+void PictureBrowser::requestVisibleThumbnails()
+{
+    if (thumbDirPath.isEmpty())
+        return ;
+
+    QRect viewRect = ui->listWidget->viewport()->rect();
+    viewRect.adjust(0, -viewRect.height(), 0, viewRect.height());
+    QSize maxIconSize = ui->listWidget->iconSize();
+    if (maxIconSize.width() <= 16 || maxIconSize.height() <= 16)
+        maxIconSize = QSize(32, 32);
+    const int generation = thumbGeneration;
+    const QString cacheDir = thumbDirPath;
+    const QStringList filters = getImageFilters();
+    const QDir::SortFlags flags = sortFlags;
+
+    for (int i = 0; i < ui->listWidget->count(); i++)
+    {
+        QListWidgetItem* item = ui->listWidget->item(i);
+        if (item->data(ThumbStateRole).toInt() != ThumbNone)
+            continue;
+        if (!ui->listWidget->visualItemRect(item).intersects(viewRect))
+            continue;
+        item->setData(ThumbStateRole, ThumbLoading);
+
+        QString path = item->data(FilePathRole).toString();
+        QFileInfo info(path);
+        bool isDir = info.isDir();
+        qint64 modified = isDir ? info.lastModified().toMSecsSinceEpoch() : 0;
+        bool dirCached = isDir && dirThumbs.contains(path) && dirThumbs.value(path).modified == modified;
+        DirectoryThumb cached = dirThumbs.value(path);
+
+        QtConcurrent::run(thumbPool, [=]{
+            QString imagePath = path;
+            int count = -1;
+            if (isDir)
+            {
+                if (dirCached)
+                {
+                    imagePath = cached.firstPath;
+                    count = cached.count;
+                }
+                else
+                {
+                    // 获取文件夹下第一张图
+                    auto infos = QDir(path).entryInfoList(filters, QDir::Files | QDir::NoSymLinks, flags);
+                    count = infos.size();
+                    imagePath = infos.size() ? infos.first().absoluteFilePath() : "";
+                }
+            }
+            QImage image;
+            if (!imagePath.isEmpty())
+                image = loadThumbnail(imagePath, cacheDir, maxIconSize);
+            emit signalThumbnailLoaded(generation, path, image, count, imagePath, modified);
+        });
+    }
+}
+
+/**
+ * 把后台读取到的缩略图设置到列表项上
+ * 绘制文件夹的数量角标、GIF标记
+ * @param dirCount 文件夹中图片数量，-1 表示是文件
+ */
+void PictureBrowser::setItemThumbnail(QListWidgetItem *item, QImage image, int dirCount)
+{
+    QSize maxIconSize = ui->listWidget->iconSize();
+    if (maxIconSize.width() <= 16 || maxIconSize.height() <= 16)
+        maxIconSize = QSize(32, 32);
+
+    QPixmap pixmap = QPixmap::fromImage(image);
+    if (pixmap.width() > maxIconSize.width() || pixmap.height() > maxIconSize.height())
+        pixmap = pixmap.scaled(maxIconSize, Qt::AspectRatioMode::KeepAspectRatio);
+
+    if (dirCount >= 0)
+    {
+        // 目录显示数量
+        QPixmap myDirIcon = thumbDirIcon;
+        QPainter dirPainter(&myDirIcon);
+        dirPainter.setFont(thumbCountFont);
+        dirPainter.setPen(QColor::fromHsl(rand() % 360, rand() % 256, rand() % 200)); // 随机颜色
+        dirPainter.drawText(QRect(0, myDirIcon.height()/8,myDirIcon.width(),myDirIcon.height()*7/8), Qt::AlignCenter, QString::number(dirCount));
+        dirPainter.end();
+
+        // 如果有图，则同时合并pixmap和icon
+        if (!pixmap.isNull())
+        {
+            // 画目录Icon到Pixmap上
+            QPainter painter(&pixmap);
+            painter.drawPixmap(QRect(pixmap.width() - myDirIcon.width(),
+                                     pixmap.height() - myDirIcon.height(),
+                                     myDirIcon.width(),
+                                     myDirIcon.height()),
+                               myDirIcon);
+        }
+        else // 如果没有图片，则只显示一个空文件夹图标
+        {
+            pixmap = myDirIcon;
+        }
+    }
+    else if (!pixmap.isNull() && QFileInfo(item->data(FilePathRole).toString()).suffix() == "gif")
+    {
+        // 绘制标记
+        QFont gifMarkFont = this->font();
+        gifMarkFont.setBold(true);
+        QPainter painter(&pixmap);
+        painter.setFont(gifMarkFont);
+        QFontMetrics fm(gifMarkFont);
+        QSize size(fm.horizontalAdvance("GIF "), fm.lineSpacing());
+        int padding = qMin(size.width(), size.height()) / 5;
+        QRect rect(pixmap.width() - size.width() + padding,
+                   padding,
+                   size.width() - padding*2,
+                   size.height() - padding*2);
+        QPainterPath path;
+        path.addRoundedRect(rect, 3, 3);
+        painter.fillPath(path, QColor(255, 255, 255, 128));
+        painter.setPen(QColor::fromHsl(rand() % 360, rand() % 256, rand() % 200)); // 随机颜色
+        painter.drawText(rect, Qt::AlignCenter, tr("GIF"));
+    }
+
+    item->setIcon(QIcon(pixmap));
+    item->setData(ThumbStateRole, ThumbLoaded);
 }
 
 void PictureBrowser::resizeEvent(QResizeEvent *event)
@@ -433,6 +547,7 @@ void PictureBrowser::resizeEvent(QResizeEvent *event)
     QSize size(ui->listWidget->iconSize());
     ui->listWidget->setIconSize(QSize(1, 1));
     ui->listWidget->setIconSize(size);
+    thumbTimer->start();
 }
 
 void PictureBrowser::showEvent(QShowEvent *event)
@@ -1389,6 +1504,59 @@ QStringList PictureBrowser::getImageFilters()
     return QStringList{"*.jpg", "*.png", "*.jpeg", "*.gif"};
 }
 
+/**
+ * 读取缩略图，优先使用磁盘缓存
+ * 缓存文件以图片完整内容+缩略图尺寸的哈希命名，移动、重命名后依然可以命中；
+ * 命中时更新修改时间，清理时按它淘汰最久没用到的
+ * 在线程池中运行
+ */
+QImage PictureBrowser::loadThumbnail(const QString &path, const QString &cacheDir, QSize size)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return QImage();
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    hash.addData(&file);
+    hash.addData(QByteArray::number(size.width()) + "x" + QByteArray::number(size.height()));
+    file.close();
+    QString cachePath = QDir(cacheDir).absoluteFilePath(hash.result().toHex());
+
+    QImage image;
+    QFileInfo cacheInfo(cachePath);
+    if (cacheInfo.exists() && image.load(cachePath))
+    {
+        if (cacheInfo.lastModified().secsTo(QDateTime::currentDateTime()) > THUMBNAIL_TOUCH_INTERVAL)
+        {
+            QFile cacheFile(cachePath);
+            if (cacheFile.open(QIODevice::ReadWrite))
+                cacheFile.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+        }
+        return image;
+    }
+
+    // 解码时直接缩放，不读取完整的大图
+    QImageReader reader(path);
+    QSize origin = reader.size();
+    if (origin.isValid() && (origin.width() > size.width() || origin.height() > size.height()))
+        reader.setScaledSize(origin.scaled(size, Qt::KeepAspectRatio));
+    image = reader.read();
+    if (image.isNull())
+        return image;
+    image.save(cachePath, image.hasAlphaChannel() ? "PNG" : "JPG");
+    return image;
+}
+
+/**
+ * 缩略图缓存超过上限时，删除修改时间最早（最久没用到）的
+ * 在线程池中运行
+ */
+void PictureBrowser::pruneThumbnails(const QString &cacheDir)
+{
+    QFileInfoList infos = QDir(cacheDir).entryInfoList(QDir::Files, QDir::Time); // 新的在前
+    for (int i = THUMBNAIL_CACHE_MAX_FILES; i < infos.size(); i++)
+        QFile::remove(infos.at(i).absoluteFilePath());
+}
+
 bool PictureBrowser::copyDirectoryFiles(const QString &fromDir, const QString &toDir, bool coverFileIfExist)
 {
     QDir sourceDir(fromDir);
@@ -1605,8 +1773,100 @@ void PictureBrowser::on_actionUndo_Delete_Command_triggered()
     ui->actionUndo_Delete_Command->setEnabled(deleteUndoCommands.size());
 }
 
+/**
+ * 导出GIF时读取一帧
+ * 缩放交给解码器完成（JPEG可以直接按比例解码），在线程池中运行，只能用QImage
+ */
+struct GifFrameReader
+{
+    typedef QImage result_type;
+
+    QSize size;
+    Qt::ImageConversionFlags flags;
+
+    QImage operator()(const QString& path) const
+    {
+        QImageReader reader(path);
+        if (reader.size().isValid() && reader.size() != size)
+            reader.setScaledSize(size);
+        QImage image = reader.read();
+        if (image.isNull())
+            return image;
+        if (image.size() != size)
+            image = image.scaled(size);
+        return image.convertToFormat(QImage::Format_RGBA8888, flags);
+    }
+};
+
+/**
+ * 导出AVI时读取一帧的JPEG数据
+ * 原图就是对应尺寸的JPEG时，不解码，直接使用文件内容
+ */
+struct AviFrameReader
+{
+    typedef QByteArray result_type;
+
+    QSize size;
+
+    QByteArray operator()(const QString& path) const
+    {
+        QImageReader reader(path);
+        QByteArray format = reader.format();
+        if ((format == "jpeg" || format == "jpg") && reader.size() == size)
+        {
+            QFile file(path);
+            if (file.open(QIODevice::ReadOnly))
+                return file.readAll();
+        }
+
+        if (reader.size().isValid() && reader.size() != size)
+            reader.setScaledSize(size);
+        QImage image = reader.read();
+        if (image.isNull())
+            return QByteArray();
+        if (image.size() != size)
+            image = image.scaled(size);
+        QByteArray ba;
+        QBuffer bf(&ba);
+        if (!image.save(&bf, "jpg", -1))
+        {
+            qDebug() << "保存图片Buffer失败" << path;
+            return QByteArray();
+        }
+        return ba;
+    }
+};
+
+/**
+ * 多线程解码，按原顺序交给writer
+ * 每次解码一批，当前批写入的同时下一批已经在解码，内存中最多只有两批
+ * 需要在线程池的线程中调用（QtConcurrent::run 内）
+ */
+template<typename Reader, typename Writer>
+static void pipelineFrames(const QStringList& paths, Reader reader, Writer writer)
+{
+    typedef typename Reader::result_type Frame;
+    const int batch = qMax(2, QThread::idealThreadCount() * 2);
+
+    // 当前线程会阻塞等待结果，先让出位置给解码任务，避免单核时死锁
+    QThreadPool::globalInstance()->releaseThread();
+    QFuture<Frame> next = QtConcurrent::mapped(paths.mid(0, batch), reader);
+    for (int start = 0; start < paths.size(); start += batch)
+    {
+        QFuture<Frame> current = next;
+        if (start + batch < paths.size())
+            next = QtConcurrent::mapped(paths.mid(start + batch, batch), reader);
+
+        int count = qMin(batch, paths.size() - start);
+        for (int i = 0; i < count; i++)
+            writer(start + i, current.resultAt(i));
+    }
+    QThreadPool::globalInstance()->reserveThread();
+}
+
 /**
  * 源代码参考自：https://github.com/douzhongqiang/EasyGifTool
+ * 所有帧共用一个调色板（从整段中均匀取样生成），只编码和上一帧不同的矩形区域
  */
 void PictureBrowser::on_actionGeneral_GIF_triggered()
 {
@@ -1632,10 +1892,9 @@ void PictureBrowser::on_actionGeneral_GIF_triggered()
     for (int i = 0; i < selectedItems.size(); i++)
         pixmapPaths.append(selectedItems.at(i)->data(FilePathRole).toString());
 
-    // 获取图片大小
+    // 获取图片大小（只读文件头）
     auto item = selectedItems.first();
-    QPixmap firstPixmap(item->data(FilePathRole).toString());
-    QSize size = firstPixmap.size(); // 图片大小
+    QSize size = QImageReader(item->data(FilePathRole).toString()).size(); // 图片大小
     QString fileName = QDateTime::currentDateTime().toString("yyyy-MM-dd hh-mm-ss.zzz")+".gif";
     QString dirPath = ui->actionCreate_To_Origin_Folder->isChecked()
             ? currentDirPath : QDir(rootDirPath).absoluteFilePath(GENERAL_DIRECTORY);
@@ -1650,11 +1909,19 @@ void PictureBrowser::on_actionGeneral_GIF_triggered()
     size_t wt = static_cast<uint32_t>(size.width() / prop);
     size_t ht = static_cast<uint32_t>(size.height() / prop);
     size_t iv = static_cast<uint32_t>(interval / 8); // GIF合成的工具有问题，只能自己微调时间了
+    if (!wt || !ht)
+    {
+        QMessageBox::warning(this, "生成GIF", "无法读取图片尺寸：" + item->data(FilePathRole).toString());
+        return ;
+    }
 
     // 创建GIF
     progressBar->setMaximum(pixmapPaths.size());
     progressBar->show();
+    GifFrameReader reader{QSize(static_cast<int>(wt), static_cast<int>(ht)), imageConversion};
+    bool dither = gifDither;
     QtConcurrent::run([=]{
+        QDir(dirPath).mkpath(dirPath);
         Gif_H m_Gif;
         Gif_H::GifWriter* m_GifWriter = new Gif_H::GifWriter;
         if (!m_Gif.GifBegin(m_GifWriter, gifPath.toLocal8Bit().data(), wt, ht, iv))
@@ -1664,21 +1931,43 @@ void PictureBrowser::on_actionGeneral_GIF_triggered()
             return;
         }
 
-        QDir(dirPath).mkpath(dirPath);
-        for (int i = 0; i < pixmapPaths.size(); i++)
+        // 均匀取样若干帧，生成共用的调色板
+        QStringList samplePaths;
+        const int sampleCount = qMin(8, pixmapPaths.size());
+        for (int i = 0; i < sampleCount; i++)
+            samplePaths.append(pixmapPaths.at(i * pixmapPaths.size() / sampleCount));
+        QList<QImage> samples;
+        pipelineFrames(samplePaths, reader, [&](int, const QImage& image){
+            if (!image.isNull())
+                samples.append(image);
+        });
+        if (samples.isEmpty())
         {
-            QPixmap pixmap(pixmapPaths.at(i));
-            if (!pixmap.isNull())
-            {
-                if (prop > 1)
-                    pixmap = pixmap.scaled(static_cast<int>(wt), static_cast<int>(ht));
-                m_Gif.GifWriteFrame(m_GifWriter, pixmap.toImage().convertToFormat(QImage::Format_RGBA8888, imageConversion).bits(), wt, ht, iv, 8, gifDither);
-            }
-            emit signalGeneralGIFProgress(i+1);
+            PBDEB << "读取图片失败，无法生成调色板";
+            m_Gif.GifEnd(m_GifWriter);
+            delete m_GifWriter;
+            return;
         }
+        std::vector<const uint8_t*> sampleBits;
+        for (int i = 0; i < samples.size(); i++)
+            sampleBits.push_back(samples.at(i).constBits());
+        Gif_H::GifPalette palette;
+        m_Gif.GifMakeSharedPalette(sampleBits.data(), static_cast<int>(sampleBits.size()), wt, ht, 8, dither, &palette);
+        sampleBits.clear();
+        samples.clear();
+
+        Gif_H::GifColorCache* colorCache = new Gif_H::GifColorCache;
+        m_Gif.GifResetColorCache(colorCache);
+
+        pipelineFrames(pixmapPaths, reader, [&](int i, const QImage& image){
+            if (!image.isNull())
+                m_Gif.GifWriteFrameShared(m_GifWriter, image.constBits(), wt, ht, iv, &palette, colorCache, dither);
+            emit signalGeneralGIFProgress(i+1);
+        });
 
         m_Gif.GifEnd(m_GifWriter);
         delete m_GifWriter;
+        delete colorCache;
 
         emit signalGeneralGIFFinished(gifPath);
         PBDEB << "GIF生成完毕：" << size << pixmapPaths.size() << interval << compress;
@@ -1883,8 +2172,7 @@ void PictureBrowser::on_actionGeneral_AVI_triggered()
 
     // 获取图片大小
     auto item = selectedItems.first();
-    QPixmap firstPixmap(item->data(FilePathRole).toString());
-    QSize size = firstPixmap.size(); // 图片大小
+    QSize size = QImageReader(item->data(FilePathRole).toString()).size(); // 图片大小
     QString fileName = QDateTime::currentDateTime().toString("yyyy-MM-dd hh-mm-ss.zzz")+".avi";
     QString dirPath = ui->actionCreate_To_Origin_Folder->isChecked()
             ? currentDirPath : QDir(rootDirPath).absoluteFilePath(GENERAL_DIRECTORY);
@@ -1900,32 +2188,26 @@ void PictureBrowser::on_actionGeneral_AVI_triggered()
     size_t ht = static_cast<uint32_t>(size.height() / prop);
     size_t iv = static_cast<uint32_t>(interval);
 
-    // 创建GIF
+    if (!wt || !ht)
+    {
+        QMessageBox::warning(this, "生成AVI", "无法读取图片尺寸：" + item->data(FilePathRole).toString());
+        return ;
+    }
+
+    // 创建AVI
     progressBar->setMaximum(pixmapPaths.size());
     progressBar->show();
+    AviFrameReader reader{QSize(static_cast<int>(wt), static_cast<int>(ht))};
     QtConcurrent::run([=]{
         QDir(dirPath).mkpath(dirPath);
         avi_t* avi = AVI_open_output_file(gifPath.toLocal8Bit().data());
         AVI_set_video(avi, wt, ht, 1000/interval, "mjpg");
 
-        for (int i = 0; i < pixmapPaths.size(); i++)
-        {
-            QPixmap pixmap(pixmapPaths.at(i));
-            if (!pixmap.isNull())
-            {
-                if (prop > 1)
-                    pixmap = pixmap.scaled(static_cast<int>(wt), static_cast<int>(ht));
-                QByteArray ba;
-                QBuffer    bf(&ba);
-                if (!pixmap.save(&bf, "jpg", -1))
-                {
-                    qDebug() << "保存图片Buffer失败" << pixmapPaths.at(i);
-                    continue;
-                }
+        pipelineFrames(pixmapPaths, reader, [&](int i, QByteArray ba){
+            if (!ba.isEmpty())
                 AVI_write_frame(avi, ba.data(), ba.size(), 1);
-            }
             emit signalGeneralGIFProgress(i+1);
-        }
+        });
 
         AVI_close(avi);
 
@@ -2019,6 +2301,7 @@ void PictureBrowser::on_actionClip_Selected_triggered()
         pixmap.save(path);
         pixmap = pixmap.scaled(maxIconSize, Qt::AspectRatioMode::KeepAspectRatio);
         item->setIcon(QIcon(pixmap));
+        item->setData(ThumbStateRole, ThumbLoaded);
     }
 
     commitDeleteCommand();
@@ -21,6 +21,9 @@
 #include <QMessageBox>
 #include <QtConcurrent/QtConcurrent>
 #include <QProgressBar>
+#include <QImageReader>
+#include <QCryptographicHash>
+#include <QThreadPool>
 #include <QInputDialog>
 #include "gif.h"
 #include "ASCII_Art.h"
@@ -31,10 +34,14 @@
 #define TEMP_DIRECTORY "temp"
 #define GENERAL_DIRECTORY "general"
 #define RECYCLE_DIRECTORY "recycle"
+#define THUMBNAIL_DIRECTORY "thumbnails"
+#define THUMBNAIL_CACHE_MAX_FILES 5000 // 缩略图缓存的最多数量，超过时删除最久没用到的
+#define THUMBNAIL_TOUCH_INTERVAL 86400 // 命中缓存时，超过这个秒数才更新修改时间
 #define SEQUENCE_PARAM_FILE "params.ini"
 #define CLASSIFICATION_FILE "classification"
 #define FilePathRole (Qt::UserRole)
 #define FileMarkRole (Qt::UserRole+1)
+#define ThumbStateRole (Qt::UserRole+2)
 
 namespace Ui {
 class PictureBrowser;
@@ -55,6 +62,20 @@ public:
         QString file;
     };
 
+    struct DirectoryThumb
+    {
+        qint64 modified; // 文件夹修改时间，变化后重新统计
+        int count;
+        QString firstPath;
+    };
+
+    enum ThumbState
+    {
+        ThumbNone,
+        ThumbLoading,
+        ThumbLoaded
+    };
+
     void readDirectory(QString targetDir);
     void enterDirectory(QString targetDir);
 
@@ -73,6 +94,9 @@ protected:
 
     void fastSortItems(QString key);
 
+    void requestVisibleThumbnails();
+    void setItemThumbnail(QListWidgetItem* item, QImage image, int dirCount);
+
 private slots:
     void on_actionRefresh_triggered();
 
@@ -253,10 +277,13 @@ private:
     int getRecordInterval();
     void saveImageConversionFlag();
     void fromImageConversionFlag();
+    static QImage loadThumbnail(const QString& path, const QString& cacheDir, QSize size);
+    static void pruneThumbnails(const QString& cacheDir);
 
 signals:
     void signalGeneralGIFProgress(int index);
     void signalGeneralGIFFinished(QString path);
+    void signalThumbnailLoaded(int generation, QString path, QImage image, int dirCount, QString firstPath, qint64 modified);
 
 private:
     Ui::PictureBrowser *ui;
@@ -273,6 +300,16 @@ private:
     bool fastSort = false;
 
     QHash<QString, ListProgress> viewPoss; // 缓存每个文件夹的浏览位置
+
+    // 缩略图：只加载可见项，线程池解码，缓存到磁盘
+    QString thumbDirPath;
+    QThreadPool* thumbPool;
+    QTimer* thumbTimer;
+    int thumbGeneration = 0; // 切换目录后丢弃旧目录的结果
+    QHash<QString, QListWidgetItem*> thumbItems;
+    QHash<QString, DirectoryThumb> dirThumbs; // 子文件夹图片数量缓存
+    QPixmap thumbDirIcon;
+    QFont thumbCountFont;
     QTimer* slideTimer;
     bool slideInSelected = false;
 
@@ -0,0 +1,373 @@
+#include <QDataStream>
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QDebug>
+#include "kvstore.h"
+
+#define KV_SNAPSHOT_MAGIC 0x4B565331 // KVS1
+#define KV_FLUSH_INTERVAL 1000 // 日志写入磁盘的间隔，毫秒
+#define KV_MIN_LOG_RECORDS 4096 // 日志超过 max(这个, 键数量) 条时写快照
+#define KV_MAX_PATTERNS 64 // 缓存的正则数量
+
+enum KVLogOp
+{
+    KVSetInt = 1,
+    KVSetString = 2,
+    KVRemove = 3
+};
+
+QString KVStore::Value::toString() const
+{
+    return isInt ? QString::number(integer) : string;
+}
+
+qint64 KVStore::Value::toLongLong() const
+{
+    return isInt ? integer : string.toLongLong();
+}
+
+KVStore::KVStore(const QString &snapshotPath, const QString &logPath, QObject *parent)
+    : QObject(parent), snapshotPath(snapshotPath), logPath(logPath)
+{
+    flushTimer.setSingleShot(true);
+    flushTimer.setInterval(KV_FLUSH_INTERVAL);
+    connect(&flushTimer, &QTimer::timeout, this, [=]{
+        flush();
+    });
+}
+
+KVStore::~KVStore()
+{
+    flush();
+}
+
+/**
+ * 读取快照，再回放日志
+ * 日志末尾不完整（例如写到一半时崩溃）的记录会被截掉
+ */
+void KVStore::load()
+{
+    entries.clear();
+
+    QFile snapshot(snapshotPath);
+    if (snapshot.open(QIODevice::ReadOnly))
+    {
+        QDataStream in(&snapshot);
+        in.setVersion(QDataStream::Qt_5_0);
+        quint32 magic = 0;
+        qint32 count = 0;
+        in >> magic >> count;
+        if (magic != KV_SNAPSHOT_MAGIC)
+        {
+            qWarning() << "变量快照格式错误：" << snapshotPath;
+            count = 0;
+        }
+        for (int i = 0; i < count && in.status() == QDataStream::Ok; i++)
+        {
+            QString key;
+            Value value;
+            in >> key >> value.isInt;
+            if (value.isInt)
+                in >> value.integer;
+            else
+                in >> value.string;
+            if (in.status() == QDataStream::Ok)
+                entries.insert(key, value);
+        }
+        snapshot.close();
+    }
+
+    logRecords = 0;
+    QFile log(logPath);
+    if (log.open(QIODevice::ReadOnly))
+    {
+        QDataStream in(&log);
+        in.setVersion(QDataStream::Qt_5_0);
+        qint64 goodPos = 0;
+        while (!in.atEnd())
+        {
+            quint8 op = 0;
+            QString key;
+            Value value;
+            in >> op >> key;
+            if (op == KVSetInt)
+            {
+                value.isInt = true;
+                in >> value.integer;
+            }
+            else if (op == KVSetString)
+            {
+                in >> value.string;
+            }
+            else if (op != KVRemove)
+            {
+                break;
+            }
+            if (in.status() != QDataStream::Ok)
+                break;
+
+            if (op == KVRemove)
+                entries.remove(key);
+            else
+                entries.insert(key, value);
+            goodPos = log.pos();
+            logRecords++;
+        }
+        bool broken = goodPos < log.size();
+        log.close();
+        if (broken)
+        {
+            qWarning() << "变量日志末尾不完整，已截断：" << logPath << goodPos;
+            QFile::resize(logPath, goodPos);
+        }
+    }
+
+    openLog(false);
+}
+
+/**
+ * 从旧版本的 heaps.ini 导入
+ * 只在还没有快照和日志时进行，原文件保留不动
+ */
+bool KVStore::migrateFrom(QSettings *settings)
+{
+    if (QFileInfo(snapshotPath).exists() || QFileInfo(logPath).exists() || !settings)
+        return false;
+    if (!QFileInfo(settings->fileName()).exists())
+        return false;
+
+    foreach (QString key, settings->allKeys())
+    {
+        QVariant var = settings->value(key);
+        if (var.type() == QVariant::StringList) // 未加引号的逗号会被QSettings读成列表
+            var = var.toStringList().join(", ");
+
+        Value value;
+        value.isInt = toInteger(var, value.integer);
+        if (!value.isInt)
+            value.string = var.toString();
+        entries.insert(key, value);
+    }
+    qInfo() << "导入旧版变量：" << settings->fileName() << entries.size();
+    writeSnapshot();
+    return true;
+}
+
+/**
+ * 日志写入磁盘；日志太长时写快照
+ */
+void KVStore::flush()
+{
+    flushTimer.stop();
+    if (logFile.isOpen())
+        logFile.flush();
+    if (logRecords > qMax(KV_MIN_LOG_RECORDS, entries.size()))
+        writeSnapshot();
+}
+
+bool KVStore::contains(const QString &key) const
+{
+    return entries.contains(key);
+}
+
+QVariant KVStore::value(const QString &key, const QVariant &def) const
+{
+    auto it = entries.constFind(key);
+    if (it == entries.constEnd())
+        return def;
+    if (it.value().isInt)
+        return it.value().integer;
+    return it.value().string;
+}
+
+/**
+ * 能无损转换成整数的值按整数保存
+ */
+void KVStore::setValue(const QString &key, const QVariant &value)
+{
+    Value val;
+    val.isInt = toInteger(value, val.integer);
+    if (!val.isInt)
+        val.string = value.toString();
+    entries.insert(key, val);
+    appendLog(val.isInt ? KVSetInt : KVSetString, key, val);
+}
+
+/**
+ * 加上 delta 并返回新的值，不存在时视为0
+ */
+qint64 KVStore::add(const QString &key, qint64 delta)
+{
+    Value& val = entries[key];
+    qint64 result = val.toLongLong() + delta;
+    val.isInt = true;
+    val.integer = result;
+    val.string.clear();
+    appendLog(KVSetInt, key, val); // 记录结果而不是增量，重复回放也不会出错
+    return result;
+}
+
+void KVStore::remove(const QString &key)
+{
+    if (!entries.remove(key))
+        return ;
+    appendLog(KVRemove, key, Value());
+}
+
+QStringList KVStore::allKeys() const
+{
+    return entries.keys();
+}
+
+/**
+ * 以 prefix 开头的所有键，按顺序
+ */
+QStringList KVStore::keys(const QString &prefix) const
+{
+    QStringList sl;
+    for (auto it = entries.lowerBound(prefix); it != entries.constEnd() && it.key().startsWith(prefix); ++it)
+        sl.append(it.key());
+    return sl;
+}
+
+/**
+ * 在 prefix 下的键中查找匹配 pattern 的（对去掉前缀的部分匹配，同 QSettings::beginGroup 后的 allKeys）
+ * 以 ^ 开头的固定前缀会缩小遍历范围
+ * 先收集结果再返回，调用方可以放心修改
+ */
+QList<KVStore::Match> KVStore::scan(const QString &prefix, const QString &pattern)
+{
+    QList<Match> matches;
+    const QRegularExpression& re = compile(pattern);
+    if (!re.isValid())
+    {
+        qWarning() << "变量正则表达式错误：" << pattern << re.errorString();
+        return matches;
+    }
+
+    QString start = prefix + literalPrefix(pattern);
+    for (auto it = entries.lowerBound(start); it != entries.constEnd() && it.key().startsWith(start); ++it)
+    {
+        QRegularExpressionMatch match = re.match(it.key().mid(prefix.length()));
+        if (match.hasMatch())
+            matches.append(Match{it.key(), match});
+    }
+    return matches;
+}
+
+bool KVStore::toInteger(const QVariant &value, qint64 &integer)
+{
+    switch (int(value.type())) {
+    case QVariant::Int:
+    case QVariant::UInt:
+    case QVariant::LongLong:
+        integer = value.toLongLong();
+        return true;
+    case QVariant::String:
+    {
+        QString s = value.toString();
+        bool ok = false;
+        integer = s.toLongLong(&ok);
+        return ok && QString::number(integer) == s; // 保留 "007"、"+1" 这类原样的文本
+    }
+    default:
+        return false;
+    }
+}
+
+/**
+ * ^abc_\d+ 这种正则一定以 abc_ 开头
+ */
+QString KVStore::literalPrefix(const QString &pattern)
+{
+    if (!pattern.startsWith("^") || pattern.contains('|')) // 有分支就不能确定前缀了
+        return QString();
+
+    const QString special = "\\.^$|?*+()[]{}";
+    QString prefix;
+    int i = 1;
+    while (i < pattern.length() && !special.contains(pattern.at(i)))
+        prefix += pattern.at(i++);
+
+    // a? a* a{0,1} 中最后一个字符是可选的
+    if (i < pattern.length() && !prefix.isEmpty() && QString("?*{").contains(pattern.at(i)))
+        prefix.chop(1);
+    return prefix;
+}
+
+const QRegularExpression &KVStore::compile(const QString &pattern)
+{
+    auto it = patterns.find(pattern);
+    if (it != patterns.end())
+        return it.value();
+
+    if (patterns.size() >= KV_MAX_PATTERNS)
+        patterns.clear();
+    QRegularExpression re(pattern);
+    re.optimize();
+    return patterns.insert(pattern, re).value();
+}
+
+void KVStore::appendLog(quint8 op, const QString &key, const Value &value)
+{
+    if (!logFile.isOpen() && !openLog(false))
+        return ;
+
+    QDataStream out(&logFile);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << op << key;
+    if (op == KVSetInt)
+        out << value.integer;
+    else if (op == KVSetString)
+        out << value.string;
+    logRecords++;
+
+    if (!flushTimer.isActive())
+        flushTimer.start();
+}
+
+/**
+ * 写完整快照，成功后清空日志
+ */
+void KVStore::writeSnapshot()
+{
+    QSaveFile file(snapshotPath);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        qWarning() << "无法写入变量快照：" << snapshotPath;
+        return ;
+    }
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << quint32(KV_SNAPSHOT_MAGIC) << qint32(entries.size());
+    for (auto it = entries.constBegin(); it != entries.constEnd(); ++it)
+    {
+        out << it.key() << it.value().isInt;
+        if (it.value().isInt)
+            out << it.value().integer;
+        else
+            out << it.value().string;
+    }
+    if (!file.commit())
+    {
+        qWarning() << "无法写入变量快照：" << snapshotPath;
+        return ;
+    }
+
+    // 快照已经包含了日志的内容；即使这里清空失败，回放日志的结果也相同
+    openLog(true);
+    logRecords = 0;
+}
+
+bool KVStore::openLog(bool truncate)
+{
+    if (logFile.isOpen())
+        logFile.close();
+    logFile.setFileName(logPath);
+    if (!logFile.open(truncate ? (QIODevice::WriteOnly | QIODevice::Truncate) : QIODevice::Append))
+    {
+        qWarning() << "无法写入变量日志：" << logPath;
+        return false;
+    }
+    return true;
+}
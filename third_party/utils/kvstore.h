@@ -0,0 +1,74 @@
+#ifndef KVSTORE_H
+#define KVSTORE_H
+
+#include <QObject>
+#include <QMap>
+#include <QHash>
+#include <QFile>
+#include <QTimer>
+#include <QVariant>
+#include <QSettings>
+#include <QRegularExpression>
+
+/**
+ * 脚本变量（heaps）的键值存储
+ * 全部数据在内存中按键排序，值只有整数和字符串两种；
+ * 每次修改追加到日志文件，日志过长时写一份快照并清空日志。
+ * 和 QSettings 相同的 value/setValue/remove/contains 接口，另有前缀遍历、正则扫描、原子加减。
+ */
+class KVStore : public QObject
+{
+    Q_OBJECT
+public:
+    KVStore(const QString& snapshotPath, const QString& logPath, QObject* parent = nullptr);
+    ~KVStore() override;
+
+    struct Value
+    {
+        bool isInt = false;
+        qint64 integer = 0;
+        QString string;
+
+        QString toString() const;
+        qint64 toLongLong() const;
+    };
+
+    struct Match
+    {
+        QString key; // 完整的键
+        QRegularExpressionMatch match; // 去掉前缀后的匹配结果
+    };
+
+    void load();
+    bool migrateFrom(QSettings* settings);
+    void flush();
+
+    bool contains(const QString& key) const;
+    QVariant value(const QString& key, const QVariant& def = QVariant()) const;
+    void setValue(const QString& key, const QVariant& value);
+    qint64 add(const QString& key, qint64 delta);
+    void remove(const QString& key);
+
+    QStringList allKeys() const;
+    QStringList keys(const QString& prefix) const;
+    QList<Match> scan(const QString& prefix, const QString& pattern);
+
+private:
+    static bool toInteger(const QVariant& value, qint64& integer);
+    static QString literalPrefix(const QString& pattern);
+    const QRegularExpression& compile(const QString& pattern);
+    void appendLog(quint8 op, const QString& key, const Value& value);
+    void writeSnapshot();
+    bool openLog(bool truncate);
+
+private:
+    QString snapshotPath;
+    QString logPath;
+    QMap<QString, Value> entries;
+    QHash<QString, QRegularExpression> patterns; // 编译过的键正则
+    QFile logFile;
+    int logRecords = 0; // 上次快照后日志的条数
+    QTimer flushTimer;
+};
+
+#endif // KVSTORE_H
@@ -0,0 +1,77 @@
+#include <cstring>
+#include "pcmringbuffer.h"
+
+PcmRingBuffer::PcmRingBuffer(int capacity, QObject *parent) : QIODevice(parent)
+{
+    buffer.resize(qMax(capacity, 1024));
+    open(QIODevice::ReadWrite);
+}
+
+void PcmRingBuffer::append(const QByteArray &data)
+{
+    write(data);
+}
+
+void PcmRingBuffer::clear()
+{
+    head = 0;
+    count = 0;
+}
+
+bool PcmRingBuffer::isSequential() const
+{
+    return true;
+}
+
+qint64 PcmRingBuffer::bytesAvailable() const
+{
+    return count + QIODevice::bytesAvailable();
+}
+
+qint64 PcmRingBuffer::readData(char *data, qint64 maxlen)
+{
+    int len = int(qMin(qint64(count), maxlen));
+    int first = qMin(len, buffer.size() - head);
+    memcpy(data, buffer.constData() + head, size_t(first));
+    memcpy(data + first, buffer.constData(), size_t(len - first));
+    head = (head + len) % buffer.size();
+    count -= len;
+    if (!count)
+        head = 0;
+    return len;
+}
+
+qint64 PcmRingBuffer::writeData(const char *data, qint64 len)
+{
+    if (len <= 0)
+        return 0;
+    reserve(count + int(len));
+
+    int tail = (head + count) % buffer.size();
+    int first = qMin(int(len), buffer.size() - tail);
+    memcpy(buffer.data() + tail, data, size_t(first));
+    memcpy(buffer.data(), data + first, size_t(len - first));
+    count += int(len);
+    emit readyRead();
+    return len;
+}
+
+/**
+ * 容量不足时翻倍，并把未读的数据排到开头
+ */
+void PcmRingBuffer::reserve(int size)
+{
+    if (size <= buffer.size())
+        return ;
+
+    int capacity = buffer.size();
+    while (capacity < size)
+        capacity *= 2;
+
+    QByteArray ba(capacity, Qt::Uninitialized);
+    int first = qMin(count, buffer.size() - head);
+    memcpy(ba.data(), buffer.constData() + head, size_t(first));
+    memcpy(ba.data() + first, buffer.constData(), size_t(count - first));
+    buffer = ba;
+    head = 0;
+}
@@ -0,0 +1,38 @@
+#ifndef PCMRINGBUFFER_H
+#define PCMRINGBUFFER_H
+
+#include <QIODevice>
+#include <QByteArray>
+
+/**
+ * 给 QAudioOutput 拉取数据的环形缓冲区
+ * 收到PCM时一边 append，QAudioOutput 一边 read，不经过临时文件；
+ * 两者都在 XfyTTS 所在的线程（socket 的信号和声卡的拉取都经过它的事件循环），没有加锁
+ * 写满时容量翻倍，读空时返回0（声卡会进入 Idle）
+ */
+class PcmRingBuffer : public QIODevice
+{
+    Q_OBJECT
+public:
+    PcmRingBuffer(int capacity = 64 * 1024, QObject* parent = nullptr);
+
+    void append(const QByteArray& data);
+    void clear();
+
+    bool isSequential() const override;
+    qint64 bytesAvailable() const override;
+
+protected:
+    qint64 readData(char *data, qint64 maxlen) override;
+    qint64 writeData(const char *data, qint64 len) override;
+
+private:
+    void reserve(int size);
+
+private:
+    QByteArray buffer;
+    int head = 0; // 下一个读取的位置
+    int count = 0; // 未读取的字节数
+};
+
+#endif // PCMRINGBUFFER_H
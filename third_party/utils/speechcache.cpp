@@ -0,0 +1,171 @@
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QSaveFile>
+#include <QDebug>
+#include <algorithm>
+#include "speechcache.h"
+
+#define SPEECH_PCM_SUFFIX "pcmz"
+
+SpeechCache::SpeechCache(const QString &dirPath, qint64 budget, QObject *parent)
+    : QObject(parent), dir(dirPath), budget(budget)
+{
+    dir.mkpath(dir.absolutePath());
+    foreach (QFileInfo info, dir.entryInfoList(QDir::Files))
+    {
+        Entry entry;
+        entry.path = info.absoluteFilePath();
+        entry.bytes = info.size();
+        entry.lastUsed = info.lastModified().toMSecsSinceEpoch();
+        entries.insert(info.completeBaseName(), entry);
+        totalBytes += entry.bytes;
+    }
+    evict(QString());
+}
+
+/**
+ * 同样的文字、同样的声音参数得到同样的键
+ */
+QString SpeechCache::keyOf(const QString &text, const QString &platform, const QString &voice, int pitch, int speed, int volume)
+{
+    QString s = QString("%1\n%2\n%3\n%4\n%5\n%6").arg(platform).arg(voice).arg(pitch).arg(speed).arg(volume).arg(text);
+    return QCryptographicHash::hash(s.toUtf8(), QCryptographicHash::Sha1).toHex();
+}
+
+bool SpeechCache::contains(const QString &key) const
+{
+    return entries.contains(key);
+}
+
+/**
+ * 读取缓存的PCM，没有时返回空
+ */
+QByteArray SpeechCache::getPcm(const QString &key)
+{
+    if (!entries.contains(key) || !entries.value(key).path.endsWith("." SPEECH_PCM_SUFFIX))
+        return QByteArray();
+
+    QFile file(entries.value(key).path);
+    if (!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+    QByteArray pcm = qUncompress(file.readAll());
+    file.close();
+    if (!pcm.isEmpty())
+        touch(key);
+    return pcm;
+}
+
+void SpeechCache::insertPcm(const QString &key, const QByteArray &pcm)
+{
+    if (pcm.isEmpty())
+        return ;
+    write(key, SPEECH_PCM_SUFFIX, qCompress(pcm));
+}
+
+/**
+ * 缓存文件的路径，没有时返回空
+ */
+QString SpeechCache::getFile(const QString &key)
+{
+    if (!entries.contains(key))
+        return QString();
+    touch(key);
+    return entries.value(key).path;
+}
+
+/**
+ * 保存已经压缩过的音频（例如mp3），返回文件路径
+ */
+QString SpeechCache::insertFile(const QString &key, const QString &suffix, const QByteArray &data)
+{
+    return write(key, suffix, data);
+}
+
+void SpeechCache::setBudget(qint64 bytes)
+{
+    this->budget = bytes;
+    evict(QString());
+}
+
+qint64 SpeechCache::getBudget() const
+{
+    return budget;
+}
+
+qint64 SpeechCache::getTotalBytes() const
+{
+    return totalBytes;
+}
+
+/**
+ * 更新最后使用时间，修改时间一并更新，下次启动时依然有效
+ */
+void SpeechCache::touch(const QString &key)
+{
+    Entry& entry = entries[key];
+    QDateTime time = QDateTime::currentDateTime();
+    entry.lastUsed = time.toMSecsSinceEpoch();
+
+    QFile file(entry.path);
+    if (file.open(QIODevice::ReadWrite | QIODevice::ExistingOnly))
+    {
+        file.setFileTime(time, QFileDevice::FileModificationTime);
+        file.close();
+    }
+}
+
+QString SpeechCache::write(const QString &key, const QString &suffix, const QByteArray &data)
+{
+    QString path = dir.absoluteFilePath(key + "." + suffix);
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        qWarning() << "无法写入语音缓存：" << path;
+        return QString();
+    }
+    file.write(data);
+    if (!file.commit())
+        return QString();
+
+    if (entries.contains(key))
+    {
+        const Entry& old = entries.value(key);
+        totalBytes -= old.bytes;
+        if (old.path != path)
+            QFile::remove(old.path);
+    }
+    Entry entry;
+    entry.path = path;
+    entry.bytes = data.size();
+    entry.lastUsed = QDateTime::currentMSecsSinceEpoch();
+    entries.insert(key, entry);
+    totalBytes += entry.bytes;
+
+    evict(key);
+    return path;
+}
+
+/**
+ * 超出容量时，从最久没用的开始删除
+ * keepKey 是刚写入、马上要播放的，不删除
+ */
+void SpeechCache::evict(const QString &keepKey)
+{
+    if (totalBytes <= budget)
+        return ;
+
+    QList<QPair<qint64, QString>> order;
+    for (auto it = entries.constBegin(); it != entries.constEnd(); ++it)
+        order.append(qMakePair(it.value().lastUsed, it.key()));
+    std::sort(order.begin(), order.end());
+
+    for (int i = 0; i < order.size() && totalBytes > budget; i++)
+    {
+        const QString& key = order.at(i).second;
+        if (key == keepKey)
+            continue;
+        const Entry entry = entries.take(key);
+        QFile::remove(entry.path);
+        totalBytes -= entry.bytes;
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef SPEECHCACHE_H
+#define SPEECHCACHE_H
+
+#include <QObject>
+#include <QDir>
+#include <QHash>
+
+/**
+ * 合成语音的缓存
+ * 以 (文本, 平台, 发音人, 音调, 音速, 音量) 的哈希为文件名，
+ * 一条语音一个文件：PCM 压缩保存，网络下载的 mp3 原样保存。
+ * 文件的修改时间即最后使用时间，超出容量时淘汰最久没用的。
+ */
+class SpeechCache : public QObject
+{
+    Q_OBJECT
+public:
+    SpeechCache(const QString& dirPath, qint64 budget, QObject* parent = nullptr);
+
+    static QString keyOf(const QString& text, const QString& platform, const QString& voice, int pitch, int speed, int volume);
+
+    bool contains(const QString& key) const;
+    QByteArray getPcm(const QString& key);
+    void insertPcm(const QString& key, const QByteArray& pcm);
+    QString getFile(const QString& key);
+    QString insertFile(const QString& key, const QString& suffix, const QByteArray& data);
+
+    void setBudget(qint64 bytes);
+    qint64 getBudget() const;
+    qint64 getTotalBytes() const;
+
+private:
+    struct Entry
+    {
+        QString path;
+        qint64 bytes = 0;
+        qint64 lastUsed = 0; // 毫秒
+    };
+
+    void touch(const QString& key);
+    QString write(const QString& key, const QString& suffix, const QByteArray& data);
+    void evict(const QString& keepKey);
+
+private:
+    QDir dir;
+    QHash<QString, Entry> entries;
+    qint64 totalBytes = 0;
+    qint64 budget = 0;
+};
+
+#endif // SPEECHCACHE_H
@@ -0,0 +1,385 @@
+#include <QDebug>
+#include <climits>
+#include <algorithm>
+#include "timerwheel.h"
+
+TimerWheel *TimerWheel::instance()
+{
+    static TimerWheel* wheel = new TimerWheel();
+    return wheel;
+}
+
+TimerWheel::TimerWheel(QObject *parent) : QObject(parent)
+{
+    clock.start();
+    timer = new QTimer(this);
+    timer->setSingleShot(true);
+    connect(timer, &QTimer::timeout, this, [=]{
+        wakeupCount++;
+        armedTick = -1;
+        advance();
+        arm();
+    });
+}
+
+TimerWheel::~TimerWheel()
+{
+    qDeleteAll(entries);
+}
+
+/**
+ * 添加任务
+ * @param delay    首次执行的延迟（毫秒）
+ * @param interval 之后重复的间隔，0 为只执行一次
+ * @param context  销毁后任务自动失效，可为空
+ * @param name     查看时显示的名字
+ */
+TimerWheel::TimerId TimerWheel::schedule(int delay, int interval, QObject *context, const QString &name, std::function<void()> func)
+{
+    if (entries.isEmpty()) // 空闲了很久，直接对齐到现在
+        currentTick = qMax(currentTick, nowTick());
+
+    Entry* entry = new Entry;
+    entry->id = nextId++;
+    entry->due = (clock.elapsed() + qMax(0, delay) + TICK_MS - 1) / TICK_MS;
+    entry->interval = qMax(0, interval);
+    entry->hasContext = context != nullptr;
+    entry->context = context;
+    entry->name = name;
+    entry->func = func;
+    entries.insert(entry->id, entry);
+    place(entry);
+
+    if (armedTick < 0 || qMax(entry->due, currentTick) < armedTick)
+        arm();
+    return entry->id;
+}
+
+TimerWheel::TimerId TimerWheel::singleShot(int delay, QObject *context, std::function<void()> func, const QString &name)
+{
+    return schedule(delay, 0, context, name, func);
+}
+
+/**
+ * 取消任务，不会重新计算唤醒时间（多唤醒一次没有影响）
+ */
+bool TimerWheel::cancel(TimerId id)
+{
+    Entry* entry = entries.take(id);
+    if (!entry)
+        return false;
+    unlink(entry);
+    delete entry;
+    return true;
+}
+
+bool TimerWheel::isScheduled(TimerId id) const
+{
+    return entries.contains(id);
+}
+
+qint64 TimerWheel::remainingTime(TimerId id) const
+{
+    Entry* entry = entries.value(id);
+    if (!entry)
+        return -1;
+    return qMax(0LL, entry->due * TICK_MS - clock.elapsed());
+}
+
+QList<TimerWheel::Info> TimerWheel::scheduled() const
+{
+    QList<Info> infos;
+    foreach (Entry* entry, entries)
+    {
+        if (entry->hasContext && !entry->context)
+            continue;
+        infos.append(Info{entry->id, entry->name, remainingTime(entry->id), entry->interval});
+    }
+    std::sort(infos.begin(), infos.end(), [](const Info& a, const Info& b){
+        return a.remaining < b.remaining;
+    });
+    return infos;
+}
+
+/**
+ * 按到期顺序列出所有任务，用于调试
+ */
+QStringList TimerWheel::describe() const
+{
+    QStringList sl;
+    foreach (const Info& info, scheduled())
+    {
+        QString line = QString("%1  %2秒后").arg(info.name.isEmpty() ? "#" + QString::number(info.id) : info.name)
+                .arg(info.remaining / 1000.0, 0, 'f', 1);
+        if (info.interval)
+            line += QString("，每%1秒").arg(info.interval / 1000.0, 0, 'f', 1);
+        sl.append(line);
+    }
+    return sl;
+}
+
+qint64 TimerWheel::getWakeupCount() const
+{
+    return wakeupCount;
+}
+
+qint64 TimerWheel::nowTick() const
+{
+    return clock.elapsed() / TICK_MS;
+}
+
+/**
+ * 根据距离到期的刻度数，放到对应层的格子里
+ */
+void TimerWheel::place(Entry *entry)
+{
+    qint64 due = qMax(entry->due, currentTick);
+    qint64 delta = due - currentTick;
+    Entry** slot = nullptr;
+    int level = 0;
+    if (delta < ROOT_SIZE)
+    {
+        slot = &root[due & (ROOT_SIZE - 1)];
+    }
+    else
+    {
+        for (level = 1; level < LEVELS; level++)
+        {
+            int shift = ROOT_BITS + level * LEVEL_BITS;
+            if (delta < (1LL << shift) || level == LEVELS - 1)
+            {
+                if (delta >= (1LL << shift)) // 超出范围，先放在最远的格子
+                    due = currentTick + (1LL << shift) - 1;
+                slot = &levels[level - 1][(due >> (shift - LEVEL_BITS)) & (LEVEL_SIZE - 1)];
+                break;
+            }
+        }
+    }
+
+    entry->prev = nullptr;
+    entry->next = *slot;
+    if (*slot)
+        (*slot)->prev = entry;
+    *slot = entry;
+    entry->slot = slot;
+    entry->level = level;
+    levelCounts[level]++;
+}
+
+void TimerWheel::unlink(Entry *entry)
+{
+    if (!entry->slot)
+        return ;
+    if (entry->prev)
+        entry->prev->next = entry->next;
+    else
+        *entry->slot = entry->next;
+    if (entry->next)
+        entry->next->prev = entry->prev;
+    levelCounts[entry->level]--;
+    entry->prev = entry->next = nullptr;
+    entry->slot = nullptr;
+}
+
+/**
+ * 把上层当前格子里的任务重新分配到下层
+ */
+void TimerWheel::cascade(int level)
+{
+    int shift = ROOT_BITS + (level - 1) * LEVEL_BITS;
+    Entry** slot = &levels[level - 1][(currentTick >> shift) & (LEVEL_SIZE - 1)];
+    Entry* entry = *slot;
+    while (entry)
+    {
+        Entry* next = entry->next;
+        unlink(entry);
+        place(entry);
+        entry = next;
+    }
+}
+
+/**
+ * 下一次需要唤醒的刻度：第0层最近的任务，或上层最近一个有任务的格子需要下放的时刻
+ * 没有任何任务时返回 -1
+ */
+qint64 TimerWheel::nextWakeTick() const
+{
+    if (levelCounts[0])
+    {
+        for (int i = 0; i < ROOT_SIZE; i++)
+            if (root[(currentTick + i) & (ROOT_SIZE - 1)])
+                return currentTick + i;
+    }
+
+    qint64 best = -1;
+    for (int level = 1; level < LEVELS; level++)
+    {
+        if (!levelCounts[level])
+            continue;
+        int shift = ROOT_BITS + (level - 1) * LEVEL_BITS;
+        qint64 block = currentTick >> shift;
+        bool pending = (currentTick & ((1LL << shift) - 1)) == 0; // 当前格子还没下放
+        for (int j = pending ? 0 : 1; j <= LEVEL_SIZE; j++)
+        {
+            if (levels[level - 1][(block + j) & (LEVEL_SIZE - 1)])
+            {
+                qint64 tick = (block + j) << shift;
+                if (best < 0 || tick < best)
+                    best = tick;
+                break;
+            }
+        }
+    }
+    return best;
+}
+
+/**
+ * 处理到现在为止的所有刻度
+ * 同一刻度到期的任务一起执行；第0层为空时直接跳到下一次下放的边界
+ */
+void TimerWheel::advance()
+{
+    const qint64 now = nowTick();
+    while (currentTick <= now)
+    {
+        if ((currentTick & (ROOT_SIZE - 1)) == 0)
+        {
+            for (int level = LEVELS - 1; level >= 1; level--)
+            {
+                int shift = ROOT_BITS + (level - 1) * LEVEL_BITS;
+                if ((currentTick & ((1LL << shift) - 1)) == 0)
+                    cascade(level);
+            }
+        }
+
+        const qint64 tick = currentTick;
+        QList<TimerId> due;
+        Entry** slot = &root[tick & (ROOT_SIZE - 1)];
+        while (*slot)
+        {
+            due.append((*slot)->id);
+            unlink(*slot);
+        }
+        currentTick++;
+
+        foreach (TimerId id, due)
+        {
+            Entry* entry = entries.value(id);
+            if (!entry || entry->slot) // 被前面的任务取消了
+                continue;
+            if (entry->hasContext && !entry->context) // 对象已经销毁
+            {
+                cancel(id);
+                continue;
+            }
+
+            std::function<void()> func = entry->func; // 执行中可能取消自己
+            if (entry->interval > 0)
+            {
+                qint64 step = qMax(1, entry->interval / TICK_MS);
+                entry->due = tick + step;
+                if (entry->due <= nowTick()) // 落后太多时不追赶，从现在重新计时
+                    entry->due = nowTick() + step;
+                place(entry);
+            }
+            else
+            {
+                entries.remove(id);
+                delete entry;
+            }
+            func();
+        }
+
+        if (!levelCounts[0] && currentTick <= now)
+        {
+            qint64 boundary = ((currentTick + ROOT_SIZE - 1) >> ROOT_BITS) << ROOT_BITS;
+            currentTick = qMin(boundary, now + 1);
+        }
+    }
+}
+
+void TimerWheel::arm()
+{
+    qint64 tick = nextWakeTick();
+    if (tick < 0)
+    {
+        timer->stop();
+        armedTick = -1;
+        return ;
+    }
+
+    qint64 delay = qMax(0LL, tick * TICK_MS - clock.elapsed());
+    timer->setTimerType(delay > 1000 ? Qt::CoarseTimer : Qt::PreciseTimer);
+    timer->start(int(qMin(delay, qint64(INT_MAX))));
+    armedTick = tick;
+}
+
+WheelTimer::WheelTimer(QObject *parent) : QObject(parent)
+{
+}
+
+WheelTimer::WheelTimer(const QString &name, QObject *parent) : QObject(parent)
+{
+    setObjectName(name);
+}
+
+WheelTimer::~WheelTimer()
+{
+    stop();
+}
+
+/**
+ * 和 QTimer 一样，运行中修改间隔会重新开始计时
+ */
+void WheelTimer::setInterval(int msec)
+{
+    inter = msec;
+    if (isActive())
+        start();
+}
+
+int WheelTimer::interval() const
+{
+    return inter;
+}
+
+void WheelTimer::setSingleShot(bool singleShot)
+{
+    this->single = singleShot;
+}
+
+bool WheelTimer::isSingleShot() const
+{
+    return single;
+}
+
+bool WheelTimer::isActive() const
+{
+    return id && TimerWheel::instance()->isScheduled(id);
+}
+
+int WheelTimer::remainingTime() const
+{
+    return isActive() ? int(TimerWheel::instance()->remainingTime(id)) : -1;
+}
+
+void WheelTimer::start()
+{
+    stop();
+    id = TimerWheel::instance()->schedule(inter, single ? 0 : qMax(1, inter), this, objectName(), [=]{
+        emit timeout();
+    });
+}
+
+void WheelTimer::start(int msec)
+{
+    inter = msec;
+    start();
+}
+
+void WheelTimer::stop()
+{
+    if (id)
+        TimerWheel::instance()->cancel(id);
+    id = 0;
+}
@@ -0,0 +1,126 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <QObject>
+#include <QTimer>
+#include <QPointer>
+#include <QElapsedTimer>
+#include <QHash>
+#include <functional>
+
+/**
+ * 全局的分层时间轮
+ * 所有延时、定时的任务都挂在这里，只用一个 QTimer：
+ * 每次只在最近一个到期的时刻唤醒，同一刻度内到期的任务一起执行，没有任务时完全不唤醒。
+ *
+ * 刻度 10ms；第0层 256 格（2.56秒），往上每层 64 格（约2.7分钟、2.9小时、7.8天），
+ * 更远的任务放在最高层，到时再往下分配。添加、取消都是 O(1)。
+ */
+class TimerWheel : public QObject
+{
+    Q_OBJECT
+public:
+    typedef quint64 TimerId;
+
+    struct Info
+    {
+        TimerId id;
+        QString name;
+        qint64 remaining; // 毫秒
+        int interval; // 0 表示只执行一次
+    };
+
+    static TimerWheel* instance();
+
+    TimerId schedule(int delay, int interval, QObject* context, const QString& name, std::function<void()> func);
+    TimerId singleShot(int delay, QObject* context, std::function<void()> func, const QString& name = QString());
+    bool cancel(TimerId id);
+    bool isScheduled(TimerId id) const;
+    qint64 remainingTime(TimerId id) const;
+
+    QList<Info> scheduled() const;
+    QStringList describe() const;
+    qint64 getWakeupCount() const;
+
+    static const int TICK_MS = 10;
+
+private:
+    TimerWheel(QObject* parent = nullptr);
+    ~TimerWheel() override;
+
+    struct Entry
+    {
+        TimerId id = 0;
+        qint64 due = 0; // 刻度
+        int interval = 0; // 毫秒
+        bool hasContext = false;
+        QPointer<QObject> context;
+        QString name;
+        std::function<void()> func;
+        Entry* prev = nullptr;
+        Entry* next = nullptr;
+        Entry** slot = nullptr; // 所在的格子，不在轮上时为空
+        int level = 0;
+    };
+
+    qint64 nowTick() const;
+    void place(Entry* entry);
+    void unlink(Entry* entry);
+    void cascade(int level);
+    qint64 nextWakeTick() const;
+    void advance();
+    void arm();
+
+private:
+    static const int LEVELS = 4;
+    static const int ROOT_BITS = 8;
+    static const int LEVEL_BITS = 6;
+    static const int ROOT_SIZE = 1 << ROOT_BITS;
+    static const int LEVEL_SIZE = 1 << LEVEL_BITS;
+
+    Entry* root[ROOT_SIZE] = {};
+    Entry* levels[LEVELS - 1][LEVEL_SIZE] = {};
+    int levelCounts[LEVELS] = {};
+    qint64 currentTick = 0; // 下一个要处理的刻度，之前的都处理过了
+
+    QHash<TimerId, Entry*> entries;
+    TimerId nextId = 1;
+    QElapsedTimer clock;
+    QTimer* timer;
+    qint64 armedTick = -1;
+    qint64 wakeupCount = 0;
+};
+
+/**
+ * 和 QTimer 用法相同的定时器，由 TimerWheel 统一调度
+ */
+class WheelTimer : public QObject
+{
+    Q_OBJECT
+public:
+    WheelTimer(QObject* parent = nullptr);
+    WheelTimer(const QString& name, QObject* parent = nullptr);
+    ~WheelTimer() override;
+
+    void setInterval(int msec);
+    int interval() const;
+    void setSingleShot(bool singleShot);
+    bool isSingleShot() const;
+    bool isActive() const;
+    int remainingTime() const;
+
+public slots:
+    void start();
+    void start(int msec);
+    void stop();
+
+signals:
+    void timeout();
+
+private:
+    int inter = 0;
+    bool single = false;
+    TimerWheel::TimerId id = 0;
+};
+
+#endif // TIMERWHEEL_H
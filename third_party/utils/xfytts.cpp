@@ -9,9 +9,7 @@ XfyTTS::XfyTTS(QString dataPath, QString APPID, QString APIKey, QString APISecre
     : QObject(parent), APPID(APPID), APIKey(APIKey), APISecret(APISecret)
 {
     AUTH_DEB << APIKey << APISecret;
-    savedDir = dataPath + "audios/";
-    QDir dir(savedDir);
-    dir.mkpath(savedDir);
+    Q_UNUSED(dataPath) // 音频直接送到声卡，不再保存临时文件
 
     fmt.setSampleRate(16000);  //设定播放采样频率为44100Hz的音频文件
     fmt.setSampleSize(16);     //设定播放采样格式（采样位数）为16位(bit)的音频文件。QAudioFormat支持的有8/16bit，即将声音振幅化为256/64k个等级
@@ -19,23 +17,108 @@ XfyTTS::XfyTTS(QString dataPath, QString APPID, QString APIKey, QString APISecre
     fmt.setCodec("audio/pcm"); //播放PCM数据（裸流）得设置编码器为"audio/pcm"。"audio/pcm"在所有的平台都支持，也就相当于音频格式的WAV,以线性方式无压缩的记录捕捉到的数据。如想使用其他编码格式 ，可以通过QAudioDeviceInfo::supportedCodecs()来获取当前平台支持的编码格式
     fmt.setByteOrder(QAudioFormat::LittleEndian); //设定字节序，以小端模式播放音频文件
     fmt.setSampleType(QAudioFormat::UnSignedInt); //设定采样类型。根据采样位数来设定。采样位数为8或16位则设置为QAudioFormat::UnSignedInt
+
+    // 一直使用同一个输出，收到多少播多少
+    pcmBuffer = new PcmRingBuffer(64 * 1024, this);
+    audio = new QAudioOutput(fmt, this);
+//    audio->setVolume(volume / 100.0); // 设置音量没有效果，1正常，0静音，但是0.x会呲呲呲的响
+    connect(audio, &QAudioOutput::stateChanged, this, [=](QAudio::State state) {
+        if (state != QAudio::IdleState || pcmBuffer->bytesAvailable())
+            return ;
+        // 缓冲区读空了：可能是播放完毕，也可能是网络跟不上，等攒够了数据再开始
+        audio->stop();
+        if (!isSpeaking())
+            emit signalSpeakFinished();
+    });
+
+    idleTimer.setSingleShot(true);
+    idleTimer.setInterval(XFY_TTS_IDLE_CLOSE);
+    connect(&idleTimer, &QTimer::timeout, this, [=]{
+        if (socket && speakingText.isEmpty())
+            socket->close();
+    });
 }
 
+/**
+ * 加入朗读队列
+ * 上一句还在播放时就开始合成下一句，合成的音频接在后面
+ */
 void XfyTTS::speakText(QString text)
 {
-    if (socket) // 表示正在连接
+    speakQueue.append(text);
+    speakNext();
+}
+
+/**
+ * 预先合成并保存到缓存，不播放
+ * 只在没有要朗读的句子时才合成
+ */
+void XfyTTS::prepareText(QString text)
+{
+    if (!speechCache || prepareQueue.contains(text) || speechCache->contains(cacheKey(text)))
         return ;
+    prepareQueue.append(text);
+    speakNext();
+}
 
-    speakQueue.append(text);
+/**
+ * 提前签名并建立连接，之后的第一句不用再等 TLS 握手
+ * 例如收到礼物、准备答谢时调用；一直没有句子要合成的话，空闲后自动断开
+ */
+void XfyTTS::preconnect()
+{
+    if (socket)
+        return ;
     startConnect();
 }
 
 void XfyTTS::speakNext()
 {
-    if (socket || !speakQueue.size()) // 表示正在连接
+    if (!speakingText.isEmpty()) // 同一个连接一次只合成一句
         return ;
 
-    startConnect();
+    // 队首已经缓存的句子直接播放，顺序不变
+    while (speakQueue.size() && speechCache)
+    {
+        QByteArray pcm = speechCache->getPcm(cacheKey(speakQueue.first()));
+        if (pcm.isEmpty())
+            break;
+        emit signalSpeakStarted(speakQueue.takeFirst());
+        playAudio(pcm, true);
+    }
+
+    bool prepare = speakQueue.isEmpty();
+    if (prepare)
+    {
+        while (prepareQueue.size() && speechCache->contains(cacheKey(prepareQueue.first())))
+            prepareQueue.removeFirst();
+        if (prepareQueue.isEmpty())
+            return ;
+    }
+
+    if (!socketConnected)
+    {
+        startConnect();
+        return ;
+    }
+
+    idleTimer.stop();
+    speakingPrepare = prepare;
+    if (prepare)
+    {
+        sendText(prepareQueue.takeFirst());
+    }
+    else
+    {
+        sendText(speakQueue.first());
+        emit signalSpeakStarted(speakQueue.takeFirst());
+    }
+}
+
+bool XfyTTS::isSpeaking() const
+{
+    return (!speakingText.isEmpty() && !speakingPrepare) || speakQueue.size()
+            || pcmBuffer->bytesAvailable() || audio->state() == QAudio::ActiveState;
 }
 
 void XfyTTS::startConnect()
@@ -49,21 +132,34 @@ void XfyTTS::startConnect()
         return ;
 
     socket = new QWebSocket();
-    QByteArray* receivedBytes = new QByteArray;
     connect(socket, &QWebSocket::connected, this, [=]{
         AUTH_DEB << "tts connected";
-        if (!speakQueue.size())
-        {
-            socket->close();
-            return ;
-        }
-
-        sendText(speakQueue.takeFirst());
+        socketConnected = true;
+        speakNext();
+        if (speakingText.isEmpty())
+            idleTimer.start();
     });
     connect(socket, &QWebSocket::disconnected, this, [=]{
         AUTH_DEB << "tts disconnected" << socket->closeCode() << socket->closeReason();
+        bool wasConnected = socketConnected;
+        socketConnected = false;
+        idleTimer.stop();
         socket->deleteLater();
         socket = nullptr;
+
+        if (!speakingText.isEmpty())
+        {
+            qWarning() << "语音合成中断：" << speakingText;
+            speakingText.clear();
+            speakingPcm.clear(); // 不完整，不缓存
+            if (!speakingPrepare)
+                playAudio(QByteArray(), true); // 已经收到的部分照常播放
+        }
+
+        // 服务端合成一句后可能会主动断开，还有待合成的就立即重连
+        // 没连上过的（鉴权失败、网络错误）不重连，等下一句再试
+        if (wasConnected)
+            speakNext();
     });
     connect(socket, &QWebSocket::stateChanged, this, [=](QAbstractSocket::SocketState state){
         AUTH_DEB << "tts stateChanged" << state;
@@ -73,6 +169,9 @@ void XfyTTS::startConnect()
     });
     connect(socket, &QWebSocket::textFrameReceived, this, [=](const QString &frame, bool isLastFrame){
         AUTH_DEB << "textFrameReceived" << frame.size() << isLastFrame;
+        if (speakingText.isEmpty()) // 已经放弃的句子
+            return ;
+
         QJsonParseError error;
         QJsonDocument document = QJsonDocument::fromJson(frame.toUtf8(), &error);
         if (error.error != QJsonParseError::NoError)
@@ -84,20 +183,25 @@ void XfyTTS::startConnect()
         if (json.value("code").toInt() != 0)
         {
             qWarning() << "TextMessage 返回 code 不为0：" << frame.left(1000);
+            finishText();
             return ;
         }
         QJsonObject data= json.value("data").toObject();
         int status = data.value("status").toInt();
-        QString audio = data.value("audio").toString();
+        QString audioBase64 = data.value("audio").toString();
 
-        QByteArray ba = QByteArray::fromBase64(audio.toUtf8());
-//        qDebug() << "~~~~~~~~~~" << ba.length() << ba.left(200).toHex();
-        receivedBytes->append(ba);
+        // 每一帧收到就送去播放，不等整句合成完
+        QByteArray pcm = QByteArray::fromBase64(audioBase64.toUtf8());
+        if (speechCache)
+            speakingPcm.append(pcm);
+        if (!speakingPrepare)
+            playAudio(pcm, status == 2);
 
         if (status == 2) // 结束了
         {
-            generalAudio(receivedBytes);
-            socket->close();
+            if (speechCache)
+                speechCache->insertPcm(cacheKey(speakingText), speakingPcm);
+            finishText();
         }
     });
 
@@ -107,9 +211,7 @@ void XfyTTS::startConnect()
     });
 
     // 开始连接
-    QString url = hostUrl + "?authorization=" + getAuthorization().toLocal8Bit().toPercentEncoding()
-            + "&date=" + getDate().toLocal8Bit().toPercentEncoding().replace("%20", "+")
-            + "&host=ws-api.xfyun.cn";
+    QString url = getAuthUrl();
     AUTH_DEB << "wss:" << url;
 
     // 设置安全套接字连接模式（不知道有啥用）
@@ -121,18 +223,36 @@ void XfyTTS::startConnect()
     socket->open(url);
 }
 
-QString XfyTTS::getAuthorization() const
+/**
+ * 带鉴权参数的连接地址
+ * 签名里的日期有效期是5分钟，短时间内连续连接时复用，不用每句都重新签名
+ */
+QString XfyTTS::getAuthUrl()
+{
+    qint64 timestamp = QDateTime::currentMSecsSinceEpoch();
+    if (!authUrl.isEmpty() && timestamp - authTime < XFY_TTS_AUTH_REUSE)
+        return authUrl;
+
+    QString date = getDate();
+    authUrl = hostUrl + "?authorization=" + getAuthorization(date).toLocal8Bit().toPercentEncoding()
+            + "&date=" + date.toLocal8Bit().toPercentEncoding().replace("%20", "+")
+            + "&host=ws-api.xfyun.cn";
+    authTime = timestamp;
+    return authUrl;
+}
+
+QString XfyTTS::getAuthorization(const QString &date) const
 {
     QString auth = QString("api_key=\"%1\", algorithm=\"hmac-sha256\", headers=\"host date request-line\", signature=\"%2\"")
-            .arg(APIKey).arg(getSignature());
+            .arg(APIKey).arg(getSignature(date));
     AUTH_DEB << "authorization:" << auth;
     AUTH_DEB << "authorization.base64:" << auth.toLocal8Bit().toBase64();
     return auth.toLocal8Bit().toBase64();
 }
 
-QString XfyTTS::getSignature() const
+QString XfyTTS::getSignature(const QString &date) const
 {
-    QString sign = QString("host: ws-api.xfyun.cn\ndate: %1\nGET /v2/tts HTTP/1.1").arg(getDate());
+    QString sign = QString("host: ws-api.xfyun.cn\ndate: %1\nGET /v2/tts HTTP/1.1").arg(date);
     AUTH_DEB << "signature:" << sign;
     QByteArray sign_sha256 = QMessageAuthenticationCode::hash(sign.toLocal8Bit(), APISecret.toLocal8Bit(), QCryptographicHash::Sha256);
     AUTH_DEB << "signature.sha256:" << sign_sha256.toHex();
@@ -170,48 +290,66 @@ void XfyTTS::sendText(QString text)
                             "}").arg(APPID).arg("raw").arg(vcn).arg(pitch).arg(speed)
             .arg(QString::fromUtf8(text.toUtf8().toBase64()));
     AUTH_DEB << param;
+    speakingText = text;
+    speakingPcm.clear();
     socket->sendTextMessage(param);
 }
 
-void XfyTTS::generalAudio(QByteArray* ba)
+/**
+ * 一句合成完毕，继续下一句
+ */
+void XfyTTS::finishText()
 {
-    QString filePath = savedDir + QString::number(QDateTime::currentMSecsSinceEpoch()) + ".pcm";
-    AUTH_DEB << "saveFile:" << filePath;
+    speakingText.clear();
+    speakingPcm.clear();
+    speakNext();
+    if (speakingText.isEmpty() && socket)
+        idleTimer.start();
+}
 
-    QFile file(filePath);
-    file.open(QFile::WriteOnly);
-    QDataStream stream(&file);
-    stream << *ba;
-    ba->clear();
-    delete ba;
-    file.flush();
-    file.close();
+/**
+ * 把PCM追加到缓冲区
+ * 输出停止时，攒够一小段（或者这一句已经结束）就开始播放
+ */
+void XfyTTS::playAudio(const QByteArray &pcm, bool force)
+{
+    if (!pcm.isEmpty())
+        pcmBuffer->append(pcm);
 
-    emit signalTTSPrepared(filePath);
-    playFile(filePath, true);
+    if (audio->state() != QAudio::StoppedState)
+        return ;
+    qint64 available = pcmBuffer->bytesAvailable();
+    if (available >= XFY_TTS_PREBUFFER_BYTES || (force && available > 0))
+        audio->start(pcmBuffer);
 }
 
+/**
+ * 播放本地的PCM文件，和合成的语音排在同一个缓冲区
+ */
 void XfyTTS::playFile(QString filePath, bool deleteAfterPlay)
 {
-    QFile *inputFile = new QFile(filePath);
-    inputFile->open(QIODevice::ReadOnly);
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        qWarning() << "无法读取音频文件：" << filePath;
+        return ;
+    }
+    QByteArray pcm = file.readAll();
+    file.close();
+    if (deleteAfterPlay)
+        file.remove();
 
-    QAudioOutput *audio = new QAudioOutput(fmt);
-//    audio->setVolume(volume / 100.0); // 设置音量没有效果，1正常，0静音，但是0.x会呲呲呲的响
-    connect(audio, &QAudioOutput::stateChanged, this, [=](QAudio::State state) {
-        if (state == QAudio::IdleState)
-        {
-            audio->stop();
-            audio->deleteLater();
-            inputFile->close();
-            if (deleteAfterPlay)
-                inputFile->remove();
-            inputFile->deleteLater();
+    playAudio(pcm, true);
+}
 
-            speakNext();
-        }
-    });
-    audio->start(inputFile);
+QString XfyTTS::cacheKey(const QString &text) const
+{
+    return SpeechCache::keyOf(text, "xfy", vcn, pitch, speed, volume);
+}
+
+void XfyTTS::setSpeechCache(SpeechCache *cache)
+{
+    this->speechCache = cache;
 }
 
 void XfyTTS::setAppId(QString s)
@@ -222,11 +360,13 @@ void XfyTTS::setAppId(QString s)
 void XfyTTS::setApiKey(QString s)
 {
     this->APIKey = s.trimmed();
+    authUrl.clear();
 }
 
 void XfyTTS::setApiSecret(QString s)
 {
     this->APISecret = s.trimmed();
+    authUrl.clear();
 }
 
 void XfyTTS::setName(QString name)
@@ -248,3 +388,12 @@ void XfyTTS::setVolume(int volume)
 {
     this->volume = volume;
 }
+
+/**
+ * 修改服务地址，例如本地模拟的合成服务
+ */
+void XfyTTS::setHostUrl(QString url)
+{
+    this->hostUrl = url;
+    authUrl.clear();
+}
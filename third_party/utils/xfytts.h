@@ -8,8 +8,14 @@
 #include <QtConcurrent/QtConcurrent>
 #include <QAudioFormat>
 #include <QAudioOutput>
+#include <QTimer>
+#include "pcmringbuffer.h"
+#include "speechcache.h"
 
 #define AUTH_DEB if (0) qDebug()
+#define XFY_TTS_PREBUFFER_BYTES 3200 // 开始播放前至少缓冲100毫秒（16k * 16bit），避免刚开始就断断续续
+#define XFY_TTS_AUTH_REUSE 60000 // 鉴权URL中的日期5分钟内有效，1分钟内重复使用
+#define XFY_TTS_IDLE_CLOSE 10000 // 空闲一段时间后主动断开
 
 class XfyTTS : public QObject
 {
@@ -18,8 +24,11 @@ public:
     XfyTTS(QString dataPath, QString APPID, QString APIKey, QString APISecret, QObject* parent = nullptr);
 
     void speakText(QString text);
+    void prepareText(QString text);
+    void preconnect();
     void speakNext();
     void playFile(QString filePath, bool deleteAfterPlay = false);
+    bool isSpeaking() const;
 
     void setAppId(QString s);
     void setApiKey(QString s);
@@ -29,27 +38,38 @@ public:
     void setPitch(int pitch);
     void setSpeed(int speed);
     void setVolume(int volume);
+    void setHostUrl(QString url);
+    void setSpeechCache(SpeechCache* cache);
+
+    friend class SelfTest; // 检查连接、队列和缓冲区的状态
 
 private:
     void startConnect();
-    QString getAuthorization() const;
-    QString getSignature() const;
+    QString getAuthUrl();
+    QString getAuthorization(const QString& date) const;
+    QString getSignature(const QString& date) const;
     QString getDate() const;
 
+    QString cacheKey(const QString& text) const;
     void sendText(QString text);
-    void generalAudio(QByteArray* ba);
+    void finishText();
+    void playAudio(const QByteArray& pcm, bool force);
 
 signals:
-    void signalTTSPrepared(QString filePath);
+    void signalSpeakStarted(QString text);
+    void signalSpeakFinished();
 
 private:
     QString APPID;
     QString APIKey;
     QString APISecret;
 
-    QString savedDir;
     QWebSocket* socket = nullptr;
+    bool socketConnected = false;
     QString hostUrl = "wss://tts-api.xfyun.cn/v2/tts";
+    QString authUrl; // 缓存的鉴权URL
+    qint64 authTime = 0;
+    QTimer idleTimer;
 
     QString vcn = "xiaoyan"; // 发音人
     int pitch = 50;  // 音调
@@ -58,6 +78,13 @@ private:
 
     QAudioFormat fmt;
     QStringList speakQueue;
+    QStringList prepareQueue; // 预先合成、只保存不播放的文本
+    QString speakingText; // 正在合成的文本，同一时间只合成一句
+    bool speakingPrepare = false; // 正在合成的是不是预先合成的
+    QByteArray speakingPcm; // 这一句已经收到的音频，结束后存入缓存
+    SpeechCache* speechCache = nullptr;
+    QAudioOutput* audio = nullptr; // 一直存在，所有句子共用
+    PcmRingBuffer* pcmBuffer = nullptr;
 };
 
 #endif // XFYTTS_H
@@ -16,6 +16,7 @@
 #include <QMenu>
 #include <QAction>
 #include <QDesktopServices>
+#include <QSharedPointer>
 #include "catchyouwidget.h"
 #include "ui_catchyouwidget.h"
 #include "livevideoplayer.h"
@@ -28,7 +29,18 @@ CatchYouWidget::CatchYouWidget(QSettings *settings, QString dataPath, QWidget *p
     ui->setupUi(this);
     userId = settings->value("paosao/userId").toString();
     ui->tableWidget->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
+
+    // catch/apiBase 可指向本地模拟的接口
+    crawler = new CrawlScheduler(this);
+    crawler->setApiBase(settings->value("catch/apiBase").toString());
+    connect(crawler, &CrawlScheduler::signalIdle, this, [=](qint64 taskTs){
+        if (taskTs == currentTaskTs)
+            qDebug() << "抓取结束，关注：" << users.size() << "找到：" << inRooms.size();
+    });
     ui->cdSpin->setValue(settings->value("catch/cd", 150).toInt());
+    ui->concurrencySpin->setValue(settings->value("catch/concurrency", 4).toInt());
+    crawler->setInterval(ui->cdSpin->value());
+    crawler->setConcurrency(ui->concurrencySpin->value());
 }
 
 CatchYouWidget::~CatchYouWidget()
@@ -39,15 +51,12 @@ CatchYouWidget::~CatchYouWidget()
 void CatchYouWidget::catchUser(QString userId)
 {
     this->userId = userId;
-    inRooms.clear();
-    ui->tableWidget->setRowCount(0);
+    clearResults();
 
     if (userId.isEmpty())
         return ;
 
-    currentTaskTs = QDateTime::currentMSecsSinceEpoch();
-
-    getUserFollows(currentTaskTs, userId);
+    getUserFollows(startTask(), userId);
 }
 
 void CatchYouWidget::setDefaultUser(QString userId)
@@ -69,14 +78,13 @@ void CatchYouWidget::on_userButton_clicked()
 
 void CatchYouWidget::on_refreshButton_clicked()
 {
-    inRooms.clear();
-    ui->tableWidget->setRowCount(0);
+    clearResults();
 
     if (!userId.isEmpty())
     {
         if (users.size()) // 已经找过了，刷新一遍
         {
-            detectUserLiveStatus(currentTaskTs = QDateTime::currentMSecsSinceEpoch(), 0);
+            detectUsersLiveStatus(startTask(), 0, users.size());
         }
         else
         {
@@ -85,68 +93,157 @@ void CatchYouWidget::on_refreshButton_clicked()
     }
 }
 
-void CatchYouWidget::getUserFollows(qint64 taskTs, QString userId, int page)
+/**
+ * 开始新的任务，之前的请求全部作废
+ */
+qint64 CatchYouWidget::startTask()
 {
-    if (currentTaskTs != taskTs)
-        return ;
-    const int pageSize = 50;
-    if (page == 1)
-        users.clear();
+    currentTaskTs = QDateTime::currentMSecsSinceEpoch();
+    crawler->setCookies(userCookies);
+    crawler->setTask(currentTaskTs);
 
-    get("http://api.bilibili.com/x/relation/followings?vmid=" + userId + "&ps=50&pn=" + QString::number(page), [=](QJsonObject json){
-        if (currentTaskTs != taskTs)
-            return ;
+    // 清理过期的扫描结果
+    qint64 now = QDateTime::currentSecsSinceEpoch();
+    for (auto it = roomCache.begin(); it != roomCache.end(); )
+    {
+        if (now - it.value().scanTime >= CATCH_CACHE_SECOND)
+            it = roomCache.erase(it);
+        else
+            ++it;
+    }
+    return currentTaskTs;
+}
 
-        QJsonObject data = json.value("data").toObject();
-        int total = data.value("total").toInt();
-        QJsonArray list = data.value("list").toArray();
+void CatchYouWidget::clearResults()
+{
+    inRooms.clear();
+    ui->tableWidget->setRowCount(0);
+    ui->progressBar->setRange(0, 0);
+    ui->progressBar->setValue(0);
+}
+
+/**
+ * 读取关注列表
+ * 第一页得到总数后，剩下的页一起加入队列；每一页到了就立即批量检测这一页的直播状态
+ */
+void CatchYouWidget::getUserFollows(qint64 taskTs, QString userId)
+{
+    users.clear();
+    auto pageUrl = [=](int page) {
+        return "http://api.bilibili.com/x/relation/followings?vmid=" + userId + "&ps=50&pn=" + QString::number(page);
+    };
 
-        foreach (QJsonValue val, list)
+    crawler->get(taskTs, pageUrl(1), [=](bool ok, QJsonObject json){
+        if (!ok || json.value("code").toInt() != 0)
         {
-            QJsonObject obj = val.toObject();
-            qint64 mid = qint64(obj.value("mid").toDouble());
-            QString uname = obj.value("uname").toString();
-            users.append(UserInfo(QString::number(mid), uname));
+            qCritical() << "获取关注列表失败：" << json.value("message").toString() << userId;
+            return ;
         }
 
-        ui->progressBar->setRange(0, total);
-        ui->progressBar->setValue(pageSize * (page - 1) + list.size());
-        if (pageSize * page < total && page < 5) // 继续下一页
+        int total = json.value("data").toObject().value("total").toInt();
+        int pages = qMin((total + 49) / 50, CATCH_FOLLOW_MAX_PAGE);
+        qDebug() << "关注总数：" << total << "读取页数：" << pages;
+        addFollowPage(taskTs, json);
+
+        for (int page = 2; page <= pages; page++)
         {
-            QTimer::singleShot(ui->cdSpin->value(), [=]{
-                getUserFollows(taskTs, userId, page + 1);
+            crawler->get(taskTs, pageUrl(page), [=](bool ok, QJsonObject json){
+                if (!ok || json.value("code").toInt() != 0)
+                {
+                    qCritical() << "获取关注列表失败：" << json.value("message").toString() << userId << page;
+                    return ;
+                }
+                addFollowPage(taskTs, json);
             });
         }
-        else // 结束了
-        {
-            qDebug() << "关注总数：" << total << "可见总数：" << users.size();
-            ui->progressBar->setRange(0, users.size() - 1);
-            ui->progressBar->setValue(0);
-            detectUserLiveStatus(taskTs, 0);
-        }
     });
 }
 
-void CatchYouWidget::detectUserLiveStatus(qint64 taskTs, int index)
+void CatchYouWidget::addFollowPage(qint64 taskTs, const QJsonObject &json)
 {
-    if (currentTaskTs != taskTs || index >= users.size())
-        return ;
+    int from = users.size();
+    QJsonArray list = json.value("data").toObject().value("list").toArray();
+    foreach (QJsonValue val, list)
+    {
+        QJsonObject obj = val.toObject();
+        qint64 mid = qint64(obj.value("mid").toDouble());
+        QString uname = obj.value("uname").toString();
+        users.append(UserInfo(QString::number(mid), uname));
+    }
 
-    UserInfo user = users.at(index);
-    if (user.liveStatus < 0) // 没有直播间或没有开播
+    detectUsersLiveStatus(taskTs, from, users.size());
+}
+
+/**
+ * 批量检测直播状态，每次最多 CATCH_STATUS_BATCH 人
+ * 批量接口失败时退回到逐个检测
+ */
+void CatchYouWidget::detectUsersLiveStatus(qint64 taskTs, int from, int to)
+{
+    for (int start = from; start < to; start += CATCH_STATUS_BATCH)
     {
-        // 直接下一个
-        ui->progressBar->setValue(index);
-        detectUserLiveStatus(taskTs, index + 1);
-        return ;
+        QList<int> indexes;
+        QStringList params;
+        for (int i = start; i < qMin(to, start + CATCH_STATUS_BATCH); i++)
+        {
+            if (users.at(i).liveStatus < 0) // 没有直播间
+                continue;
+            indexes.append(i);
+            params.append("uids[]=" + users.at(i).userId);
+        }
+        if (indexes.isEmpty())
+            continue;
+
+        addProgress(indexes.size(), 0);
+        QString url = "https://api.live.bilibili.com/room/v1/Room/get_status_info_by_uids?" + params.join("&");
+        crawler->get(taskTs, url, [=](bool ok, QJsonObject json){
+            if (!ok || json.value("code").toInt() != 0)
+            {
+                qWarning() << "批量检测直播状态失败，改为逐个检测：" << json.value("message").toString();
+                foreach (int index, indexes)
+                    detectUserLiveStatus(taskTs, index);
+                return ;
+            }
+
+            // 没有直播间的用户不在结果里
+            QJsonObject data = json.value("data").toObject();
+            foreach (int index, indexes)
+            {
+                UserInfo& user = users[index];
+                QJsonObject info = data.value(user.userId).toObject();
+                if (info.isEmpty())
+                {
+                    user.liveStatus = -1;
+                    continue;
+                }
+                if (info.value("live_status").toInt() != 1)
+                {
+                    user.liveStatus = 0;
+                    continue;
+                }
+
+                user.liveStatus = 1;
+                RoomInfo room;
+                room.roomId = qint64(info.value("room_id").toDouble());
+                room.roomName = info.value("title").toString();
+                room.upUid = user.userId.toLongLong();
+                room.upName = info.value("uname").toString();
+                if (room.upName.isEmpty())
+                    room.upName = user.userName;
+                scanRoom(taskTs, room);
+            }
+            addProgress(0, indexes.size());
+        });
     }
+}
 
+void CatchYouWidget::detectUserLiveStatus(qint64 taskTs, int index)
+{
+    UserInfo user = users.at(index);
     QString url = "http://api.live.bilibili.com/room/v1/Room/getRoomInfoOld?mid=" + user.userId;
-    get(url, [=](QJsonObject json) {
-        if (currentTaskTs != taskTs)
-            return ;
-
-        if (json.value("code").toInt() != 0)
+    crawler->get(taskTs, url, [=](bool ok, QJsonObject json) {
+        addProgress(0, 1);
+        if (!ok || json.value("code").toInt() != 0)
         {
             qCritical() << "检测直播状态失败：" << json.value("message").toString() << user.userId << user.userName;
             return ;
@@ -154,55 +251,82 @@ void CatchYouWidget::detectUserLiveStatus(qint64 taskTs, int index)
 
         QJsonObject data = json.value("data").toObject();
         int roomStatus = data.value("roomStatus").toInt(); // 1
-        int roundStatus = data.value("roundStatus").toInt(); // 1
         int liveStatus = data.value("liveStatus").toInt(); // 1
         if (roomStatus && liveStatus) // 直播中，需要检测
         {
-            QString roomId = QString::number(qint64(data.value("roomid").toDouble()));
-
-            // 先检测弹幕
-            detectRoomDanmaku(taskTs, user.userId, roomId);
+            users[index].liveStatus = 1;
+            RoomInfo room;
+            room.roomId = qint64(data.value("roomid").toDouble());
+            room.roomName = data.value("title").toString();
+            room.upUid = user.userId.toLongLong();
+            room.upName = user.userName;
+            scanRoom(taskTs, room);
         }
         else
         {
-            UserInfo u = user;
-            u.liveStatus = -1;
-            users[index] = u;
+            users[index].liveStatus = roomStatus ? 0 : -1;
         }
-
-        // 检测下一个
-        ui->progressBar->setValue(index);
-        QTimer::singleShot(ui->cdSpin->value(), [=]{
-            detectUserLiveStatus(taskTs, index + 1);
-        });
     });
 }
 
-void CatchYouWidget::detectRoomDanmaku(qint64 taskTs, QString upUid, QString roomId)
+/**
+ * 扫描直播间的最近弹幕和高能榜，两个请求同时进行
+ * 结果按房间缓存 CATCH_CACHE_SECOND 秒，期间重复搜索同一个用户直接使用
+ */
+void CatchYouWidget::scanRoom(qint64 taskTs, RoomInfo room)
 {
-    get("https://api.live.bilibili.com/ajax/msg?roomid=" + roomId, [=](QJsonObject json) {
-        if (currentTaskTs != taskTs)
+    qint64 targetUid = this->userId.toLongLong();
+    qint64 now = QDateTime::currentSecsSinceEpoch();
+    if (roomCache.contains(room.roomId))
+    {
+        const RoomScan& cached = roomCache[room.roomId];
+        if (cached.targetUid == targetUid && now - cached.scanTime < CATCH_CACHE_SECOND)
+        {
+            if (cached.found)
+                addInRoom(cached.room);
             return ;
-        if (json.value("code").toInt() != 0)
+        }
+    }
+
+    addProgress(1, 0);
+    QSharedPointer<RoomScan> scan(new RoomScan);
+    scan->scanTime = now;
+    scan->targetUid = targetUid;
+    scan->room = room;
+    QSharedPointer<int> remaining(new int(2));
+    QSharedPointer<bool> failed(new bool(false));
+    auto finished = [=]{
+        if (--(*remaining) > 0)
+            return ;
+        addProgress(0, 1);
+        scan->found = scan->room.time || scan->room.gold100;
+        if (!*failed)
+            roomCache.insert(scan->room.roomId, *scan);
+        if (scan->found)
+            addInRoom(scan->room);
+    };
+
+    QString roomId = QString::number(room.roomId);
+    QString upUid = QString::number(room.upUid);
+    crawler->get(taskTs, "https://api.live.bilibili.com/ajax/msg?roomid=" + roomId, [=](bool ok, QJsonObject json) {
+        if (!ok || json.value("code").toInt() != 0)
         {
             qCritical() << "检测房间弹幕失败" << json.value("message").toString() << roomId;
+            *failed = true;
+            finished();
             return ;
         }
 
         QJsonObject data = json.value("data").toObject();
-
-        qint64 uid = this->userId.toLongLong();
-        qint64 time = 0;
-        QStringList texts;
         auto each = [&](QJsonObject danmaku) {
-            if (qint64(danmaku.value("uid").toDouble()) == uid)
+            if (qint64(danmaku.value("uid").toDouble()) == targetUid)
             {
                 // 是这个用户的
                 qint64 t = QDateTime::fromString(danmaku.value("timeline").toString(), "yyyy-MM-dd hh:mm:ss").toSecsSinceEpoch();
-                if (t > time)
-                    time = t;
+                if (t > scan->room.time)
+                    scan->room.time = t;
                 QString text = danmaku.value("text").toString();
-                texts.append(text);
+                scan->room.danmakus.append(text);
                 qDebug() << "检测到弹幕：" << roomId << text << t;
             }
         };
@@ -214,89 +338,36 @@ void CatchYouWidget::detectRoomDanmaku(qint64 taskTs, QString upUid, QString roo
         {
             each(val.toObject());
         }
+        finished();
+    }, true);
 
-        if (time) // 有弹幕
-        {
-            detectRoomGift(taskTs, upUid, roomId,  time, texts);
-        }
-        else // 没有弹幕，检测送礼榜
-        {
-            detectRoomGift(taskTs, upUid, roomId);
-        }
-    });
-}
-
-void CatchYouWidget::detectRoomGift(qint64 taskTs, QString upUid, QString roomId, qint64 second, QStringList texts)
-{
-    get("https://api.live.bilibili.com/xlive/general-interface/v1/rank/getOnlineGoldRank?ruid="+upUid+"&roomId="+roomId+"&page=1&pageSize=50", [=](QJsonObject json){
-        int gold100 = 0;
+    crawler->get(taskTs, "https://api.live.bilibili.com/xlive/general-interface/v1/rank/getOnlineGoldRank?ruid="+upUid+"&roomId="+roomId+"&page=1&pageSize=50", [=](bool ok, QJsonObject json){
+        if (!ok)
+            *failed = true;
         QJsonArray array = json.value("data").toObject().value("OnlineRankItem").toArray();
-        qint64 uid = this->userId.toLongLong();
         foreach (QJsonValue val, array)
         {
             QJsonObject item = val.toObject();
-            if (qint64(item.value("uid").toDouble()) == uid)
+            if (qint64(item.value("uid").toDouble()) == targetUid)
             {
-                gold100 = item.value("score").toInt();
+                scan->room.gold100 = item.value("score").toInt();
                 break;
             }
         }
-
-        addInRoom(taskTs, upUid, roomId, second, texts, gold100);
-    });
+        finished();
+    }, true);
 }
 
-void CatchYouWidget::addInRoom(qint64 taskTs, QString upUid, QString roomId, qint64 second, QStringList texts, int gold100)
+void CatchYouWidget::addProgress(int total, int finished)
 {
-    get("https://api.live.bilibili.com/xlive/web-room/v1/index/getInfoByRoom?room_id=" + roomId, [=](QJsonObject json){
-        if (currentTaskTs != taskTs)
-            return ;
-
-        if (json.value("code").toInt() != 0)
-        {
-            qCritical() << "获取房间信息失败" << json.value("message").toString() << roomId;
-            return ;
-        }
-        QJsonObject dataObj = json.value("data").toObject();
-        QJsonObject roomInfo = dataObj.value("room_info").toObject();
-        QJsonObject anchorInfo = dataObj.value("anchor_info").toObject();
-
-        qint64 roomId = roomInfo.value("room_id").toInt();
-        QString roomTitle = roomInfo.value("title").toString();
-        qint64 upUid = static_cast<qint64>(roomInfo.value("uid").toDouble());
-        QString upName = anchorInfo.value("base_info").toObject().value("uname").toString();
-
-        RoomInfo room;
-        room.roomId = roomId;
-        room.roomName = roomTitle;
-        room.upUid = upUid;
-        room.upName = upName;
-        room.time = second;
-        room.danmakus = texts;
-        room.gold100 = gold100;
-        inRooms.append(room);
-
-        addToTable(room);
-    });
+    ui->progressBar->setMaximum(ui->progressBar->maximum() + total);
+    ui->progressBar->setValue(ui->progressBar->value() + finished);
 }
 
-void CatchYouWidget::detectRoomGift(qint64 taskTs, QString upUid, QString roomId)
+void CatchYouWidget::addInRoom(CatchYouWidget::RoomInfo room)
 {
-    get("https://api.live.bilibili.com/xlive/general-interface/v1/rank/getOnlineGoldRank?ruid="+upUid+"&roomId="+roomId+"&page=1&pageSize=50", [=](QJsonObject json){
-        QJsonArray array = json.value("data").toObject().value("OnlineRankItem").toArray();
-        qint64 uid = this->userId.toLongLong();
-        foreach (QJsonValue val, array)
-        {
-            QJsonObject item = val.toObject();
-            if (qint64(item.value("uid").toDouble()) == uid)
-            {
-                int gold100 = item.value("score").toInt();
-                RoomInfo room;
-                addInRoom(taskTs, upUid, roomId, 0, QStringList{}, gold100);
-                break;
-            }
-        }
-    });
+    inRooms.append(room);
+    addToTable(room);
 }
 
 void CatchYouWidget::addToTable(CatchYouWidget::RoomInfo room)
@@ -324,31 +395,6 @@ void CatchYouWidget::openRoomVideo(QString roomId)
     player->show();
 }
 
-void CatchYouWidget::get(QString url, std::function<void(QJsonObject)> const func)
-{
-    QNetworkAccessManager* manager = new QNetworkAccessManager;
-    QNetworkRequest* request = new QNetworkRequest(url);
-    request->setHeader(QNetworkRequest::ContentTypeHeader, "application/x-www-form-urlencoded; charset=UTF-8");
-    request->setHeader(QNetworkRequest::UserAgentHeader, "Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/86.0.4240.111 Safari/537.36");
-    if (url.contains("bilibili.com"))
-        request->setHeader(QNetworkRequest::CookieHeader, userCookies);
-    connect(manager, &QNetworkAccessManager::finished, this, [=](QNetworkReply* reply){
-        QJsonParseError error;
-        QJsonDocument document = QJsonDocument::fromJson(reply->readAll(), &error);
-        if (error.error != QJsonParseError::NoError)
-        {
-            qDebug() << error.errorString() << url;
-            return ;
-        }
-        func(document.object());
-
-        manager->deleteLater();
-        delete request;
-        reply->deleteLater();
-    });
-    manager->get(*request);
-}
-
 void CatchYouWidget::closeEvent(QCloseEvent *event)
 {
     settings->setValue("catch/geometry", this->saveGeometry());
@@ -401,4 +447,11 @@ void CatchYouWidget::on_tableWidget_customContextMenuRequested(const QPoint &)
 void CatchYouWidget::on_cdSpin_valueChanged(int arg1)
 {
     settings->setValue("catch/cd", arg1);
+    crawler->setInterval(arg1);
+}
+
+void CatchYouWidget::on_concurrencySpin_valueChanged(int arg1)
+{
+    settings->setValue("catch/concurrency", arg1);
+    crawler->setConcurrency(arg1);
 }
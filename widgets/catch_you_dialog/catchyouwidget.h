@@ -4,7 +4,13 @@
 #include <QWidget>
 #include <functional>
 #include <QSettings>
+#include <QHash>
 #include "commonvalues.h"
+#include "crawlscheduler.h"
+
+#define CATCH_FOLLOW_MAX_PAGE 5 // 关注列表最多读取的页数（每页50）
+#define CATCH_STATUS_BATCH 50 // 每次批量查询直播状态的用户数
+#define CATCH_CACHE_SECOND 30 // 房间扫描结果的缓存时长（秒）
 
 namespace Ui {
 class CatchYouWidget;
@@ -37,7 +43,7 @@ public:
     {
         QString userId;
         QString userName;
-        int liveStatus = 0; // -1未播，0未知，1直播
+        int liveStatus = 0; // -1没有直播间，0未播/未知，1直播
 
         UserInfo(QString id, QString name) : userId(id), userName(name)
         {}
@@ -52,19 +58,30 @@ private slots:
 
     void on_cdSpin_valueChanged(int arg1);
 
+    void on_concurrencySpin_valueChanged(int arg1);
+
 private:
-    void getUserFollows(qint64 taskTs, QString userId, int page = 1);
+    struct RoomScan
+    {
+        qint64 scanTime = 0; // 扫描的时间，秒
+        qint64 targetUid = 0;
+        RoomInfo room;
+        bool found = false;
+    };
+
+    qint64 startTask();
+    void clearResults();
+    void getUserFollows(qint64 taskTs, QString userId);
+    void addFollowPage(qint64 taskTs, const QJsonObject& json);
+    void detectUsersLiveStatus(qint64 taskTs, int from, int to);
     void detectUserLiveStatus(qint64 taskTs, int index);
-    void detectRoomDanmaku(qint64 taskTs, QString upUid, QString roomId);
-    void detectRoomGift(qint64 taskTs, QString upUid, QString roomId, qint64 second, QStringList texts);
-    void addInRoom(qint64 taskTs, QString upUid, QString roomId, qint64 second, QStringList texts, int gold100);
-    void detectRoomGift(qint64 taskTs, QString upUid, QString roomId);
+    void scanRoom(qint64 taskTs, RoomInfo room);
+    void addProgress(int total, int finished);
 
+    void addInRoom(RoomInfo room);
     void addToTable(RoomInfo room);
     void openRoomVideo(QString roomId);
 
-    void get(QString url, const std::function<void(QJsonObject)> func);
-
 protected:
     void closeEvent(QCloseEvent *event) override;
     void showEvent(QShowEvent *event) override;
@@ -79,6 +96,8 @@ private:
     QList<RoomInfo> inRooms;
 
     qint64 currentTaskTs = 0; // 任务Id，允许中止
+    CrawlScheduler* crawler;
+    QHash<qint64, RoomScan> roomCache; // 房间ID -> 最近一次扫描的结果
 };
 
 #endif // CATCHYOUWIDGET_H
@@ -0,0 +1,239 @@
+#include <QNetworkAccessManager>
+#include <QNetworkRequest>
+#include <QNetworkReply>
+#include <QJsonDocument>
+#include <QJsonParseError>
+#include <QDebug>
+#include <cmath>
+#include "crawlscheduler.h"
+#include "timerwheel.h"
+
+CrawlScheduler::CrawlScheduler(QObject *parent) : QObject(parent)
+{
+    manager = new QNetworkAccessManager(this);
+    clock.start();
+    tokens = concurrency;
+}
+
+CrawlScheduler::~CrawlScheduler()
+{
+    queue.clear();
+    currentTask = 0;
+    foreach (QNetworkReply* reply, running.keys())
+    {
+        reply->disconnect(this);
+        reply->abort();
+        reply->deleteLater();
+    }
+    running.clear();
+}
+
+void CrawlScheduler::setConcurrency(int count)
+{
+    concurrency = qMax(1, count);
+    schedule();
+}
+
+void CrawlScheduler::setInterval(int msec)
+{
+    interval = qMax(0, msec);
+    tokens = qMin(tokens, double(concurrency));
+    schedule();
+}
+
+/**
+ * 替换请求的地址，例如 http://127.0.0.1:8080/mock
+ * 为空时恢复原地址
+ */
+void CrawlScheduler::setApiBase(const QString &base)
+{
+    apiBase = base.isEmpty() ? QUrl() : QUrl(base);
+}
+
+void CrawlScheduler::setCookies(const QVariant &cookies)
+{
+    this->cookies = cookies;
+}
+
+/**
+ * 切换到新的任务
+ * 旧任务排队中的请求直接丢弃，进行中的中止
+ */
+void CrawlScheduler::setTask(qint64 taskTs)
+{
+    currentTask = taskTs;
+    queue.clear();
+
+    QList<QNetworkReply*> stale;
+    for (auto it = running.begin(); it != running.end(); ++it)
+    {
+        if (it.value().taskTs != taskTs)
+            stale.append(it.key());
+    }
+    foreach (QNetworkReply* reply, stale)
+    {
+        if (running.contains(reply))
+            reply->abort(); // 会触发 finished，在那里移除
+    }
+}
+
+qint64 CrawlScheduler::getTask() const
+{
+    return currentTask;
+}
+
+/**
+ * 添加一个 GET 请求
+ * 只有属于当前任务才会发送；回调在失败时也会执行（ok=false），便于调用方计数
+ * @param urgent 插到队列最前面，用于需要尽快显示结果的请求
+ */
+void CrawlScheduler::get(qint64 taskTs, const QString &url, JsonFunc func, bool urgent)
+{
+    if (taskTs != currentTask)
+        return ;
+
+    Job job;
+    job.taskTs = taskTs;
+    job.url = url;
+    job.func = func;
+    if (urgent)
+        queue.prepend(job);
+    else
+        queue.enqueue(job);
+    schedule();
+}
+
+int CrawlScheduler::getPendingCount() const
+{
+    return queue.size();
+}
+
+int CrawlScheduler::getRunningCount() const
+{
+    return running.size();
+}
+
+void CrawlScheduler::schedule()
+{
+    while (running.size() < concurrency && !queue.isEmpty())
+    {
+        if (!takeToken())
+        {
+            if (waiting)
+                return ;
+            waiting = true;
+            qint64 now = clock.elapsed();
+            int delay = now < pauseUntil ? int(pauseUntil - now)
+                                         : qMax(1, int(std::ceil((1 - tokens) * interval)));
+            TimerWheel::instance()->singleShot(delay, this, [=]{
+                waiting = false;
+                schedule();
+            }, "抓取限速");
+            return ;
+        }
+        start(queue.dequeue());
+    }
+}
+
+/**
+ * 令牌桶：每 interval 毫秒补充一个，最多积攒 concurrency 个
+ */
+bool CrawlScheduler::takeToken()
+{
+    qint64 now = clock.elapsed();
+    if (now < pauseUntil)
+        return false;
+    if (interval <= 0)
+        return true;
+
+    tokens = qMin(double(concurrency), tokens + double(now - lastRefill) / interval);
+    lastRefill = now;
+    if (tokens < 1)
+        return false;
+    tokens -= 1;
+    return true;
+}
+
+void CrawlScheduler::start(const Job &job)
+{
+    QNetworkRequest request(mapUrl(job.url));
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/x-www-form-urlencoded; charset=UTF-8");
+    request.setHeader(QNetworkRequest::UserAgentHeader, "Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/86.0.4240.111 Safari/537.36");
+    if (job.url.contains("bilibili.com"))
+        request.setHeader(QNetworkRequest::CookieHeader, cookies);
+
+    QNetworkReply* reply = manager->get(request);
+    running.insert(reply, job);
+    connect(reply, &QNetworkReply::finished, this, [=]{
+        finish(reply);
+    });
+    TimerWheel::instance()->singleShot(CRAWL_TIMEOUT, reply, [=]{
+        reply->abort();
+    }, "抓取超时");
+}
+
+void CrawlScheduler::finish(QNetworkReply *reply)
+{
+    if (!running.contains(reply))
+        return ;
+    Job job = running.take(reply);
+    reply->deleteLater();
+
+    bool ok = false;
+    QJsonObject json;
+    if (reply->error() == QNetworkReply::NoError)
+    {
+        QJsonParseError error;
+        QJsonDocument document = QJsonDocument::fromJson(reply->readAll(), &error);
+        if (error.error == QJsonParseError::NoError && document.isObject())
+        {
+            ok = true;
+            json = document.object();
+        }
+        else
+        {
+            qWarning() << "抓取解析失败：" << error.errorString() << job.url;
+        }
+    }
+    else if (job.taskTs == currentTask)
+    {
+        qWarning() << "抓取失败：" << reply->errorString() << job.url;
+    }
+
+    if (ok && json.value("code").toInt() == -412) // 请求被拦截，整体暂停一会儿
+    {
+        qWarning() << "抓取请求被拦截，暂停" << CRAWL_BLOCKED_PAUSE << "毫秒";
+        pauseUntil = clock.elapsed() + CRAWL_BLOCKED_PAUSE;
+        lastRefill = pauseUntil;
+        tokens = 0;
+        if (!job.retried && job.taskTs == currentTask)
+        {
+            job.retried = true;
+            queue.prepend(job);
+            schedule();
+            return ;
+        }
+    }
+
+    if (job.taskTs == currentTask && job.func)
+        job.func(ok, json);
+
+    schedule();
+    if (job.taskTs == currentTask && running.isEmpty() && queue.isEmpty())
+        emit signalIdle(currentTask);
+}
+
+QUrl CrawlScheduler::mapUrl(const QString &url) const
+{
+    QUrl target(url);
+    if (apiBase.isEmpty())
+        return target;
+
+    QUrl mapped = apiBase;
+    QString basePath = apiBase.path();
+    if (basePath.endsWith("/"))
+        basePath.chop(1);
+    mapped.setPath(basePath + target.path());
+    mapped.setQuery(target.query(QUrl::FullyEncoded));
+    return mapped;
+}
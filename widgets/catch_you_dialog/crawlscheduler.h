@@ -0,0 +1,82 @@
+#ifndef CRAWLSCHEDULER_H
+#define CRAWLSCHEDULER_H
+
+#include <QObject>
+#include <QQueue>
+#include <QHash>
+#include <QUrl>
+#include <QJsonObject>
+#include <QVariant>
+#include <QElapsedTimer>
+#include <functional>
+
+class QNetworkAccessManager;
+class QNetworkReply;
+
+#define CRAWL_TIMEOUT 10000 // 单个请求的超时（毫秒）
+#define CRAWL_BLOCKED_PAUSE 5000 // 被B站拦截后暂停发送（毫秒）
+
+/**
+ * 批量抓取接口的调度器
+ * 同时进行的请求不超过并发数，所有请求共用一个令牌桶限制频率；
+ * 每个请求属于一个任务，切换任务时丢弃排队中的请求并中止正在进行的，旧任务的回调不再执行。
+ * 设置 apiBase 后所有请求改发到该地址（保留路径和参数），用于对接本地模拟的接口。
+ */
+class CrawlScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    typedef std::function<void(bool ok, QJsonObject json)> JsonFunc;
+
+    CrawlScheduler(QObject* parent = nullptr);
+    ~CrawlScheduler() override;
+
+    void setConcurrency(int count);
+    void setInterval(int msec);
+    void setApiBase(const QString& base);
+    void setCookies(const QVariant& cookies);
+
+    void setTask(qint64 taskTs);
+    qint64 getTask() const;
+    void get(qint64 taskTs, const QString& url, JsonFunc func, bool urgent = false);
+
+    int getPendingCount() const;
+    int getRunningCount() const;
+
+signals:
+    void signalIdle(qint64 taskTs);
+
+private:
+    struct Job
+    {
+        qint64 taskTs = 0;
+        QString url;
+        JsonFunc func;
+        bool retried = false;
+    };
+
+    void schedule();
+    bool takeToken();
+    void start(const Job& job);
+    void finish(QNetworkReply* reply);
+    QUrl mapUrl(const QString& url) const;
+
+private:
+    QNetworkAccessManager* manager;
+    qint64 currentTask = 0;
+    QQueue<Job> queue;
+    QHash<QNetworkReply*, Job> running;
+
+    int concurrency = 4;
+    int interval = 150; // 每个令牌的间隔，0 表示不限制
+    double tokens = 0;
+    QElapsedTimer clock;
+    qint64 lastRefill = 0;
+    qint64 pauseUntil = 0; // 被拦截后暂停到这个时刻
+    bool waiting = false; // 已经安排了等待令牌的唤醒
+
+    QUrl apiBase;
+    QVariant cookies;
+};
+
+#endif // CRAWLSCHEDULER_H
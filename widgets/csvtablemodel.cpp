@@ -0,0 +1,669 @@
+#include <QSaveFile>
+#include <QDebug>
+#include <climits>
+#include <cstring>
+#include <algorithm>
+#include "csvtablemodel.h"
+
+#define CSV_FETCH_ROWS 2000 // 每次建立索引的行数
+#define CSV_CODEC_SAMPLE 1048576 // 判断编码时检查的字节数
+#define CSV_LINE_CACHE 4096 // 缓存解析过的行数
+
+CSVTableModel::CSVTableModel(QObject *parent) : QAbstractTableModel(parent)
+{
+    lineCache.setMaxCost(CSV_LINE_CACHE);
+}
+
+CSVTableModel::~CSVTableModel()
+{
+    close();
+}
+
+/**
+ * 打开文件，只建立开头部分的索引
+ * 已经设置的排序、筛选会重新应用
+ */
+bool CSVTableModel::open(const QString &path)
+{
+    beginResetModel();
+    close();
+    filePath = path;
+    codec = QTextCodec::codecForName("UTF-8");
+
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        qWarning() << "无法打开文件：" << path;
+        endResetModel();
+        return false;
+    }
+    mappedSize = file.size();
+    if (mappedSize > 0)
+    {
+        mapped = file.map(0, mappedSize);
+        if (!mapped)
+        {
+            qWarning() << "无法映射文件：" << path << file.errorString();
+            file.close();
+            mappedSize = 0;
+            endResetModel();
+            return false;
+        }
+    }
+
+    // 和 readTextFileAutoCodec 一样，UTF-8 有无效字符时当做 GBK；只检查开头
+    if (mappedSize >= 3 && mapped[0] == 0xEF && mapped[1] == 0xBB && mapped[2] == 0xBF)
+        dataStart = 3;
+    qint64 sample = qMin(mappedSize - dataStart, qint64(CSV_CODEC_SAMPLE));
+    if (sample < mappedSize - dataStart) // 不要截断在多字节字符中间
+    {
+        qint64 end = dataStart + sample;
+        while (end > dataStart && mapped[end - 1] != '\n')
+            end--;
+        if (end > dataStart)
+            sample = end - dataStart;
+    }
+    if (sample > 0)
+    {
+        QTextCodec::ConverterState state;
+        codec->toUnicode(reinterpret_cast<const char*>(mapped + dataStart), int(sample), &state);
+        if (state.invalidChars > 0)
+            codec = QTextCodec::codecForName("GBK");
+    }
+
+    scanPos = dataStart;
+    int columns = 0;
+    lineOffsets = indexLines(mapped, mappedSize, &scanPos, CSV_FETCH_ROWS, &columns);
+    appendSourceColumns(columns);
+    for (int i = 0; i < lineOffsets.size(); i++)
+        baseRows.append(i);
+    rows = baseRows;
+    endResetModel();
+
+    if (sortColumn >= 0 || !filterText.isEmpty())
+        startViewTask();
+    return true;
+}
+
+/**
+ * 按保存顺序写回：没有改动的行直接复制原文件的内容，改动的行重新编码
+ * 写入后映射新的文件，显示的行不变，视图不用重置
+ */
+bool CSVTableModel::save()
+{
+    if (filePath.isEmpty())
+        return false;
+    if (watcher)
+    {
+        watcher->waitForFinished(); // 不再读取旧的映射，结果会被丢弃
+        pendingTask = true;
+    }
+    generation++;
+
+    QSaveFile out(filePath);
+    if (!out.open(QIODevice::WriteOnly))
+    {
+        qWarning() << "无法保存：" << filePath << out.errorString();
+        return false;
+    }
+
+    // 还没有建立索引的行跟在后面
+    qint64 pos = scanPos;
+    int columns = sourceColumns;
+    QVector<qint64> tail = indexLines(mapped, mappedSize, &pos, INT_MAX, &columns);
+    QVector<int> map = columnMap;
+    for (int c = sourceColumns; c < columns; c++)
+        map.append(c);
+    bool sameColumns = map.size() == columns;
+    for (int i = 0; i < map.size() && sameColumns; i++)
+        sameColumns = map.at(i) == i;
+
+    auto writeSource = [&](qint64 start) {
+        if (sameColumns)
+            out.write(reinterpret_cast<const char*>(mapped + start), lineEnd(mapped, mappedSize, start) - start);
+        else
+            out.write(codec->fromUnicode(mapColumns(splitLine(mapped, mappedSize, start, codec), map).join(",")));
+        out.write("\n");
+    };
+
+    if (dataStart)
+        out.write(reinterpret_cast<const char*>(mapped), dataStart);
+    QVector<qint64> newOffsets;
+    QHash<int, int> newIndexes; // 旧的行 -> 新文件的第几行
+    newOffsets.reserve(baseRows.size());
+    foreach (int ref, baseRows)
+    {
+        newIndexes.insert(ref, newOffsets.size());
+        newOffsets.append(out.pos());
+        if (ref < 0 || editedLines.contains(ref))
+        {
+            QStringList cells = ref < 0 ? addedRows.at(-ref - 1) : editedLines.value(ref);
+            out.write(codec->fromUnicode(cells.join(",")));
+            out.write("\n");
+        }
+        else
+        {
+            writeSource(lineOffsets.at(ref));
+        }
+    }
+    qint64 tailStart = out.pos();
+    foreach (qint64 start, tail)
+        writeSource(start);
+
+    // 替换文件前先取消映射
+    file.unmap(mapped);
+    mapped = nullptr;
+    file.close();
+    bool ok = out.commit();
+    if (!ok)
+        qWarning() << "无法保存：" << filePath << out.errorString();
+
+    file.setFileName(filePath);
+    if (!ok || !file.open(QIODevice::ReadOnly) || (file.size() > 0 && !(mapped = file.map(0, file.size()))))
+    {
+        open(filePath);
+        return ok;
+    }
+    mappedSize = file.size();
+
+    if (map.size() > columnMap.size())
+    {
+        beginInsertColumns(QModelIndex(), columnMap.size(), map.size() - 1);
+        columnMap = map;
+        endInsertColumns();
+    }
+    for (int i = 0; i < columnMap.size(); i++)
+        columnMap[i] = i;
+    sourceColumns = columnMap.size();
+    lineOffsets = newOffsets;
+    scanPos = tailStart;
+    for (int i = 0; i < rows.size(); i++)
+        rows[i] = newIndexes.value(rows.at(i));
+    baseRows.clear();
+    for (int i = 0; i < lineOffsets.size(); i++)
+        baseRows.append(i);
+    editedLines.clear();
+    addedRows.clear();
+    lineCache.clear();
+    modified = false;
+    return ok;
+}
+
+/**
+ * 等待后台任务结束，取消映射
+ * 不通知视图，调用的地方自己重置
+ */
+void CSVTableModel::close()
+{
+    if (watcher)
+    {
+        watcher->waitForFinished();
+        disconnect(watcher, nullptr, this, nullptr);
+        watcher->deleteLater();
+        watcher = nullptr;
+        pendingTask = false;
+        emit signalBusyChanged(false);
+    }
+    generation++;
+
+    if (mapped)
+        file.unmap(mapped);
+    mapped = nullptr;
+    mappedSize = 0;
+    dataStart = 0;
+    if (file.isOpen())
+        file.close();
+
+    lineOffsets.clear();
+    scanPos = 0;
+    sourceColumns = 0;
+    columnMap.clear();
+    baseRows.clear();
+    rows.clear();
+    editedLines.clear();
+    addedRows.clear();
+    lineCache.clear();
+    modified = false;
+}
+
+bool CSVTableModel::isModified() const
+{
+    return modified;
+}
+
+bool CSVTableModel::isBusy() const
+{
+    return watcher != nullptr;
+}
+
+QString CSVTableModel::getCodec() const
+{
+    return codec ? QString(codec->name()) : "UTF-8";
+}
+
+/**
+ * 显示的第 row 行的所有单元格
+ */
+QStringList CSVTableModel::rowCells(int row) const
+{
+    if (row < 0 || row >= rows.size())
+        return QStringList();
+    int ref = rows.at(row);
+    if (ref < 0)
+        return addedRows.at(-ref - 1);
+    auto it = editedLines.constFind(ref);
+    if (it != editedLines.constEnd())
+        return it.value();
+    return mapColumns(sourceCells(ref), columnMap);
+}
+
+/**
+ * 只显示包含 text 的行（不区分大小写），空为全部显示
+ */
+void CSVTableModel::setFilter(const QString &text)
+{
+    if (filterText == text)
+        return ;
+    filterText = text;
+    startViewTask();
+}
+
+int CSVTableModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : rows.size();
+}
+
+int CSVTableModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : columnMap.size();
+}
+
+QVariant CSVTableModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || (role != Qt::DisplayRole && role != Qt::EditRole))
+        return QVariant();
+    return rowCells(index.row()).value(index.column());
+}
+
+/**
+ * 修改的整行记录下来，保存时再写入
+ */
+bool CSVTableModel::setData(const QModelIndex &index, const QVariant &value, int role)
+{
+    if (!index.isValid() || role != Qt::EditRole || index.row() >= rows.size())
+        return false;
+
+    QStringList cells = rowCells(index.row());
+    while (cells.size() < columnMap.size())
+        cells.append("");
+    QString text = value.toString();
+    if (cells.at(index.column()) == text)
+        return false;
+    cells[index.column()] = text;
+
+    int ref = rows.at(index.row());
+    if (ref < 0)
+        addedRows[-ref - 1] = cells;
+    else
+        editedLines.insert(ref, cells);
+    modified = true;
+    emit dataChanged(index, index, {Qt::DisplayRole, Qt::EditRole});
+    emit signalEdited();
+    return true;
+}
+
+Qt::ItemFlags CSVTableModel::flags(const QModelIndex &index) const
+{
+    if (!index.isValid())
+        return Qt::NoItemFlags;
+    return Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsEditable;
+}
+
+/**
+ * 后台排序、筛选时会建立全部的索引，不用再获取
+ */
+bool CSVTableModel::canFetchMore(const QModelIndex &parent) const
+{
+    return !parent.isValid() && !watcher && scanPos < mappedSize;
+}
+
+void CSVTableModel::fetchMore(const QModelIndex &parent)
+{
+    if (!canFetchMore(parent))
+        return ;
+
+    int columns = sourceColumns;
+    QVector<qint64> more = indexLines(mapped, mappedSize, &scanPos, CSV_FETCH_ROWS, &columns);
+    if (columns > sourceColumns)
+    {
+        beginInsertColumns(QModelIndex(), columnMap.size(), columnMap.size() + columns - sourceColumns - 1);
+        appendSourceColumns(columns);
+        endInsertColumns();
+    }
+    if (more.isEmpty())
+        return ;
+
+    int first = lineOffsets.size();
+    beginInsertRows(QModelIndex(), rows.size(), rows.size() + more.size() - 1);
+    lineOffsets += more;
+    for (int i = 0; i < more.size(); i++)
+    {
+        baseRows.append(first + i);
+        rows.append(first + i);
+    }
+    endInsertRows();
+}
+
+/**
+ * 后台任务进行中时不允许改变行列，避免结果和当前的行对不上
+ */
+bool CSVTableModel::insertRows(int row, int count, const QModelIndex &parent)
+{
+    if (parent.isValid() || watcher || row < 0 || row > rows.size() || count <= 0)
+        return false;
+
+    int basePos = baseRows.size();
+    if (row < rows.size())
+        basePos = baseRows.indexOf(rows.at(row));
+    else if (!rows.isEmpty())
+        basePos = baseRows.indexOf(rows.last()) + 1;
+
+    beginInsertRows(parent, row, row + count - 1);
+    for (int i = 0; i < count; i++)
+    {
+        addedRows.append(QStringList());
+        int ref = -addedRows.size();
+        rows.insert(row + i, ref);
+        baseRows.insert(basePos + i, ref);
+    }
+    endInsertRows();
+    modified = true;
+    return true;
+}
+
+bool CSVTableModel::removeRows(int row, int count, const QModelIndex &parent)
+{
+    if (parent.isValid() || watcher || row < 0 || count <= 0 || row + count > rows.size())
+        return false;
+
+    beginRemoveRows(parent, row, row + count - 1);
+    for (int i = 0; i < count; i++)
+    {
+        int ref = rows.takeAt(row);
+        baseRows.removeOne(ref);
+        if (ref < 0)
+            addedRows[-ref - 1].clear(); // 保留位置，其他插入行的序号不变
+        else
+            editedLines.remove(ref);
+    }
+    endRemoveRows();
+    modified = true;
+    return true;
+}
+
+bool CSVTableModel::insertColumns(int column, int count, const QModelIndex &parent)
+{
+    if (parent.isValid() || watcher || column < 0 || column > columnMap.size() || count <= 0)
+        return false;
+
+    beginInsertColumns(parent, column, column + count - 1);
+    for (int i = 0; i < count; i++)
+        columnMap.insert(column, -1);
+    auto insertEmpty = [=](QStringList& cells) {
+        for (int i = 0; i < count && column <= cells.size(); i++)
+            cells.insert(column, "");
+    };
+    for (auto it = editedLines.begin(); it != editedLines.end(); ++it)
+        insertEmpty(it.value());
+    for (int i = 0; i < addedRows.size(); i++)
+        insertEmpty(addedRows[i]);
+    endInsertColumns();
+    modified = true;
+    return true;
+}
+
+bool CSVTableModel::removeColumns(int column, int count, const QModelIndex &parent)
+{
+    if (parent.isValid() || watcher || column < 0 || count <= 0 || column + count > columnMap.size())
+        return false;
+
+    beginRemoveColumns(parent, column, column + count - 1);
+    columnMap.remove(column, count);
+    auto removeCells = [=](QStringList& cells) {
+        for (int i = 0; i < count && column < cells.size(); i++)
+            cells.removeAt(column);
+    };
+    for (auto it = editedLines.begin(); it != editedLines.end(); ++it)
+        removeCells(it.value());
+    for (int i = 0; i < addedRows.size(); i++)
+        removeCells(addedRows[i]);
+    endRemoveColumns();
+    modified = true;
+    return true;
+}
+
+/**
+ * column 为 -1 时恢复文件中的顺序
+ */
+void CSVTableModel::sort(int column, Qt::SortOrder order)
+{
+    if (sortColumn == column && sortOrder == order)
+        return ;
+    sortColumn = column;
+    sortOrder = order;
+    startViewTask();
+}
+
+qint64 CSVTableModel::lineEnd(const uchar *data, qint64 size, qint64 start)
+{
+    const void* end = memchr(data + start, '\n', size_t(size - start));
+    return end ? static_cast<const uchar*>(end) - data : size;
+}
+
+/**
+ * 从 pos 开始建立最多 maxLines 行的索引，跳过空行
+ * @param maxColumns 输入已知的列数，输出这些行里最多的列数
+ */
+QVector<qint64> CSVTableModel::indexLines(const uchar *data, qint64 size, qint64 *pos, int maxLines, int *maxColumns)
+{
+    QVector<qint64> offsets;
+    qint64 p = *pos;
+    while (p < size && offsets.size() < maxLines)
+    {
+        qint64 end = lineEnd(data, size, p);
+        qint64 len = end - p;
+        if (len > 0 && data[end - 1] == '\r')
+            len--;
+        if (len > 0)
+        {
+            offsets.append(p);
+            int columns = int(std::count(data + p, data + p + len, ',')) + 1;
+            if (columns > *maxColumns)
+                *maxColumns = columns;
+        }
+        p = end + 1;
+    }
+    *pos = qMin(p, size);
+    return offsets;
+}
+
+QStringList CSVTableModel::splitLine(const uchar *data, qint64 size, qint64 start, QTextCodec *codec)
+{
+    qint64 end = lineEnd(data, size, start);
+    if (end > start && data[end - 1] == '\r')
+        end--;
+    return codec->toUnicode(reinterpret_cast<const char*>(data + start), int(end - start)).split(",");
+}
+
+QStringList CSVTableModel::mapColumns(const QStringList &source, const QVector<int> &columnMap)
+{
+    QStringList cells;
+    cells.reserve(columnMap.size());
+    foreach (int col, columnMap)
+        cells.append(col >= 0 ? source.value(col) : "");
+    return cells;
+}
+
+QStringList CSVTableModel::sourceCells(int line) const
+{
+    if (QStringList* cached = lineCache.object(line))
+        return *cached;
+    QStringList cells = splitLine(mapped, mappedSize, lineOffsets.at(line), codec);
+    lineCache.insert(line, new QStringList(cells));
+    return cells;
+}
+
+/**
+ * 原文件出现了更多的列，追加到显示的最后
+ */
+void CSVTableModel::appendSourceColumns(int columns)
+{
+    for (int c = sourceColumns; c < columns; c++)
+        columnMap.append(c);
+    sourceColumns = qMax(sourceColumns, columns);
+}
+
+/**
+ * 在后台线程建立全部索引，再筛选、排序
+ * 同时只有一个任务，期间的新请求等它结束后再开始
+ */
+void CSVTableModel::startViewTask()
+{
+    generation++;
+    if (watcher)
+    {
+        pendingTask = true;
+        return ;
+    }
+
+    if (sortColumn < 0 && filterText.isEmpty())
+    {
+        beginResetModel();
+        rows = baseRows;
+        endResetModel();
+        return ;
+    }
+
+    const qint64 gen = generation;
+    const uchar* data = mapped;
+    const qint64 size = mappedSize;
+    const qint64 from = scanPos;
+    const QVector<qint64> offsets = lineOffsets;
+    const int columns = sourceColumns;
+    const QVector<int> colMap = columnMap;
+    const QVector<int> base = baseRows;
+    const QHash<int, QStringList> edited = editedLines;
+    const QVector<QStringList> added = addedRows;
+    QTextCodec* const textCodec = codec;
+    const QString filter = filterText;
+    const int sortCol = sortColumn;
+    const Qt::SortOrder order = sortOrder;
+
+    QFutureWatcher<ViewResult>* w = new QFutureWatcher<ViewResult>(this);
+    watcher = w;
+    connect(w, &QFutureWatcher<ViewResult>::finished, this, [=]{
+        ViewResult result = w->result();
+        w->deleteLater();
+        watcher = nullptr;
+        if (result.generation == generation)
+        {
+            beginResetModel();
+            lineOffsets = result.offsets;
+            scanPos = mappedSize;
+            appendSourceColumns(result.sourceColumns);
+            baseRows = result.baseRows;
+            rows = result.rows;
+            endResetModel();
+        }
+        emit signalBusyChanged(false);
+
+        if (pendingTask)
+        {
+            pendingTask = false;
+            startViewTask();
+        }
+    });
+    emit signalBusyChanged(true);
+
+    w->setFuture(QtConcurrent::run([=]{
+        ViewResult result;
+        result.generation = gen;
+        result.offsets = offsets;
+        qint64 pos = from;
+        int maxColumns = columns;
+        result.offsets += indexLines(data, size, &pos, INT_MAX, &maxColumns);
+        result.sourceColumns = maxColumns;
+
+        QVector<int> map = colMap;
+        for (int c = columns; c < maxColumns; c++)
+            map.append(c);
+        result.baseRows = base;
+        for (int i = offsets.size(); i < result.offsets.size(); i++)
+            result.baseRows.append(i);
+
+        auto cellsOf = [&](int ref) -> QStringList {
+            if (ref < 0)
+                return added.at(-ref - 1);
+            auto it = edited.constFind(ref);
+            if (it != edited.constEnd())
+                return it.value();
+            return mapColumns(splitLine(data, size, result.offsets.at(ref), textCodec), map);
+        };
+
+        // 筛选
+        if (filter.isEmpty())
+        {
+            result.rows = result.baseRows;
+        }
+        else
+        {
+            foreach (int ref, result.baseRows)
+            {
+                foreach (const QString& cell, cellsOf(ref))
+                {
+                    if (cell.contains(filter, Qt::CaseInsensitive))
+                    {
+                        result.rows.append(ref);
+                        break;
+                    }
+                }
+            }
+        }
+
+        // 排序：数字按大小在前，其余按文本
+        if (sortCol >= 0)
+        {
+            struct SortKey
+            {
+                int ref;
+                bool isNumber;
+                double number;
+                QString text;
+            };
+            QVector<SortKey> keys;
+            keys.reserve(result.rows.size());
+            foreach (int ref, result.rows)
+            {
+                SortKey key;
+                key.ref = ref;
+                key.text = cellsOf(ref).value(sortCol);
+                key.number = key.text.toDouble(&key.isNumber);
+                keys.append(key);
+            }
+            auto less = [](const SortKey& a, const SortKey& b) {
+                if (a.isNumber != b.isNumber)
+                    return a.isNumber;
+                if (a.isNumber)
+                    return a.number < b.number;
+                return a.text < b.text;
+            };
+            if (order == Qt::AscendingOrder)
+                std::stable_sort(keys.begin(), keys.end(), less);
+            else
+                std::stable_sort(keys.begin(), keys.end(), [&](const SortKey& a, const SortKey& b) { return less(b, a); });
+            for (int i = 0; i < keys.size(); i++)
+                result.rows[i] = keys.at(i).ref;
+        }
+        return result;
+    }));
+}
@@ -0,0 +1,98 @@
+#ifndef CSVTABLEMODEL_H
+#define CSVTABLEMODEL_H
+
+#include <QAbstractTableModel>
+#include <QFile>
+#include <QCache>
+#include <QTextCodec>
+#include <QFutureWatcher>
+#include <QtConcurrent/QtConcurrent>
+
+/**
+ * 映射到内存的 CSV 表格
+ * 行的位置在滚动到时才建立索引，单元格只在显示时解析；
+ * 排序、筛选在后台线程进行；修改只记录改动的行，保存时和原文件合并写入。
+ * 逗号分隔，不处理引号，和保存礼物、上船记录的格式一致。
+ */
+class CSVTableModel : public QAbstractTableModel
+{
+    Q_OBJECT
+public:
+    CSVTableModel(QObject* parent = nullptr);
+    ~CSVTableModel() override;
+
+    bool open(const QString& path);
+    bool save();
+    void close();
+    bool isModified() const;
+    bool isBusy() const;
+    QString getCodec() const;
+    QStringList rowCells(int row) const;
+
+    void setFilter(const QString& text);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    bool setData(const QModelIndex& index, const QVariant& value, int role = Qt::EditRole) override;
+    Qt::ItemFlags flags(const QModelIndex& index) const override;
+    bool canFetchMore(const QModelIndex& parent) const override;
+    void fetchMore(const QModelIndex& parent) override;
+    bool insertRows(int row, int count, const QModelIndex& parent = QModelIndex()) override;
+    bool removeRows(int row, int count, const QModelIndex& parent = QModelIndex()) override;
+    bool insertColumns(int column, int count, const QModelIndex& parent = QModelIndex()) override;
+    bool removeColumns(int column, int count, const QModelIndex& parent = QModelIndex()) override;
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
+
+signals:
+    void signalEdited();
+    void signalBusyChanged(bool busy);
+
+private:
+    struct ViewResult
+    {
+        qint64 generation = 0;
+        QVector<qint64> offsets;
+        int sourceColumns = 0;
+        QVector<int> baseRows;
+        QVector<int> rows;
+    };
+
+    static qint64 lineEnd(const uchar* data, qint64 size, qint64 start);
+    static QVector<qint64> indexLines(const uchar* data, qint64 size, qint64* pos, int maxLines, int* maxColumns);
+    static QStringList splitLine(const uchar* data, qint64 size, qint64 start, QTextCodec* codec);
+    static QStringList mapColumns(const QStringList& source, const QVector<int>& columnMap);
+
+    QStringList sourceCells(int line) const;
+    void appendSourceColumns(int count);
+    void startViewTask();
+
+private:
+    QString filePath;
+    QTextCodec* codec = nullptr;
+    QFile file;
+    uchar* mapped = nullptr;
+    qint64 mappedSize = 0;
+    qint64 dataStart = 0; // 跳过 BOM
+
+    QVector<qint64> lineOffsets; // 已经建立索引的行的开头
+    qint64 scanPos = 0; // 下一次建立索引的位置
+    int sourceColumns = 0; // 原文件的列数（已索引部分的最大值）
+    QVector<int> columnMap; // 显示的列 -> 原文件的列，-1 为插入的空列
+
+    QVector<int> baseRows; // 保存时的行顺序；>=0 为原文件第几行，<0 为插入的第 -(n+1) 行
+    QVector<int> rows; // 显示的行（筛选、排序后）
+    QHash<int, QStringList> editedLines; // 修改过的原文件行，按显示的列
+    QVector<QStringList> addedRows; // 插入的行
+    bool modified = false;
+    mutable QCache<int, QStringList> lineCache; // 解析过的原文件行
+
+    int sortColumn = -1;
+    Qt::SortOrder sortOrder = Qt::AscendingOrder;
+    QString filterText;
+    qint64 generation = 0; // 排序、筛选的序号，旧的结果直接丢弃
+    QFutureWatcher<ViewResult>* watcher = nullptr; // 正在后台处理的任务
+    bool pendingTask = false;
+};
+
+#endif // CSVTABLEMODEL_H
@@ -2,7 +2,6 @@
 #include "csvviewer.h"
 #include "facilemenu.h"
 #include "orderplayerwindow.h"
-#include "fileutil.h"
 
 CSVViewer::CSVViewer(QString filePath, QWidget *parent) : QDialog(parent)
 {
@@ -12,16 +11,45 @@ CSVViewer::CSVViewer(QString filePath, QWidget *parent) : QDialog(parent)
     setWindowTitle(filePath);
 
     QVBoxLayout* lay = new QVBoxLayout(this);
+    filterEdit = new QLineEdit(this);
+    filterEdit->setPlaceholderText("筛选");
+    filterEdit->setClearButtonEnabled(true);
+    lay->addWidget(filterEdit);
     tableView = new QTableView(this);
     lay->addWidget(tableView);
 
     // 设置表格
     this->filePath = filePath;
-    model = new QStandardItemModel(tableView);
+    model = new CSVTableModel(tableView);
     tableView->setModel(model);
     tableView->setItemDelegate(new NoFocusDelegate(tableView, model->columnCount()));
     tableView->setSelectionMode(QAbstractItemView::ExtendedSelection);
     tableView->setSelectionBehavior(QAbstractItemView::SelectRows);
+    tableView->horizontalHeader()->setSortIndicator(-1, Qt::AscendingOrder); // 默认按文件中的顺序
+    tableView->setSortingEnabled(true);
+
+    // 修改后延迟保存
+    saveTimer = new QTimer(this);
+    saveTimer->setSingleShot(true);
+    saveTimer->setInterval(1000);
+    connect(saveTimer, &QTimer::timeout, this, &CSVViewer::save);
+    connect(model, &CSVTableModel::signalEdited, saveTimer, [=]{
+        saveTimer->start();
+    });
+
+    // 筛选、排序在后台进行
+    filterTimer = new QTimer(this);
+    filterTimer->setSingleShot(true);
+    filterTimer->setInterval(300);
+    connect(filterTimer, &QTimer::timeout, this, [=]{
+        model->setFilter(filterEdit->text());
+    });
+    connect(filterEdit, &QLineEdit::textChanged, filterTimer, [=]{
+        filterTimer->start();
+    });
+    connect(model, &CSVTableModel::signalBusyChanged, this, [=](bool busy){
+        setWindowTitle(busy ? this->filePath + " (处理中...)" : this->filePath);
+    });
 
     // 读取数据
     read();
@@ -57,26 +85,16 @@ CSVViewer::CSVViewer(QString filePath, QWidget *parent) : QDialog(parent)
     });
 }
 
+CSVViewer::~CSVViewer()
+{
+    if (model->isModified())
+        save();
+}
+
 void CSVViewer::read()
 {
-    model->clear();
-    startModify();
-    QString content = readTextFileAutoCodec(filePath, &fileCodec);
-    QStringList lines = content.split("\n", QString::SkipEmptyParts);
-    if (lines.size())
-    {
-        QStringList cells = lines.first().split(",");
-        model->setColumnCount(cells.size());
-    }
-    for (int i = 0; i < lines.size(); i++)
-    {
-        QStringList cells = lines.at(i).split(",");
-        for (int j = 0; j < cells.size(); j++)
-        {
-            model->setItem(i, j, new QStandardItem(cells.at(j)));
-        }
-    }
-    endModify();
+    saveTimer->stop();
+    model->open(filePath);
 
     tableView->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
     QTimer::singleShot(0, [=]{
@@ -84,24 +102,13 @@ void CSVViewer::read()
     });
 }
 
+/**
+ * 只有修改过的行会重新编码，其余直接复制
+ */
 void CSVViewer::save()
 {
-    QStringList sl;
-    for (int row = 0; row < model->rowCount(); row++)
-    {
-        QStringList l;
-        for (int col = 0; col < model->columnCount(); col++)
-        {
-            auto item = model->item(row, col);
-            if (item)
-                l.append(item->data(Qt::DisplayRole).toString());
-            else
-                l.append("");
-        }
-        sl.append(l.join(","));
-    }
-    QString ss = sl.join("\n");
-    writeTextFile(filePath, ss, fileCodec);
+    saveTimer->stop();
+    model->save();
 }
 
 void CSVViewer::showTableMenu()
@@ -117,12 +124,10 @@ void CSVViewer::showTableMenu()
         for (int i = 0; i < selects.size(); i++)
             insertRows.append(selects.at(i).row());
         std::sort(insertRows.begin(), insertRows.end(), [=](int a, int b) { return a > b; });
-        startModify();
         for (int i = 0; i < insertRows.size(); i++)
             model->insertRow(insertRows.at(i));
-        endModify();
         save();
-    });
+    })->disable(model->isBusy());
 
     menu->addAction("下方插入行 (&S)", [=]{
         auto selects = tableView->selectionModel()->selectedRows(0);
@@ -130,12 +135,10 @@ void CSVViewer::showTableMenu()
         for (int i = 0; i < selects.size(); i++)
             insertRows.append(selects.at(i).row());
         std::sort(insertRows.begin(), insertRows.end(), [=](int a, int b) { return a > b; });
-        startModify();
         for (int i = 0; i < insertRows.size(); i++)
             model->insertRow(insertRows.at(i) + 1);
-        endModify();
         save();
-    });
+    })->disable(model->isBusy());
 
     menu->addAction("复制选中行 (&C)", [=]{
         QStringList sl;
@@ -143,13 +146,7 @@ void CSVViewer::showTableMenu()
         for (int i = 0; i < selects.size(); i++)
         {
             int row = selects.at(i).row();
-            QStringList l;
-            for (int col = 0; col < model->columnCount(); col++)
-            {
-                auto item = model->item(row, col);
-                l.append(item->data(Qt::DisplayRole).toString());
-            }
-            sl.append(l.join("\t"));
+            sl.append(model->rowCells(row).join("\t"));
         }
         QString ss = sl.join("\n");
         QApplication::clipboard()->setText(ss);
@@ -168,13 +165,11 @@ void CSVViewer::showTableMenu()
 
         // 倒序删除项
         std::sort(deletedRows.begin(), deletedRows.end(), [=](int a, int b) { return a > b; });
-        startModify();
         for (int i = 0; i < deletedRows.size(); i++)
             model->removeRow(deletedRows.at(i));
-        endModify();
 
         save();
-    })->disable(row < 0);
+    })->disable(row < 0 || model->isBusy());
 
     auto colMenu = menu->addMenu("列操作");
 
@@ -182,46 +177,35 @@ void CSVViewer::showTableMenu()
         int currentCol = tableView->currentIndex().column();
         if (currentCol < 0)
             return ;
-        startModify();
         model->insertColumn(currentCol);
-        endModify();
         save();
-    });
+    })->disable(model->isBusy());
 
     colMenu->addAction("右边插入列", [=]{
         int currentCol = tableView->currentIndex().column();
         if (currentCol < 0)
             return ;
-        startModify();
         model->insertColumn(currentCol + 1);
-        endModify();
         save();
-    });
+    })->disable(model->isBusy());
 
     colMenu->split()->addAction("删除列", [=]{
         int currentCol = tableView->currentIndex().column();
         if (currentCol < 0)
             return ;
-        startModify();
         model->removeColumn(currentCol);
-        endModify();
         save();
+    })->disable(model->isBusy());
+
+    menu->split()->addAction("原始顺序 (&O)", [=]{
+        tableView->sortByColumn(-1, Qt::AscendingOrder);
     });
 
-    menu->split()->addAction("刷新 (&R)", [=]{
+    menu->addAction("刷新 (&R)", [=]{
+        if (model->isModified())
+            save();
         read();
     });
 
     menu->exec();
 }
-
-void CSVViewer::startModify()
-{
-    disconnect(model, &QStandardItemModel::itemChanged, this, &CSVViewer::save);
-}
-
-void CSVViewer::endModify()
-{
-    connect(model, &QStandardItemModel::itemChanged, this, &CSVViewer::save);
-}
-
@@ -4,13 +4,16 @@
 #include <QDialog>
 #include <QSettings>
 #include <QTableView>
-#include <QStandardItemModel>
+#include <QLineEdit>
+#include <QTimer>
+#include "csvtablemodel.h"
 
 class CSVViewer : public QDialog
 {
     Q_OBJECT
 public:
     explicit CSVViewer(QString filePath, QWidget *parent = nullptr);
+    ~CSVViewer() override;
 
 signals:
 
@@ -19,14 +22,13 @@ public slots:
     void save();
     void showTableMenu();
 
-    void startModify();
-    void endModify();
-
 private:
     QString filePath;
-    QString fileCodec;
     QTableView* tableView;
-    QStandardItemModel* model;
+    QLineEdit* filterEdit;
+    CSVTableModel* model;
+    QTimer* saveTimer; // 修改单元格后延迟保存
+    QTimer* filterTimer;
 };
 
 #endif // CSVVIEWER_H
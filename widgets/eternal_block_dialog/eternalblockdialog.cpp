@@ -4,7 +4,7 @@
 #include "eternalblockdialog.h"
 #include "ui_eternalblockdialog.h"
 
-EternalBlockDialog::EternalBlockDialog(QList<EternalBlockUser> *users, QWidget *parent) :
+EternalBlockDialog::EternalBlockDialog(QList<EternalBlockUser> users, QWidget *parent) :
     QDialog(parent),
     ui(new Ui::EternalBlockDialog),
     users(users)
@@ -16,9 +16,9 @@ EternalBlockDialog::EternalBlockDialog(QList<EternalBlockUser> *users, QWidget *
     setWindowFlag(Qt::WindowContextHelpButtonHint, false);
 
     QStringList sl;
-    for (int i = 0; i < users->size(); i++)
+    for (int i = 0; i < users.size(); i++)
     {
-        EternalBlockUser user = users->at(i);
+        EternalBlockUser user = users.at(i);
         QString text = QString("%2 (%1) [%4] %3").arg(user.uid).arg(user.uname)
                 .arg(QDateTime::fromSecsSinceEpoch(user.time).toString("yy-MM-dd hh:mm"))
                 .arg(user.upName);
@@ -36,7 +36,7 @@ void EternalBlockDialog::on_listWidget_activated(const QModelIndex &index)
     if (!index.isValid())
         return ;
     int row = index.row();
-    emit signalCancelEternalBlock(users->at(row).uid);
+    emit signalCancelEternalBlock(users.takeAt(row).uid);
     ui->listWidget->takeItem(row);
 }
 
@@ -59,11 +59,11 @@ void EternalBlockDialog::on_listWidget_customContextMenuRequested(const QPoint &
     menu->addAction(actionCancelBlock);
 
     connect(actionCancelEternalBlock, &QAction::triggered, this, [=]{
-        emit signalCancelEternalBlock(users->at(row).uid);
+        emit signalCancelEternalBlock(users.takeAt(row).uid);
         ui->listWidget->takeItem(row);
     });
     connect(actionCancelBlock, &QAction::triggered, this, [=]{
-        emit signalCancelBlock(users->at(row).uid);
+        emit signalCancelBlock(users.takeAt(row).uid);
         ui->listWidget->takeItem(row);
     });
 
@@ -65,7 +65,7 @@ class EternalBlockDialog : public QDialog
     Q_OBJECT
 
 public:
-    EternalBlockDialog(QList<EternalBlockUser>* users, QWidget *parent = nullptr);
+    EternalBlockDialog(QList<EternalBlockUser> users, QWidget *parent = nullptr);
     ~EternalBlockDialog();
 
 private slots:
@@ -79,7 +79,7 @@ signals:
 
 private:
     Ui::EternalBlockDialog *ui;
-    QList<EternalBlockUser>* users;
+    QList<EternalBlockUser> users; // 打开时的副本，和列表的行对应
 };
 
 #endif // ETERNALBLOCKDIALOG_H
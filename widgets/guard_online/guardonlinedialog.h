@@ -21,7 +21,7 @@ private slots:
     void on_refreshButton_clicked();
 
 private:
-    void refreshOnlineGuards(int page);
+    void refreshOnlineGuards();
 
 protected:
     void keyPressEvent(QKeyEvent *e) override;
@@ -0,0 +1,138 @@
+#include <QDebug>
+#include "pagedfetcher.h"
+
+PagedFetcher::PagedFetcher(QObject *parent) : QObject(parent)
+{
+    manager = new QNetworkAccessManager(this);
+}
+
+/**
+ * context 释放时一起释放，中止还没返回的请求
+ */
+PagedFetcher::~PagedFetcher()
+{
+    abortAll();
+}
+
+/**
+ * 开始获取，结束后（不论成功与否）自动释放
+ * @param context 随其释放而中止，回调不再执行
+ */
+PagedFetcher *PagedFetcher::fetch(QObject *context, UrlFunc urlFunc, PageCountFunc pageCountFunc, FinishedFunc finished,
+                                  QVariant cookies, int parallel, int maxPage)
+{
+    PagedFetcher* fetcher = new PagedFetcher(context);
+    fetcher->urlFunc = urlFunc;
+    fetcher->pageCountFunc = pageCountFunc;
+    fetcher->finished = finished;
+    fetcher->cookies = cookies;
+    fetcher->parallel = qMax(1, parallel);
+    fetcher->maxPage = qMax(1, maxPage);
+    fetcher->start();
+    return fetcher;
+}
+
+void PagedFetcher::start()
+{
+    getPage(1, [=](QNetworkReply* reply){
+        bool ok = false;
+        QString errorString;
+        MyJson json = MyJson::from(reply->readAll(), &ok, &errorString);
+        if (!ok || json.i("code") != 0)
+        {
+            qWarning() << "获取第1页失败：" << (ok ? json.s("message") : errorString) << reply->url();
+            finish(false);
+            return ;
+        }
+
+        int count = pageCountFunc(json);
+        if (count > maxPage)
+        {
+            qWarning() << "分页数量超过上限：" << count << ">" << maxPage << "，只获取前" << maxPage << "页";
+            count = maxPage;
+        }
+        pageCount = qMax(1, count);
+        pages.resize(pageCount);
+        pages[0] = json;
+        receivedCount = 1;
+
+        if (receivedCount >= pageCount)
+        {
+            finish(true);
+            return ;
+        }
+        for (int i = 0; i < parallel && nextPage <= pageCount; i++)
+            fetchPage(nextPage++);
+    });
+}
+
+void PagedFetcher::fetchPage(int page)
+{
+    getPage(page, [=](QNetworkReply* reply){
+        bool ok = false;
+        QString errorString;
+        MyJson json = MyJson::from(reply->readAll(), &ok, &errorString);
+        if (!ok || json.i("code") != 0)
+        {
+            qWarning() << "获取第" << page << "页失败：" << (ok ? json.s("message") : errorString) << reply->url();
+            finish(false);
+            return ;
+        }
+
+        pages[page - 1] = json;
+        if (++receivedCount >= pageCount)
+        {
+            finish(true);
+            return ;
+        }
+        if (nextPage <= pageCount)
+            fetchPage(nextPage++);
+    });
+}
+
+/**
+ * 请求一页，结束后才执行回调；已经结束的获取不再回调
+ */
+void PagedFetcher::getPage(int page, std::function<void(QNetworkReply*)> func)
+{
+    QNetworkRequest request(urlFunc(page));
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/x-www-form-urlencoded; charset=UTF-8");
+    request.setHeader(QNetworkRequest::UserAgentHeader, "Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/86.0.4240.111 Safari/537.36");
+    if (cookies.isValid())
+        request.setHeader(QNetworkRequest::CookieHeader, cookies);
+
+    QNetworkReply* reply = manager->get(request);
+    replies.insert(reply);
+    connect(reply, &QNetworkReply::finished, this, [=]{
+        replies.remove(reply);
+        reply->deleteLater();
+        if (!done)
+            func(reply);
+    });
+}
+
+/**
+ * 中止所有正在进行的请求，不再回调
+ */
+void PagedFetcher::abortAll()
+{
+    QSet<QNetworkReply*> aborting = replies;
+    replies.clear();
+    foreach (QNetworkReply* reply, aborting)
+    {
+        reply->disconnect(this);
+        reply->abort();
+        reply->deleteLater();
+    }
+}
+
+void PagedFetcher::finish(bool ok)
+{
+    if (done)
+        return ;
+    done = true;
+    abortAll();
+    if (finished)
+        finished(ok, ok ? pages.toList() : QList<MyJson>());
+    deleteLater();
+}
@@ -0,0 +1,76 @@
+#ifndef PAGEDFETCHER_H
+#define PAGEDFETCHER_H
+
+#include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QVector>
+#include "netinterface.h"
+
+#define PAGED_FETCH_PARALLEL 4 // 同时获取的页数
+#define PAGED_FETCH_MAX_PAGE 100 // 最多获取的页数
+
+/**
+ * 分页列表的并行获取
+ * 先取第一页得到总页数，剩下的页最多同时请求 parallel 个；
+ * 所有页都成功后按页码顺序一次性交给回调，调用方在回调里整体替换旧的列表，
+ * 获取过程中旧列表保持不变；任何一页失败则整体失败，并中止其余正在进行的请求。
+ */
+class PagedFetcher : public QObject
+{
+    Q_OBJECT
+public:
+    typedef std::function<QString(int page)> UrlFunc; // 页码从1开始
+    typedef std::function<int(const MyJson& json)> PageCountFunc; // 从第一页解析总页数
+    typedef std::function<void(bool ok, const QList<MyJson>& pages)> FinishedFunc;
+
+    static PagedFetcher* fetch(QObject* context, UrlFunc urlFunc, PageCountFunc pageCountFunc, FinishedFunc finished,
+                               QVariant cookies = QVariant(), int parallel = PAGED_FETCH_PARALLEL, int maxPage = PAGED_FETCH_MAX_PAGE);
+
+    ~PagedFetcher() override;
+
+private:
+    PagedFetcher(QObject* parent);
+
+    void start();
+    void fetchPage(int page);
+    void getPage(int page, std::function<void(QNetworkReply*)> func);
+    void abortAll();
+    void finish(bool ok);
+
+private:
+    QNetworkAccessManager* manager;
+    QSet<QNetworkReply*> replies; // 正在进行的请求
+    UrlFunc urlFunc;
+    PageCountFunc pageCountFunc;
+    FinishedFunc finished;
+    QVariant cookies;
+    int parallel = PAGED_FETCH_PARALLEL;
+    int maxPage = PAGED_FETCH_MAX_PAGE;
+
+    QVector<MyJson> pages;
+    int pageCount = 0;
+    int nextPage = 2;
+    int receivedCount = 0;
+    bool done = false;
+};
+
+/**
+ * 两次完整列表之间的差异：after 有而 before 没有的为新增，反之为移除
+ */
+template<typename K, typename V>
+void diffCollections(const QHash<K, V>& before, const QHash<K, V>& after, QList<K>* added, QList<K>* removed)
+{
+    for (auto it = after.constBegin(); it != after.constEnd(); ++it)
+    {
+        if (!before.contains(it.key()))
+            added->append(it.key());
+    }
+    for (auto it = before.constBegin(); it != before.constEnd(); ++it)
+    {
+        if (!after.contains(it.key()))
+            removed->append(it.key());
+    }
+}
+
+#endif // PAGEDFETCHER_H
@@ -0,0 +1,244 @@
+#include <QPainter>
+#include <QFontMetrics>
+#include <algorithm>
+#include <limits>
+#include "screendanmakuoverlay.h"
+
+ScreenDanmakuOverlay::ScreenDanmakuOverlay(QWidget *parent) : QWidget(parent)
+{
+    setWindowFlags(Qt::FramelessWindowHint | Qt::Tool | Qt::WindowStaysOnTopHint | Qt::WindowTransparentForInput);
+    setAttribute(Qt::WA_TranslucentBackground, true); // 设置窗口透明
+    setAttribute(Qt::WA_TransparentForMouseEvents, true);
+    setAttribute(Qt::WA_ShowWithoutActivating, true);
+
+    frameTimer = new QTimer(this);
+    frameTimer->setTimerType(Qt::PreciseTimer);
+    frameTimer->setInterval(SCREEN_DANMAKU_FRAME_INTERVAL);
+    connect(frameTimer, &QTimer::timeout, this, [=]{
+        advance(clock.elapsed());
+        if (items.isEmpty())
+        {
+            frameTimer->stop();
+            hide();
+            return ;
+        }
+        update();
+    });
+
+    clock.start();
+    setTextFont(font());
+}
+
+/**
+ * 设置飞行的区域（屏幕坐标）
+ * @param leftToRight 从左往右飞，默认从右往左
+ */
+void ScreenDanmakuOverlay::setArea(const QRect &area, bool leftToRight)
+{
+    this->leftToRight = leftToRight;
+    if (geometry() == area)
+        return ;
+    setGeometry(area);
+    resetLanes();
+
+    qreal ratio = devicePixelRatioF();
+    if (!qFuzzyCompare(ratio, spriteRatio))
+    {
+        spriteRatio = ratio;
+        sprites.clear();
+        spriteWidths.clear();
+        spriteOrder.clear();
+    }
+}
+
+/**
+ * 从进入到离开的时间，只影响之后添加的弹幕
+ */
+void ScreenDanmakuOverlay::setDuration(int msec)
+{
+    duration = qMax(1000, msec);
+}
+
+void ScreenDanmakuOverlay::setTextFont(const QFont &font)
+{
+    if (font == textFont && !lanes.isEmpty())
+        return ;
+    textFont = font;
+    lineHeight = QFontMetrics(textFont).height() + SCREEN_DANMAKU_LANE_SPACING;
+    sprites.clear();
+    spriteWidths.clear();
+    spriteOrder.clear();
+    resetLanes();
+}
+
+void ScreenDanmakuOverlay::addDanmaku(const QString &text, const QColor &color)
+{
+    if (items.size() >= SCREEN_DANMAKU_MAX_ITEMS || text.isEmpty())
+        return ;
+    addAt(text, color, clock.elapsed());
+    if (!isVisible())
+        show();
+    if (!frameTimer->isActive())
+        frameTimer->start();
+}
+
+void ScreenDanmakuOverlay::clear()
+{
+    items.clear();
+    resetLanes();
+    frameTimer->stop();
+    hide();
+}
+
+int ScreenDanmakuOverlay::getItemCount() const
+{
+    return items.size();
+}
+
+void ScreenDanmakuOverlay::paintEvent(QPaintEvent *)
+{
+    QPainter painter(this);
+    render(&painter, clock.elapsed());
+}
+
+void ScreenDanmakuOverlay::addAt(const QString &text, const QColor &color, qint64 now)
+{
+    Item item;
+    item.sprite = getSprite(text, color, &item.width);
+    item.start = now;
+    item.duration = duration;
+    item.lane = allocateLane(item.width, now);
+    if (leftToRight)
+    {
+        item.startX = -item.width;
+        item.endX = width();
+    }
+    else
+    {
+        item.startX = width();
+        item.endX = -item.width;
+    }
+    items.append(item);
+}
+
+/**
+ * 移除已经飞出去的
+ */
+void ScreenDanmakuOverlay::advance(qint64 now)
+{
+    auto end = std::remove_if(items.begin(), items.end(), [=](const Item& item) {
+        return now >= item.start + item.duration;
+    });
+    items.erase(end, items.end());
+}
+
+/**
+ * 按时间计算位置并贴图，整数坐标走最快的绘制路径
+ */
+void ScreenDanmakuOverlay::render(QPainter *painter, qint64 now)
+{
+    int w = width();
+    for (int i = 0; i < items.size(); i++)
+    {
+        const Item& item = items.at(i);
+        double progress = double(now - item.start) / item.duration;
+        int x = qRound(item.startX + (item.endX - item.startX) * progress);
+        if (x >= w || x + item.width <= 0)
+            continue;
+        painter->drawImage(QPoint(x, item.lane * lineHeight), item.sprite);
+    }
+}
+
+/**
+ * 获取文字图片，相同文字和颜色的复用同一张
+ */
+QImage ScreenDanmakuOverlay::getSprite(const QString &text, const QColor &color, int *width)
+{
+    QString key = color.name(QColor::HexArgb) + text;
+    auto it = sprites.constFind(key);
+    if (it != sprites.constEnd())
+    {
+        *width = spriteWidths.value(key);
+        return it.value();
+    }
+
+    QFontMetrics fm(textFont);
+    int w = qMax(1, fm.horizontalAdvance(text));
+    int h = fm.height();
+    QImage image(QSize(w, h) * spriteRatio, QImage::Format_ARGB32_Premultiplied);
+    image.setDevicePixelRatio(spriteRatio);
+    image.fill(Qt::transparent);
+    QPainter painter(&image);
+    painter.setRenderHint(QPainter::TextAntialiasing, true);
+    painter.setFont(textFont);
+    painter.setPen(color);
+    painter.drawText(0, fm.ascent(), text);
+    painter.end();
+
+    sprites.insert(key, image);
+    spriteWidths.insert(key, w);
+    spriteOrder.enqueue(key);
+    while (spriteOrder.size() > SCREEN_DANMAKU_SPRITE_CACHE)
+    {
+        QString old = spriteOrder.dequeue();
+        sprites.remove(old);
+        spriteWidths.remove(old);
+    }
+    *width = w;
+    return image;
+}
+
+/**
+ * 从上往下找第一条可用的行：
+ * 前一条已经完全进入（留出间距），并且新的这条到达另一端时前一条已经离开（不会追尾）。
+ * 都不可用时选冲突时间最短的行，结果只和时间有关，不用随机。
+ */
+int ScreenDanmakuOverlay::allocateLane(int width, qint64 now)
+{
+    if (lanes.isEmpty())
+        return 0;
+
+    int areaWidth = qMax(1, this->width());
+    qint64 reachEnd = now + qint64(areaWidth) * duration / (areaWidth + width); // 头部到达另一端的时间
+    int best = 0;
+    qint64 bestConflict = std::numeric_limits<qint64>::max();
+    for (int i = 0; i < lanes.size(); i++)
+    {
+        const Lane& lane = lanes.at(i);
+        qint64 conflict = qMax(lane.freeAt - now, lane.exitAt - reachEnd);
+        if (conflict <= 0)
+        {
+            best = i;
+            break;
+        }
+        if (conflict < bestConflict)
+        {
+            bestConflict = conflict;
+            best = i;
+        }
+    }
+
+    Lane& lane = lanes[best];
+    lane.freeAt = now + qint64(width + SCREEN_DANMAKU_ITEM_SPACING) * duration / (areaWidth + width);
+    lane.exitAt = now + duration;
+    return best;
+}
+
+/**
+ * 按当前高度重新分行
+ * 正在飞行的弹幕超出新行数的按取余换到已有的行，再按它们恢复每行的占用时间，
+ * 之后添加的不会和它们重叠
+ */
+void ScreenDanmakuOverlay::resetLanes()
+{
+    lanes = QVector<Lane>(qMax(1, height() / qMax(1, lineHeight)));
+    for (int i = 0; i < items.size(); i++)
+    {
+        Item& item = items[i];
+        item.lane %= lanes.size();
+        Lane& lane = lanes[item.lane];
+        double distance = qMax(1.0, qAbs(item.endX - item.startX)); // 添加时的区域宽度加文字宽度
+        lane.freeAt = qMax(lane.freeAt, item.start + qint64((item.width + SCREEN_DANMAKU_ITEM_SPACING) * item.duration / distance));
+        lane.exitAt = qMax(lane.exitAt, item.start + item.duration);
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef SCREENDANMAKUOVERLAY_H
+#define SCREENDANMAKUOVERLAY_H
+
+#include <QWidget>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QQueue>
+#include <QImage>
+#include <QVector>
+
+#define SCREEN_DANMAKU_FRAME_INTERVAL 16 // 帧间隔，毫秒
+#define SCREEN_DANMAKU_MAX_ITEMS 5000 // 同时飞行的最多条数，超过的不显示
+#define SCREEN_DANMAKU_SPRITE_CACHE 512 // 缓存的文字图片数量，礼物刷屏时大多是重复的文字
+#define SCREEN_DANMAKU_LANE_SPACING 4 // 行间距
+#define SCREEN_DANMAKU_ITEM_SPACING 24 // 同一行前后两条的最小间距
+
+/**
+ * 屏幕弹幕的透明覆盖层
+ * 只有一个窗口，所有飞过的弹幕由它自己绘制：
+ * 文字预先渲染成图片并缓存复用，每帧只按时间计算位置后贴图；
+ * 行按从上到下的顺序分配，选第一条既不会和前一条重叠、也追不上前一条的行。
+ */
+class ScreenDanmakuOverlay : public QWidget
+{
+    Q_OBJECT
+public:
+    ScreenDanmakuOverlay(QWidget* parent = nullptr);
+
+    void setArea(const QRect& area, bool leftToRight);
+    void setDuration(int msec);
+    void setTextFont(const QFont& font);
+
+    void addDanmaku(const QString& text, const QColor& color);
+    void clear();
+    int getItemCount() const;
+
+    friend class ComponentBenchmark; // 用模拟的时间逐帧绘制
+
+protected:
+    void paintEvent(QPaintEvent*) override;
+
+private:
+    struct Item
+    {
+        QImage sprite;
+        int width = 0; // 文字宽度，逻辑像素
+        int lane = 0;
+        qint64 start = 0;
+        double startX = 0;
+        double endX = 0;
+        int duration = 0;
+    };
+
+    struct Lane
+    {
+        qint64 freeAt = 0; // 前一条完全进入（加上间距）的时间
+        qint64 exitAt = 0; // 前一条完全离开的时间
+    };
+
+    void addAt(const QString& text, const QColor& color, qint64 now);
+    void advance(qint64 now);
+    void render(QPainter* painter, qint64 now);
+    QImage getSprite(const QString& text, const QColor& color, int* width);
+    int allocateLane(int width, qint64 now);
+    void resetLanes();
+
+private:
+    QTimer* frameTimer;
+    QElapsedTimer clock;
+    bool leftToRight = false;
+    int duration = 10000;
+    QFont textFont;
+    int lineHeight = 20; // 每行的高度，包括行间距
+    qreal spriteRatio = 1;
+
+    QVector<Item> items;
+    QVector<Lane> lanes;
+    QHash<QString, QImage> sprites;
+    QHash<QString, int> spriteWidths;
+    QQueue<QString> spriteOrder; // 先进先出淘汰
+};
+
+#endif // SCREENDANMAKUOVERLAY_H
@@ -4,7 +4,7 @@
 #include "facilemenu.h"
 #include "orderplayerwindow.h"
 
-VariantViewer::VariantViewer(QString caption, QSettings *vals, QString loopKeyStr, QStringList tableFileds, QSettings *counts, QSettings *heaps, QWidget *parent)
+VariantViewer::VariantViewer(QString caption, QSettings *vals, QString loopKeyStr, QStringList tableFileds, QSettings *counts, KVStore *heaps, QWidget *parent)
     : QDialog(parent), vals(vals), counts(counts), heaps(heaps)
 {
     setModal(false);
@@ -12,7 +12,7 @@ VariantViewer::VariantViewer(QString caption, QSettings *vals, QString loopKeySt
     setAttribute(Qt::WA_DeleteOnClose, true);
 
     QRegularExpression loopKeyRe(loopKeyStr);
-    QStringList keys = vals->allKeys();
+    QStringList keys = vals ? vals->allKeys() : heaps->allKeys();
     QRegularExpressionMatch match;
 
     QVBoxLayout* lay = new QVBoxLayout(this);
@@ -120,12 +120,12 @@ VariantViewer::VariantViewer(QString caption, QSettings *vals, QString loopKeySt
                 }
                 else if (keyExp.startsWith(HEAPS_PREFIX))
                 {
-                    sts = heaps;
+                    sts = nullptr;
                     keyExp.remove(0, HEAPS_PREFIX.length());
                     if (!keyExp.contains("/"))
                         keyExp.insert(0, "heaps/");
                 }
-                QString val = sts->value(keyExp, "").toString();
+                QString val = sts ? sts->value(keyExp, "").toString() : heaps->value(keyExp, "").toString();
 
                 if (tableCol == sortCol) // 排序，肯定是数值
                 {
@@ -190,7 +190,7 @@ VariantViewer::VariantViewer(QString caption, QSettings *vals, QString loopKeySt
         if (!key.isEmpty())
         {
             qInfo() << "修改heaps值:" << key << item->data(Qt::DisplayRole);
-            vals->setValue(key, item->data(Qt::DisplayRole));
+            setValue(key, item->data(Qt::DisplayRole));
         }
     });
 
@@ -231,7 +231,7 @@ void VariantViewer::showTableMenu()
         auto item = model->item(row, col);
         QString key = item->data(Qt::UserRole).toString();
         if (!key.isEmpty())
-            vals->remove(key);
+            removeValue(key);
         qInfo() << "删除heaps值:" << key << item->data(Qt::DisplayRole);
         item->setData("", Qt::UserRole); // 先取消键，否则下面的留空还是会引发修改值，剩下一个空值键
         item->setData("", Qt::DisplayRole);
@@ -250,7 +250,7 @@ void VariantViewer::showTableMenu()
                 auto item = model->item(row, col);
                 QString key = item->data(Qt::UserRole).toString();
                 if (!key.isEmpty())
-                    vals->remove(key);
+                    removeValue(key);
             }
             deletedRows.append(row);
         }
@@ -264,3 +264,19 @@ void VariantViewer::showTableMenu()
 
     menu->exec();
 }
+
+void VariantViewer::setValue(const QString &key, const QVariant &value)
+{
+    if (vals)
+        vals->setValue(key, value);
+    else
+        heaps->setValue(key, value);
+}
+
+void VariantViewer::removeValue(const QString &key)
+{
+    if (vals)
+        vals->remove(key);
+    else
+        heaps->remove(key);
+}
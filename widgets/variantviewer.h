@@ -6,6 +6,7 @@
 #include <QSettings>
 #include <QTableView>
 #include <QStandardItemModel>
+#include "kvstore.h"
 
 #define SETTINGS_PREFIX QString("_settings/")
 #define COUNTS_PREFIX QString("_counts/")
@@ -15,19 +16,23 @@ class VariantViewer : public QDialog
 {
     Q_OBJECT
 public:
-    explicit VariantViewer(QString caption, QSettings* vals, QString loopKeyStr, QStringList keys, QSettings* counts, QSettings* heaps, QWidget *parent = nullptr);
+    explicit VariantViewer(QString caption, QSettings* vals, QString loopKeyStr, QStringList keys, QSettings* counts, KVStore* heaps, QWidget *parent = nullptr);
 
 signals:
 
 public slots:
     void showTableMenu();
 
+private:
+    void setValue(const QString& key, const QVariant& value);
+    void removeValue(const QString& key);
+
 private:
     QTableView* tableView;
     QStandardItemModel* model;
-    QSettings* vals;
+    QSettings* vals; // 为空时表示 heaps
     QSettings* counts;
-    QSettings* heaps;
+    KVStore* heaps;
 };
 
 #endif // VARIANTVIEWER_H